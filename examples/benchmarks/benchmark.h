@@ -0,0 +1,81 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    benchmarks/benchmark.h
+        timing and data helpers shared by benchmark programs
+
+        benchmarks are console programs, they're not tied to example
+        application window and can be run on any platform
+*/
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstddef>
+
+
+// small deterministic random generator (xorshift), benchmark data is
+// the same on every run and platform
+class BenchmarkRandom
+{
+public:
+    BenchmarkRandom(uint32_t seed = 2463534242u) :
+        p_state(seed ? seed : 1)
+    {}
+
+    uint32_t next()
+    {
+        p_state ^= p_state << 13;
+        p_state ^= p_state >> 17;
+        p_state ^= p_state << 5;
+        return p_state;
+    }
+
+    // value in [0, range)
+    uint32_t next(uint32_t range)
+    {
+        return next() % range;
+    }
+
+private:
+    uint32_t p_state;
+};
+
+
+// runs test.Run() repeatedly for at least mintime seconds (and at least
+// minruns times), returns best time of single run in seconds, best time
+// is the least affected by other processes
+template <typename T>
+double BenchmarkBest(T &test, double mintime = 0.25, size_t minruns = 3)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double best = 0;
+    double total = 0;
+
+    for (size_t run = 0; run < minruns || total < mintime; ++run) {
+        Clock::time_point start = Clock::now();
+        test.Run();
+        double time = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if (run == 0 || time < best) {
+            best = time;
+        }
+        total += time;
+    }
+
+    return best;
+}
+
+// size_t command line argument at index, or default value if it's not given
+inline size_t BenchmarkArgument(int argc, char **argv, int index, size_t value)
+{
+    return argc > index ? size_t(strtoul(argv[index], nullptr, 10)) : value;
+}
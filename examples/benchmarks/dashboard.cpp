@@ -0,0 +1,109 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    benchmarks/dashboard.cpp
+        dashboard like test scene for rendering and encoding benchmarks
+*/
+
+#include "kcanvas/canvas.h"
+#include "dashboard.h"
+#include "benchmark.h"
+#include <cstdio>
+#include <vector>
+
+
+using namespace c_util;
+using namespace k_canvas;
+
+
+// panel size in pixels, scene is made of as many panels as fit
+static const size_t PANEL_WIDTH = 480;
+static const size_t PANEL_HEIGHT = 320;
+static const size_t CHART_POINTS = 96;
+
+
+static void DrawPanel(kCanvas &canvas, const kRect &rect, BenchmarkRandom &random, const kFont &font)
+{
+    kPen border(kColor(70, 80, 96), 1);
+    kBrush panel(kColor(32, 36, 44));
+    kBrush text(kColor(220, 224, 232));
+    kPen grid(kColor(60, 66, 78), 1);
+
+    canvas.RoundedRectangle(rect, kSize(8, 8), &border, &panel);
+
+    char title[32];
+    snprintf(title, sizeof(title), "metric %u", random.next(1000));
+    canvas.Text(kPoint(rect.left + 12, rect.top + 8), title, -1, font, text);
+
+    kRect chart(rect.left + 12, rect.top + 40, rect.right - 120, rect.bottom - 16);
+
+    // grid lines
+    for (int n = 0; n <= 4; ++n) {
+        kScalar y = chart.top + chart.height() * kScalar(n) / 4;
+        canvas.Line(kPoint(chart.left, y), kPoint(chart.right, y), grid);
+    }
+
+    // area under line chart with gradient, then the line itself
+    kPoint points[CHART_POINTS + 2];
+    kScalar value = kScalar(random.next(100)) / 100;
+    for (size_t n = 0; n < CHART_POINTS; ++n) {
+        value = umin(umax(value + (kScalar(random.next(100)) - 50) / 400, kScalar(0)), kScalar(1));
+        points[n] = kPoint(
+            chart.left + chart.width() * kScalar(n) / (CHART_POINTS - 1),
+            chart.bottom - chart.height() * value
+        );
+    }
+    points[CHART_POINTS] = kPoint(chart.right, chart.bottom);
+    points[CHART_POINTS + 1] = kPoint(chart.left, chart.bottom);
+
+    kColor color(uint8_t(80 + random.next(176)), uint8_t(80 + random.next(176)), uint8_t(80 + random.next(176)));
+    kGradient gradient(kColor(color, 160), kColor(color, 0));
+    kBrush area(kPoint(0, chart.top), kPoint(0, chart.bottom), gradient);
+    canvas.Polygon(points, CHART_POINTS + 2, nullptr, &area);
+    canvas.PolyLine(points, CHART_POINTS, kPen(color, 2));
+
+    // gauge
+    kRect gauge(rect.right - 104, rect.top + 60, rect.right - 16, rect.top + 148);
+    kScalar level = kScalar(random.next(100)) / 100;
+    canvas.Arc(gauge, 135, 405, kPen(kColor(60, 66, 78), 10));
+    canvas.Arc(gauge, 135, 135 + 270 * level, kPen(color, 10));
+
+    // bars
+    kRect bars[8];
+    kScalar barwidth = (gauge.width()) / 8;
+    for (size_t n = 0; n < 8; ++n) {
+        kScalar height = kScalar(10 + random.next(100));
+        bars[n] = kRect(
+            gauge.left + barwidth * n + 1, rect.bottom - 16 - height,
+            gauge.left + barwidth * (n + 1) - 1, rect.bottom - 16
+        );
+    }
+    kBrush barbrush(color);
+    canvas.Rectangles(bars, 8, nullptr, &barbrush);
+}
+
+void DrawDashboard(kCanvas &canvas, size_t width, size_t height)
+{
+    BenchmarkRandom random;
+    kFont font("Sans", 16);
+
+    kGradient background(kColor(18, 20, 26), kColor(30, 34, 44));
+    kBrush backgroundbrush(kPoint(0, 0), kPoint(0, kScalar(height)), background);
+    canvas.Rectangle(kRect(0, 0, kScalar(width), kScalar(height)), nullptr, &backgroundbrush);
+
+    for (size_t y = 0; y + PANEL_HEIGHT <= height; y += PANEL_HEIGHT) {
+        for (size_t x = 0; x + PANEL_WIDTH <= width; x += PANEL_WIDTH) {
+            kRect rect(
+                kScalar(x + 8), kScalar(y + 8),
+                kScalar(x + PANEL_WIDTH - 8), kScalar(y + PANEL_HEIGHT - 8)
+            );
+            DrawPanel(canvas, rect, random, font);
+        }
+    }
+}
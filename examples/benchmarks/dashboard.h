@@ -0,0 +1,26 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    benchmarks/dashboard.h
+        dashboard like test scene for rendering and encoding benchmarks
+*/
+
+#pragma once
+
+
+namespace k_canvas
+{
+    // forward declarations
+    class kCanvas;
+}
+
+
+// DrawDashboard - draws grid of panels with charts, gauges and text
+//      covering width x height pixels, scene is the same for the same size
+void DrawDashboard(k_canvas::kCanvas &canvas, size_t width, size_t height);
@@ -0,0 +1,303 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    benchmarks/pixelconversion.cpp
+        pixel format conversion benchmark
+
+        compares conversion kernels used by kBitmap Update and Read with
+        plain scalar reference code, every conversion is also checked to
+        give exactly the same pixels as reference
+
+        usage: pixelconversion [width] [height]
+*/
+
+#include "pixelconverter.h"
+#include "benchmark.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+
+using namespace k_canvas;
+using namespace impl;
+
+
+// scalar reference conversions, one pixel at a time, the way callers
+// converted pixels before conversion kernels were added
+
+static inline uint32_t RefPremultiply(uint32_t c, uint32_t a)
+{
+    return (c * a + 127) / 255;
+}
+
+static inline uint32_t RefUnpremultiply(uint32_t c, uint32_t a)
+{
+    uint32_t r = (c * 255 + a / 2) / a;
+    return r > 255 ? 255 : r;
+}
+
+static void RefPremultiplyRGBA(void *dstrow, const void *srcrow, size_t width)
+{
+    uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+    const uint8_t *src = reinterpret_cast<const uint8_t*>(srcrow);
+
+    for (size_t x = 0; x < width; ++x, src += 4, dst += 4) {
+        uint32_t a = src[3];
+        dst[0] = uint8_t(RefPremultiply(src[2], a));
+        dst[1] = uint8_t(RefPremultiply(src[1], a));
+        dst[2] = uint8_t(RefPremultiply(src[0], a));
+        dst[3] = uint8_t(a);
+    }
+}
+
+static void RefPremultiplyBGRA(void *dstrow, const void *srcrow, size_t width)
+{
+    uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+    const uint8_t *src = reinterpret_cast<const uint8_t*>(srcrow);
+
+    for (size_t x = 0; x < width; ++x, src += 4, dst += 4) {
+        uint32_t a = src[3];
+        dst[0] = uint8_t(RefPremultiply(src[0], a));
+        dst[1] = uint8_t(RefPremultiply(src[1], a));
+        dst[2] = uint8_t(RefPremultiply(src[2], a));
+        dst[3] = uint8_t(a);
+    }
+}
+
+static void RefSwizzle(void *dstrow, const void *srcrow, size_t width)
+{
+    uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+    const uint8_t *src = reinterpret_cast<const uint8_t*>(srcrow);
+
+    for (size_t x = 0; x < width; ++x, src += 4, dst += 4) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        dst[3] = src[3];
+    }
+}
+
+static void RefExpandRGB(void *dstrow, const void *srcrow, size_t width)
+{
+    uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+    const uint8_t *src = reinterpret_cast<const uint8_t*>(srcrow);
+
+    for (size_t x = 0; x < width; ++x, src += 3, dst += 4) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        dst[3] = 255;
+    }
+}
+
+static void RefExpandGray(void *dstrow, const void *srcrow, size_t width)
+{
+    uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+    const uint8_t *src = reinterpret_cast<const uint8_t*>(srcrow);
+
+    for (size_t x = 0; x < width; ++x, dst += 4) {
+        dst[0] = dst[1] = dst[2] = src[x];
+        dst[3] = 255;
+    }
+}
+
+static void RefAlpha(void *dstrow, const void *srcrow, size_t width)
+{
+    uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+    const uint8_t *src = reinterpret_cast<const uint8_t*>(srcrow);
+
+    for (size_t x = 0; x < width; ++x, src += 4) {
+        dst[x] = src[3];
+    }
+}
+
+static void RefUnpremultiplyBGRA(void *dstrow, const void *srcrow, size_t width)
+{
+    uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+    const uint8_t *src = reinterpret_cast<const uint8_t*>(srcrow);
+
+    for (size_t x = 0; x < width; ++x, src += 4, dst += 4) {
+        uint32_t a = src[3];
+        if (a == 0) {
+            dst[0] = dst[1] = dst[2] = dst[3] = 0;
+            continue;
+        }
+        dst[0] = uint8_t(RefUnpremultiply(src[0], a));
+        dst[1] = uint8_t(RefUnpremultiply(src[1], a));
+        dst[2] = uint8_t(RefUnpremultiply(src[2], a));
+        dst[3] = uint8_t(a);
+    }
+}
+
+static void RefUnpremultiplyRGBA(void *dstrow, const void *srcrow, size_t width)
+{
+    uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+    const uint8_t *src = reinterpret_cast<const uint8_t*>(srcrow);
+
+    for (size_t x = 0; x < width; ++x, src += 4, dst += 4) {
+        uint32_t a = src[3];
+        if (a == 0) {
+            dst[0] = dst[1] = dst[2] = dst[3] = 0;
+            continue;
+        }
+        dst[0] = uint8_t(RefUnpremultiply(src[2], a));
+        dst[1] = uint8_t(RefUnpremultiply(src[1], a));
+        dst[2] = uint8_t(RefUnpremultiply(src[0], a));
+        dst[3] = uint8_t(a);
+    }
+}
+
+static void RefShrinkRGB(void *dstrow, const void *srcrow, size_t width)
+{
+    uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+    const uint8_t *src = reinterpret_cast<const uint8_t*>(srcrow);
+
+    for (size_t x = 0; x < width; ++x, src += 4, dst += 3) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+    }
+}
+
+static void RefExpandMask(void *dstrow, const void *srcrow, size_t width)
+{
+    uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+    const uint8_t *src = reinterpret_cast<const uint8_t*>(srcrow);
+
+    for (size_t x = 0; x < width; ++x, dst += 4) {
+        dst[0] = dst[1] = dst[2] = dst[3] = src[x];
+    }
+}
+
+
+struct Conversion
+{
+    const char        *name;
+    kBitmapFormat      dstformat;
+    kBitmapFormat      srcformat;
+    PixelRowConverter  reference;
+    bool               premultiplied; // source must be valid premultiplied color
+};
+
+static const Conversion CONVERSIONS[] = {
+    // Update
+    { "straight BGRA -> premultiplied",   kBitmapFormat::Color32BitAlphaPremultiplied, kBitmapFormat::Color32BitAlpha,                  RefPremultiplyBGRA,   false },
+    { "straight RGBA -> premultiplied",   kBitmapFormat::Color32BitAlphaPremultiplied, kBitmapFormat::Color32BitRGBAAlpha,              RefPremultiplyRGBA,   false },
+    { "premultiplied RGBA -> BGRA",       kBitmapFormat::Color32BitAlphaPremultiplied, kBitmapFormat::Color32BitRGBAAlphaPremultiplied, RefSwizzle,           true  },
+    { "RGB24 -> premultiplied",           kBitmapFormat::Color32BitAlphaPremultiplied, kBitmapFormat::Color24Bit,                       RefExpandRGB,         false },
+    { "gray -> premultiplied",            kBitmapFormat::Color32BitAlphaPremultiplied, kBitmapFormat::Gray8Bit,                         RefExpandGray,        false },
+    { "BGRA -> mask",                     kBitmapFormat::Mask8Bit,                     kBitmapFormat::Color32BitAlpha,                  RefAlpha,             false },
+    // Read
+    { "premultiplied -> straight BGRA",   kBitmapFormat::Color32BitAlpha,              kBitmapFormat::Color32BitAlphaPremultiplied,     RefUnpremultiplyBGRA, true  },
+    { "premultiplied -> straight RGBA",   kBitmapFormat::Color32BitRGBAAlpha,          kBitmapFormat::Color32BitAlphaPremultiplied,     RefUnpremultiplyRGBA, true  },
+    { "premultiplied -> RGB24",           kBitmapFormat::Color24Bit,                   kBitmapFormat::Color32BitAlphaPremultiplied,     RefShrinkRGB,         true  },
+    { "mask -> premultiplied RGBA",       kBitmapFormat::Color32BitRGBAAlphaPremultiplied, kBitmapFormat::Mask8Bit,                     RefExpandMask,        false }
+};
+
+
+// converts whole image row by row
+struct ConvertImage
+{
+    PixelRowConverter  converter;
+    uint8_t           *dst;
+    const uint8_t     *src;
+    size_t             dstpitch;
+    size_t             srcpitch;
+    size_t             width;
+    size_t             height;
+
+    void Run()
+    {
+        for (size_t y = 0; y < height; ++y) {
+            converter(dst + y * dstpitch, src + y * srcpitch, width);
+        }
+    }
+};
+
+
+// source pixels mix opaque, transparent and translucent pixels in runs,
+// like real images do, so both fast paths and full math are measured
+static void FillSource(std::vector<uint8_t> &data, size_t pixelsize, bool premultiplied)
+{
+    BenchmarkRandom random;
+
+    size_t pixels = data.size() / pixelsize;
+    size_t run = 0;
+    uint32_t alphakind = 0;
+
+    for (size_t n = 0; n < pixels; ++n) {
+        if (run == 0) {
+            run = 1 + random.next(64);
+            alphakind = random.next(3);
+        }
+        --run;
+
+        uint8_t *p = data.data() + n * pixelsize;
+        for (size_t c = 0; c < pixelsize; ++c) {
+            p[c] = uint8_t(random.next());
+        }
+
+        if (pixelsize == 4) {
+            uint32_t a = alphakind == 0 ? 255 : alphakind == 1 ? 0 : random.next(256);
+            p[3] = uint8_t(a);
+            if (premultiplied) {
+                for (size_t c = 0; c < 3; ++c) {
+                    p[c] = uint8_t(RefPremultiply(p[c], a));
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t width = BenchmarkArgument(argc, argv, 1, 4096);
+    size_t height = BenchmarkArgument(argc, argv, 2, 1024);
+    // odd width keeps scalar tails of vectorised kernels in the test
+    size_t rowwidth = width | 1;
+
+    printf("pixel conversion, %zux%zu pixels, MPixels/s\n\n", rowwidth, height);
+    printf("%-34s %10s %10s %8s\n", "conversion", "reference", "kernel", "speedup");
+
+    bool mismatch = false;
+
+    for (size_t n = 0; n < sizeof(CONVERSIONS) / sizeof(CONVERSIONS[0]); ++n) {
+        const Conversion &conversion = CONVERSIONS[n];
+
+        size_t srcpitch = rowwidth * PixelSize(conversion.srcformat);
+        size_t dstpitch = rowwidth * PixelSize(conversion.dstformat);
+
+        std::vector<uint8_t> source(srcpitch * height);
+        std::vector<uint8_t> reference(dstpitch * height);
+        std::vector<uint8_t> result(dstpitch * height);
+        FillSource(source, PixelSize(conversion.srcformat), conversion.premultiplied);
+
+        ConvertImage test = {
+            conversion.reference, reference.data(), source.data(),
+            dstpitch, srcpitch, rowwidth, height
+        };
+        double reftime = BenchmarkBest(test);
+
+        test.converter = GetPixelRowConverter(conversion.dstformat, conversion.srcformat);
+        test.dst = result.data();
+        double kerneltime = BenchmarkBest(test);
+
+        bool same = memcmp(reference.data(), result.data(), result.size()) == 0;
+        mismatch = mismatch || !same;
+
+        double mpixels = double(rowwidth * height) / 1000000.0;
+        printf(
+            "%-34s %10.1f %10.1f %7.2fx%s\n",
+            conversion.name, mpixels / reftime, mpixels / kerneltime, reftime / kerneltime,
+            same ? "" : "  MISMATCH"
+        );
+    }
+
+    return mismatch ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    benchmarks/pngencoding.cpp
+        parallel PNG compression thread scaling benchmark
+
+        renders large dashboard bitmap and encodes it into PNG in memory
+        with implementation's single threaded encoder and with parallel
+        encoder on growing number of threads, parallel encoder output must
+        be the same for any number of threads
+
+        usage: pngencoding [width] [height] [max threads] [compression]
+*/
+
+#include "kcanvas/canvas.h"
+#include "pngencoder.h"
+#include "benchmark.h"
+#include "dashboard.h"
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+
+using namespace c_util;
+using namespace k_canvas;
+using namespace impl;
+
+
+struct EncodeTest
+{
+    const kBitmap          *bitmap;
+    kImageMemorySink       *sink;
+    kImageEncodeProperties  properties;
+    bool                    parallel; // parallel encoder even for single thread
+    bool                    result;
+
+    void Run()
+    {
+        sink->Clear();
+        result = parallel ?
+            EncodeParallelPNG(*bitmap, *sink, &properties) :
+            bitmap->Encode(kImageFormat::PNG, *sink, &properties);
+    }
+};
+
+int main(int argc, char **argv)
+{
+    size_t width = BenchmarkArgument(argc, argv, 1, 8192);
+    size_t height = BenchmarkArgument(argc, argv, 2, 8192);
+    size_t maxthreads = umax(BenchmarkArgument(argc, argv, 3, std::thread::hardware_concurrency()), size_t(1));
+    int compression = int(BenchmarkArgument(argc, argv, 4, 6));
+
+    kBitmap bitmap(width, height, kBitmapFormat::Color32BitAlphaPremultiplied);
+    {
+        kBitmapCanvas canvas(bitmap);
+        DrawDashboard(canvas, width, height);
+    }
+
+    double mb = double(width * height * 4) / (1024.0 * 1024.0);
+    printf("PNG encoding, %zux%zu pixels (%.0f MB), compression %d\n\n", width, height, mb, compression);
+    printf("%-16s %8s %10s %10s %8s\n", "encoder", "threads", "PNG KB", "MB/s", "speedup");
+
+    kImageMemorySink sink(width * height);
+
+    // implementation encoder, it's used for single thread encoding
+    EncodeTest test = {
+        &bitmap, &sink, kImageEncodeProperties::construct(compression, 1), false, false
+    };
+    double time = BenchmarkBest(test, 0, 1);
+    printf(
+        "%-16s %8d %10zu %10.1f %8s\n",
+        "implementation", 1, sink.size() / 1024, mb / time, test.result ? "" : "FAILED"
+    );
+
+    // parallel encoder scaling, every thread count gives the same output
+    test.parallel = true;
+    std::vector<uint8_t> reference;
+    double single = 0;
+    bool same = true;
+
+    // thread counts are powers of two up to max threads
+    for (size_t threads = 1; ; threads = umin(threads * 2, maxthreads)) {
+        test.properties.threads = threads;
+        time = BenchmarkBest(test, 0, 3);
+
+        if (threads == 1) {
+            single = time;
+            reference.assign(sink.data(), sink.data() + sink.size());
+        } else {
+            same = same && test.result &&
+                reference.size() == sink.size() &&
+                memcmp(reference.data(), sink.data(), sink.size()) == 0;
+        }
+
+        printf(
+            "%-16s %8zu %10zu %10.1f %7.2fx%s\n",
+            "parallel", threads, sink.size() / 1024, mb / time, single / time,
+            !test.result ? "  FAILED" : same ? "" : "  MISMATCH"
+        );
+
+        if (threads == maxthreads) {
+            break;
+        }
+    }
+
+    return same && test.result ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    benchmarks/tiledrendering.cpp
+        tiled canvas thread scaling benchmark
+
+        draws large dashboard bitmap with kBitmapCanvas on calling thread
+        and with kTiledBitmapCanvas on growing number of threads, tiled
+        time includes recording of drawing commands, tiled output must be
+        the same for any number of threads
+
+        usage: tiledrendering [width] [height] [max threads] [tile size]
+*/
+
+#include "kcanvas/canvas.h"
+#include "benchmark.h"
+#include "dashboard.h"
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+
+using namespace c_util;
+using namespace k_canvas;
+
+
+struct RenderTest
+{
+    const kBitmap          *bitmap;
+    size_t                  width;
+    size_t                  height;
+    kTiledCanvasProperties  properties;
+    bool                    tiled;
+    size_t                  renderedtiles;
+
+    void Run()
+    {
+        if (tiled) {
+            kTiledBitmapCanvas canvas(*bitmap, &properties);
+            DrawDashboard(canvas, width, height);
+            canvas.Flush();
+            renderedtiles = canvas.renderedtiles();
+        } else {
+            kBitmapCanvas canvas(*bitmap);
+            DrawDashboard(canvas, width, height);
+        }
+    }
+};
+
+static void ReadPixels(const kBitmap &bitmap, size_t width, size_t height, std::vector<uint8_t> &pixels)
+{
+    pixels.resize(width * height * 4);
+    bitmap.Read(nullptr, kBitmapFormat::Color32BitAlphaPremultiplied, width * 4, pixels.data());
+}
+
+// largest difference of pixel channels, tiled output is compared with
+// direct rendering for information only, tile edges may change
+// antialiasing slightly
+static int MaxDifference(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b)
+{
+    int result = 0;
+    for (size_t n = 0; n < a.size(); ++n) {
+        result = umax(result, a[n] > b[n] ? a[n] - b[n] : b[n] - a[n]);
+    }
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    size_t width = BenchmarkArgument(argc, argv, 1, 8192);
+    size_t height = BenchmarkArgument(argc, argv, 2, 8192);
+    size_t maxthreads = umax(BenchmarkArgument(argc, argv, 3, std::thread::hardware_concurrency()), size_t(1));
+    size_t tilesize = umax(BenchmarkArgument(argc, argv, 4, 256), size_t(1));
+
+    kBitmap bitmap(width, height, kBitmapFormat::Color32BitAlphaPremultiplied);
+
+    double mpixels = double(width * height) / 1000000.0;
+    printf("tiled rendering, %zux%zu pixels, %zu pixel tiles\n\n", width, height, tilesize);
+    printf("%-16s %8s %8s %10s %8s %8s\n", "canvas", "threads", "tiles", "MPixels/s", "speedup", "maxdiff");
+
+    // direct rendering on calling thread
+    RenderTest test = {
+        &bitmap, width, height, kTiledCanvasProperties::construct(tilesize, 1), false, 0
+    };
+    double single = BenchmarkBest(test, 0, 3);
+    printf("%-16s %8d %8s %10.1f %7.2fx %8s\n", "bitmap", 1, "", mpixels / single, 1.0, "");
+
+    std::vector<uint8_t> direct;
+    ReadPixels(bitmap, width, height, direct);
+
+    // tiled rendering scaling, every thread count gives the same pixels
+    test.tiled = true;
+    std::vector<uint8_t> reference;
+    std::vector<uint8_t> pixels;
+    bool same = true;
+
+    // thread counts are powers of two up to max threads
+    for (size_t threads = 1; ; threads = umin(threads * 2, maxthreads)) {
+        test.properties.threads = threads;
+        double time = BenchmarkBest(test, 0, 3);
+
+        ReadPixels(bitmap, width, height, pixels);
+        if (threads == 1) {
+            reference = pixels;
+        } else {
+            same = same && reference == pixels;
+        }
+
+        printf(
+            "%-16s %8zu %8zu %10.1f %7.2fx %8d%s\n",
+            "tiled", threads, test.renderedtiles, mpixels / time, single / time,
+            MaxDifference(direct, pixels), same ? "" : "  MISMATCH"
+        );
+
+        if (threads == maxthreads) {
+            break;
+        }
+    }
+
+    return same ? 0 : 1;
+}
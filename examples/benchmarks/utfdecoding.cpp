@@ -0,0 +1,358 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    benchmarks/utfdecoding.cpp
+        UTF-8 decoding throughput benchmark
+
+        compares decoders used for text drawing and measurement with scalar
+        reference decoder (one code point at a time into new string) on
+        generated ASCII, mixed ASCII/CJK and CJK corpora, text is decoded line
+        by line, the way it's passed to text functions, decoded text is
+        checked to be the same as reference
+
+        usage: utfdecoding [corpus size in KB] [text file]
+        text file, if given, is used as additional corpus, it must be
+        valid UTF-8, reference decoder doesn't validate input
+*/
+
+#include "unicodeconverter.h"
+#include "benchmark.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+using namespace k_canvas;
+using namespace impl;
+
+
+// scalar reference decoder, valid UTF-8 only
+static inline char32_t RefCodepoint(const unsigned char *&utf8)
+{
+    unsigned char lead = *utf8++;
+    if (lead < 0x80) {
+        return lead;
+    }
+
+    size_t bytecount = lead >= 0xf0 ? 3 : lead >= 0xe0 ? 2 : 1;
+    char32_t codepoint = lead & (0x3f >> bytecount);
+    for (size_t n = 0; n < bytecount; ++n) {
+        codepoint = (codepoint << 6) | (*utf8++ & 0x3f);
+    }
+
+    return codepoint;
+}
+
+static std::wstring RefUTF16(const char *utf8, size_t size)
+{
+    std::wstring result;
+    result.reserve(size);
+
+    const unsigned char *p = reinterpret_cast<const unsigned char*>(utf8);
+    const unsigned char *end = p + size;
+    while (p < end) {
+        // wchar_t of 32 bits holds any code point
+        char32_t codepoint = RefCodepoint(p);
+        if (codepoint < 0x10000 || sizeof(wchar_t) > 2) {
+            result.push_back(wchar_t(codepoint));
+        } else {
+            codepoint -= 0x10000;
+            result.push_back(wchar_t(0xd800 | (codepoint >> 10)));
+            result.push_back(wchar_t(0xdc00 | (codepoint & 0x3ff)));
+        }
+    }
+
+    return result;
+}
+
+static std::u32string RefUTF32(const char *utf8, size_t size)
+{
+    std::u32string result;
+    result.reserve(size);
+
+    const unsigned char *p = reinterpret_cast<const unsigned char*>(utf8);
+    const unsigned char *end = p + size;
+    while (p < end) {
+        result.push_back(RefCodepoint(p));
+    }
+
+    return result;
+}
+
+
+// corpus generation
+
+static void AppendCodepoint(std::string &text, char32_t c)
+{
+    if (c < 0x80) {
+        text.push_back(char(c));
+    } else if (c < 0x800) {
+        text.push_back(char(0xc0 | (c >> 6)));
+        text.push_back(char(0x80 | (c & 0x3f)));
+    } else if (c < 0x10000) {
+        text.push_back(char(0xe0 | (c >> 12)));
+        text.push_back(char(0x80 | ((c >> 6) & 0x3f)));
+        text.push_back(char(0x80 | (c & 0x3f)));
+    } else {
+        text.push_back(char(0xf0 | (c >> 18)));
+        text.push_back(char(0x80 | ((c >> 12) & 0x3f)));
+        text.push_back(char(0x80 | ((c >> 6) & 0x3f)));
+        text.push_back(char(0x80 | (c & 0x3f)));
+    }
+}
+
+static const char *WORDS[] = {
+    "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "render",
+    "canvas", "bitmap", "layout", "paragraph", "request", "completed", "in",
+    "ms", "status=200", "GET", "/api/v1/items", "error:", "timeout", "value"
+};
+
+// cjk - percent of words made of CJK ideographs, rest are ASCII words,
+// few words of every corpus get Latin-1 and emoji characters
+static std::string MakeCorpus(size_t size, size_t cjk)
+{
+    BenchmarkRandom random(size + cjk);
+    std::string text;
+    size_t linelength = 0;
+
+    while (text.size() < size) {
+        uint32_t kind = random.next(100);
+
+        if (kind < cjk) {
+            size_t count = 1 + random.next(4);
+            for (size_t n = 0; n < count; ++n) {
+                AppendCodepoint(text, 0x4e00 + random.next(0x5200));
+            }
+        } else if (kind == 99) {
+            AppendCodepoint(text, 0x1f600 + random.next(0x50));
+        } else if (kind == 98) {
+            AppendCodepoint(text, 0xc0 + random.next(0x40));
+        } else {
+            text += WORDS[random.next(sizeof(WORDS) / sizeof(WORDS[0]))];
+        }
+
+        // CJK text has no spaces between words, lines are broken on
+        // the same average length for every corpus
+        if (kind >= cjk || random.next(8) == 0) {
+            text.push_back(' ');
+        }
+
+        if (text.size() - linelength > 40 + random.next(80)) {
+            text.push_back('\n');
+            linelength = text.size();
+        }
+    }
+
+    return text;
+}
+
+// line start and length pairs
+typedef std::vector<std::pair<size_t, size_t> > Lines;
+
+static void SplitLines(const std::string &text, Lines &lines)
+{
+    size_t start = 0;
+    for (size_t n = 0; n <= text.size(); ++n) {
+        if (n == text.size() || text[n] == '\n') {
+            lines.push_back(std::make_pair(start, n - start));
+            start = n + 1;
+        }
+    }
+}
+
+
+// decoding tests, every one decodes all corpus lines
+
+struct DecodeTest
+{
+    DecodeTest(const std::string &text, const Lines &lines) :
+        text(&text),
+        lines(&lines),
+        units(0)
+    {}
+
+    const std::string *text;
+    const Lines       *lines;
+    size_t             units; // decoded code units, keeps result
+                              // from being optimised away
+};
+
+struct RefUTF16Test : DecodeTest
+{
+    using DecodeTest::DecodeTest;
+
+    void Run()
+    {
+        units = 0;
+        for (size_t n = 0; n < lines->size(); ++n) {
+            units += RefUTF16(text->data() + (*lines)[n].first, (*lines)[n].second).size();
+        }
+    }
+};
+
+struct StringUTF16Test : DecodeTest
+{
+    using DecodeTest::DecodeTest;
+
+    void Run()
+    {
+        units = 0;
+        for (size_t n = 0; n < lines->size(); ++n) {
+            units += utf8toutf16(text->data() + (*lines)[n].first, (*lines)[n].second).size();
+        }
+    }
+};
+
+struct BufferUTF16Test : DecodeTest
+{
+    BufferUTF16Test(const std::string &text, const Lines &lines) :
+        DecodeTest(text, lines),
+        buffer(text.size() + 1)
+    {}
+
+    std::vector<wchar_t> buffer;
+
+    void Run()
+    {
+        units = 0;
+        for (size_t n = 0; n < lines->size(); ++n) {
+            units += utf8toutf16(text->data() + (*lines)[n].first, (*lines)[n].second, buffer.data());
+        }
+    }
+};
+
+struct RefUTF32Test : DecodeTest
+{
+    using DecodeTest::DecodeTest;
+
+    void Run()
+    {
+        units = 0;
+        for (size_t n = 0; n < lines->size(); ++n) {
+            units += RefUTF32(text->data() + (*lines)[n].first, (*lines)[n].second).size();
+        }
+    }
+};
+
+struct BufferUTF32Test : DecodeTest
+{
+    BufferUTF32Test(const std::string &text, const Lines &lines) :
+        DecodeTest(text, lines),
+        buffer(text.size() + 1)
+    {}
+
+    std::vector<char32_t> buffer;
+
+    void Run()
+    {
+        units = 0;
+        for (size_t n = 0; n < lines->size(); ++n) {
+            units += utf8toutf32(text->data() + (*lines)[n].first, (*lines)[n].second, buffer.data());
+        }
+    }
+};
+
+
+// decoded lines must match reference
+static bool Verify(const std::string &text, const Lines &lines)
+{
+    std::vector<wchar_t> buffer16(text.size() + 1);
+    std::vector<char32_t> buffer32(text.size() + 1);
+
+    for (size_t n = 0; n < lines.size(); ++n) {
+        const char *line = text.data() + lines[n].first;
+        size_t size = lines[n].second;
+
+        std::wstring ref16 = RefUTF16(line, size);
+        std::u32string ref32 = RefUTF32(line, size);
+        size_t units16 = utf8toutf16(line, size, buffer16.data());
+        size_t units32 = utf8toutf32(line, size, buffer32.data());
+
+        if (ref16 != utf8toutf16(line, size) ||
+            units16 != ref16.size() || std::wstring(buffer16.data(), units16) != ref16 ||
+            units32 != ref32.size() || std::u32string(buffer32.data(), units32) != ref32) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool Benchmark(const char *name, const std::string &text)
+{
+    Lines lines;
+    SplitLines(text, lines);
+
+    size_t ascii = 0;
+    for (size_t n = 0; n < text.size(); ++n) {
+        ascii += (text[n] & 0x80) == 0;
+    }
+
+    bool same = Verify(text, lines);
+
+    RefUTF16Test ref16(text, lines);
+    StringUTF16Test string16(text, lines);
+    BufferUTF16Test buffer16(text, lines);
+    RefUTF32Test ref32(text, lines);
+    BufferUTF32Test buffer32(text, lines);
+
+    double mb = double(text.size()) / (1024.0 * 1024.0);
+    double tref16 = BenchmarkBest(ref16);
+    double tstring16 = BenchmarkBest(string16);
+    double tbuffer16 = BenchmarkBest(buffer16);
+    double tref32 = BenchmarkBest(ref32);
+    double tbuffer32 = BenchmarkBest(buffer32);
+
+    printf(
+        "%-10s %5.1f%% %8.1f %8.1f %8.1f %7.2fx %8.1f %8.1f %7.2fx%s\n",
+        name, 100.0 * double(ascii) / double(text.size() ? text.size() : 1),
+        mb / tref16, mb / tstring16, mb / tbuffer16, tref16 / tbuffer16,
+        mb / tref32, mb / tbuffer32, tref32 / tbuffer32,
+        same ? "" : "  MISMATCH"
+    );
+
+    return same;
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = BenchmarkArgument(argc, argv, 1, 4096) * 1024;
+
+    printf("UTF-8 decoding, %zu KB corpora decoded line by line, MB/s\n\n", size / 1024);
+    printf(
+        "%-10s %6s %8s %8s %8s %8s %8s %8s %8s\n",
+        "corpus", "ASCII", "ref16", "string16", "span16", "speedup", "ref32", "span32", "speedup"
+    );
+
+    bool same = true;
+    same = Benchmark("ascii", MakeCorpus(size, 0)) && same;
+    same = Benchmark("mixed", MakeCorpus(size, 25)) && same;
+    same = Benchmark("cjk", MakeCorpus(size, 97)) && same;
+
+    if (argc > 2) {
+        FILE *file = fopen(argv[2], "rb");
+        if (!file) {
+            printf("can't open %s\n", argv[2]);
+            return 1;
+        }
+
+        std::string text;
+        char block[65536];
+        size_t read;
+        while ((read = fread(block, 1, sizeof(block), file)) > 0) {
+            text.append(block, read);
+        }
+        fclose(file);
+
+        same = Benchmark("file", text) && same;
+    }
+
+    return same ? 0 : 1;
+}
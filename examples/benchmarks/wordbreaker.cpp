@@ -0,0 +1,355 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    benchmarks/wordbreaker.cpp
+        word breaker differential test and benchmark
+
+        word breaker used for text layout is compared with scalar byte by
+        byte reference breaker for all kTextFlags combinations, on random
+        texts of all short lengths and on generated log and prose corpora,
+        every word (position, length and type) must be the same
+        then both breakers are timed on the corpora
+
+        usage: wordbreaker [corpus size in KB] [text file]
+        text file, if given, is used as additional corpus
+*/
+
+#include "textlayout.h"
+#include "benchmark.h"
+#include <cstdio>
+#include <string>
+
+
+using namespace k_canvas;
+using namespace impl;
+
+
+// reference breaker, scans text byte by byte, the way it was done
+// before block scanning was added
+class ReferenceWordBreaker
+{
+public:
+    // initialize word breaker with text, length and flags
+    ReferenceWordBreaker(const char *text, size_t length, kTextFlags flags) :
+        p_text(reinterpret_cast<const unsigned char *>(text)),
+        p_pos(0),
+        p_length(length),
+        p_linebreaks((flags & kTextFlags::IgnoreLineBreaks) == 0),
+        p_tabstops((flags & kTextFlags::UseTabs) != 0)
+    {}
+
+    // extract next word from text
+    bool NextWord(Word &word)
+    {
+        if (p_pos == p_length) {
+            return false;
+        }
+
+        word.text = reinterpret_cast<const char *>(p_text + p_pos);
+
+        // try to find word boundaries
+        size_t start = p_pos;
+        while (p_pos < p_length) {
+            if (p_text[p_pos] <= ' ') {
+                break;
+            }
+            ++p_pos;
+        }
+
+        // if there were some characters this part of text is a word
+        if (p_pos > start) {
+            word.length = p_pos - start;
+            word.type = Word::Text;
+            return true;
+        }
+
+        // loop through spacing characters
+        word.length = 0;
+        while (p_pos < p_length) {
+            bool returnspaces = false;
+
+            switch (p_text[p_pos]) {
+                // check for tab stop character
+                case '\t':
+                    if (p_tabstops) {
+                        if (word.length) {
+                            returnspaces = true;
+                        } else {
+                            word.type = Word::Tab;
+                            ++p_pos;
+                            return true;
+                        }
+                    } else {
+                        ++p_pos;
+                        ++word.length;
+                    }
+                    break;
+
+                // check for line break sequence
+                case '\n':
+                case '\r': {
+                    size_t linebreak = 0;
+
+                    // check for one or two characters line breaks (LF, CRLF or LFCR)
+                    if ((p_length - p_pos) == 1) {
+                        linebreak = 1;
+                    } else {
+                        if ((p_text[p_pos] == '\r' && p_text[p_pos + 1] == '\n') ||
+                            (p_text[p_pos] == '\n' && p_text[p_pos + 1] == '\r')) {
+                            linebreak = 2;
+                        } else {
+                            linebreak = 1;
+                        }
+                    }
+
+                    if (p_linebreaks) {
+                        if (word.length) {
+                            returnspaces = true;
+                        } else {
+                            word.type = Word::LineBreak;
+                            p_pos += linebreak;
+                            return true;
+                        }
+                    } else {
+                        p_pos += linebreak;
+                        ++word.length;
+                    }
+                    break;
+                }
+
+                default:
+                    if (p_text[p_pos] > ' ') {
+                        returnspaces = true;
+                    } else {
+                        ++p_pos;
+                        ++word.length;
+                    }
+            }
+
+            if (returnspaces) {
+                break;
+            }
+        }
+
+        word.type = Word::Space;
+        return true;
+    }
+
+private:
+    const unsigned char *p_text;
+    size_t               p_pos;
+    size_t               p_length;
+    bool                 p_linebreaks;
+    bool                 p_tabstops;
+};
+
+
+
+// compares words of both breakers, prints first difference
+static bool Compare(const std::string &text, uint32_t flags, const char *name)
+{
+    WordBreaker breaker(text.data(), text.size(), flags);
+    ReferenceWordBreaker reference(text.data(), text.size(), flags);
+
+    for (size_t index = 0; ; ++index) {
+        Word word;
+        Word refword;
+        bool next = breaker.NextWord(word);
+        bool refnext = reference.NextWord(refword);
+
+        if (next != refnext ||
+            (next && (word.text != refword.text || word.length != refword.length || word.type != refword.type))) {
+            printf(
+                "MISMATCH: %s, length %zu, flags 0x%02x, word %zu at %zu\n",
+                name, text.size(), flags, index,
+                size_t((next ? word.text : refword.text) - text.data())
+            );
+            return false;
+        }
+
+        if (!next) {
+            return true;
+        }
+    }
+}
+
+
+// corpus generation
+
+static const char *WORDS[] = {
+    "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "render",
+    "canvas", "bitmap", "layout", "paragraph", "request", "completed", "in",
+    "ms", "status=200", "GET", "/api/v1/items", "error:", "timeout", "value",
+    "\xe6\x96\x87\xe5\xad\x97", "na\xc3\xafve", "internationalization"
+};
+
+// log lines, tab separated fields and CRLF line ends
+static std::string MakeLog(size_t size)
+{
+    BenchmarkRandom random(1);
+    std::string text;
+    char field[64];
+
+    while (text.size() < size) {
+        snprintf(
+            field, sizeof(field), "2017-%02u-%02u %02u:%02u:%02u.%03u\t",
+            1 + random.next(12), 1 + random.next(28),
+            random.next(24), random.next(60), random.next(60), random.next(1000)
+        );
+        text += field;
+        text += random.next(4) ? "INFO\t" : "WARN\t";
+
+        size_t words = 3 + random.next(12);
+        for (size_t n = 0; n < words; ++n) {
+            text += WORDS[random.next(sizeof(WORDS) / sizeof(WORDS[0]))];
+            text += ' ';
+        }
+        text += "\r\n";
+    }
+
+    return text;
+}
+
+// prose paragraphs, long runs of words with single and double spaces
+static std::string MakeProse(size_t size)
+{
+    BenchmarkRandom random(2);
+    std::string text;
+
+    while (text.size() < size) {
+        size_t words = 20 + random.next(200);
+        for (size_t n = 0; n < words; ++n) {
+            text += WORDS[random.next(sizeof(WORDS) / sizeof(WORDS[0]))];
+            text += random.next(10) ? " " : "  ";
+        }
+        text += "\n\n";
+    }
+
+    return text;
+}
+
+// random bytes biased to spacing, control and line break characters,
+// so every branch of both breakers is taken
+static std::string MakeRandom(BenchmarkRandom &random, size_t length)
+{
+    static const char CHARS[] = { ' ', ' ', '\t', '\n', '\r', '\x01', '\x1f', 'a', 'b', '\x80', '\xff', '!' };
+
+    std::string text(length, ' ');
+
+    // long runs of the same class cross scan block boundaries
+    size_t n = 0;
+    while (n < length) {
+        size_t run = random.next(4) ? 1 : 1 + random.next(150);
+        char c = CHARS[random.next(sizeof(CHARS))];
+        for (; run && n < length; --run, ++n) {
+            text[n] = c;
+        }
+    }
+
+    return text;
+}
+
+
+// counts words of whole corpus with given breaker type
+template <typename T>
+struct BreakTest
+{
+    const std::string *text;
+    uint32_t           flags;
+    size_t             words;
+
+    void Run()
+    {
+        T breaker(text->data(), text->size(), flags);
+        Word word;
+
+        words = 0;
+        while (breaker.NextWord(word)) {
+            ++words;
+        }
+    }
+};
+
+static void Benchmark(const char *name, const std::string &text)
+{
+    static const uint32_t FLAGS[] = { 0, kTextFlags::UseTabs, kTextFlags::IgnoreLineBreaks };
+    static const char *FLAGNAMES[] = { "default", "tabs", "no breaks" };
+
+    double mb = double(text.size()) / (1024.0 * 1024.0);
+
+    for (size_t n = 0; n < sizeof(FLAGS) / sizeof(FLAGS[0]); ++n) {
+        BreakTest<ReferenceWordBreaker> reference = { &text, FLAGS[n], 0 };
+        BreakTest<WordBreaker> breaker = { &text, FLAGS[n], 0 };
+
+        double reftime = BenchmarkBest(reference);
+        double time = BenchmarkBest(breaker);
+
+        printf(
+            "%-8s %-10s %10zu %10.1f %10.1f %7.2fx\n",
+            name, FLAGNAMES[n], breaker.words, mb / reftime, mb / time, reftime / time
+        );
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = BenchmarkArgument(argc, argv, 1, 8192) * 1024;
+
+    std::string log = MakeLog(size);
+    std::string prose = MakeProse(size);
+    std::string file;
+
+    if (argc > 2) {
+        FILE *input = fopen(argv[2], "rb");
+        if (!input) {
+            printf("can't open %s\n", argv[2]);
+            return 1;
+        }
+
+        char block[65536];
+        size_t read;
+        while ((read = fread(block, 1, sizeof(block), input)) > 0) {
+            file.append(block, read);
+        }
+        fclose(input);
+    }
+
+    // differential test, all flag combinations, flags which don't affect
+    // breaking are included too, so any future dependency on them is tested
+    bool same = true;
+    BenchmarkRandom random;
+
+    for (uint32_t flags = 0; flags < 0x80 && same; ++flags) {
+        for (size_t length = 0; length <= 300 && same; ++length) {
+            for (size_t n = 0; n < 8 && same; ++n) {
+                same = Compare(MakeRandom(random, length), flags, "random");
+            }
+        }
+
+        same = same && Compare(log.substr(0, 1 << 20), flags, "log");
+        same = same && Compare(prose.substr(0, 1 << 20), flags, "prose");
+        same = same && (file.empty() || Compare(file, flags, "file"));
+    }
+
+    printf("differential test: %s\n\n", same ? "passed" : "FAILED");
+    if (!same) {
+        return 1;
+    }
+
+    printf("word breaking, %zu KB corpora, MB/s\n\n", size / 1024);
+    printf("%-8s %-10s %10s %10s %10s %8s\n", "corpus", "flags", "words", "reference", "breaker", "speedup");
+
+    Benchmark("log", log);
+    Benchmark("prose", prose);
+    if (file.size()) {
+        Benchmark("file", file);
+    }
+
+    return 0;
+}
@@ -19,6 +19,7 @@
 
 #pragma once
 #include <vector>
+#include <string>
 #include "canvastypes.h"     // all basic data types used by canvas and its objects
 #include "canvasresources.h" // internal resource object definitions
 
@@ -39,10 +40,21 @@ namespace k_canvas
     class kFont;          // font object, holds all font properties
     class kPath;          // path object, holds shape definition
     class kBitmap;        // bitmap object, holds pixel data
+    class kImageSink;     // destination for encoded bitmap image data
+    class kRowSink;       // destination for rows of pixels produced band by band
     class kTextService;   // text service, provides font info/text measurement interface
+    class kTextLayout;    // text layout, holds measured and layed out text block
+    class kTextEditLayout; // editable text layout, relayouts only changed paragraphs
+    class kDamageRegion;  // set of rectangles covering changed pixels
+    class kGroupCache;    // cache of rendered groups of drawing calls
     class kCanvas;        // canvas, provides drawing interface
     class kBitmapCanvas;  // canvas for painting into kBitmap
     class kContextCanvas; // canvas for painting into implementation specific context
+    class kTiledBitmapCanvas; // canvas for painting into kBitmap by tiles on several threads
+    class kBandRenderer;  // renders huge images by horizontal bands
+    class kRenderBatch;   // renders many independent images on worker threads
+    class kSceneNode;     // retained scene node, holds drawing items and child nodes
+    class kScene;         // retained scene, redraws only changed parts of target
 
     namespace impl
     {
@@ -51,6 +63,12 @@ namespace k_canvas
         class kPathImpl;
         class kBitmapImpl;
         class kCanvasImpl;
+        class kCanvasImplDamage;
+        class kGroupCacheImpl;
+        class kTextLayoutImpl;
+        class kTextEditLayoutImpl;
+        class PNGStreamWriter;
+        class kRenderBatchImpl;
     }
 
 
@@ -385,6 +403,7 @@ namespace k_canvas
     class kPath
     {
         friend class kCanvas;
+        friend class kSceneNode;
 
     private:
         // Path constructor helper class
@@ -457,20 +476,93 @@ namespace k_canvas
                 updateerect - optional destination rectangle
                     if not provided the whole bitmap is updated
                     always clipped to bitmap's dimensions
-                format      - format of source pixel data (now should match bitmap format)
+                format      - format of source pixel data, converted to bitmap format
+                              if it doesn't match
                 sourcepitch - byte size of source data row
-                void        - source data pointer
+                void        - source data pointer, points to top left pixel
+                              of update rectangle (before clipping)
 
                 source pixels are not stretched and copied as is into desired place
+
+            Read(optional kRect readrect, kBitmapFormat destformat, size_t destpitch, data)
+                read whole or part of bitmap's pixel data, converting it into
+                desired format, parameters have the same meaning as for Update
+                returns false if implementation doesn't support reading pixels
+                reading premultiplied color into format without alpha gives
+                color as if it was drawn over black background
+
+            Lock(size_t &pitch)
+                gives direct access to bitmap's pixel memory, returns pointer to
+                top left pixel and sets pitch to byte size of pixel row
+                returns nullptr if implementation doesn't provide direct access,
+                Update should be used in that case
+                pending drawing into bitmap is finished before Lock returns
+                pixel data must not be accessed after Unlock call
+
+            Unlock(optional kRectInt dirtyrect)
+                finishes direct pixel access
+                dirtyrect - optional rectangle of changed pixels, if not provided
+                            the whole bitmap is treated as changed
+
+            Encode(kImageFormat format, kImageSink &sink, optional kImageEncodeProperties properties)
+                writes bitmap image encoded in given format into sink
+                data is streamed by bands of rows, no full copy of
+                bitmap is made
+                large PNG images are compressed by bands on several threads
+                when library is built with zlib, otherwise PNG is written by
+                implementation and properties are ignored
+                returns false if format isn't supported or sink failed
+
+            SetMipmaps(bool enable)
+                enables reduced copies of bitmap (each one half size of previous)
+                used when bitmap is drawn scaled down by half or more, this gives
+                smoother result and reads less memory for small thumbnails
+                reduced copies are made on demand on first downscaled drawing
+                and dropped when bitmap pixels change through Update, Unlock or
+                drawing into bitmap, disabled by default
+                ignored by implementations which don't support it
+
+        Bitmap can be constructed over caller owned pixel memory, in that case
+        data is not copied and changes made through Lock/Unlock or by drawing
+        are visible in caller's memory. Memory must stay valid until release
+        callback is called (or until bitmap destruction if no callback provided).
+        pitch must be a multiple of 4 and not less than row byte size, if
+        implementation can't use memory directly, pixels are copied into own
+        storage and release callback is called immediately.
+
+        Only Color32BitAlphaPremultiplied and Mask8Bit are bitmap storage
+        formats, bitmap constructed with any other format is empty (0x0 with
+        Color32BitAlphaPremultiplied format), caller memory isn't used then
+        and its release callback is called immediately.
+
+        Bitmap with kBitmapStorage::Mapped storage keeps pixels in memory mapped
+        file, which is created (or truncated) at given path, or in anonymous
+        shared memory if path isn't provided. Pixel memory is committed lazily
+        as it's touched by drawing, so huge bitmaps can be rendered and streamed
+        out band by band without holding whole image in RAM. File holds raw
+        pixel rows in bitmap's format with implementation's pitch. If file
+        can't be created or mapped, anonymous memory is mapped instead, if
+        nothing can be mapped bitmap is empty (0x0), whole image is never
+        allocated as regular memory instead of mapping.
+        Implementations without mapping support use regular memory.
+        Bitmap which can't be allocated is empty as well.
     */
     class kBitmap
     {
         friend class kCanvas;
         friend class kBitmapCanvas;
+        friend class kTiledBitmapCanvas;
         friend class kBrush;
+        friend class kSceneNode;
+        friend class impl::kRenderBatchImpl;
 
     public:
         kBitmap(size_t width, size_t height, kBitmapFormat format);
+        kBitmap(size_t width, size_t height, kBitmapFormat format, kBitmapStorage storage, const char *path = nullptr);
+        kBitmap(
+            size_t width, size_t height, kBitmapFormat format, size_t pitch, void *data,
+            kBitmapReleaseProc release = nullptr, void *context = nullptr
+        );
         ~kBitmap();
 
         // this type of object can NOT be copied and reassigned to other
@@ -486,6 +578,19 @@ namespace k_canvas
         kBitmapFormat format() const { return p_format; }
 
         void Update(const kRectInt *updaterect, kBitmapFormat sourceformat, size_t sourcepitch, const void *data);
+        bool Read(const kRectInt *readrect, kBitmapFormat destformat, size_t destpitch, void *data) const;
+        bool Encode(kImageFormat format, kImageSink &sink, const kImageEncodeProperties *properties = nullptr) const;
+
+        void* Lock(size_t &pitch);
+        void Unlock(const kRectInt *dirtyrect = nullptr);
+
+        void SetMipmaps(bool enable);
+
+    protected:
+        // makes empty bitmap instead of bitmap of non storage format
+        void InitializeEmpty();
+        // takes empty size if implementation couldn't allocate pixels
+        void CheckAllocated();
 
     protected:
         impl::kBitmapImpl *p_impl;
@@ -495,6 +600,125 @@ namespace k_canvas
     };
 
 
+    /*
+     -------------------------------------------------------------------------------
+     kImageSink
+     -------------------------------------------------------------------------------
+        destination for encoded image data written by kBitmap::Encode
+
+        Write(data, size) is called sequentially with consecutive chunks
+        of encoded data, it returns false to stop encoding on error
+
+        available sinks:
+            kImageFileSink     - writes into file descriptor, caller keeps
+                                 descriptor open and owns it
+            kImageMemorySink   - appends into own growing memory buffer,
+                                 Clear keeps allocated memory, so single sink
+                                 can be reused for many images without
+                                 reallocations
+            kImageCallbackSink - passes data to user callback
+    */
+    class kImageSink
+    {
+    public:
+        virtual ~kImageSink() {}
+
+        virtual bool Write(const void *data, size_t size) = 0;
+    };
+
+    class kImageFileSink : public kImageSink
+    {
+    public:
+        kImageFileSink(int fd);
+
+        bool Write(const void *data, size_t size) override;
+
+    protected:
+        int p_fd;
+    };
+
+    class kImageMemorySink : public kImageSink
+    {
+    public:
+        kImageMemorySink(size_t reserve = 0);
+
+        bool Write(const void *data, size_t size) override;
+
+        const uint8_t* data() const { return p_buffer.data(); }
+        size_t size() const { return p_buffer.size(); }
+
+        void Clear();
+
+    protected:
+        std::vector<uint8_t> p_buffer;
+    };
+
+    class kImageCallbackSink : public kImageSink
+    {
+    public:
+        kImageCallbackSink(kImageWriteProc proc, void *context = nullptr);
+
+        bool Write(const void *data, size_t size) override;
+
+    protected:
+        kImageWriteProc  p_proc;
+        void            *p_context;
+    };
+
+
+    /*
+     -------------------------------------------------------------------------------
+     kRowSink
+     -------------------------------------------------------------------------------
+        destination for image pixels produced by bands of rows (see kBandRenderer)
+
+        Begin(width, height, format) is called once before any rows with
+        dimensions and pixel format of the whole image
+        WriteRows(data, pitch, count) is called for every band with consecutive
+        rows from top to bottom, data is valid only during the call
+        End() is called after all rows have been written
+        any of calls can return false to stop rendering
+
+        kImageRowEncoder encodes rows into image written to kImageSink, only
+        rows of a single band are held in memory, PNG is available only when
+        library is built with zlib
+    */
+    class kRowSink
+    {
+    public:
+        virtual ~kRowSink() {}
+
+        virtual bool Begin(size_t width, size_t height, kBitmapFormat format) { return true; }
+        virtual bool WriteRows(const void *data, size_t pitch, size_t count) = 0;
+        virtual bool End() { return true; }
+    };
+
+    class kImageRowEncoder : public kRowSink
+    {
+    public:
+        kImageRowEncoder(kImageFormat format, kImageSink &sink, const kImageEncodeProperties *properties = nullptr);
+        ~kImageRowEncoder() override;
+
+        // this type of object can NOT be copied and reassigned to other
+        kImageRowEncoder(const kImageRowEncoder &source) = delete;
+        kImageRowEncoder &operator=(const kImageRowEncoder &source) = delete;
+
+        bool Begin(size_t width, size_t height, kBitmapFormat format) override;
+        bool WriteRows(const void *data, size_t pitch, size_t count) override;
+        bool End() override;
+
+    protected:
+        kImageFormat           p_format;
+        kImageSink            &p_sink;
+        int                    p_compression;
+        size_t                 p_width;
+        kBitmapFormat          p_sourceformat;
+        kBitmapFormat          p_rowformat;
+        std::vector<uint8_t>   p_buffer;
+        impl::PNGStreamWriter *p_png;
+    };
+
+
     /*
      -------------------------------------------------------------------------------
      kTextService
@@ -528,6 +752,207 @@ namespace k_canvas
     };
 
 
+    /*
+     -------------------------------------------------------------------------------
+     kTextLayout
+     -------------------------------------------------------------------------------
+        text layout object
+
+        holds text block layed out inside layout bounds with given font and
+        text properties, the same way as kCanvas::Text(kRect ...) does
+
+        text is copied into layout object, broken into words and measured only
+        once on layout creation, changing layout width re-wraps text using
+        cached word measurements, so layout object is cheap to keep and
+        re-layout for frequently repainted or resized text
+
+        Methods
+            SetBounds(kSize bounds) - set new layout bounds
+            SetWidth(kScalar width) - set new layout width
+                both methods re-wrap text only if width changed and text
+                is multiline
+            Size()                  - layout text size (same as TextSize result)
+            InkBounds()             - text ink bounds (same as TextSize bounds)
+            HitTest(kPoint point)
+                returns byte offset into layout text of the character
+                boundary nearest to point, point is relative to layout origin
+            Draw(kCanvas canvas, kPoint origin, kBrush brush)
+                draws layout at origin point with provided brush
+    */
+    class kTextLayout
+    {
+    public:
+        kTextLayout(const kSize &bounds, const char *text, int count, const kFont &font, const kTextOutProperties *properties = nullptr);
+        ~kTextLayout();
+
+        // this type of object can NOT be copied and reassigned to other
+        kTextLayout(const kTextLayout &source) = delete;
+        kTextLayout &operator=(const kTextLayout &source) = delete;
+
+        kTextLayout(kTextLayout &&source);
+        kTextLayout &operator=(kTextLayout &&source);
+
+        const kSize& bounds() const;
+
+        void SetBounds(const kSize &bounds);
+        void SetWidth(kScalar width);
+
+        kSize Size() const;
+        kRect InkBounds() const;
+        size_t HitTest(const kPoint &point) const;
+
+        void Draw(kCanvas &canvas, const kPoint &origin, const kBrush &brush);
+
+    protected:
+        impl::kTextLayoutImpl *p_impl;
+    };
+
+
+    /*
+     -------------------------------------------------------------------------------
+     kTextEditLayout
+     -------------------------------------------------------------------------------
+        editable text layout object
+
+        holds large editable text split into paragraphs by LF characters
+        each paragraph keeps its own measured words and line breaks, text edit
+        measures and re-wraps only changed paragraphs, so edit cost doesn't
+        depend on overall text size
+        paragraphs are kept in balanced tree with sums of their heights and
+        lengths, so adding or removing paragraphs and finding paragraph by
+        y coordinate or text position is O(log n)
+
+        text properties are used the same way as by kCanvas::Text, except
+        vertical alignment, ellipses and clipping which are not used
+
+        all text positions are byte offsets into layout text
+
+        Methods
+            SetText(text, count)            - replace whole text
+            Insert(position, text, count)   - insert text at position
+            Erase(position, count)          - erase count bytes at position
+            SetWidth(kScalar width)
+                set new layout width, re-wraps all paragraphs (without measuring)
+            Size()                          - layout text size
+            HitTest(kPoint point)
+                returns text position nearest to point, point is relative
+                to layout origin
+            Draw(kCanvas canvas, kPoint origin, kBrush brush, kRect visible)
+                draws layout at origin point, only paragraphs intersecting
+                optional visible rect (relative to layout origin) are drawn
+    */
+    class kTextEditLayout
+    {
+    public:
+        kTextEditLayout(kScalar width, const kFont &font, const kTextOutProperties *properties = nullptr);
+        ~kTextEditLayout();
+
+        // this type of object can NOT be copied and reassigned to other
+        kTextEditLayout(const kTextEditLayout &source) = delete;
+        kTextEditLayout &operator=(const kTextEditLayout &source) = delete;
+
+        kTextEditLayout(kTextEditLayout &&source);
+        kTextEditLayout &operator=(kTextEditLayout &&source);
+
+        kScalar width() const;
+        size_t length() const;
+        size_t paragraphs() const;
+
+        void SetText(const char *text, int count);
+        void Insert(size_t position, const char *text, int count);
+        void Erase(size_t position, size_t count);
+        void SetWidth(kScalar width);
+
+        kSize Size() const;
+        size_t HitTest(const kPoint &point) const;
+
+        void Draw(kCanvas &canvas, const kPoint &origin, const kBrush &brush, const kRect *visible = nullptr);
+
+    protected:
+        impl::kTextEditLayoutImpl *p_impl;
+    };
+
+
+    /*
+     -------------------------------------------------------------------------------
+     kDamageRegion
+     -------------------------------------------------------------------------------
+        region of target pixels changed by drawing, it's kept as short list
+        of non-overlapping rectangles in target pixel coordinates
+
+        Add merges new rectangle with every rectangle it overlaps or forms
+        exact larger rectangle with, when list grows over maxrects rectangles
+        the pair which wastes the least area being united is merged, so region
+        stays conservative (it can cover unchanged pixels, but never misses
+        changed ones)
+    */
+    class kDamageRegion
+    {
+    public:
+        kDamageRegion(size_t maxrects = 16);
+
+        void Add(const kRectInt &rect);
+        void Clear();
+
+        bool empty() const { return p_rects.empty(); }
+        size_t count() const { return p_rects.size(); }
+        const kRectInt* rects() const { return p_rects.data(); }
+        const kRectInt& rect(size_t index) const { return p_rects[index]; }
+        // bounding rectangle of whole region, empty rectangle if region is empty
+        kRectInt bounds() const;
+
+    protected:
+        void Insert(kRectInt rect);
+
+    protected:
+        std::vector<kRectInt> p_rects;
+        size_t                p_maxrects;
+    };
+
+
+    /*
+     -------------------------------------------------------------------------------
+     kGroupCache
+     -------------------------------------------------------------------------------
+        cache of groups rendered by kCanvas::BeginCachedGroup, it outlives
+        canvases, so the same cache is given to canvas of every frame
+
+        rendered groups are kept in bitmaps while their total size fits
+        budget (in bytes), least recently used groups are dropped to make
+        room for new ones, group which doesn't fit budget isn't cached
+        Invalidate drops group with given key, next frame renders it again
+        Clear drops all groups
+        hits and misses count BeginCachedGroup calls which used cached
+        group and which had to render it
+    */
+    class kGroupCache
+    {
+        friend class kCanvas;
+
+    public:
+        kGroupCache(size_t budget = 32 * 1024 * 1024);
+        ~kGroupCache();
+
+        // this type of object can NOT be copied and reassigned to other
+        kGroupCache(const kGroupCache &source) = delete;
+        kGroupCache &operator=(const kGroupCache &source) = delete;
+
+        void SetBudget(size_t budget);
+        void Invalidate(uint64_t key);
+        void Clear();
+        void ResetCounters();
+
+        size_t budget() const;
+        size_t size() const;  // bytes used by cached groups
+        size_t count() const; // number of cached groups
+        size_t hits() const;
+        size_t misses() const;
+
+    protected:
+        impl::kGroupCacheImpl *p_impl;
+    };
+
+
     /*
      -------------------------------------------------------------------------------
      kCanvas
@@ -569,9 +994,28 @@ namespace k_canvas
                 except the last one - it should contain only two control points and
                 the last point is automatically equals to first point
 
+        batched drawing
+            Rectangles, Ellipses, Lines and Points draw arrays of primitives
+            much faster than separate calls, all items of one call are filled
+            as single shape and then stroked as single shape, so overlapping
+            items are painted once and all outlines are drawn over all fills
+            Lines      - count lines, points array holds two points per line
+            Points     - filled circles of size diameter centered at points
+            overloads with colors array fill every item with its own solid
+            color, items are grouped by color and every group is drawn by
+            one call, so painting order of different colors isn't kept
+
         object drawing
             DrawPath command draws kPath object
+            DrawPathInstances draws the same kPath under many transforms (or
+                offsets) in one call, result is the same as drawing instances
+                one by one in array order, every instance is filled with path's
+                even-odd rule, pen width isn't transformed
             DrawBitmap commands are used to draw kBitmap objects
+            DrawBitmaps draws many sprites (parts of one atlas bitmap) in one
+                call, it's much faster than the same number of DrawBitmap calls
+                sprites are drawn in array order, unscaled sprites of whole atlas
+                pixels placed on whole canvas pixels are the cheapest to draw
 
         text drawing
             canvas provides only basic text drawing capabilities
@@ -581,12 +1025,52 @@ namespace k_canvas
             Text(kPoint p ...)   - render single line of text with specified font and brush
             Text(kRect rect ...) - render bounded multiline text
                 with optional alignment and clipping
+            kTextLayout object can be used to keep bounded text layout
+            between paints instead of laying it out on every Text() call
 
         clipping
             drawing can be clipped by any arbitrary shape or mask
             use kCanvasClipper helper class with apropriate constructor to
             setup painting with clipping
 
+        layers
+            PushLayer redirects drawing into offscreen layer, PopLayer blends
+            layer content with drawing below it with layer's opacity and blend
+            mode, this way a group of primitives is faded or blended as a whole
+            bounds - layer rectangle in current canvas coordinates, drawing
+                     outside of it is clipped, the smaller layer is the cheaper
+            layers and clipping must be nested, kCanvasLayer helper class can be
+            used for "safe" layered drawing
+            implementations without blending support use Normal mode
+
+        cached groups
+            group of drawing calls which looks the same from frame to frame
+            can be rendered once and then reused as a bitmap
+            SetGroupCache    - sets cache used by groups, without cache groups
+                               are always drawn directly
+            BeginCachedGroup - starts group with user defined key, bounds
+                               is group rectangle in current canvas coordinates,
+                               returns true if group contents must be drawn
+                               (it's rendered into cache) and false if cached
+                               group was drawn, contents must be skipped then
+            EndCachedGroup   - ends group, rendered group is drawn to canvas
+            cached group is reused while canvas transform has the same scale
+            and rotation, it moves with transform translation
+            groups can be nested, clipping and layers started inside of group
+            must end inside of it, groups left open when canvas is destroyed
+            are discarded without drawing and their cache entries are dropped
+
+        damage tracking
+            kBitmapCanvas and kContextCanvas created with damagerects > 0
+            collect region of pixels changed by drawing, every call adds its
+            conservative bounds in target pixels (after transform and clipping)
+            GetDamage   - changed region since creation or last ResetDamage,
+                          nullptr if canvas doesn't track damage
+            ResetDamage - starts collecting new region, typically after
+                          changed pixels were presented or uploaded
+            mask clipping doesn't narrow damage, clip by mask bounds
+            rectangle to get tighter damage
+
         transform
             canvas transform organized as a stack
             SetTransform command changes transform at the top of the stack (it will be last in a hierarchy)
@@ -596,10 +1080,16 @@ namespace k_canvas
     class kCanvas : public kTextService
     {
         friend class kCanvasClipper;
+        friend class kTextLayout;
+        friend class kTextEditLayout;
+        friend class kSceneNode;
 
     public:
         // clear painting area to full black/transparent
         void Clear();
+        // set pixels under rectangle to color, no blending is done, so
+        // transparent color makes transparent pixels
+        void Clear(const kRect &rect, const kColor &color);
 
         // quick draw calls of certain primitive types for non-closed outlines
         void Line(const kPoint &a, const kPoint &b, const kPen &pen);
@@ -616,13 +1106,25 @@ namespace k_canvas
         void Polygon(const kPoint *points, size_t count, const kPen *pen, const kBrush *brush);
         void PolygonBezier(const kPoint *points, size_t count, const kPen *pen, const kBrush *brush);
 
+        // batched draw calls for arrays of primitives
+        void Rectangles(const kRect *rects, size_t count, const kPen *pen, const kBrush *brush);
+        void Rectangles(const kRect *rects, const kColor *colors, size_t count, const kPen *pen = nullptr);
+        void Ellipses(const kRect *rects, size_t count, const kPen *pen, const kBrush *brush);
+        void Ellipses(const kRect *rects, const kColor *colors, size_t count, const kPen *pen = nullptr);
+        void Lines(const kPoint *points, size_t count, const kPen &pen);
+        void Points(const kPoint *points, size_t count, kScalar size, const kBrush &brush);
+        void Points(const kPoint *points, const kColor *colors, size_t count, kScalar size);
+
         // object drawing
         void DrawPath(const kPath &path, const kPen *pen, const kBrush *brush);
         void DrawPath(const kPath &path, const kPen *pen, const kBrush *brush, const kPoint &offset);
         void DrawPath(const kPath &path, const kPen *pen, const kBrush *brush, const kTransform &transform);
+        void DrawPathInstances(const kPath &path, const kPen *pen, const kBrush *brush, const kTransform *transforms, size_t count);
+        void DrawPathInstances(const kPath &path, const kPen *pen, const kBrush *brush, const kPoint *offsets, size_t count);
         void DrawBitmap(const kBitmap &bitmap, const kPoint &origin, kScalar sourcealpha = 1.0f);
         void DrawBitmap(const kBitmap &bitmap, const kPoint &origin, const kPoint &source, const kSize &size, kScalar sourcealpha = 1.0f);
         void DrawBitmap(const kBitmap &bitmap, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize, kScalar sourcealpha = 1.0f);
+        void DrawBitmaps(const kBitmap &atlas, const kSpriteInstance *instances, size_t count);
         void DrawMask(const kBitmap &mask, kBrush &brush, const kPoint &origin);
         void DrawMask(const kBitmap &mask, kBrush &brush, const kPoint &origin, const kPoint &source, const kSize &size);
         void DrawMask(const kBitmap &mask, kBrush &brush, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize);
@@ -636,16 +1138,50 @@ namespace k_canvas
         void PushTransform(const kTransform &transform);
         void PopTransform();
 
+        // layers
+        void PushLayer(const kRect &bounds, kScalar opacity, kBlendMode blend = kBlendMode::Normal);
+        void PopLayer();
+
+        // cached groups
+        void SetGroupCache(kGroupCache *cache);
+        bool BeginCachedGroup(uint64_t key, const kRect &bounds);
+        void EndCachedGroup();
+
+        // damage tracking
+        const kDamageRegion* GetDamage() const;
+        void ResetDamage();
+
         // global initialization & finalization
         static bool Initialize(Impl implementation = IMPL_NONE);
         static bool Shutdown();
 
     protected:
         // Default canvas instantiation is not allowed
-        kCanvas() {}
-        ~kCanvas() override {}
+        kCanvas() : p_damage(nullptr), p_groupcache(nullptr) {}
+        ~kCanvas() override;
+
+        static void needResources(const kPen *pen, const kBrush *brush);
+
+        // wraps bound implementation canvas into damage tracker
+        // target - bound part of target in pixels
+        void TrackDamage(const kRectInt &target, size_t maxrects);
 
-        static inline void needResources(const kPen *pen, const kBrush *brush);
+        // canvas transform combined with offset of group bitmap being rendered
+        kTransform DeviceTransform() const;
+        // draws cached group bitmap at its place for current transform
+        void DrawCachedGroup(uint64_t key);
+        // discards groups left open, restores original implementation canvas
+        // and drops unfinished cache entries, must be called by derived
+        // canvas destructors before implementation canvas is unbound
+        void DiscardCachedGroups();
+
+        struct CachedGroup
+        {
+            uint64_t           key;
+            impl::kCanvasImpl *impl;   // implementation canvas to restore, nullptr
+                                       // if group isn't rendered into cache
+            kTransform         offset; // group bitmap offset applied to transform
+        };
 
         // masking & clipping
         // now it's protected to make Canvas more stateless
@@ -656,8 +1192,11 @@ namespace k_canvas
         void EndClippedDrawing();
 
     protected:
-        std::vector<kTransform> p_transform_stack;
-        kTransform              p_transform;
+        std::vector<kTransform>  p_transform_stack;
+        kTransform               p_transform;
+        impl::kCanvasImplDamage *p_damage; // damage tracker, it's p_impl when used
+        kGroupCache             *p_groupcache;
+        std::vector<CachedGroup> p_groups;
     };
 
 
@@ -666,11 +1205,14 @@ namespace k_canvas
      kBitmapCanvas
      -------------------------------------------------------------------------------
         canvas object for painting to kBitmap object
+
+        damagerects - maximum number of damage rectangles, 0 disables
+                      damage tracking
     */
     class kBitmapCanvas : public kCanvas
     {
     public:
-        kBitmapCanvas(const kBitmap &target, const kRectInt *rect = nullptr);
+        kBitmapCanvas(const kBitmap &target, const kRectInt *rect = nullptr, size_t damagerects = 0);
         ~kBitmapCanvas() override;
 
         // this type of object can NOT be copied and reassigned to other
@@ -679,16 +1221,63 @@ namespace k_canvas
     };
 
 
+    /*
+     -------------------------------------------------------------------------------
+     kTiledBitmapCanvas
+     -------------------------------------------------------------------------------
+        canvas object for painting to kBitmap object on several threads
+
+        drawing commands are recorded, not executed, and rasterised into
+        target bitmap by Flush() (or on destruction), bitmap is split into
+        tiles which are rendered on worker threads, every tile replays only
+        commands whose bounds touch it and tiles touched by nothing are skipped
+
+        objects used for drawing (bitmaps, paths) are referenced by recorded
+        commands, so they must not be changed until drawing is flushed
+        Flush() must not be called while clipping is active
+        implementations which can't render concurrently render tiles on
+        calling thread
+
+        tiles() and renderedtiles() give number of all and actually
+        rendered tiles of the last Flush()
+    */
+    class kTiledBitmapCanvas : public kCanvas
+    {
+    public:
+        kTiledBitmapCanvas(const kBitmap &target, const kTiledCanvasProperties *properties = nullptr);
+        ~kTiledBitmapCanvas() override;
+
+        // this type of object can NOT be copied and reassigned to other
+        kTiledBitmapCanvas(const kTiledBitmapCanvas &source) = delete;
+        kTiledBitmapCanvas &operator=(const kTiledBitmapCanvas &source) = delete;
+
+        void Flush();
+
+        size_t tiles() const { return p_tiles; }
+        size_t renderedtiles() const { return p_renderedtiles; }
+
+    protected:
+        const kBitmap          &p_target;
+        kTiledCanvasProperties  p_properties;
+        size_t                  p_tiles;
+        size_t                  p_renderedtiles;
+    };
+
+
     /*
      -------------------------------------------------------------------------------
      kContextCanvas
      -------------------------------------------------------------------------------
         canvas object for painting to platform context (typically window)
+
+        damagerects - maximum number of damage rectangles, 0 disables
+                      damage tracking, damage isn't limited by context
+                      size when rect isn't given
     */
     class kContextCanvas : public kCanvas
     {
     public:
-        kContextCanvas(kContext context, const kRectInt *rect = nullptr);
+        kContextCanvas(kContext context, const kRectInt *rect = nullptr, size_t damagerects = 0);
         ~kContextCanvas() override;
 
         // this type of object can NOT be copied and reassigned to other
@@ -714,6 +1303,286 @@ namespace k_canvas
         kPrinterCanvas &operator=(const kPrinterCanvas &source) = delete;
     };
 
+
+    /*
+     -------------------------------------------------------------------------------
+     kBandRenderer
+     -------------------------------------------------------------------------------
+        renders image of any size by horizontal bands of fixed height,
+        only one band bitmap is allocated, so memory use depends on band
+        height and not on image height
+
+        scene is drawn by kBandScene object, its Draw method is called for
+        every band with canvas which is translated so scene is drawn in whole
+        image coordinates and clipped to band rectangle (given in image
+        coordinates too, so scene can skip invisible objects)
+        scene can use SetTransform, PushTransform and PopTransform as usual,
+        band translation stays applied underneath
+
+        every finished band is passed to kRowSink
+        Render returns false if any sink call failed
+    */
+    class kBandScene
+    {
+    public:
+        virtual ~kBandScene() {}
+
+        virtual void Draw(kCanvas &canvas, const kRectInt &band) = 0;
+    };
+
+    class kBandRenderer
+    {
+    public:
+        kBandRenderer(
+            size_t width, size_t height, size_t bandheight,
+            kBitmapFormat format = kBitmapFormat::Color32BitAlphaPremultiplied
+        );
+
+        size_t width() const { return p_width; }
+        size_t height() const { return p_height; }
+        size_t bandheight() const { return p_bandheight; }
+
+        bool Render(kBandScene &scene, kRowSink &sink);
+
+    protected:
+        size_t        p_width;
+        size_t        p_height;
+        size_t        p_bandheight;
+        kBitmapFormat p_format;
+    };
+
+
+    /*
+     -------------------------------------------------------------------------------
+     kRenderBatch
+     -------------------------------------------------------------------------------
+        renders many small independent images on a pool of worker threads
+
+        Submit(width, height, job, format) queues job which draws into clear
+        bitmap of given size and format, rendered bitmap is passed to
+        job's Output() and is valid only during the call, format must be
+        bitmap storage format, jobs with other formats fail without drawing
+        Submit(width, height, job, imageformat, sink) also encodes rendered
+        image into sink before Output() is called
+        job's Finished() is called last with job result and its latency
+        (time in seconds from Submit to finish)
+        job methods are called on worker threads, jobs run in any order,
+        job objects (and sinks) must stay alive until jobs are finished
+
+        every worker keeps its own implementation canvas (with its text
+        measurement context) and a small pool of scratch bitmaps reused by
+        jobs of the same size and format, so per job setup is mostly clearing
+        of bitmap, idle workers steal queued jobs from busy ones
+
+        resource objects (pens, brushes, fonts, paths, bitmaps) must not be
+        shared by jobs running at the same time, unless they were used for
+        drawing before Submit (implementation objects are created on first use)
+
+        Wait() blocks until all submitted jobs are finished, it's also
+        called on destruction
+        stats() reports job statistics accumulated since batch creation
+    */
+    class kRenderJob
+    {
+    public:
+        virtual ~kRenderJob() {}
+
+        virtual void Draw(kCanvas &canvas) = 0;
+        virtual bool Output(const kBitmap &bitmap) { return true; }
+        virtual void Finished(bool success, double latency) {}
+    };
+
+    class kRenderBatch
+    {
+    public:
+        kRenderBatch(size_t threads = 0);
+        ~kRenderBatch();
+
+        // this type of object can NOT be copied and reassigned to other
+        kRenderBatch(const kRenderBatch &source) = delete;
+        kRenderBatch &operator=(const kRenderBatch &source) = delete;
+
+        void Submit(
+            size_t width, size_t height, kRenderJob &job,
+            kBitmapFormat format = kBitmapFormat::Color32BitAlphaPremultiplied
+        );
+        void Submit(size_t width, size_t height, kRenderJob &job, kImageFormat imageformat, kImageSink &sink);
+        void Wait();
+
+        size_t threads() const;
+        kRenderBatchStats stats() const;
+
+    protected:
+        impl::kRenderBatchImpl *p_impl;
+    };
+
+
+    /*
+     -------------------------------------------------------------------------------
+     kSceneNode, kScene
+     -------------------------------------------------------------------------------
+        retained scene, alternative to immediate drawing for content which
+        changes a little between frames
+
+        kSceneNode holds list of drawing items (shapes, paths, bitmaps and
+        text) in its local coordinates, local transform and child nodes
+        node's items are drawn first, then its children in order they were added
+        local transform is applied on top of parent's transform
+        AddChild takes ownership of child, RemoveChild deletes child with
+        all its children
+        items keep their own references to path and bitmap objects, so source
+        kPath and kBitmap can be deleted while they're in scene, but bitmap
+        pixels are shared with source and aren't tracked, after bitmap content
+        is updated node's Invalidate must be called to redraw its items
+
+        any change of node (items, transform, visibility, children) marks it
+        changed, next Render invalidates old and new bounds of changed nodes
+        and redraws only invalidated rectangles of target bitmap, every
+        rectangle is cleared to background color and scene is drawn clipped
+        by it, nodes outside of rectangle are skipped, so cost of Render
+        depends on changed area and not on scene size
+        only changed nodes and their parents are visited to find changes
+
+        bounds() - node and its children bounds in target pixels, valid
+                   after Render
+        Invalidate - marks part of target (or whole target) for redraw, e.g.
+                     when target pixels were changed outside of scene
+        Render returns region redrawn by the call, so only this region of
+        target can be presented or uploaded
+    */
+    class kSceneNode
+    {
+        friend class kScene;
+
+    public:
+        kSceneNode();
+        ~kSceneNode();
+
+        // this type of object can NOT be copied and reassigned to other
+        kSceneNode(const kSceneNode &source) = delete;
+        kSceneNode &operator=(const kSceneNode &source) = delete;
+
+        // children
+        void AddChild(kSceneNode *child);
+        void RemoveChild(kSceneNode *child);
+
+        kSceneNode* parent() const { return p_parent; }
+        size_t childcount() const { return p_children.size(); }
+        kSceneNode* child(size_t index) const { return p_children[index]; }
+
+        // placement
+        void SetTransform(const kTransform &transform);
+        void SetVisible(bool visible);
+
+        const kTransform& transform() const { return p_transform; }
+        bool visible() const { return p_visible; }
+        const kRect& bounds() const { return p_bounds; }
+
+        // marks own items changed, their area is redrawn by next Render
+        void Invalidate();
+
+        // items, drawn in order they were added
+        void ClearItems();
+        void Rectangle(const kRect &rect, const kPen *pen, const kBrush *brush);
+        void RoundedRectangle(const kRect &rect, const kSize &round, const kPen *pen, const kBrush *brush);
+        void Ellipse(const kRect &rect, const kPen *pen, const kBrush *brush);
+        void DrawPath(const kPath &path, const kPen *pen, const kBrush *brush);
+        void DrawBitmap(const kBitmap &bitmap, const kPoint &origin, kScalar sourcealpha = 1.0f);
+        void DrawBitmap(const kBitmap &bitmap, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize, kScalar sourcealpha = 1.0f);
+        void Text(const kPoint &p, const char *text, int count, const kFont &font, const kBrush &brush, kTextOrigin origin = kTextOrigin::Top);
+
+    protected:
+        enum ItemType
+        {
+            ITEM_RECTANGLE,
+            ITEM_ROUNDEDRECTANGLE,
+            ITEM_ELLIPSE,
+            ITEM_PATH,
+            ITEM_BITMAP,
+            ITEM_TEXT
+        };
+
+        struct Item
+        {
+            ItemType       type;
+            kRect          rect;       // shape rectangle or bitmap destination
+            kSize          round;
+            kPoint         source;
+            kSize          sourcesize;
+            kScalar        alpha;
+            kPen           pen;
+            kBrush         brush;
+            bool           haspen;
+            bool           hasbrush;
+            impl::kPathImpl   *path;   // referenced by item
+            impl::kBitmapImpl *bitmap; // referenced by item
+            kFont          font;
+            std::string    text;
+            kTextOrigin    textorigin;
+        };
+
+        // change flags
+        enum
+        {
+            CHANGED_ITEMS     = 1, // own items, only own items area changes
+            CHANGED_PLACEMENT = 2, // transform or visibility, whole subtree moves
+            CHANGED_CHILDREN  = 4  // some of children changed
+        };
+
+        Item& AddItem(ItemType type, const kPen *pen, const kBrush *brush);
+        // releases path and bitmap references held by items
+        void ReleaseItems();
+        void Changed(unsigned int changes);
+
+        // updates bounds of changed nodes and invalidates changed areas
+        // moved - parent's subtree moved and its old area is invalidated already
+        void Update(kScene &scene, kCanvas &canvas, const kTransform &parent, bool moved);
+        kRect ItemBounds(kCanvas &canvas, const Item &item) const;
+        void Draw(kCanvas &canvas, const kRect &clip) const;
+
+    protected:
+        kSceneNode               *p_parent;
+        std::vector<kSceneNode*>  p_children;
+        std::vector<Item>         p_items;
+        std::vector<kRect>        p_removed;    // bounds of removed children
+        kTransform                p_transform;
+        kTransform                p_world;      // local to target transform
+        kRect                     p_itembounds; // own items bounds in target pixels
+        kRect                     p_bounds;     // own items and children bounds
+        bool                      p_visible;
+        unsigned int              p_changes;    // CHANGED_* flags
+    };
+
+    class kScene
+    {
+        friend class kSceneNode;
+
+    public:
+        kScene(kBitmap &target, const kColor &background = kColor(0, 0, 0, 0), size_t maxrects = 16);
+
+        // this type of object can NOT be copied and reassigned to other
+        kScene(const kScene &source) = delete;
+        kScene &operator=(const kScene &source) = delete;
+
+        kSceneNode& root() { return p_root; }
+
+        void Invalidate();
+        void Invalidate(const kRectInt &rect);
+
+        const kDamageRegion& Render();
+
+    protected:
+        // adds bounds in target pixels to invalidated region
+        void InvalidateBounds(const kRect &bounds);
+
+    protected:
+        kBitmap       &p_target;
+        kColor         p_background;
+        kSceneNode     p_root;
+        kDamageRegion  p_dirty;    // region to redraw on next Render
+        kDamageRegion  p_rendered; // region redrawn by last Render
+    };
+
 } // namespace k_canvas
 
 #undef in
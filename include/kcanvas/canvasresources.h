@@ -199,6 +199,8 @@ namespace k_canvas
             friend class k_canvas::kCanvas;
             friend class kCanvasImpl;
             friend class kPathImplDefault;
+            friend class kTextLayoutImpl;
+            friend class kTextEditLayoutImpl;
 
         protected:
             kSharedResourceBase() :
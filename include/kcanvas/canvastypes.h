@@ -51,6 +51,18 @@ namespace k_canvas
         Wrap  = 1
     };
 
+    // layer blending with content below it
+    enum class kBlendMode
+    {
+        Normal   = 0,
+        Multiply = 1,
+        Screen   = 2,
+        Overlay  = 3,
+        Darken   = 4,
+        Lighten  = 5,
+        Add      = 6
+    };
+
     // kStroke styles
     enum class kStrokeStyle
     {
@@ -122,10 +134,126 @@ namespace k_canvas
     };
 
     // kBitmap data formats
+    //      only Color32BitAlphaPremultiplied and Mask8Bit are bitmap storage formats,
+    //      the rest are valid only as source or destination pixel data formats
+    //      for kBitmap Update and Read
+    //      32 bit formats without RGBA in the name have native 32 bit ARGB layout
+    //      (B, G, R, A byte order)
     enum class kBitmapFormat
     {
-        Color32BitAlphaPremultiplied = 1,
-        Mask8Bit                     = 2
+        Color32BitAlphaPremultiplied     = 1,
+        Mask8Bit                         = 2,
+        Color32BitAlpha                  = 3, // straight (not premultiplied) alpha
+        Color32BitRGBAAlphaPremultiplied = 4, // R, G, B, A byte order
+        Color32BitRGBAAlpha              = 5, // R, G, B, A byte order, straight alpha
+        Color24Bit                       = 6, // R, G, B byte order, no alpha
+        Gray8Bit                         = 7  // luminance, no alpha
+    };
+
+    // kBitmap pixel storage
+    enum class kBitmapStorage
+    {
+        Memory = 0, // regular memory allocated by implementation
+        Mapped = 1  // memory mapped file or anonymous shared memory,
+                    // pages are committed only when touched
+    };
+
+    // kBitmapReleaseProc
+    //      callback for releasing caller owned pixel memory wrapped by kBitmap
+    //      called exactly once when memory isn't used by bitmap anymore
+    typedef void (*kBitmapReleaseProc)(void *data, void *context);
+
+    // kBitmap encoded image formats
+    enum class kImageFormat
+    {
+        PNG = 1, // compressed PNG, implementation dependent
+        PPM = 2, // binary PPM (P6), 24 bit color
+        BMP = 3, // top-down 32 bit BMP with straight alpha
+        Raw = 4  // bitmap storage format pixels without padding, no header
+    };
+
+    // kImageWriteProc
+    //      callback for writing encoded image data, returns false on error
+    typedef bool (*kImageWriteProc)(const void *data, size_t size, void *context);
+
+    // kImageEncodeProperties
+    //      properties for kBitmap image encoding
+    //      compression - compression level 0..9, -1 for default level
+    //      threads     - number of compression threads, 0 for number of
+    //                    hardware threads
+    struct kImageEncodeProperties
+    {
+        int    compression;
+        size_t threads;
+
+        static kImageEncodeProperties construct(int compression = -1, size_t threads = 0)
+        {
+            kImageEncodeProperties result;
+            result.compression = compression;
+            result.threads     = threads;
+            return result;
+        }
+    };
+
+    // kTiledCanvasProperties
+    //      properties for kTiledBitmapCanvas rasterisation
+    //      tilesize - tile width and height in pixels
+    //      threads  - number of rendering threads, 0 for number of
+    //                 hardware threads
+    struct kTiledCanvasProperties
+    {
+        size_t tilesize;
+        size_t threads;
+
+        static kTiledCanvasProperties construct(size_t tilesize = 256, size_t threads = 0)
+        {
+            kTiledCanvasProperties result;
+            result.tilesize = tilesize;
+            result.threads  = threads;
+            return result;
+        }
+    };
+
+    // kRenderBatchStats
+    //      kRenderBatch job statistics, times are in seconds
+    //      latency is time from job submission to its finish
+    struct kRenderBatchStats
+    {
+        size_t jobs;           // number of finished jobs
+        size_t failed;         // number of jobs with failed output
+        double elapsed;        // time from the first submission to the last finished job
+        double throughput;     // finished jobs per second
+        double averagelatency;
+        double maxlatency;
+    };
+
+    // kSpriteInstance
+    //      single sprite drawn by kCanvas::DrawBitmaps
+    //      source    - rectangle of atlas pixels
+    //      dest      - destination rectangle, source is stretched to fill it
+    //      transform - applied to destination rectangle before canvas transform
+    //      alpha     - sprite opacity 0..1
+    struct kSpriteInstance
+    {
+        kRect      source;
+        kRect      dest;
+        kTransform transform;
+        kScalar    alpha;
+
+        static kSpriteInstance construct(const kRect &source, const kRect &dest, kScalar alpha = 1)
+        {
+            return construct(source, dest, kTransform(), alpha);
+        }
+
+        static kSpriteInstance construct(const kRect &source, const kRect &dest, const kTransform &transform, kScalar alpha = 1)
+        {
+            kSpriteInstance result;
+            result.source    = source;
+            result.dest      = dest;
+            result.transform = transform;
+            result.alpha     = alpha;
+            return result;
+        }
     };
 
     // kColor
@@ -537,6 +665,28 @@ namespace k_canvas
     };
 
 
+    /*
+     -------------------------------------------------------------------------------
+     kCanvasLayer
+     -------------------------------------------------------------------------------
+        helper object for "safe" layered drawing within {} block
+        automatically calls PopLayer when object goes out of scope
+    */
+    class kCanvasLayer
+    {
+    public:
+        kCanvasLayer(kCanvas &canvas, const kRect &bounds, kScalar opacity, kBlendMode blend = kBlendMode::Normal);
+        ~kCanvasLayer();
+
+        // this type of object can NOT be copied and reassigned to other
+        kCanvasLayer(const kCanvasLayer &source) = delete;
+        kCanvasLayer &operator=(const kCanvasLayer &source) = delete;
+
+    private:
+        kCanvas &p_canvas;
+    };
+
+
 
     // Implementation for inline funcs
 
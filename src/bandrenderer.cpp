@@ -0,0 +1,116 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    bandrenderer.cpp
+        rendering of huge images by horizontal bands
+*/
+
+#include "canvas.h"
+#include "pixelconverter.h"
+#include <cstring>
+
+
+using namespace k_canvas;
+using namespace impl;
+using namespace c_util;
+
+
+/*
+ -------------------------------------------------------------------------------
+ kBandRenderer implementation
+ -------------------------------------------------------------------------------
+*/
+
+kBandRenderer::kBandRenderer(size_t width, size_t height, size_t bandheight, kBitmapFormat format) :
+    p_width(width),
+    p_height(height),
+    p_bandheight(umax(bandheight, size_t(1))),
+    p_format(format)
+{}
+
+// clears whole band bitmap to transparent black
+static void ClearBand(kBitmap &band, std::vector<uint8_t> &zero)
+{
+    size_t pitch;
+    void *pixels = band.Lock(pitch);
+    if (pixels) {
+        memset(pixels, 0, pitch * band.height());
+        band.Unlock();
+        return;
+    }
+
+    size_t rowsize = band.width() * PixelSize(band.format());
+    zero.resize(rowsize * band.height(), 0);
+    band.Update(nullptr, band.format(), rowsize, zero.data());
+}
+
+bool kBandRenderer::Render(kBandScene &scene, kRowSink &sink)
+{
+    if (!sink.Begin(p_width, p_height, p_format)) {
+        return false;
+    }
+
+    if (p_width == 0 || p_height == 0) {
+        return sink.End();
+    }
+
+    // the only bitmap holding image pixels, reused for every band
+    size_t bandrows = umin(p_bandheight, p_height);
+    kBitmap band(p_width, bandrows, p_format);
+
+    std::vector<uint8_t> zero;
+    std::vector<uint8_t> buffer;
+    size_t rowsize = p_width * PixelSize(p_format);
+
+    for (size_t top = 0; top < p_height; top += bandrows) {
+        size_t rows = umin(bandrows, p_height - top);
+        kRectInt bandrect(0, int(top), int(p_width), int(top + rows));
+
+        // new bitmap is already clear
+        if (top) {
+            ClearBand(band, zero);
+        }
+
+        {
+            kBitmapCanvas canvas(band);
+
+            // band translation is kept on its own stack level, so scene's
+            // SetTransform calls are applied on top of it
+            canvas.PushTransform(kTransform::construct::translate(0, -kScalar(top)));
+            canvas.PushTransform(kTransform());
+
+            kCanvasClipper clipper(canvas, kRect(0, kScalar(top), kScalar(p_width), kScalar(top + rows)));
+            scene.Draw(canvas, bandrect);
+        }
+
+        // band pixels are passed directly when possible
+        size_t pitch;
+        const void *pixels = band.Lock(pitch);
+        if (pixels) {
+            bool result = sink.WriteRows(pixels, pitch, rows);
+
+            // pixels weren't changed
+            kRectInt unchanged(0, 0, 0, 0);
+            band.Unlock(&unchanged);
+
+            if (!result) {
+                return false;
+            }
+        } else {
+            kRectInt rect(0, 0, int(p_width), int(rows));
+            buffer.resize(rowsize * rows);
+            if (!band.Read(&rect, p_format, rowsize, buffer.data()) ||
+                !sink.WriteRows(buffer.data(), rowsize, rows)) {
+                return false;
+            }
+        }
+    }
+
+    return sink.End();
+}
@@ -12,7 +12,21 @@
 */
 
 #include "canvasimplcairo.h"
+#include "../pixelconverter.h"
+#include "canvas.h"
 #include <algorithm>
+#include <cstdlib>
+#include <cmath>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <sys/mman.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+
+    #ifndef MAP_NORESERVE
+        #define MAP_NORESERVE 0
+    #endif
+#endif
 
 
 using namespace c_util;
@@ -77,15 +91,32 @@ void kGradientImplCairo::Initialize(const kGradientStop *stops, size_t count, kE
 */
 
 kPathImplCairo::kPathImplCairo() :
-    kPathImplDefault()
+    kPathImplDefault(),
+    p_native(nullptr)
 {}
 
 kPathImplCairo::~kPathImplCairo()
-{}
+{
+    DropNativePath();
+}
 
 void kPathImplCairo::FromPath(const kPathImpl *source, const kTransform &transform)
 {}
 
+void kPathImplCairo::Clear()
+{
+    DropNativePath();
+    kPathImplDefault::Clear();
+}
+
+void kPathImplCairo::DropNativePath()
+{
+    if (p_native) {
+        cairo_path_destroy(p_native);
+        p_native = nullptr;
+    }
+}
+
 
 /*
  -------------------------------------------------------------------------------
@@ -96,45 +127,473 @@ void kPathImplCairo::FromPath(const kPathImpl *source, const kTransform &transfo
 kBitmapImplCairo::kBitmapImplCairo() :
     p_bitmap(nullptr),
     p_data(nullptr),
+    p_owndata(false),
+    p_allocated(true),
     p_width(0),
-    p_height(0)
+    p_height(0),
+    p_pitch(0),
+    p_format(kBitmapFormat::Color32BitAlphaPremultiplied),
+    p_mipmaps(false),
+    p_pattern(nullptr),
+    p_patternused(false)
 {}
 
 kBitmapImplCairo::~kBitmapImplCairo()
 {
+    InvalidateMipLevels();
+    if (p_pattern) {
+        cairo_pattern_destroy(p_pattern);
+    }
     cairo_surface_destroy(p_bitmap);
-    delete[] p_data;
+    if (p_owndata) {
+        free(p_data);
+    }
 }
 
-static const cairo_format_t formats[3] = {
+// only storage formats are valid for cairo surface
+static const cairo_format_t formats[8] = {
     CAIRO_FORMAT_INVALID,
     CAIRO_FORMAT_ARGB32,
-    CAIRO_FORMAT_A8
+    CAIRO_FORMAT_A8,
+    CAIRO_FORMAT_INVALID,
+    CAIRO_FORMAT_INVALID,
+    CAIRO_FORMAT_INVALID,
+    CAIRO_FORMAT_INVALID,
+    CAIRO_FORMAT_INVALID
 };
 
 void kBitmapImplCairo::Initialize(size_t width, size_t height, kBitmapFormat format)
 {
+    InvalidateMipLevels();
+
+    // kBitmap never passes source only formats, they would give invalid
+    // stride, so they still make empty bitmap here
+    if (formats[size_t(format)] == CAIRO_FORMAT_INVALID) {
+        width = 0;
+        height = 0;
+        format = kBitmapFormat::Color32BitAlphaPremultiplied;
+    }
+
+    // new bitmap should be transparent, calloc gives large blocks as fresh
+    // zero pages from the system, so they are committed lazily without memset
+    // bitmap which is too wide for valid stride or can't be allocated is
+    // left empty, so pixel access never goes through null data
+    int stride = cairo_format_stride_for_width(formats[size_t(format)], int(width));
+    p_data = stride < 0 ? nullptr : reinterpret_cast<unsigned char*>(calloc(height, size_t(stride)));
+    p_allocated = p_data || (stride >= 0 && (stride == 0 || height == 0));
+    if (!p_allocated) {
+        width = 0;
+        height = 0;
+        stride = 0;
+    }
+
     p_width = width;
     p_height = height;
-    p_pitch = cairo_format_stride_for_width(formats[size_t(format)], int(width));
-    p_data = new unsigned char[p_pitch * p_height];
+    p_format = format;
+    p_pitch = size_t(stride);
+    p_owndata = true;
+
+    p_bitmap = cairo_image_surface_create_for_data(p_data, formats[size_t(format)], int(width), int(height), int(p_pitch));
+}
+
+// caller's release callback, attached to surface as user data, so it's
+// called when surface is finally destroyed (surface might be still referenced
+// by patterns after bitmap object destruction)
+struct BitmapRelease
+{
+    kBitmapReleaseProc  release;
+    void               *data;
+    void               *context;
+
+    static void destroy(void *userdata)
+    {
+        BitmapRelease *r = reinterpret_cast<BitmapRelease*>(userdata);
+        r->release(r->data, r->context);
+        delete r;
+    }
+};
+
+static cairo_user_data_key_t bitmapreleasekey;
 
-    // TODO: check this is explicitly needed
-    memset(p_data, 0, p_pitch * p_height);
+void kBitmapImplCairo::InitializeWithData(
+    size_t width, size_t height, kBitmapFormat format, size_t pitch, void *data,
+    kBitmapReleaseProc release, void *context
+)
+{
+    // cairo can use only 4 byte aligned rows, otherwise pixels are copied
+    size_t minpitch = cairo_format_stride_for_width(formats[size_t(format)], int(width));
+    if ((pitch & 3) != 0 || pitch < minpitch) {
+        kBitmapImpl::InitializeWithData(width, height, format, pitch, data, release, context);
+        return;
+    }
+
+    InvalidateMipLevels();
+
+    p_width = width;
+    p_height = height;
+    p_format = format;
+    p_pitch = pitch;
+    p_data = reinterpret_cast<unsigned char*>(data);
+    p_owndata = false;
+    p_allocated = true;
 
     p_bitmap = cairo_image_surface_create_for_data(p_data, formats[size_t(format)], int(width), int(height), int(p_pitch));
+
+    if (release) {
+        BitmapRelease *r = new BitmapRelease;
+        r->release = release;
+        r->data = data;
+        r->context = context;
+
+        if (cairo_surface_set_user_data(p_bitmap, &bitmapreleasekey, r, BitmapRelease::destroy) != CAIRO_STATUS_SUCCESS) {
+            // memory is not used by surface in error state
+            delete r;
+            release(data, context);
+        }
+    }
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+static void UnmapBitmapData(void *data, void *context)
+{
+    munmap(data, reinterpret_cast<size_t>(context));
+}
+#endif
+
+void kBitmapImplCairo::InitializeMapped(size_t width, size_t height, kBitmapFormat format, const char *path)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    int stride = cairo_format_stride_for_width(formats[size_t(format)], int(width));
+    size_t pitch = stride > 0 ? size_t(stride) : 0;
+    size_t size = pitch * height;
+
+    // empty bitmap has nothing to map, too large one can't be mapped
+    if (size == 0 || size / pitch != height) {
+        Initialize(size ? 0 : width, size ? 0 : height, format);
+        p_allocated = size == 0 && stride >= 0;
+        return;
+    }
+
+    int fd = -1;
+    if (path) {
+        fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    } else {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+        fd = memfd_create("kcanvas-bitmap", MFD_CLOEXEC);
+#endif
+    }
+
+    void *data = MAP_FAILED;
+    if (fd >= 0) {
+        // file is extended without writing, it's sparse and its pages are
+        // allocated only when touched, mapping keeps file alive after close
+        if (ftruncate(fd, off_t(size)) == 0) {
+            data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+    }
+
+    // file couldn't be made or mapped, anonymous mapping still commits
+    // pages only when they're touched, unlike heap memory
+    if (data == MAP_FAILED) {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    }
+
+    // mapping is released by surface when it's destroyed
+    if (data != MAP_FAILED) {
+        InitializeWithData(width, height, format, pitch, data, UnmapBitmapData, reinterpret_cast<void*>(size));
+        return;
+    }
+
+    // nothing could be mapped, bitmap is left empty instead of committing
+    // whole image in heap memory
+    Initialize(0, 0, format);
+    p_allocated = false;
+#else
+    // no mapping support
+    Initialize(width, height, format);
+#endif
+}
+
+void* kBitmapImplCairo::Lock(size_t &pitch)
+{
+    // finish any pending drawing before giving access to pixels
+    cairo_surface_flush(p_bitmap);
+
+    pitch = p_pitch;
+    return p_data;
+}
+
+void kBitmapImplCairo::Unlock(const kRectInt *dirtyrect)
+{
+    // any change drops all reduced copies, empty dirty rectangle keeps them
+    if (!dirtyrect || (dirtyrect->right > dirtyrect->left && dirtyrect->bottom > dirtyrect->top)) {
+        InvalidateMipLevels();
+    }
+
+    if (!dirtyrect) {
+        cairo_surface_mark_dirty(p_bitmap);
+        return;
+    }
+
+    kRectInt dirty(
+        umax(dirtyrect->left, 0), umax(dirtyrect->top, 0),
+        umin(dirtyrect->right, int(p_width)), umin(dirtyrect->bottom, int(p_height))
+    );
+
+    if (dirty.right > dirty.left && dirty.bottom > dirty.top) {
+        cairo_surface_mark_dirty_rectangle(
+            p_bitmap, dirty.left, dirty.top,
+            dirty.right - dirty.left, dirty.bottom - dirty.top
+        );
+    }
+}
+
+// clip update or read rectangle to bitmap dimensions, returns false if
+// nothing left after clipping
+static bool ClipBitmapRect(const kRectInt *rect, size_t width, size_t height, kRectInt &source, kRectInt &clipped)
+{
+    source = rect ? *rect : kRectInt(0, 0, int(width), int(height));
+    clipped = kRectInt(
+        umax(source.left, 0), umax(source.top, 0),
+        umin(source.right, int(width)), umin(source.bottom, int(height))
+    );
+
+    return clipped.right > clipped.left && clipped.bottom > clipped.top;
 }
 
 void kBitmapImplCairo::Update(const kRectInt *updaterect, kBitmapFormat sourceformat, size_t sourcepitch, const void *data)
 {
-    unsigned char *dst = p_data;
-    const unsigned char *src = reinterpret_cast<const unsigned char*>(data);
+    PixelRowConverter convert = GetPixelRowConverter(p_format, sourceformat);
 
-    for (size_t y = 0; y < p_height; ++y) {
-        memcpy(dst, src, p_pitch);
+    // source data starts at the top left corner of update rectangle,
+    // update rectangle is clipped to bitmap dimensions
+    kRectInt source, update;
+    if (!convert || !ClipBitmapRect(updaterect, p_width, p_height, source, update)) {
+        return;
+    }
+
+    size_t width = update.right - update.left;
+    size_t height = update.bottom - update.top;
+
+    const unsigned char *src =
+        reinterpret_cast<const unsigned char*>(data) +
+        (update.top - source.top) * sourcepitch +
+        (update.left - source.left) * PixelSize(sourceformat);
+
+    unsigned char *dst =
+        p_data +
+        update.top * p_pitch +
+        update.left * PixelSize(p_format);
+
+    // make sure there's no pending drawing on surface before modifying its data
+    cairo_surface_flush(p_bitmap);
+
+    for (size_t y = 0; y < height; ++y) {
+        convert(dst, src, width);
         dst += p_pitch;
         src += sourcepitch;
     }
+
+    cairo_surface_mark_dirty_rectangle(p_bitmap, update.left, update.top, int(width), int(height));
+
+    InvalidateMipLevels();
+}
+
+bool kBitmapImplCairo::Read(const kRectInt *readrect, kBitmapFormat destformat, size_t destpitch, void *data)
+{
+    PixelRowConverter convert = GetPixelRowConverter(destformat, p_format);
+    if (!convert) {
+        return false;
+    }
+
+    // destination data starts at the top left corner of read rectangle,
+    // pixels outside of bitmap are left untouched
+    kRectInt dest, read;
+    if (!ClipBitmapRect(readrect, p_width, p_height, dest, read)) {
+        return true;
+    }
+
+    size_t width = read.right - read.left;
+    size_t height = read.bottom - read.top;
+
+    const unsigned char *src =
+        p_data +
+        read.top * p_pitch +
+        read.left * PixelSize(p_format);
+
+    unsigned char *dst =
+        reinterpret_cast<unsigned char*>(data) +
+        (read.top - dest.top) * destpitch +
+        (read.left - dest.left) * PixelSize(destformat);
+
+    // finish pending drawing before reading surface data
+    cairo_surface_flush(p_bitmap);
+
+    for (size_t y = 0; y < height; ++y) {
+        convert(dst, src, width);
+        dst += destpitch;
+        src += p_pitch;
+    }
+
+    return true;
+}
+
+static cairo_status_t WritePNGStream(void *closure, const unsigned char *data, unsigned int length)
+{
+    kImageSink *sink = reinterpret_cast<kImageSink*>(closure);
+    return sink->Write(data, length) ? CAIRO_STATUS_SUCCESS : CAIRO_STATUS_WRITE_ERROR;
+}
+
+bool kBitmapImplCairo::EncodePNG(kImageSink &sink)
+{
+    // cairo passes encoded data by small chunks as it's being compressed
+    return cairo_surface_write_to_png_stream(p_bitmap, WritePNGStream, &sink) == CAIRO_STATUS_SUCCESS;
+}
+
+bool kBitmapImplCairo::Allocated() const
+{
+    return p_allocated;
+}
+
+void kBitmapImplCairo::SetMipmaps(bool enable)
+{
+    p_mipmaps = enable;
+    if (!enable) {
+        InvalidateMipLevels();
+    }
+}
+
+cairo_surface_t* kBitmapImplCairo::MipLevel(size_t &level) const
+{
+    std::lock_guard<std::mutex> lock(p_lock);
+
+    // every level is built from previous one, so each source pixel
+    // is read once for the whole chain
+    while (p_miplevels.size() < level) {
+        cairo_surface_t *source = p_miplevels.size() ? p_miplevels.back() : p_bitmap;
+        size_t sw = cairo_image_surface_get_width(source);
+        size_t sh = cairo_image_surface_get_height(source);
+        if (sw == 1 && sh == 1) {
+            break;
+        }
+
+        size_t w = umax(sw / 2, size_t(1));
+        size_t h = umax(sh / 2, size_t(1));
+        cairo_surface_t *reduced = cairo_image_surface_create(formats[size_t(p_format)], int(w), int(h));
+        if (cairo_surface_status(reduced) != CAIRO_STATUS_SUCCESS) {
+            cairo_surface_destroy(reduced);
+            break;
+        }
+
+        cairo_surface_flush(source);
+        cairo_surface_flush(reduced);
+
+        const unsigned char *src = cairo_image_surface_get_data(source);
+        size_t srcpitch = cairo_image_surface_get_stride(source);
+        unsigned char *dst = cairo_image_surface_get_data(reduced);
+        size_t dstpitch = cairo_image_surface_get_stride(reduced);
+
+        for (size_t y = 0; y < h; ++y) {
+            const unsigned char *row0 = src + y * 2 * srcpitch;
+            const unsigned char *row1 = y * 2 + 1 < sh ? row0 + srcpitch : row0;
+            DownsampleRow(p_format, dst + y * dstpitch, row0, row1, w, sw);
+        }
+
+        cairo_surface_mark_dirty(reduced);
+        p_miplevels.push_back(reduced);
+    }
+
+    level = umin(level, p_miplevels.size());
+    return cairo_surface_reference(level ? p_miplevels[level - 1] : p_bitmap);
+}
+
+cairo_pattern_t* kBitmapImplCairo::AcquirePattern() const
+{
+    cairo_pattern_t *pattern = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(p_lock);
+        if (p_pattern && !p_patternused) {
+            p_patternused = true;
+            pattern = p_pattern;
+        }
+    }
+
+    if (!pattern) {
+        return cairo_pattern_create_for_surface(p_bitmap);
+    }
+
+    // previous user could change pattern's state
+    cairo_pattern_set_extend(pattern, CAIRO_EXTEND_NONE);
+    cairo_pattern_set_filter(pattern, CAIRO_FILTER_GOOD);
+    return pattern;
+}
+
+void kBitmapImplCairo::ReleasePattern(cairo_pattern_t *pattern) const
+{
+    {
+        std::lock_guard<std::mutex> lock(p_lock);
+        if (pattern == p_pattern) {
+            p_patternused = false;
+            return;
+        }
+        if (!p_pattern) {
+            p_pattern = pattern;
+            return;
+        }
+    }
+
+    // cached pattern is already there, contexts might still hold
+    // references to this one
+    cairo_pattern_destroy(pattern);
+}
+
+// alpha of storage format pixel, it's the high byte of native 32 bit pixel
+static inline bool PixelTransparent(const unsigned char *pixel, size_t pixelsize)
+{
+    return pixelsize == 4 ?
+        (*reinterpret_cast<const uint32_t*>(pixel) >> 24) == 0 :
+        *pixel == 0;
+}
+
+bool kBitmapImplCairo::TransparentBorder() const
+{
+    if (p_width == 0 || p_height == 0) {
+        return true;
+    }
+
+    cairo_surface_flush(p_bitmap);
+
+    size_t pixelsize = PixelSize(p_format);
+    const unsigned char *first = p_data;
+    const unsigned char *last = p_data + (p_height - 1) * p_pitch;
+    for (size_t x = 0; x < p_width; ++x) {
+        if (!PixelTransparent(first + x * pixelsize, pixelsize) ||
+            !PixelTransparent(last + x * pixelsize, pixelsize)) {
+            return false;
+        }
+    }
+
+    const unsigned char *right = p_data + (p_width - 1) * pixelsize;
+    for (size_t y = 0; y < p_height; ++y) {
+        if (!PixelTransparent(first + y * p_pitch, pixelsize) ||
+            !PixelTransparent(right + y * p_pitch, pixelsize)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void kBitmapImplCairo::InvalidateMipLevels() const
+{
+    std::lock_guard<std::mutex> lock(p_lock);
+
+    // surfaces still used by patterns are kept alive by their references
+    for (size_t n = 0; n < p_miplevels.size(); ++n) {
+        cairo_surface_destroy(p_miplevels[n]);
+    }
+    p_miplevels.clear();
 }
 
 
@@ -146,17 +605,64 @@ void kBitmapImplCairo::Update(const kRectInt *updaterect, kBitmapFormat sourcefo
 
 kCanvasImplCairo::kCanvasImplCairo(const CanvasFactory *factory) :
     boundContext(0),
-    releaseContext(false)
+    releaseContext(false),
+    boundBitmap(nullptr),
+    measureContext(nullptr)
 {}
 
 kCanvasImplCairo::~kCanvasImplCairo()
 {
     Unbind();
+
+    for (size_t n = 0; n < surfacePool.size(); ++n) {
+        cairo_surface_destroy(surfacePool[n]);
+    }
+
+    if (measureContext) {
+        cairo_destroy(measureContext);
+    }
 }
 
 void kCanvasImplCairo::Clear()
 {
-    // TODO: implement clear
+    if (!boundContext) {
+        return;
+    }
+
+    if (boundBitmap && clipStack.empty()) {
+        FillPixels(bounds, 0);
+        return;
+    }
+
+    cairo_save(boundContext);
+    cairo_set_operator(boundContext, CAIRO_OPERATOR_CLEAR);
+    cairo_paint(boundContext);
+    cairo_restore(boundContext);
+}
+
+void kCanvasImplCairo::Clear(const kRect &rect, const kColor &color)
+{
+    if (!boundContext) {
+        return;
+    }
+
+    kRectInt pixels;
+    if (DirectPixels(rect, pixels)) {
+        FillPixels(pixels, StoragePixel(boundBitmap->p_format, color));
+        return;
+    }
+
+    // source operator replaces pixels under rectangle, edges which
+    // don't fall on whole pixels are blended by their coverage
+    cairo_save(boundContext);
+    cairo_set_operator(boundContext, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_rgba(
+        boundContext,
+        color.r / 255.0, color.g / 255.0, color.b / 255.0, color.a / 255.0
+    );
+    cairo_rectangle(boundContext, rect.left, rect.top, rect.width(), rect.height());
+    cairo_fill(boundContext);
+    cairo_restore(boundContext);
 }
 
 bool kCanvasImplCairo::BindToBitmap(const kBitmapImpl *target, const kRectInt *rect)
@@ -167,17 +673,41 @@ bool kCanvasImplCairo::BindToBitmap(const kBitmapImpl *target, const kRectInt *r
 
     const kBitmapImplCairo *bitmap = static_cast<const kBitmapImplCairo*>(target);
 
-    boundContext = cairo_create(bitmap->p_bitmap);
-    releaseContext = true;
-
-    // TODO: adjust top level clip for bitmap rendering
+    bounds = kRectInt(0, 0, bitmap->p_width, bitmap->p_height);
 
     if (rect) {
-        bounds = *rect;
+        // drawing is confined to sub-surface of given rectangle, device offset
+        // keeps canvas coordinates the same as bitmap coordinates
+        int left = umax(bounds.left, rect->left);
+        int top = umax(bounds.top, rect->top);
+        bounds = kRectInt(
+            left, top,
+            umax(umin(bounds.right, rect->right), left),
+            umax(umin(bounds.bottom, rect->bottom), top)
+        );
+
+        cairo_surface_t *surface = cairo_surface_create_for_rectangle(
+            bitmap->p_bitmap,
+            bounds.left, bounds.top, bounds.width(), bounds.height()
+        );
+        cairo_surface_set_device_offset(surface, -bounds.left, -bounds.top);
+
+        boundContext = cairo_create(surface);
+        cairo_surface_destroy(surface);
     } else {
-        bounds = kRectInt(0, 0, bitmap->p_width, bitmap->p_height);
+        boundContext = cairo_create(bitmap->p_bitmap);
     }
 
+    releaseContext = true;
+    boundBitmap = bitmap;
+
+    return true;
+}
+
+bool kCanvasImplCairo::ConcurrentTiles() const
+{
+    // contexts on sub-surfaces of the same image surface don't share state,
+    // pixman writes only pixels inside of each sub-surface
     return true;
 }
 
@@ -221,6 +751,12 @@ bool kCanvasImplCairo::Unbind()
             cairo_destroy(boundContext);
         }
 
+        // reduced copies don't match drawn pixels anymore
+        if (boundBitmap) {
+            boundBitmap->InvalidateMipLevels();
+            boundBitmap = nullptr;
+        }
+
         boundContext = 0;
         return true;
     }
@@ -387,6 +923,76 @@ void kCanvasImplCairo::PolygonBezier(const kPoint *points, size_t count, const k
     FillAndStroke(pen, brush);
 }
 
+void kCanvasImplCairo::Rectangles(const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush)
+{
+    if (!(brush_not_empty) && !(pen_not_empty)) {
+        return;
+    }
+
+    for (size_t n = 0; n < count; ++n) {
+        cairo_rectangle(boundContext, rects[n].left, rects[n].top, rects[n].width(), rects[n].height());
+    }
+    FillAndStrokeUnion(pen, brush);
+}
+
+// ellipse is built by four bezier quarters, control points are placed at
+// KAPPA of radius from quarter's ends
+static const double KAPPA = 0.5522847498;
+
+static void EllipseToCairoPath(cairo_t *context, const kRect &rect)
+{
+    double cx = (double(rect.left) + rect.right) * 0.5;
+    double cy = (double(rect.top) + rect.bottom) * 0.5;
+    double rx = rect.width() * 0.5;
+    double ry = rect.height() * 0.5;
+    double kx = rx * KAPPA;
+    double ky = ry * KAPPA;
+
+    cairo_move_to(context, cx + rx, cy);
+    cairo_curve_to(context, cx + rx, cy + ky, cx + kx, cy + ry, cx, cy + ry);
+    cairo_curve_to(context, cx - kx, cy + ry, cx - rx, cy + ky, cx - rx, cy);
+    cairo_curve_to(context, cx - rx, cy - ky, cx - kx, cy - ry, cx, cy - ry);
+    cairo_curve_to(context, cx + kx, cy - ry, cx + rx, cy - ky, cx + rx, cy);
+    cairo_close_path(context);
+}
+
+void kCanvasImplCairo::Ellipses(const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush)
+{
+    if (!(brush_not_empty) && !(pen_not_empty)) {
+        return;
+    }
+
+    for (size_t n = 0; n < count; ++n) {
+        EllipseToCairoPath(boundContext, rects[n]);
+    }
+    FillAndStrokeUnion(pen, brush);
+}
+
+void kCanvasImplCairo::Lines(const kPoint *points, size_t count, const kPenBase *pen)
+{
+    if (pen_not_empty) {
+        ApplyPen(pen);
+
+        for (size_t n = 0; n < count; ++n) {
+            cairo_move_to(boundContext, points[n * 2].x, points[n * 2].y);
+            cairo_line_to(boundContext, points[n * 2 + 1].x, points[n * 2 + 1].y);
+        }
+
+        cairo_stroke(boundContext);
+    }
+}
+
+void kCanvasImplCairo::Points(const kPoint *points, size_t count, kScalar size, const kBrushBase *brush)
+{
+    if (brush_not_empty) {
+        for (size_t n = 0; n < count; ++n) {
+            cairo_new_sub_path(boundContext);
+            cairo_arc(boundContext, points[n].x, points[n].y, size * 0.5, 0, 2 * M_PI);
+        }
+        FillAndStrokeUnion(nullptr, brush);
+    }
+}
+
 void kCanvasImplCairo::DrawPath(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush)
 {
     PathToCairoPath(path, kTransform());
@@ -399,11 +1005,20 @@ void kCanvasImplCairo::DrawPath(const kPathImpl *path, const kPenBase *pen, cons
     FillAndStroke(pen, brush);
 }
 
+void kCanvasImplCairo::DrawPathInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kTransform *transforms, size_t count)
+{
+    DrawInstances(path, pen, brush, transforms, nullptr, count);
+}
+
+void kCanvasImplCairo::DrawPathInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kPoint *offsets, size_t count)
+{
+    DrawInstances(path, pen, brush, nullptr, offsets, count);
+}
+
 void kCanvasImplCairo::DrawBitmap(const kBitmapImpl *bitmap, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize, float sourcealpha)
 {
     const kBitmapImplCairo *bmp = static_cast<const kBitmapImplCairo*>(bitmap);
 
-    cairo_pattern_t *p = cairo_pattern_create_for_surface(bmp->p_bitmap);
     float kx = sourcesize.width / destsize.width;
     float ky = sourcesize.height / destsize.height;
     cairo_matrix_t m = {
@@ -411,23 +1026,70 @@ void kCanvasImplCairo::DrawBitmap(const kBitmapImpl *bitmap, const kPoint &origi
         0, ky,
         -origin.x * kx + source.x, -origin.y * ky + source.y
     };
-    cairo_pattern_set_matrix(p, &m);
 
-    cairo_save(boundContext);
-    cairo_set_source(boundContext, p);
+    cairo_surface_t *surface = nullptr;
+    if (bmp->p_mipmaps) {
+        // source pixels per device pixel, including canvas transform scale
+        cairo_matrix_t ctm;
+        cairo_get_matrix(boundContext, &ctm);
+        double sx = hypot(ctm.xx, ctm.yx);
+        double sy = hypot(ctm.xy, ctm.yy);
+        double scale = umin(fabs(kx) / sx, fabs(ky) / sy);
+
+        // the smallest copy which still has at least one pixel per device pixel,
+        // degenerate transform gives infinite scale, so level is limited by size
+        size_t level = 0;
+        size_t maxsize = umax(bmp->p_width, bmp->p_height);
+        while (scale >= 2 && (size_t(2) << level) <= maxsize) {
+            scale *= 0.5;
+            ++level;
+        }
 
-    cairo_rectangle(boundContext, origin.x, origin.y, destsize.width, destsize.height);
-    cairo_clip(boundContext);
+        if (level) {
+            surface = bmp->MipLevel(level);
 
-    cairo_paint_with_alpha(boundContext, sourcealpha);
-    cairo_restore(boundContext);
+            cairo_matrix_t reduce;
+            cairo_matrix_init_scale(
+                &reduce,
+                double(cairo_image_surface_get_width(surface)) / bmp->p_width,
+                double(cairo_image_surface_get_height(surface)) / bmp->p_height
+            );
+            cairo_matrix_multiply(&m, &m, &reduce);
+        }
+    }
 
-    cairo_pattern_destroy(p);
+    cairo_pattern_t *p = surface ? cairo_pattern_create_for_surface(surface) : bmp->AcquirePattern();
+    cairo_pattern_set_matrix(p, &m);
+    cairo_set_source(boundContext, p);
+
+    if (sourcealpha >= 1) {
+        // opaque source is limited to destination rectangle by fill itself
+        cairo_rectangle(boundContext, origin.x, origin.y, destsize.width, destsize.height);
+        cairo_fill(boundContext);
+    } else if (!surface && ExactPlacement(bmp, origin, destsize, source, sourcesize)) {
+        // pattern has no pixels outside of destination rectangle
+        cairo_paint_with_alpha(boundContext, sourcealpha);
+    } else {
+        cairo_save(boundContext);
+        cairo_rectangle(boundContext, origin.x, origin.y, destsize.width, destsize.height);
+        cairo_clip(boundContext);
+        cairo_paint_with_alpha(boundContext, sourcealpha);
+        cairo_restore(boundContext);
+    }
+
+    if (surface) {
+        cairo_pattern_destroy(p);
+        cairo_surface_destroy(surface);
+    } else {
+        bmp->ReleasePattern(p);
+    }
 }
 
 void kCanvasImplCairo::DrawMask(const kBitmapImpl *mask, kBrushBase *brush, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize)
 {
-    cairo_pattern_t *p = cairo_pattern_create_for_surface(static_cast<const kBitmapImplCairo*>(mask)->p_bitmap);
+    const kBitmapImplCairo *bmp = static_cast<const kBitmapImplCairo*>(mask);
+
+    cairo_pattern_t *p = bmp->AcquirePattern();
     float kx = sourcesize.width / destsize.width;
     float ky = sourcesize.height / destsize.height;
     cairo_matrix_t m = {
@@ -437,23 +1099,181 @@ void kCanvasImplCairo::DrawMask(const kBitmapImpl *mask, kBrushBase *brush, cons
     };
     cairo_pattern_set_matrix(p, &m);
 
-    cairo_save(boundContext);
-    cairo_rectangle(boundContext, origin.x, origin.y, destsize.width, destsize.height);
-    cairo_clip(boundContext);
+    if (ExactPlacement(bmp, origin, destsize, source, sourcesize)) {
+        ApplyBrush(brush);
+        cairo_mask(boundContext, p);
+    } else {
+        cairo_save(boundContext);
+        cairo_rectangle(boundContext, origin.x, origin.y, destsize.width, destsize.height);
+        cairo_clip(boundContext);
 
-    ApplyBrush(brush);
-    cairo_mask(boundContext, p);
+        ApplyBrush(brush);
+        cairo_mask(boundContext, p);
 
-    cairo_restore(boundContext);
+        cairo_restore(boundContext);
+    }
+
+    bmp->ReleasePattern(p);
+}
+
+void kCanvasImplCairo::DrawBitmaps(const kBitmapImpl *atlas, const kSpriteInstance *instances, size_t count, const kTransform &transform)
+{
+    const kBitmapImplCairo *bmp = static_cast<const kBitmapImplCairo*>(atlas);
+
+    // the same pattern and source serve all sprites, only pattern matrix
+    // is changed from sprite to sprite
+    cairo_pattern_t *p = bmp->AcquirePattern();
+    cairo_set_source(boundContext, p);
+
+    cairo_matrix_t base;
+    cairo_get_matrix(boundContext, &base);
+    bool transformed = false;
+
+    for (size_t n = 0; n < count; ++n) {
+        const kSpriteInstance &sprite = instances[n];
+
+        kScalar width = sprite.dest.width();
+        kScalar height = sprite.dest.height();
+        if (sprite.alpha <= 0 || width == 0 || height == 0) {
+            continue;
+        }
+
+        bool identity = IsIdentity(sprite.transform);
+        if (!identity || transformed) {
+            if (identity) {
+                cairo_set_matrix(boundContext, &base);
+            } else {
+                const kTransform &t = sprite.transform;
+                cairo_matrix_t m = { t.m00, t.m01, t.m10, t.m11, t.m20, t.m21 };
+                cairo_matrix_multiply(&m, &m, &base);
+                cairo_set_matrix(boundContext, &m);
+            }
+            transformed = !identity;
+
+            // source is locked to user space in effect when it's set
+            cairo_set_source(boundContext, p);
+        }
+
+        kRectInt source;
+        if (AlignedSprite(bmp, sprite, source)) {
+            // atlas pixels are read directly, so atlas can't be the bitmap
+            // being drawn into
+            kRectInt pixels;
+            if (bmp != boundBitmap && boundBitmap && bmp->p_format == boundBitmap->p_format &&
+                DirectPixels(sprite.dest, pixels)) {
+                // destination pixels are clipped by canvas bounds
+                double x = sprite.dest.left, y = sprite.dest.top;
+                cairo_user_to_device(boundContext, &x, &y);
+
+                BlitPixels(
+                    bmp,
+                    source.left + pixels.left - int(x), source.top + pixels.top - int(y),
+                    pixels, sprite.alpha >= 1 ? 255 : uint32_t(sprite.alpha * 65535 + 0.5) >> 8
+                );
+                continue;
+            }
+
+            if (sprite.alpha < 1) {
+                // part of atlas as pattern has no pixels outside of
+                // destination rectangle, so there's nothing to clip
+                cairo_surface_t *part = cairo_surface_create_for_rectangle(
+                    bmp->p_bitmap, source.left, source.top, source.width(), source.height()
+                );
+                cairo_pattern_t *partpattern = cairo_pattern_create_for_surface(part);
+
+                cairo_matrix_t m;
+                cairo_matrix_init_translate(&m, -sprite.dest.left, -sprite.dest.top);
+                cairo_pattern_set_matrix(partpattern, &m);
+
+                cairo_set_source(boundContext, partpattern);
+                cairo_paint_with_alpha(boundContext, sprite.alpha);
+                cairo_set_source(boundContext, p);
+
+                cairo_pattern_destroy(partpattern);
+                cairo_surface_destroy(part);
+                continue;
+            }
+        }
+
+        float kx = sprite.source.width() / width;
+        float ky = sprite.source.height() / height;
+        cairo_matrix_t m = {
+            kx, 0,
+            0, ky,
+            -sprite.dest.left * kx + sprite.source.left, -sprite.dest.top * ky + sprite.source.top
+        };
+        cairo_pattern_set_matrix(p, &m);
+
+        cairo_rectangle(boundContext, sprite.dest.left, sprite.dest.top, width, height);
+        if (sprite.alpha >= 1) {
+            cairo_fill(boundContext);
+        } else {
+            cairo_save(boundContext);
+            cairo_clip(boundContext);
+            cairo_paint_with_alpha(boundContext, sprite.alpha);
+            cairo_restore(boundContext);
+        }
+    }
 
-    cairo_pattern_destroy(p);
+    if (transformed) {
+        cairo_set_matrix(boundContext, &base);
+    }
+
+    bmp->ReleasePattern(p);
+}
+
+bool kCanvasImplCairo::ExactPlacement(const kBitmapImplCairo *bitmap, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize) const
+{
+    if (source.x != 0 || source.y != 0 ||
+        sourcesize.width != kScalar(bitmap->p_width) || sourcesize.height != kScalar(bitmap->p_height) ||
+        destsize.width != sourcesize.width || destsize.height != sourcesize.height) {
+        return false;
+    }
+
+    cairo_matrix_t ctm;
+    cairo_get_matrix(boundContext, &ctm);
+    if (ctm.xx != 1 || ctm.yy != 1 || ctm.xy != 0 || ctm.yx != 0) {
+        return false;
+    }
+
+    double x = origin.x + ctm.x0;
+    double y = origin.y + ctm.y0;
+    return x == floor(x) && y == floor(y);
+}
+
+bool kCanvasImplCairo::AlignedSprite(const kBitmapImplCairo *atlas, const kSpriteInstance &sprite, kRectInt &source) const
+{
+    const kRect &s = sprite.source;
+    if (s.left != floor(s.left) || s.top != floor(s.top) ||
+        s.right != floor(s.right) || s.bottom != floor(s.bottom) ||
+        s.left < 0 || s.top < 0 || s.right <= s.left || s.bottom <= s.top ||
+        s.right > kScalar(atlas->p_width) || s.bottom > kScalar(atlas->p_height) ||
+        sprite.dest.width() != s.width() || sprite.dest.height() != s.height()) {
+        return false;
+    }
+
+    cairo_matrix_t ctm;
+    cairo_get_matrix(boundContext, &ctm);
+    if (ctm.xx != 1 || ctm.yy != 1 || ctm.xy != 0 || ctm.yx != 0) {
+        return false;
+    }
+
+    double x = sprite.dest.left + ctm.x0;
+    double y = sprite.dest.top + ctm.y0;
+    if (x != floor(x) || y != floor(y)) {
+        return false;
+    }
+
+    source = kRectInt(int(s.left), int(s.top), int(s.right), int(s.bottom));
+    return true;
 }
 
 void kCanvasImplCairo::GetFontMetrics(const kFontBase *font, kFontMetrics &metrics)
 {
-    ApplyFont(font);
+    cairo_t *context = MeasureContext();
+    ApplyFont(font, context);
     cairo_font_extents_t ext;
-    cairo_font_extents(boundContext, &ext);
+    cairo_font_extents(context, &ext);
 
     metrics.ascent = kScalar(ext.ascent);
     metrics.descent = kScalar(ext.descent);
@@ -471,7 +1291,8 @@ void kCanvasImplCairo::GetFontMetrics(const kFontBase *font, kFontMetrics &metri
 
 void kCanvasImplCairo::GetGlyphMetrics(const kFontBase *font, size_t first, size_t last, kGlyphMetrics *metrics)
 {
-    ApplyFont(font);
+    cairo_t *context = MeasureContext();
+    ApplyFont(font, context);
 
     while (first <= last) {
         cairo_text_extents_t ext;
@@ -480,7 +1301,7 @@ void kCanvasImplCairo::GetGlyphMetrics(const kFontBase *font, size_t first, size
         //       check and refine glyph indices for all implementations
         //       specify this in api reference
         char glyph[2] = { (char)(first++), 0 };
-        cairo_text_extents(boundContext, glyph, &ext);
+        cairo_text_extents(context, glyph, &ext);
 
         metrics->leftbearing = kScalar(ext.x_bearing);
         metrics->advance = kScalar(ext.x_advance);
@@ -492,28 +1313,16 @@ void kCanvasImplCairo::GetGlyphMetrics(const kFontBase *font, size_t first, size
 
 kSize kCanvasImplCairo::TextSize(const char *text, size_t count, const kFontBase *font)
 {
-    bool notbound = boundContext == nullptr;
-    cairo_surface_t *surface = nullptr;
-    if (notbound) {
-        surface = cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
-        boundContext = cairo_create(surface);
-    }
-
-    ApplyFont(font);
+    cairo_t *context = MeasureContext();
+    ApplyFont(font, context);
 
     string copy(text, text + count);
     replace(copy.begin(), copy.end(), '\n', ' ');
 
     cairo_text_extents_t t_ext;
-    cairo_text_extents(boundContext, copy.c_str(), &t_ext);
+    cairo_text_extents(context, copy.c_str(), &t_ext);
     cairo_font_extents_t f_ext;
-    cairo_font_extents(boundContext, &f_ext);
-
-    if (notbound) {
-        cairo_destroy(boundContext);
-        cairo_surface_destroy(surface);
-        boundContext = nullptr;
-    }
+    cairo_font_extents(context, &f_ext);
 
     return kSize(float(t_ext.x_advance), float(f_ext.height));
 }
@@ -541,19 +1350,64 @@ void kCanvasImplCairo::Text(const kPoint &p, const char *text, size_t count, con
     }
 }
 
-void kCanvasImplCairo::BeginClippedDrawingByMask(const kBitmapImpl *mask, const kTransform &transform, kExtendType xextend, kExtendType yextend)
+void kCanvasImplCairo::TextRun(const TextRunWord *words, size_t count, const kFontBase *font, const kBrushBase *brush)
 {
-    Clip &clip = PushClip(false);
+    ApplyFont(font);
+    ApplyBrush(brush);
 
-    clip.surface = cairo_image_surface_create(
-        CAIRO_FORMAT_ARGB32,
-        bounds.width(), bounds.height()
-    );
+    cairo_font_extents_t ext;
+    cairo_font_extents(boundContext, &ext);
 
-    clip.pattern = cairo_pattern_create_for_surface(
-        static_cast<const kBitmapImplCairo*>(mask)->p_bitmap
-    );
+    cairo_scaled_font_t *scaledfont = cairo_get_scaled_font(boundContext);
+
+    // convert all words into single array of positioned glyphs
+    //      word byte length is enough room for its glyphs in most cases, if it isn't
+    //      cairo allocates its own buffer which is copied and freed afterwards
+    glyphBuffer.clear();
+    for (size_t n = 0; n < count; ++n) {
+        const TextRunWord &word = words[n];
+
+        size_t start = glyphBuffer.size();
+        glyphBuffer.resize(start + word.count);
+
+        cairo_glyph_t *glyphs = glyphBuffer.data() + start;
+        int glyphcount = int(word.count);
+
+        cairo_status_t status = cairo_scaled_font_text_to_glyphs(
+            scaledfont,
+            word.position.x, word.position.y + ext.ascent,
+            word.text, int(word.count),
+            &glyphs, &glyphcount,
+            nullptr, nullptr, nullptr
+        );
 
+        if (status != CAIRO_STATUS_SUCCESS) {
+            glyphBuffer.resize(start);
+            continue;
+        }
+
+        if (glyphs != glyphBuffer.data() + start) {
+            glyphBuffer.resize(start + glyphcount);
+            memcpy(glyphBuffer.data() + start, glyphs, glyphcount * sizeof(cairo_glyph_t));
+            cairo_glyph_free(glyphs);
+        } else {
+            glyphBuffer.resize(start + glyphcount);
+        }
+    }
+
+    if (glyphBuffer.size()) {
+        cairo_show_glyphs(boundContext, glyphBuffer.data(), int(glyphBuffer.size()));
+    }
+}
+
+void kCanvasImplCairo::BeginClippedDrawingByMask(const kBitmapImpl *mask, const kTransform &transform, kExtendType xextend, kExtendType yextend)
+{
+    const kBitmapImplCairo *bitmap = static_cast<const kBitmapImplCairo*>(mask);
+
+    Clip &clip = PushClip(false);
+
+    clip.mask = bitmap;
+    clip.pattern = bitmap->AcquirePattern();
     clip.cairo = boundContext;
 
     cairo_matrix_t org;
@@ -570,11 +1424,40 @@ void kCanvasImplCairo::BeginClippedDrawingByMask(const kBitmapImpl *mask, const
         -invx * (transform.m20 + org.x0), -invy * (transform.m21 + org.y0)
     };
 
+    // Cairo has single extend for both directions
+    bool clamp = xextend == kExtendType::Clamp && yextend == kExtendType::Clamp;
     cairo_pattern_set_matrix(clip.pattern, &m);
-    cairo_pattern_set_extend(clip.pattern, CAIRO_EXTEND_REPEAT);
+    cairo_pattern_set_extend(clip.pattern, clamp ? CAIRO_EXTEND_PAD : CAIRO_EXTEND_REPEAT);
+
+    // intermediate surface covers only part covered by mask if it doesn't
+    // spread beyond its pixels, mask pixels are widened by one for filtering
+    double x1 = -HUGE_VAL, y1 = -HUGE_VAL, x2 = HUGE_VAL, y2 = HUGE_VAL;
+    cairo_matrix_t inverse = m;
+    if (clamp && cairo_matrix_invert(&inverse) == CAIRO_STATUS_SUCCESS && bitmap->TransparentBorder()) {
+        double corners[4][2] = {
+            { 0, 0 },
+            { double(bitmap->p_width), 0 },
+            { 0, double(bitmap->p_height) },
+            { double(bitmap->p_width), double(bitmap->p_height) }
+        };
+
+        double mx1 = HUGE_VAL, my1 = HUGE_VAL, mx2 = -HUGE_VAL, my2 = -HUGE_VAL;
+        for (size_t n = 0; n < 4; ++n) {
+            cairo_matrix_transform_point(&inverse, &corners[n][0], &corners[n][1]);
+            mx1 = umin(mx1, corners[n][0] - 1);
+            my1 = umin(my1, corners[n][1] - 1);
+            mx2 = umax(mx2, corners[n][0] + 1);
+            my2 = umax(my2, corners[n][1] + 1);
+        }
 
-    boundContext = cairo_create(clip.surface);
-    cairo_set_matrix(boundContext, &org);
+        x1 = mx1;
+        y1 = my1;
+        x2 = mx2;
+        y2 = my2;
+    }
+
+    clip.region = VisibleRegion(x1, y1, x2, y2);
+    RedirectToSurface(clip);
 }
 
 void kCanvasImplCairo::BeginClippedDrawingByPath(const kPathImpl *clip, const kTransform &transform)
@@ -598,6 +1481,57 @@ void kCanvasImplCairo::EndClippedDrawing()
     PopClip();
 }
 
+static const cairo_operator_t blendmodes[7] = {
+    CAIRO_OPERATOR_OVER,
+    CAIRO_OPERATOR_MULTIPLY,
+    CAIRO_OPERATOR_SCREEN,
+    CAIRO_OPERATOR_OVERLAY,
+    CAIRO_OPERATOR_DARKEN,
+    CAIRO_OPERATOR_LIGHTEN,
+    CAIRO_OPERATOR_ADD
+};
+
+void kCanvasImplCairo::PushLayer(const kRect &layerbounds, kScalar opacity, kBlendMode blend)
+{
+    Clip &clip = PushClip(false);
+
+    clip.cairo = boundContext;
+    clip.opacity = opacity;
+    clip.blend = blendmodes[size_t(blend)];
+
+    // layer bounds are transformed into canvas pixels
+    cairo_matrix_t m;
+    cairo_get_matrix(boundContext, &m);
+
+    double corners[4][2] = {
+        { layerbounds.left, layerbounds.top },
+        { layerbounds.right, layerbounds.top },
+        { layerbounds.left, layerbounds.bottom },
+        { layerbounds.right, layerbounds.bottom }
+    };
+
+    double x1 = HUGE_VAL, y1 = HUGE_VAL, x2 = -HUGE_VAL, y2 = -HUGE_VAL;
+    for (size_t n = 0; n < 4; ++n) {
+        cairo_matrix_transform_point(&m, &corners[n][0], &corners[n][1]);
+        x1 = umin(x1, corners[n][0]);
+        y1 = umin(y1, corners[n][1]);
+        x2 = umax(x2, corners[n][0]);
+        y2 = umax(y2, corners[n][1]);
+    }
+
+    clip.region = VisibleRegion(x1, y1, x2, y2);
+    RedirectToSurface(clip);
+
+    // drawing is clipped to layer bounds, not only to its pixel extents
+    cairo_rectangle(boundContext, layerbounds.left, layerbounds.top, layerbounds.width(), layerbounds.height());
+    cairo_clip(boundContext);
+}
+
+void kCanvasImplCairo::PopLayer()
+{
+    PopClip();
+}
+
 void kCanvasImplCairo::SetTransform(const kTransform &transform)
 {
     cairo_matrix_t m = {
@@ -695,6 +1629,30 @@ void kCanvasImplCairo::PathToCairoPath(const kPathImpl *path, const kTransform &
     }
 }
 
+const cairo_path_t* kCanvasImplCairo::NativePath(const kPathImpl *path)
+{
+    const kPathImplCairo *cairopath = static_cast<const kPathImplCairo*>(path);
+
+    // path can be drawn by many tiles at once
+    std::lock_guard<std::mutex> lock(cairopath->p_lock);
+
+    if (!cairopath->p_native) {
+        // path is built in its own coordinates, current path is empty
+        // between drawing calls
+        cairo_matrix_t base;
+        cairo_get_matrix(boundContext, &base);
+        cairo_identity_matrix(boundContext);
+
+        PathToCairoPath(path, kTransform());
+        cairopath->p_native = cairo_copy_path(boundContext);
+        cairo_new_path(boundContext);
+
+        cairo_set_matrix(boundContext, &base);
+    }
+
+    return cairopath->p_native;
+}
+
 void kCanvasImplCairo::ApplyPen(const kPenBase *pen)
 {
     reinterpret_cast<kCairoPen*>(native(pen)[kCairoPen::RESOURCE_PEN])->ApplyToContext(boundContext);
@@ -707,7 +1665,29 @@ void kCanvasImplCairo::ApplyBrush(const kBrushBase *brush)
 
 void kCanvasImplCairo::ApplyFont(const kFontBase *font)
 {
-    reinterpret_cast<kCairoFont*>(native(font)[kCairoFont::RESOURCE_FONT])->ApplyToContext(boundContext);
+    ApplyFont(font, boundContext);
+}
+
+void kCanvasImplCairo::ApplyFont(const kFontBase *font, cairo_t *context)
+{
+    reinterpret_cast<kCairoFont*>(native(font)[kCairoFont::RESOURCE_FONT])->ApplyToContext(context);
+}
+
+cairo_t* kCanvasImplCairo::MeasureContext()
+{
+    if (boundContext) {
+        return boundContext;
+    }
+
+    // canvas isn't bound to any target, measurement is done with own
+    // context, which is created once and kept until canvas is destroyed
+    if (measureContext == nullptr) {
+        cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
+        measureContext = cairo_create(surface);
+        cairo_surface_destroy(surface);
+    }
+
+    return measureContext;
 }
 
 void kCanvasImplCairo::FillAndStroke(const kPenBase *pen, const kBrushBase *brush)
@@ -725,6 +1705,103 @@ void kCanvasImplCairo::FillAndStroke(const kPenBase *pen, const kBrushBase *brus
     }
 }
 
+void kCanvasImplCairo::FillAndStrokeUnion(const kPenBase *pen, const kBrushBase *brush)
+{
+    // paths usually leave even-odd rule set, it's kept for other calls
+    cairo_fill_rule_t rule = cairo_get_fill_rule(boundContext);
+    cairo_set_fill_rule(boundContext, CAIRO_FILL_RULE_WINDING);
+
+    FillAndStroke(pen, brush);
+
+    cairo_set_fill_rule(boundContext, rule);
+}
+
+// the most instances filled together, limits overlap test cost
+static const size_t INSTANCE_BATCH = 128;
+
+static inline bool Intersects(const kRect &a, const kRect &b)
+{
+    return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+}
+
+void kCanvasImplCairo::DrawInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kTransform *transforms, const kPoint *offsets, size_t count)
+{
+    if (!(brush_not_empty) && !(pen_not_empty)) {
+        return;
+    }
+
+    const cairo_path_t *native = NativePath(path);
+
+    // native path is appended under transform of every instance, so its
+    // points are transformed by Cairo, pen is applied with canvas transform
+    cairo_matrix_t base;
+    cairo_get_matrix(boundContext, &base);
+
+    kTransform canvas;
+    canvas.m00 = kScalar(base.xx);
+    canvas.m01 = kScalar(base.yx);
+    canvas.m10 = kScalar(base.xy);
+    canvas.m11 = kScalar(base.yy);
+    canvas.m20 = kScalar(base.x0);
+    canvas.m21 = kScalar(base.y0);
+
+    // every instance is filled by path's own even-odd rule
+    cairo_set_fill_rule(boundContext, CAIRO_FILL_RULE_EVEN_ODD);
+
+    // instances are filled together only while their device bounds don't
+    // overlap, even-odd rule of one fill would cut holes where instances
+    // overlap and single stroke over all of them would change paint order,
+    // path without bounds (text) is drawn instance by instance
+    kRect local;
+    bool bounded = path->Bounds(local);
+
+    std::vector<kRect> batch;
+    kRect united;
+
+    for (size_t n = 0; n < count; ++n) {
+        kTransform t = transforms ? transforms[n] : kTransform::construct::translate(offsets[n].x, offsets[n].y);
+
+        if (bounded) {
+            kRect device = DeviceBounds(local, t, pen, canvas);
+
+            bool flush = batch.size() == INSTANCE_BATCH;
+            if (!flush && batch.size() && Intersects(united, device)) {
+                for (size_t b = 0; b < batch.size() && !flush; ++b) {
+                    flush = Intersects(batch[b], device);
+                }
+            }
+
+            if (flush) {
+                cairo_set_matrix(boundContext, &base);
+                FillAndStroke(pen, brush);
+                batch.clear();
+            }
+
+            united = batch.size() ?
+                kRect(
+                    umin(united.left, device.left), umin(united.top, device.top),
+                    umax(united.right, device.right), umax(united.bottom, device.bottom)
+                ) : device;
+            batch.push_back(device);
+        }
+
+        cairo_matrix_t m = { t.m00, t.m01, t.m10, t.m11, t.m20, t.m21 };
+        cairo_matrix_multiply(&m, &m, &base);
+        cairo_set_matrix(boundContext, &m);
+        cairo_append_path(boundContext, native);
+
+        if (!bounded) {
+            cairo_set_matrix(boundContext, &base);
+            FillAndStroke(pen, brush);
+        }
+    }
+
+    cairo_set_matrix(boundContext, &base);
+    if (bounded) {
+        FillAndStroke(pen, brush);
+    }
+}
+
 kCanvasImplCairo::Clip& kCanvasImplCairo::PushClip(bool save)
 {
     Clip clip = {};
@@ -737,6 +1814,200 @@ kCanvasImplCairo::Clip& kCanvasImplCairo::PushClip(bool save)
     return clipStack.back();
 }
 
+kRectInt kCanvasImplCairo::VisibleRegion(double x1, double y1, double x2, double y2)
+{
+    // clip extents are taken in canvas pixels
+    cairo_matrix_t m;
+    cairo_get_matrix(boundContext, &m);
+    cairo_identity_matrix(boundContext);
+
+    double cx1, cy1, cx2, cy2;
+    cairo_clip_extents(boundContext, &cx1, &cy1, &cx2, &cy2);
+
+    cairo_set_matrix(boundContext, &m);
+
+    int left = int(floor(umax(umax(x1, cx1), double(bounds.left))));
+    int top = int(floor(umax(umax(y1, cy1), double(bounds.top))));
+    return kRectInt(
+        left, top,
+        umax(int(ceil(umin(umin(x2, cx2), double(bounds.right)))), left),
+        umax(int(ceil(umin(umin(y2, cy2), double(bounds.bottom)))), top)
+    );
+}
+
+void kCanvasImplCairo::RedirectToSurface(Clip &clip)
+{
+    cairo_matrix_t m;
+    cairo_get_matrix(boundContext, &m);
+
+    // drawing into mask bitmap needs only alpha
+    cairo_surface_t *target = cairo_get_target(boundContext);
+    cairo_format_t format =
+        cairo_surface_get_type(target) == CAIRO_SURFACE_TYPE_IMAGE &&
+        cairo_image_surface_get_format(target) == CAIRO_FORMAT_A8 ?
+        CAIRO_FORMAT_A8 : CAIRO_FORMAT_ARGB32;
+
+    clip.surface = TakeSurface(
+        format,
+        umax(clip.region.width(), 1), umax(clip.region.height(), 1)
+    );
+    cairo_surface_set_device_offset(clip.surface, -clip.region.left, -clip.region.top);
+
+    boundContext = cairo_create(clip.surface);
+
+    // pooled surface can be larger than region and has previous content
+    cairo_rectangle(boundContext, clip.region.left, clip.region.top, clip.region.width(), clip.region.height());
+    cairo_clip(boundContext);
+    cairo_set_operator(boundContext, CAIRO_OPERATOR_CLEAR);
+    cairo_paint(boundContext);
+    cairo_set_operator(boundContext, CAIRO_OPERATOR_OVER);
+
+    cairo_set_matrix(boundContext, &m);
+}
+
+// number of released intermediate surfaces kept by canvas
+static const size_t SURFACE_POOL = 4;
+
+// surface dimension rounded up to power of two, so close sizes share surfaces
+static int SizeClass(int size)
+{
+    int result = 32;
+    while (result < size) {
+        result <<= 1;
+    }
+    return result;
+}
+
+cairo_surface_t* kCanvasImplCairo::TakeSurface(cairo_format_t format, int width, int height)
+{
+    // surface larger than canvas is never needed
+    int w = umax(umin(SizeClass(width), bounds.width()), width);
+    int h = umax(umin(SizeClass(height), bounds.height()), height);
+
+    for (size_t n = surfacePool.size(); n > 0; --n) {
+        cairo_surface_t *surface = surfacePool[n - 1];
+        if (cairo_image_surface_get_format(surface) == format &&
+            cairo_image_surface_get_width(surface) == w &&
+            cairo_image_surface_get_height(surface) == h) {
+            surfacePool.erase(surfacePool.begin() + (n - 1));
+            return surface;
+        }
+    }
+
+    return cairo_image_surface_create(format, w, h);
+}
+
+bool kCanvasImplCairo::DirectPixels(const kRect &rect, kRectInt &pixels)
+{
+    if (!boundBitmap || clipStack.size()) {
+        return false;
+    }
+
+    cairo_matrix_t m;
+    cairo_get_matrix(boundContext, &m);
+    if (m.xy != 0 || m.yx != 0) {
+        return false;
+    }
+
+    double x1 = rect.left, y1 = rect.top;
+    double x2 = rect.right, y2 = rect.bottom;
+    cairo_user_to_device(boundContext, &x1, &y1);
+    cairo_user_to_device(boundContext, &x2, &y2);
+
+    double left = std::floor(umin(x1, x2) + 0.5);
+    double top = std::floor(umin(y1, y2) + 0.5);
+    double right = std::floor(umax(x1, x2) + 0.5);
+    double bottom = std::floor(umax(y1, y2) + 0.5);
+
+    const double tolerance = 1.0 / 256;
+    if (std::fabs(umin(x1, x2) - left) > tolerance || std::fabs(umin(y1, y2) - top) > tolerance ||
+        std::fabs(umax(x1, x2) - right) > tolerance || std::fabs(umax(y1, y2) - bottom) > tolerance) {
+        return false;
+    }
+
+    // device coordinates are bitmap coordinates, sub-surface binding
+    // sets device offset for that
+    pixels = kRectInt(
+        int(umax(left, double(bounds.left))),
+        int(umax(top, double(bounds.top))),
+        int(umin(right, double(bounds.right))),
+        int(umin(bottom, double(bounds.bottom)))
+    );
+
+    return true;
+}
+
+void kCanvasImplCairo::FillPixels(const kRectInt &pixels, uint32_t pixel)
+{
+    if (pixels.right <= pixels.left || pixels.bottom <= pixels.top) {
+        return;
+    }
+
+    // pending drawing of context target must land before pixels are
+    // written, sub-surface target keeps other tiles untouched
+    cairo_surface_t *target = cairo_get_target(boundContext);
+    cairo_surface_flush(target);
+
+    size_t pixelsize = PixelSize(boundBitmap->p_format);
+    size_t width = size_t(pixels.width());
+    unsigned char *row =
+        boundBitmap->p_data +
+        size_t(pixels.top) * boundBitmap->p_pitch +
+        size_t(pixels.left) * pixelsize;
+
+    for (int y = pixels.top; y < pixels.bottom; ++y) {
+        FillRow(boundBitmap->p_format, row, pixel, width);
+        row += boundBitmap->p_pitch;
+    }
+
+    cairo_surface_mark_dirty_rectangle(
+        target, pixels.left, pixels.top, pixels.width(), pixels.height()
+    );
+}
+
+void kCanvasImplCairo::BlitPixels(const kBitmapImplCairo *bitmap, int x, int y, const kRectInt &pixels, uint32_t alpha)
+{
+    if (pixels.right <= pixels.left || pixels.bottom <= pixels.top || alpha == 0) {
+        return;
+    }
+
+    // the same as for FillPixels, pending drawing of both surfaces
+    // must land before their pixels are touched
+    cairo_surface_flush(bitmap->p_bitmap);
+    cairo_surface_t *target = cairo_get_target(boundContext);
+    cairo_surface_flush(target);
+
+    size_t pixelsize = PixelSize(boundBitmap->p_format);
+    size_t width = size_t(pixels.width());
+    unsigned char *row =
+        boundBitmap->p_data +
+        size_t(pixels.top) * boundBitmap->p_pitch +
+        size_t(pixels.left) * pixelsize;
+    const unsigned char *source =
+        bitmap->p_data +
+        size_t(y) * bitmap->p_pitch +
+        size_t(x) * pixelsize;
+
+    for (int n = pixels.top; n < pixels.bottom; ++n) {
+        BlendRow(boundBitmap->p_format, row, source, width, alpha);
+        row += boundBitmap->p_pitch;
+        source += bitmap->p_pitch;
+    }
+
+    cairo_surface_mark_dirty_rectangle(
+        target, pixels.left, pixels.top, pixels.width(), pixels.height()
+    );
+}
+
+void kCanvasImplCairo::ReturnSurface(cairo_surface_t *surface)
+{
+    if (surfacePool.size() == SURFACE_POOL) {
+        cairo_surface_destroy(surfacePool.front());
+        surfacePool.erase(surfacePool.begin());
+    }
+    surfacePool.push_back(surface);
+}
+
 void kCanvasImplCairo::PopClip()
 {
     Clip clip = clipStack.back();
@@ -746,17 +2017,32 @@ void kCanvasImplCairo::PopClip()
         cairo_destroy(boundContext);
         boundContext = clip.cairo;
 
-        cairo_save(boundContext);
-        cairo_reset_clip(boundContext);
-        cairo_identity_matrix(boundContext);
+        if (clip.region.right > clip.region.left && clip.region.bottom > clip.region.top) {
+            cairo_save(boundContext);
+            cairo_identity_matrix(boundContext);
 
-        cairo_set_source_surface(boundContext, clip.surface, 0, 0);
-        cairo_mask(boundContext, clip.pattern);
+            // only drawn region is composited, outer clip stays in effect
+            cairo_rectangle(
+                boundContext,
+                clip.region.left, clip.region.top, clip.region.width(), clip.region.height()
+            );
+            cairo_clip(boundContext);
+
+            cairo_set_source_surface(boundContext, clip.surface, 0, 0);
+            if (clip.pattern) {
+                cairo_mask(boundContext, clip.pattern);
+            } else {
+                cairo_set_operator(boundContext, clip.blend);
+                cairo_paint_with_alpha(boundContext, clip.opacity);
+            }
 
-        cairo_restore(boundContext);
+            cairo_restore(boundContext);
+        }
 
-        cairo_surface_destroy(clip.surface);
-        cairo_pattern_destroy(clip.pattern);
+        ReturnSurface(clip.surface);
+        if (clip.pattern) {
+            clip.mask->ReleasePattern(clip.pattern);
+        }
     } else {
         cairo_restore(boundContext);
     }
@@ -15,6 +15,7 @@
 #include "../canvasimpl.h"
 #include "cairo/cairo.h"
 #include <cstring>
+#include <mutex>
 
 
 namespace k_canvas
@@ -65,6 +66,17 @@ namespace k_canvas
 
             // TODO: move this to default implementation?
             void FromPath(const kPathImpl *source, const kTransform &transform) override;
+
+            void Clear() override;
+
+        private:
+            void DropNativePath();
+
+        private:
+            // path built by Cairo in path coordinates, made on first instanced
+            // drawing and kept as long as path isn't changed
+            mutable cairo_path_t *p_native;
+            mutable std::mutex    p_lock;
         };
 
 
@@ -84,14 +96,55 @@ namespace k_canvas
             ~kBitmapImplCairo() override;
 
             void Initialize(size_t width, size_t height, kBitmapFormat format) override;
-            void Update(const kRectInt *updaterect, kBitmapFormat sourceformat, size_t sourceputch, const void *data) override;
+            void Update(const kRectInt *updaterect, kBitmapFormat sourceformat, size_t sourcepitch, const void *data) override;
+            bool Read(const kRectInt *readrect, kBitmapFormat destformat, size_t destpitch, void *data) override;
+            bool EncodePNG(kImageSink &sink) override;
+
+            void InitializeMapped(size_t width, size_t height, kBitmapFormat format, const char *path) override;
+            void InitializeWithData(
+                size_t width, size_t height, kBitmapFormat format, size_t pitch, void *data,
+                kBitmapReleaseProc release, void *context
+            ) override;
+            void* Lock(size_t &pitch) override;
+            void Unlock(const kRectInt *dirtyrect) override;
+
+            void SetMipmaps(bool enable) override;
+            bool Allocated() const override;
+
+        private:
+            // returns referenced surface of reduced copy, level 0 is bitmap
+            // itself, level is clamped to the smallest available copy
+            cairo_surface_t* MipLevel(size_t &level) const;
+            void InvalidateMipLevels() const;
+
+            // returns pattern for bitmap surface with default extend and filter,
+            // the same pattern object is given out again after it's released,
+            // new pattern is made while cached one is in use
+            cairo_pattern_t* AcquirePattern() const;
+            void ReleasePattern(cairo_pattern_t *pattern) const;
+
+            // true if all border pixels are fully transparent, so clamped
+            // bitmap has no coverage outside of its own pixels
+            bool TransparentBorder() const;
 
         private:
             cairo_surface_t *p_bitmap;
             unsigned char   *p_data;
+            bool             p_owndata;
+            bool             p_allocated; // requested pixels were allocated
             size_t           p_width;
             size_t           p_height;
             size_t           p_pitch;
+            kBitmapFormat    p_format;
+
+            // reduced copies built on demand, starting from half size,
+            // cached pattern and copies are guarded by lock because bitmap
+            // can be drawn by many tiles at once
+            bool                                  p_mipmaps;
+            mutable std::vector<cairo_surface_t*> p_miplevels;
+            mutable cairo_pattern_t              *p_pattern;
+            mutable bool                          p_patternused;
+            mutable std::mutex                    p_lock;
         };
 
 
@@ -113,6 +166,9 @@ namespace k_canvas
             ~kCanvasImplCairo() override;
 
             void Clear() override;
+            void Clear(const kRect &rect, const kColor &color) override;
+
+            bool ConcurrentTiles() const override;
 
             bool BindToBitmap(const kBitmapImpl *target, const kRectInt *rect) override;
             bool BindToContext(kContext context, const kRectInt *rect) override;
@@ -130,44 +186,109 @@ namespace k_canvas
             void Polygon(const kPoint *points, size_t count, const kPenBase *pen, const kBrushBase *brush) override;
             void PolygonBezier(const kPoint *points, size_t count, const kPenBase *pen, const kBrushBase *brush) override;
 
+            void Rectangles(const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush) override;
+            void Ellipses(const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush) override;
+            void Lines(const kPoint *points, size_t count, const kPenBase *pen) override;
+            void Points(const kPoint *points, size_t count, kScalar size, const kBrushBase *brush) override;
+
             void DrawPath(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush) override;
             void DrawPath(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kTransform &transform) override;
+            void DrawPathInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kTransform *transforms, size_t count) override;
+            void DrawPathInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kPoint *offsets, size_t count) override;
             void DrawBitmap(const kBitmapImpl *bitmap, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize, kScalar sourcealpha) override;
             void DrawMask(const kBitmapImpl *mask, kBrushBase *brush, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize) override;
+            void DrawBitmaps(const kBitmapImpl *atlas, const kSpriteInstance *instances, size_t count, const kTransform &transform) override;
 
             void GetFontMetrics(const kFontBase *font, kFontMetrics &metrics) override;
             void GetGlyphMetrics(const kFontBase *font, size_t first, size_t last, kGlyphMetrics *metrics) override;
             kSize TextSize(const char *text, size_t count, const kFontBase *font) override;
             void Text(const kPoint &p, const char *text, size_t count, const kFontBase *font, const kBrushBase *brush, kTextOrigin origin) override;
+            void TextRun(const TextRunWord *words, size_t count, const kFontBase *font, const kBrushBase *brush) override;
 
             void BeginClippedDrawingByMask(const kBitmapImpl *mask, const kTransform &transform, kExtendType xextend, kExtendType yextend) override;
             void BeginClippedDrawingByPath(const kPathImpl *clip, const kTransform &transform) override;
             void BeginClippedDrawingByRect(const kRect &clip) override;
             void EndClippedDrawing() override;
 
+            void PushLayer(const kRect &bounds, kScalar opacity, kBlendMode blend) override;
+            void PopLayer() override;
+
             void SetTransform(const kTransform &transform) override;
 
         private:
+            // clipping or layer state, mask clips and layers redirect drawing
+            // into intermediate surface, which is blended back on pop
             struct Clip
             {
-                cairo_surface_t *surface;
-                cairo_t         *cairo;
-                cairo_pattern_t *pattern;
+                cairo_surface_t        *surface;
+                cairo_t                *cairo;
+                cairo_pattern_t        *pattern; // mask pattern, nullptr for layer
+                const kBitmapImplCairo *mask;    // owner of acquired pattern
+                kRectInt                region;  // used part of surface
+                kScalar                 opacity; // layer opacity and blending
+                cairo_operator_t        blend;
             };
 
             void PathToCairoPath(const kPathImpl *path, const kTransform &transform);
+            // returns cached native path of path object, builds it if needed
+            const cairo_path_t* NativePath(const kPathImpl *path);
             void ApplyPen(const kPenBase *pen);
             void ApplyBrush(const kBrushBase *brush);
             void ApplyFont(const kFontBase *font);
+            void ApplyFont(const kFontBase *font, cairo_t *context);
+            // returns context for font and text measurement, works for unbound canvas
+            cairo_t* MeasureContext();
             void FillAndStroke(const kPenBase *pen, const kBrushBase *brush);
+            // fills path of many shapes as their union, shapes overlapping
+            // each other don't make holes
+            void FillAndStrokeUnion(const kPenBase *pen, const kBrushBase *brush);
+            // draws path instances, given either by transforms or by offsets,
+            // consecutive instances which don't overlap are filled and stroked
+            // together, so result is the same as drawing them one by one
+            void DrawInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kTransform *transforms, const kPoint *offsets, size_t count);
+            // true if whole source bitmap is drawn unscaled on whole device
+            // pixels, so pattern without extend doesn't need clipping
+            bool ExactPlacement(const kBitmapImplCairo *bitmap, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize) const;
+            // true if sprite's source is whole atlas pixels drawn unscaled on
+            // whole device pixels, source pixels are returned in source
+            bool AlignedSprite(const kBitmapImplCairo *atlas, const kSpriteInstance &sprite, kRectInt &source) const;
             Clip& PushClip(bool save);
             void PopClip();
+            // part of given rectangle in canvas pixels inside of current clip
+            kRectInt VisibleRegion(double x1, double y1, double x2, double y2);
+            // redirects drawing into cleared intermediate surface for clip.region
+            void RedirectToSurface(Clip &clip);
+            // intermediate surfaces are taken from pool of recently used
+            // ones of the same size class
+            cairo_surface_t* TakeSurface(cairo_format_t format, int width, int height);
+            void ReturnSurface(cairo_surface_t *surface);
+            // true if rectangle maps onto whole pixels of bound bitmap and
+            // there's no clip, so its pixels can be written directly
+            bool DirectPixels(const kRect &rect, kRectInt &pixels);
+            // sets pixels of bound bitmap to storage pixel value
+            void FillPixels(const kRectInt &pixels, uint32_t pixel);
+            // draws pixels of bitmap starting at x, y over pixels of bound
+            // bitmap of the same format, source is scaled by alpha (0 - 255)
+            void BlitPixels(const kBitmapImplCairo *bitmap, int x, int y, const kRectInt &pixels, uint32_t alpha);
 
         private:
             cairo_t           *boundContext;
             bool               releaseContext;
             kRectInt           bounds;
+
+            // bitmap which is drawn into, its reduced copies are dropped on unbind
+            const kBitmapImplCairo *boundBitmap;
+
             std::vector<Clip>  clipStack;
+
+            // released intermediate surfaces, most recently used last
+            std::vector<cairo_surface_t*> surfacePool;
+
+            // context for text measurement when canvas isn't bound
+            cairo_t           *measureContext;
+
+            // glyph buffer for text runs, reused between TextRun() calls
+            std::vector<cairo_glyph_t> glyphBuffer;
         };
 
 
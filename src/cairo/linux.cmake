@@ -26,3 +26,10 @@ set(SOURCES
 )
 
 add_definitions(-D_CAIRO)
+
+# zlib for parallel PNG encoder, cairo depends on it anyway
+find_package(ZLIB)
+if (ZLIB_FOUND)
+	add_definitions(-DKCANVAS_ZLIB)
+	set(PLATFORM_LIBS ${PLATFORM_LIBS} ZLIB::ZLIB)
+endif ()
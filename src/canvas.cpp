@@ -14,8 +14,15 @@
 
 #include "canvas.h"
 #include "canvasimpl.h"
-#include "unicodeconverter.h"
+#include "canvasrecorder.h"
+#include "canvasdamage.h"
+#include "groupcache.h"
+#include "textlayout.h"
+#include "imageencoder.h"
+#include "pngencoder.h"
+#include "pixelconverter.h"
 #include <cstring>
+#include <algorithm>
 
 
 using namespace k_canvas;
@@ -539,7 +546,70 @@ kBitmap::kBitmap(size_t width, size_t height, kBitmapFormat format) :
     p_height(height),
     p_format(format)
 {
+    if (!StorageFormat(format)) {
+        InitializeEmpty();
+        return;
+    }
+
     p_impl->Initialize(width, height, format);
+    CheckAllocated();
+}
+
+kBitmap::kBitmap(size_t width, size_t height, kBitmapFormat format, kBitmapStorage storage, const char *path) :
+    p_impl(CanvasFactory::CreateBitmap()),
+    p_width(width),
+    p_height(height),
+    p_format(format)
+{
+    if (!StorageFormat(format)) {
+        InitializeEmpty();
+        return;
+    }
+
+    if (storage == kBitmapStorage::Mapped) {
+        p_impl->InitializeMapped(width, height, format, path);
+    } else {
+        p_impl->Initialize(width, height, format);
+    }
+    CheckAllocated();
+}
+
+kBitmap::kBitmap(
+    size_t width, size_t height, kBitmapFormat format, size_t pitch, void *data,
+    kBitmapReleaseProc release, void *context
+) :
+    p_impl(CanvasFactory::CreateBitmap()),
+    p_width(width),
+    p_height(height),
+    p_format(format)
+{
+    if (!StorageFormat(format)) {
+        InitializeEmpty();
+        if (release) {
+            release(data, context);
+        }
+        return;
+    }
+
+    p_impl->InitializeWithData(width, height, format, pitch, data, release, context);
+    CheckAllocated();
+}
+
+void kBitmap::InitializeEmpty()
+{
+    p_width = 0;
+    p_height = 0;
+    p_format = kBitmapFormat::Color32BitAlphaPremultiplied;
+    p_impl->Initialize(0, 0, p_format);
+}
+
+void kBitmap::CheckAllocated()
+{
+    // implementation leaves bitmap empty if its pixels can't be allocated
+    if (!p_impl->Allocated()) {
+        p_width = 0;
+        p_height = 0;
+    }
 }
 
 kBitmap::~kBitmap()
@@ -577,149 +647,41 @@ void kBitmap::Update(const kRectInt *updaterect, kBitmapFormat sourceformat, siz
     p_impl->Update(updaterect, sourceformat, sourcepitch, data);
 }
 
-
-/*
- -------------------------------------------------------------------------------
- kWord & kWordBreaker helper classes
- -------------------------------------------------------------------------------
-    Breaks text into words and other elements
-*/
-
-// defines word inside text by pointer to first char, length and type
-class Word
+bool kBitmap::Read(const kRectInt *readrect, kBitmapFormat destformat, size_t destpitch, void *data) const
 {
-public:
-    enum Type
-    {
-        Text,
-        Space,
-        Tab,
-        LineBreak
-    };
-
-public:
-    const char *text;
-    size_t      length;
-    Type        type;
-};
+    return p_impl->Read(readrect, destformat, destpitch, data);
+}
 
-// helps to split source text into words
-class WordBreaker
+bool kBitmap::Encode(kImageFormat format, kImageSink &sink, const kImageEncodeProperties *properties) const
 {
-public:
-    // initialize word breaker with text, length and flags
-    WordBreaker(const char *text, size_t length, kTextFlags flags) :
-        p_text(reinterpret_cast<const unsigned char *>(text)),
-        p_pos(0),
-        p_length(length),
-        p_linebreaks((flags & kTextFlags::IgnoreLineBreaks) == 0),
-        p_tabstops((flags & kTextFlags::UseTabs) != 0)
-    {}
-
-    // extract next word from text
-    bool NextWord(Word &word)
-    {
-        if (p_pos == p_length) {
-            return false;
+    // PNG compression is provided by implementation unless image is large
+    // enough for parallel compression, the rest of formats are written
+    // by generic encoder
+    if (format == kImageFormat::PNG) {
+        if (UseParallelPNG(*this, properties)) {
+            return EncodeParallelPNG(*this, sink, properties);
         }
 
-        word.text = reinterpret_cast<const char *>(p_text + p_pos);
-
-        // try to find word boundaries
-        size_t start = p_pos;
-        while (p_pos < p_length) {
-            if (p_text[p_pos] <= ' ') {
-                break;
-            }
-            ++p_pos;
-        }
+        return p_impl->EncodePNG(sink);
+    }
 
-        // if there were some characters this part of text is a word
-        if (p_pos > start) {
-            word.length = p_pos - start;
-            word.type = Word::Text;
-            return true;
-        }
+    return EncodeImage(*this, format, sink);
+}
 
-        // loop through spacing characters
-        word.length = 0;
-        while (p_pos < p_length) {
-            bool returnspaces = false;
-
-            switch (p_text[p_pos]) {
-                // check for tab stop character
-                case '\t':
-                    if (p_tabstops) {
-                        if (word.length) {
-                            returnspaces = true;
-                        } else {
-                            word.type = Word::Tab;
-                            ++p_pos;
-                            return true;
-                        }
-                    } else {
-                        ++p_pos;
-                        ++word.length;
-                    }
-                    break;
-
-                // check for line break sequence
-                case '\n':
-                case '\r': {
-                    size_t linebreak = 0;
-
-                    // check for one or two characters line breaks (LF, CRLF or LFCR)
-                    if ((p_length - p_pos) == 1) {
-                        linebreak = 1;
-                    } else {
-                        if ((p_text[p_pos] == '\r' && p_text[p_pos + 1] == '\n') ||
-                            (p_text[p_pos] == '\n' && p_text[p_pos + 1] == '\r')) {
-                            linebreak = 2;
-                        } else {
-                            linebreak = 1;
-                        }
-                    }
-
-                    if (p_linebreaks) {
-                        if (word.length) {
-                            returnspaces = true;
-                        } else {
-                            word.type = Word::LineBreak;
-                            p_pos += linebreak;
-                            return true;
-                        }
-                    } else {
-                        p_pos += linebreak;
-                        ++word.length;
-                    }
-                    break;
-                }
-
-                default:
-                    if (p_text[p_pos] > ' ') {
-                        returnspaces = true;
-                    } else {
-                        ++p_pos;
-                        ++word.length;
-                    }
-            }
-
-            if (returnspaces) {
-                break;
-            }
-        }
+void* kBitmap::Lock(size_t &pitch)
+{
+    return p_impl->Lock(pitch);
+}
 
-        word.type = Word::Space;
-        return true;
-    }
+void kBitmap::Unlock(const kRectInt *dirtyrect)
+{
+    p_impl->Unlock(dirtyrect);
+}
 
-private:
-    const unsigned char *p_text;
-    size_t               p_pos;
-    size_t               p_length;
-    bool                 p_linebreaks;
-    bool                 p_tabstops;
-};
+void kBitmap::SetMipmaps(bool enable)
+{
+    p_impl->SetMipmaps(enable);
+}
 
 
 /*
@@ -749,195 +711,6 @@ void kTextService::GetGlyphMetrics(const kFont &font, size_t first, size_t last,
     p_impl->GetGlyphMetrics(&font, first, last, metrics);
 }
 
-// helper function to count and measure word glyphs up until specified right edge from starting x position
-static size_t MeasureUntil(kCanvasImpl *impl, const kFont &font, const char *text, size_t count, kScalar x, kScalar right, kScalar &actualwidth)
-{
-    size_t result = 0;
-    kScalar startx = x;
-    for (; result < count; ++result) {
-        kGlyphMetrics gm;
-        size_t glyph = *text++;
-        impl->GetGlyphMetrics(&font, glyph, glyph, &gm);
-
-        if ((x + gm.advance) > right) {
-            break;
-        }
-
-        x += gm.advance;
-    }
-    actualwidth = x - startx;
-    return result;
-}
-
-// helper layout callback
-//      performs text to word split and layout of individual word blocks
-//      each layed out word passed to provided callback function
-//      text mesure functions use it to compute final text dimensions and metrics
-//      text painting functions use it to render text with computed position
-//
-// this is "common" flow layout, eventually it should be changed to klayout generic
-// algorithms
-template <typename T, typename C>
-static kSize TextLayout(
-    kCanvasImpl *impl, const char *text, int count, const kFont *font,
-    const T *properties, kScalar maxwidth, const C &callback, kRect &bounds,
-    kFontMetrics *fontmetrics = nullptr
-)
-{
-    // get basic space glyph and overall font metrics
-    kGlyphMetrics spaceglyph;
-    impl->GetGlyphMetrics(font, ' ', ' ', &spaceglyph);
-
-    kFontMetrics fm;
-    impl->GetFontMetrics(font, fm);
-    if (fontmetrics) {
-        *fontmetrics = fm;
-    }
-
-    // fill in properties
-
-    kTextFlags flags;
-    kScalar    interval;
-    kScalar    indent;
-    kScalar    defaulttabwidth;
-
-    if (properties) {
-        flags = properties->flags;
-        interval = properties->interval;
-        indent = properties->indent;
-        defaulttabwidth = properties->defaulttabwidth;
-        if (defaulttabwidth < spaceglyph.advance) {
-            defaulttabwidth = spaceglyph.advance;
-        }
-    } else {
-        defaulttabwidth = 0;
-        indent = 0;
-        interval = 0;
-        flags = kTextFlags::IgnoreLineBreaks;
-    }
-
-    bool multiline = (flags & kTextFlags::Multiline) != 0;
-    bool ignorelinebreaks = !multiline || (flags & kTextFlags::IgnoreLineBreaks) != 0;
-    bool usetabs = (flags & kTextFlags::UseTabs) != 0;
-    bool mergespaces = (flags & kTextFlags::MergeSpaces) != 0;
-
-    // perform layout
-
-    WordBreaker wordbreaker(text, count, flags);
-
-    kScalar tabwidth = 0;
-    kSize result;
-    kPoint cp(indent, 0);
-
-    kScalar leftbound = 0;
-    kScalar rightbound = 0;
-
-    Word word;
-    bool breaktonextline = false;
-    while (wordbreaker.NextWord(word)) {
-        switch (word.type) {
-            case Word::Text: {
-                // TODO
-                // here might be tricky situation when the word itself bigger than
-                // provided width to fit it in
-                // in this case word should be broken in subwords which fit required width
-                // propose an options for that or do it by default?
-                //      in case without doing long word break - words will fall outside
-                //      provided bounds
-
-                kScalar wordwidth = impl->TextSize(word.text, word.length, font).width;
-
-                // don't do line break if word doesn't fit and it's first word in a line
-                breaktonextline =
-                    breaktonextline ||
-                    (multiline && cp.x > 0 && (cp.x + wordwidth) > maxwidth);
-
-                if (breaktonextline) {
-                    cp.x = 0;
-                    cp.y += fm.height + fm.linegap + interval;
-                    result.height = cp.y;
-                }
-
-                kGlyphMetrics gm;
-                // take word's first glyph metrics for adjusting left bound
-                size_t glyph = utf8codepoint(word.text);
-                impl->GetGlyphMetrics(font, glyph, glyph, &gm);
-
-                if ((cp.x + gm.leftbearing) < leftbound) {
-                    leftbound = cp.x + gm.leftbearing;
-                }
-
-                // take word's last glyph metrics for adjusting right bound
-                if (word.length > 1) {
-                    glyph = word.text[word.length - 1];
-                    impl->GetGlyphMetrics(font, glyph, glyph, &gm);
-                }
-
-                callback(cp, word.text, word.length, wordwidth, breaktonextline);
-                cp.x += wordwidth;
-
-                breaktonextline = false;
-
-                if (cp.x > result.width) {
-                    result.width = cp.x;
-                }
-
-                if ((cp.x + gm.rightbearing) > rightbound) {
-                    rightbound = cp.x + gm.rightbearing;
-                }
-
-                break;
-            }
-
-            case Word::LineBreak:
-                if (multiline && !ignorelinebreaks) {
-                    breaktonextline = true;
-                } else {
-                    cp.x += spaceglyph.advance;
-                }
-                break;
-
-            case Word::Space:
-                // NOTE: now all spaces at end of line are ignored if word-wrapping
-                // occurs, actually spaces should wrap to next line too (except first one)
-                //      this behaviour should be examined
-                cp.x += spaceglyph.advance *
-                    (mergespaces ? 1 : word.length);
-                break;
-
-            case Word::Tab:
-                if (!usetabs) {
-                    cp.x += spaceglyph.advance;
-                } else {
-                    while (tabwidth <= cp.x) {
-                        tabwidth += defaulttabwidth;
-                    }
-                    cp.x = tabwidth;
-                }
-                break;
-        }
-    }
-
-    if (cp.x > 0.0f) {
-        if (cp.x > result.width) {
-            result.width = cp.x;
-        }
-        result.height += fm.height;
-    }
-
-    bounds.left = leftbound;
-    bounds.top = 0;
-    bounds.right = rightbound;
-    bounds.bottom = result.height + fm.linegap;
-
-    return result;
-}
-
-#define LAYOUT_CALLBACK_PARAMS\
-    const kPoint &cp,\
-    const char *text, size_t count,\
-    kScalar width, bool newline
-
 // TextLayout function does all the bounds computation, so its actual layout output not
 // needed, this null callback just does nothing for reported words
 class NullLayoutCallback
@@ -987,6 +760,13 @@ kSize kTextService::TextSize(const char *text, int count, const kFont &font, con
  -------------------------------------------------------------------------------
 */
 
+kCanvas::~kCanvas()
+{
+    // derived canvases discard groups before unbinding, this covers
+    // the ones which don't unbind
+    DiscardCachedGroups();
+}
+
 bool kCanvas::Initialize(Impl implementation)
 {
     // TODO
@@ -1017,6 +797,11 @@ void kCanvas::Clear()
     p_impl->Clear();
 }
 
+void kCanvas::Clear(const kRect &rect, const kColor &color)
+{
+    p_impl->Clear(rect, color);
+}
+
 void kCanvas::Line(const kPoint &a, const kPoint &b, const kPen &pen)
 {
     pen.needResource();
@@ -1079,6 +864,135 @@ void kCanvas::PolygonBezier(const kPoint *points, size_t count, const kPen *pen,
     p_impl->PolygonBezier(points, count, pen, brush);
 }
 
+// splits items with per item colors into groups of the same color,
+// items of every group are gathered into contiguous array
+template <typename T>
+class ColorGroups
+{
+public:
+    ColorGroups(const T *items, const kColor *colors, size_t count) :
+        p_items(items),
+        p_colors(colors),
+        p_order(count),
+        p_next(0)
+    {
+        for (size_t n = 0; n < count; ++n) {
+            p_order[n] = n;
+        }
+        // stable sort keeps drawing order inside of every group
+        std::stable_sort(p_order.begin(), p_order.end(), Less(colors));
+    }
+
+    bool Next(kColor &color, const T *&items, size_t &count)
+    {
+        if (p_next == p_order.size()) {
+            return false;
+        }
+
+        color = p_colors[p_order[p_next]];
+        uint32_t key = Key(color);
+
+        p_group.clear();
+        while (p_next < p_order.size() && Key(p_colors[p_order[p_next]]) == key) {
+            p_group.push_back(p_items[p_order[p_next++]]);
+        }
+
+        items = p_group.data();
+        count = p_group.size();
+        return true;
+    }
+
+private:
+    static uint32_t Key(const kColor &color)
+    {
+        return uint32_t(color.r) << 24 | uint32_t(color.g) << 16 | uint32_t(color.b) << 8 | color.a;
+    }
+
+    struct Less
+    {
+        const kColor *colors;
+        Less(const kColor *colors) : colors(colors) {}
+        bool operator()(size_t a, size_t b) const { return Key(colors[a]) < Key(colors[b]); }
+    };
+
+private:
+    const T             *p_items;
+    const kColor        *p_colors;
+    std::vector<size_t>  p_order;
+    std::vector<T>       p_group;
+    size_t               p_next;
+};
+
+void kCanvas::Rectangles(const kRect *rects, size_t count, const kPen *pen, const kBrush *brush)
+{
+    if (count) {
+        needResources(pen, brush);
+        p_impl->Rectangles(rects, count, pen, brush);
+    }
+}
+
+void kCanvas::Rectangles(const kRect *rects, const kColor *colors, size_t count, const kPen *pen)
+{
+    ColorGroups<kRect> groups(rects, colors, count);
+
+    kColor color;
+    const kRect *group;
+    size_t groupcount;
+    while (groups.Next(color, group, groupcount)) {
+        kBrush brush(color);
+        Rectangles(group, groupcount, pen, &brush);
+    }
+}
+
+void kCanvas::Ellipses(const kRect *rects, size_t count, const kPen *pen, const kBrush *brush)
+{
+    if (count) {
+        needResources(pen, brush);
+        p_impl->Ellipses(rects, count, pen, brush);
+    }
+}
+
+void kCanvas::Ellipses(const kRect *rects, const kColor *colors, size_t count, const kPen *pen)
+{
+    ColorGroups<kRect> groups(rects, colors, count);
+
+    kColor color;
+    const kRect *group;
+    size_t groupcount;
+    while (groups.Next(color, group, groupcount)) {
+        kBrush brush(color);
+        Ellipses(group, groupcount, pen, &brush);
+    }
+}
+
+void kCanvas::Lines(const kPoint *points, size_t count, const kPen &pen)
+{
+    if (count) {
+        pen.needResource();
+        p_impl->Lines(points, count, &pen);
+    }
+}
+
+void kCanvas::Points(const kPoint *points, size_t count, kScalar size, const kBrush &brush)
+{
+    if (count) {
+        brush.needResource();
+        p_impl->Points(points, count, size, &brush);
+    }
+}
+
+void kCanvas::Points(const kPoint *points, const kColor *colors, size_t count, kScalar size)
+{
+    ColorGroups<kPoint> groups(points, colors, count);
+
+    kColor color;
+    const kPoint *group;
+    size_t groupcount;
+    while (groups.Next(color, group, groupcount)) {
+        Points(group, groupcount, size, kBrush(color));
+    }
+}
+
 void kCanvas::DrawPath(const kPath &path, const kPen *pen, const kBrush *brush)
 {
     needResources(pen, brush);
@@ -1098,6 +1012,22 @@ void kCanvas::DrawPath(const kPath &path, const kPen *pen, const kBrush *brush,
     p_impl->DrawPath(path.p_impl, pen, brush, transform);
 }
 
+void kCanvas::DrawPathInstances(const kPath &path, const kPen *pen, const kBrush *brush, const kTransform *transforms, size_t count)
+{
+    if (count) {
+        needResources(pen, brush);
+        p_impl->DrawPathInstances(path.p_impl, pen, brush, transforms, count);
+    }
+}
+
+void kCanvas::DrawPathInstances(const kPath &path, const kPen *pen, const kBrush *brush, const kPoint *offsets, size_t count)
+{
+    if (count) {
+        needResources(pen, brush);
+        p_impl->DrawPathInstances(path.p_impl, pen, brush, offsets, count);
+    }
+}
+
 void kCanvas::DrawBitmap(const kBitmap &bitmap, const kPoint &origin, kScalar sourcealpha)
 {
     kSize sz = bitmap.size();
@@ -1114,6 +1044,13 @@ void kCanvas::DrawBitmap(const kBitmap &bitmap, const kPoint &origin, const kSiz
     p_impl->DrawBitmap(bitmap.p_impl, origin, destsize, source, sourcesize, sourcealpha);
 }
 
+void kCanvas::DrawBitmaps(const kBitmap &atlas, const kSpriteInstance *instances, size_t count)
+{
+    if (count) {
+        p_impl->DrawBitmaps(atlas.p_impl, instances, count, DeviceTransform());
+    }
+}
+
 void kCanvas::DrawMask(const kBitmap &mask, kBrush &brush, const kPoint &origin)
 {
     brush.needResource();
@@ -1149,66 +1086,25 @@ void kCanvas::Text(const kPoint &p, const char *text, int count, const kFont &fo
     p_impl->Text(p, text, count, &font, &brush, origin);
 }
 
-// this callback class for TextLayout function actually renders provided word blocks
+// this callback class for TextLayout function collects provided word blocks into
+// text run which is rendered after layout is done
 // it's used when it's possible to render layout result as is
 class RenderLayoutCallback
 {
 public:
-    RenderLayoutCallback(
-        const kPoint &origin, kCanvasImpl *impl,
-        const kFont *font, const kBrush *brush
-    ) :
+    RenderLayoutCallback(const kPoint &origin, TextRunWordsList &run) :
         p_origin(origin),
-        p_impl(impl),
-        p_font(font),
-        p_brush(brush)
-    {}
-
-    void operator()(LAYOUT_CALLBACK_PARAMS) const
-    {
-        p_impl->Text(p_origin + cp, text, count, p_font, p_brush, kTextOrigin::Top);
-    }
-
-private:
-    kPoint        p_origin;
-    kCanvasImpl  *p_impl;
-    const kFont  *p_font;
-    const kBrush *p_brush;
-};
-
-// struct for storing TextLayout output provided by callback function
-struct CachedWord
-{
-    const char *text;
-    size_t      count;
-    kPoint      position;
-    kScalar     width;
-    bool        newline;
-};
-
-typedef std::vector<CachedWord> CachedWordsList;
-
-// this callback class for TextLayout helper function stores layout results in a cache
-// before any actual output occurs
-// when additional alignment and adjustment work required for some of text render behaviors
-// it's being done on cached layout output
-class CacheLayoutCallback
-{
-public:
-    CacheLayoutCallback(CachedWordsList &cache) :
-        p_cache(cache)
+        p_run(run)
     {}
 
     void operator()(LAYOUT_CALLBACK_PARAMS) const
     {
-        CachedWord word = {
-            text, count, cp, width, newline
-        };
-        p_cache.push_back(word);
+        AddRunWord(p_run, p_origin + cp, text, count);
     }
 
 private:
-    CachedWordsList &p_cache;
+    kPoint            p_origin;
+    TextRunWordsList &p_run;
 };
 
 void kCanvas::Text(const kRect &rect, const char *text, int count, const kFont &font, const kBrush &brush, const kTextOutProperties *properties)
@@ -1232,6 +1128,10 @@ void kCanvas::Text(const kRect &rect, const char *text, int count, const kFont &
 
     kRect resultbounds;
 
+    // all words of the text block are collected here and rendered at once
+    TextRunWordsList run;
+    run.reserve(256);
+
     // this condition indicates whether it's possible to directly draw layout result
     bool directoutput =
         properties == nullptr || (
@@ -1243,14 +1143,13 @@ void kCanvas::Text(const kRect &rect, const char *text, int count, const kFont &
     if (directoutput) {
         // no additional computation after layout required - pass render callback to
         // layout helper
-        RenderLayoutCallback callback(rect.getLeftTop(), p_impl, &font, &brush);
+        RenderLayoutCallback callback(rect.getLeftTop(), run);
         TextLayout(
             p_impl, text, count, &font, properties,
             rect.width(), callback, resultbounds
         );
     } else {
         // additional computation required after layout, collect layout data into cache
-
         kFontMetrics fm;
 
         CachedWordsList cache;
@@ -1258,156 +1157,17 @@ void kCanvas::Text(const kRect &rect, const char *text, int count, const kFont &
 
         CacheLayoutCallback callback(cache);
 
-        bool ellipses = (properties->flags & kTextFlags::Ellipses) != 0;
-
         kSize size = TextLayout(
             p_impl, text, count, &font, properties,
             rect.width(), callback, resultbounds,
             &fm
         );
 
-        // compute bounds which will be used for text alignment
-        kSize alignboundssize;
-        alignboundssize.width = umax(size.width, rect.width());
-        alignboundssize.height = umax(size.height, rect.height());
-
-        // compute overall vertical offset for vertical alignment
-        kScalar verticaloffset = 0;
-        switch (properties->vertalign) {
-            case kTextVerticalAlignment::Middle:
-                verticaloffset = alignboundssize.height * 0.5f - size.height * 0.5f;
-                break;
-
-            case kTextVerticalAlignment::Bottom:
-                verticaloffset = alignboundssize.height - size.height;
-                break;
-        }
-
-        // compute ellipses width, if required
-        kScalar ellipseswidth = 0;
-        if (ellipses) {
-            kGlyphMetrics gm;
-            p_impl->GetGlyphMetrics(&font, '.', '.', &gm);
-            ellipseswidth = gm.advance * 3;
-        }
+        AlignLayout(p_impl, rect, &font, *properties, fm, size, cache, run);
+    }
 
-        // walk through cached layout result and render text line by line
-        // with applying horizontal alignment and other options
-        size_t cw = 0;
-        size_t sz = cache.size();
-        kScalar y = 0;
-        while (cw < sz) {
-            // search for row bounds
-            size_t start = cw;
-            while (cw < sz && !cache[cw].newline) {
-                ++cw;
-            }
-
-            // compute total width of current line of text
-            kScalar width = cache[cw - 1].position.x + cache[cw - 1].width;
-
-            // compute horizontal alignment
-            // interwordspacing is used for additional spacing to add between words
-            // in order to get line fit whole text block width
-            kScalar totaloffset = 0;
-            kScalar interwordspacing = 0;
-
-            switch (properties->horzalign) {
-                case kTextHorizontalAlignment::Center:
-                    totaloffset = alignboundssize.width * 0.5f - width * 0.5f;
-                    break;
-
-                case kTextHorizontalAlignment::Right:
-                    totaloffset = alignboundssize.width - width;
-                    break;
-
-                case kTextHorizontalAlignment::Justify:
-                    if (cw < sz) {
-                        size_t spacecount = cw - start - 1;
-                        if (spacecount) {
-                            interwordspacing =
-                                (alignboundssize.width - width) /
-                                spacecount;
-                        }
-                    }
-                    break;
-            }
-
-            // compute current output position
-            kPoint cp = rect.getLeftTop() + kPoint(totaloffset, verticaloffset);
-
-            bool lasttextline = false;
-            if (ellipses) {
-                // check if this line of text is last row and next row
-                // can't fit in bounds (so ellipses should be painted)
-                kScalar nextrowbottom =
-                    cp.y + y + fm.height * 2 + fm.linegap + properties->interval;
-                lasttextline = nextrowbottom > rect.bottom;
-            }
-
-            // output line words one by one
-            bool stopoutput = false;
-            for (size_t n = start; n < cw; ++n) {
-                const CachedWord &w = cache[n];
-
-                if (ellipses) {
-                    // check if word crosses right bound (this is possible for
-                    // single line text or for adding ellipses on a last visible row)
-                    kScalar wordrightbound = cp.x + w.position.x + w.width;
-
-                    // if this is last visible line of text - adjust right bound to fit
-                    // ellipses
-                    if (lasttextline) {
-                        wordrightbound += ellipseswidth;
-                    }
-
-                    // check if word is last in a visible row
-                    bool lastword = lasttextline && n == (cw - 1);
-
-                    if (wordrightbound > rect.right || lastword) {
-                        cp += w.position;
-
-                        if ((cp.x + w.width + ellipseswidth) < rect.right) {
-                            p_impl->Text(
-                                cp, w.text, w.count,
-                                &font, &brush, kTextOrigin::Top
-                            );
-                            cp.x += w.width;
-                        } else {
-                            // measure word glyphs one by one while there's enough space
-                            // to fit ellipses after word, then paint fitted glyphs of the word
-                            kScalar fitwidth;
-                            size_t c = MeasureUntil(p_impl, font, w.text, w.count, cp.x, rect.right - ellipseswidth, fitwidth);
-
-                            p_impl->Text(cp, w.text, c, &font, &brush, kTextOrigin::Top);
-                            cp.x += fitwidth;
-                        }
-
-                        p_impl->Text(cp, "...", 3, &font, &brush, kTextOrigin::Top);
-
-                        // TODO: currently first word out of bounds will stop text output
-                        // this seems to be layout issue, since it doesn't break long words
-                        stopoutput = true;
-                        break;
-                    }
-                }
-
-                p_impl->Text(
-                    cp + w.position , w.text, w.count,
-                    &font, &brush, kTextOrigin::Top
-                );
-                cp.x += interwordspacing;
-            }
-
-            if (stopoutput) {
-                break;
-            }
-
-            if (cw < sz) {
-                cache[cw].newline = false;
-                y += fm.height + fm.linegap + properties->interval;
-            }
-        }
+    if (run.size()) {
+        p_impl->TextRun(run.data(), run.size(), &font, &brush);
     }
 
     if (cliptobounds) {
@@ -1435,6 +1195,161 @@ void kCanvas::EndClippedDrawing()
     p_impl->EndClippedDrawing();
 }
 
+void kCanvas::PushLayer(const kRect &bounds, kScalar opacity, kBlendMode blend)
+{
+    p_impl->PushLayer(bounds, opacity, blend);
+}
+
+void kCanvas::PopLayer()
+{
+    p_impl->PopLayer();
+}
+
+void kCanvas::SetGroupCache(kGroupCache *cache)
+{
+    p_groupcache = cache;
+}
+
+bool kCanvas::BeginCachedGroup(uint64_t key, const kRect &bounds)
+{
+    CachedGroup group;
+    group.key = key;
+    group.impl = nullptr;
+    group.offset = p_groups.size() ? p_groups.back().offset : kTransform();
+
+    if (!p_groupcache) {
+        p_groups.push_back(group);
+        return true;
+    }
+
+    kGroupCacheImpl *cache = p_groupcache->p_impl;
+    kTransform device = DeviceTransform();
+
+    if (cache->Find(key, device)) {
+        DrawCachedGroup(key);
+        p_groups.push_back(group);
+        return false;
+    }
+
+    // group is rendered into bitmap covering its bounds on whole pixels,
+    // it's drawn directly if it doesn't fit cache
+    kRect rect = kCanvasImpl::DeviceBounds(bounds, nullptr, device);
+    int left = int(std::floor(rect.left));
+    int top = int(std::floor(rect.top));
+    int right = int(std::ceil(rect.right));
+    int bottom = int(std::ceil(rect.bottom));
+
+    kGroupCacheImpl::Entry *entry = right > left && bottom > top ?
+        cache->Create(key, size_t(right - left), size_t(bottom - top)) :
+        nullptr;
+
+    if (entry) {
+        entry->transform = device;
+        entry->origin = kPoint(kScalar(left), kScalar(top));
+
+        group.impl = p_impl;
+        group.offset = kTransform::construct::translate(-kScalar(left), -kScalar(top)) * group.offset;
+
+        p_impl = CanvasFactory::CreateCanvas();
+        p_impl->BindToBitmap(entry->bitmap->p_impl, nullptr);
+    }
+
+    p_groups.push_back(group);
+
+    if (entry) {
+        p_impl->SetTransform(DeviceTransform());
+    }
+
+    return true;
+}
+
+void kCanvas::EndCachedGroup()
+{
+    if (p_groups.empty()) {
+        return;
+    }
+
+    CachedGroup group = p_groups.back();
+    p_groups.pop_back();
+
+    // group wasn't rendered into cache
+    if (!group.impl) {
+        return;
+    }
+
+    p_impl->Unbind();
+    delete p_impl;
+    p_impl = group.impl;
+    p_impl->SetTransform(DeviceTransform());
+
+    DrawCachedGroup(group.key);
+    p_groupcache->p_impl->Unlock(group.key);
+}
+
+void kCanvas::DrawCachedGroup(uint64_t key)
+{
+    const kGroupCacheImpl::Entry *entry = p_groupcache->p_impl->Get(key);
+    if (!entry) {
+        return;
+    }
+
+    // cached group moves with transform translation, it's drawn
+    // with canvas transform reset
+    kTransform device = DeviceTransform();
+    kPoint origin(
+        entry->origin.x + device.m20 - entry->transform.m20,
+        entry->origin.y + device.m21 - entry->transform.m21
+    );
+    kSize size(kScalar(entry->bitmap->width()), kScalar(entry->bitmap->height()));
+
+    p_impl->SetTransform(kTransform());
+    p_impl->DrawBitmap(entry->bitmap->p_impl, origin, size, kPoint(), size, 1);
+    p_impl->SetTransform(device);
+}
+
+void kCanvas::DiscardCachedGroups()
+{
+    while (p_groups.size()) {
+        CachedGroup group = p_groups.back();
+        p_groups.pop_back();
+
+        if (!group.impl) {
+            continue;
+        }
+
+        p_impl->Unbind();
+        delete p_impl;
+        p_impl = group.impl;
+
+        // group bitmap is incomplete, it's dropped as soon as it's unlocked
+        p_groupcache->p_impl->Invalidate(group.key);
+        p_groupcache->p_impl->Unlock(group.key);
+    }
+}
+
+kTransform kCanvas::DeviceTransform() const
+{
+    return p_groups.size() ? p_groups.back().offset * p_transform : p_transform;
+}
+
+const kDamageRegion* kCanvas::GetDamage() const
+{
+    return p_damage ? &p_damage->damage() : nullptr;
+}
+
+void kCanvas::ResetDamage()
+{
+    if (p_damage) {
+        p_damage->ResetDamage();
+    }
+}
+
+void kCanvas::TrackDamage(const kRectInt &target, size_t maxrects)
+{
+    p_damage = new kCanvasImplDamage(p_impl, target, maxrects);
+    p_impl = p_damage;
+}
+
 void kCanvas::SetTransform(const kTransform &transform)
 {
     p_transform =
@@ -1442,7 +1357,7 @@ void kCanvas::SetTransform(const kTransform &transform)
         p_transform_stack.back() * transform :
         transform;
 
-    p_impl->SetTransform(p_transform);
+    p_impl->SetTransform(DeviceTransform());
 }
 
 void kCanvas::PushTransform(const kTransform &transform)
@@ -1450,14 +1365,14 @@ void kCanvas::PushTransform(const kTransform &transform)
     p_transform_stack.push_back(p_transform);
 
     p_transform = p_transform * transform;
-    p_impl->SetTransform(p_transform);
+    p_impl->SetTransform(DeviceTransform());
 }
 
 void kCanvas::PopTransform()
 {
     if (p_transform_stack.size()) {
         p_transform = p_transform_stack.back();
-        p_impl->SetTransform(p_transform);
+        p_impl->SetTransform(DeviceTransform());
         p_transform_stack.pop_back();
     }
 }
@@ -1469,31 +1384,88 @@ void kCanvas::PopTransform()
  -------------------------------------------------------------------------------
 */
 
-kBitmapCanvas::kBitmapCanvas(const kBitmap &target, const kRectInt *rect) :
+kBitmapCanvas::kBitmapCanvas(const kBitmap &target, const kRectInt *rect, size_t damagerects) :
     kCanvas()
 {
     p_impl->BindToBitmap(target.p_impl, rect);
+
+    if (damagerects) {
+        kRectInt bounds(0, 0, int(target.width()), int(target.height()));
+        if (rect) {
+            bounds = kRectInt(
+                umax(bounds.left, rect->left), umax(bounds.top, rect->top),
+                umin(bounds.right, rect->right), umin(bounds.bottom, rect->bottom)
+            );
+        }
+        TrackDamage(bounds, damagerects);
+    }
 }
 
 kBitmapCanvas::~kBitmapCanvas()
 {
+    DiscardCachedGroups();
     p_impl->Unbind();
 }
 
 
+/*
+ -------------------------------------------------------------------------------
+ kTiledBitmapCanvas implementation
+ -------------------------------------------------------------------------------
+*/
+
+kTiledBitmapCanvas::kTiledBitmapCanvas(const kBitmap &target, const kTiledCanvasProperties *properties) :
+    kCanvas(),
+    p_target(target),
+    p_properties(properties ? *properties : kTiledCanvasProperties::construct()),
+    p_tiles(0),
+    p_renderedtiles(0)
+{
+    // drawing is recorded, implementation canvas is kept by recorder
+    // for text measurement
+    p_impl = new kCanvasImplRecorder(p_impl);
+}
+
+kTiledBitmapCanvas::~kTiledBitmapCanvas()
+{
+    DiscardCachedGroups();
+    Flush();
+}
+
+void kTiledBitmapCanvas::Flush()
+{
+    kCanvasImplRecorder *recorder = static_cast<kCanvasImplRecorder*>(p_impl);
+
+    p_renderedtiles = recorder->Rasterize(
+        p_target.p_impl, p_target.width(), p_target.height(),
+        p_properties.tilesize, p_properties.threads, p_tiles
+    );
+
+    recorder->Reset();
+}
+
+
 /*
  -------------------------------------------------------------------------------
  kContextCanvas implementation
  -------------------------------------------------------------------------------
 */
 
-kContextCanvas::kContextCanvas(kContext context, const kRectInt *rect) :
+kContextCanvas::kContextCanvas(kContext context, const kRectInt *rect, size_t damagerects) :
     kCanvas()
 {
     p_impl->BindToContext(context, rect);
+
+    if (damagerects) {
+        // context size isn't known, so damage is limited only by
+        // large enough rectangle which can't overflow
+        const int limit = std::numeric_limits<int>::max() / 4;
+        TrackDamage(rect ? *rect : kRectInt(-limit, -limit, limit, limit), damagerects);
+    }
 }
 
 kContextCanvas::~kContextCanvas()
 {
+    DiscardCachedGroups();
     p_impl->Unbind();
 }
@@ -0,0 +1,511 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    canvasdamage.cpp
+        damage region and damage tracking canvas implementation
+*/
+
+#include "canvasdamage.h"
+
+
+using namespace k_canvas;
+using namespace impl;
+using namespace c_util;
+
+
+static inline int64_t Area(const kRectInt &rect)
+{
+    return int64_t(rect.width()) * int64_t(rect.height());
+}
+
+static inline kRectInt Union(const kRectInt &a, const kRectInt &b)
+{
+    return kRectInt(
+        umin(a.left, b.left), umin(a.top, b.top),
+        umax(a.right, b.right), umax(a.bottom, b.bottom)
+    );
+}
+
+static inline bool Overlaps(const kRectInt &a, const kRectInt &b)
+{
+    return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+}
+
+static inline void Unite(kRect &a, const kRect &b)
+{
+    a.left = umin(a.left, b.left);
+    a.top = umin(a.top, b.top);
+    a.right = umax(a.right, b.right);
+    a.bottom = umax(a.bottom, b.bottom);
+}
+
+
+/*
+ -------------------------------------------------------------------------------
+ kDamageRegion implementation
+ -------------------------------------------------------------------------------
+*/
+
+kDamageRegion::kDamageRegion(size_t maxrects) :
+    p_maxrects(umax(maxrects, size_t(1)))
+{}
+
+void kDamageRegion::Add(const kRectInt &rect)
+{
+    if (rect.right <= rect.left || rect.bottom <= rect.top) {
+        return;
+    }
+
+    Insert(rect);
+
+    while (p_rects.size() > p_maxrects) {
+        // rectangles don't overlap, so area wasted by union is what
+        // union has over areas of both rectangles
+        size_t a = 0;
+        size_t b = 1;
+        int64_t best = -1;
+        for (size_t i = 0; i < p_rects.size(); ++i) {
+            for (size_t j = i + 1; j < p_rects.size(); ++j) {
+                int64_t waste = Area(Union(p_rects[i], p_rects[j])) - Area(p_rects[i]) - Area(p_rects[j]);
+                if (best < 0 || waste < best) {
+                    best = waste;
+                    a = i;
+                    b = j;
+                }
+            }
+        }
+
+        kRectInt merged = Union(p_rects[a], p_rects[b]);
+        p_rects.erase(p_rects.begin() + b);
+        p_rects.erase(p_rects.begin() + a);
+        Insert(merged);
+    }
+}
+
+void kDamageRegion::Clear()
+{
+    p_rects.clear();
+}
+
+kRectInt kDamageRegion::bounds() const
+{
+    if (p_rects.empty()) {
+        return kRectInt(0, 0, 0, 0);
+    }
+
+    kRectInt result = p_rects[0];
+    for (size_t n = 1; n < p_rects.size(); ++n) {
+        result = Union(result, p_rects[n]);
+    }
+
+    return result;
+}
+
+void kDamageRegion::Insert(kRectInt rect)
+{
+    // united rectangle can reach rectangles which didn't touch original
+    // one, so search starts over after every merge
+    size_t n = 0;
+    while (n < p_rects.size()) {
+        const kRectInt &current = p_rects[n];
+        kRectInt united = Union(rect, current);
+
+        if (Overlaps(rect, current) || Area(united) == Area(rect) + Area(current)) {
+            rect = united;
+            p_rects.erase(p_rects.begin() + n);
+            n = 0;
+        } else {
+            ++n;
+        }
+    }
+
+    p_rects.push_back(rect);
+}
+
+
+/*
+ -------------------------------------------------------------------------------
+ kCanvasImplDamage implementation
+ -------------------------------------------------------------------------------
+*/
+
+kCanvasImplDamage::kCanvasImplDamage(kCanvasImpl *canvas, const kRectInt &target, size_t maxrects) :
+    p_canvas(canvas),
+    p_transform(),
+    p_damage(maxrects)
+{
+    p_clips.push_back(kRect(
+        kScalar(target.left), kScalar(target.top),
+        kScalar(target.right), kScalar(target.bottom)
+    ));
+}
+
+kCanvasImplDamage::~kCanvasImplDamage()
+{
+    delete p_canvas;
+}
+
+void kCanvasImplDamage::Clear()
+{
+    AddClipDamage();
+    p_canvas->Clear();
+}
+
+void kCanvasImplDamage::Clear(const kRect &rect, const kColor &color)
+{
+    AddDamage(DeviceBounds(rect, nullptr, p_transform));
+    p_canvas->Clear(rect, color);
+}
+
+bool kCanvasImplDamage::ConcurrentTiles() const
+{
+    return p_canvas->ConcurrentTiles();
+}
+
+bool kCanvasImplDamage::BindToBitmap(const kBitmapImpl *target, const kRectInt *rect)
+{
+    return p_canvas->BindToBitmap(target, rect);
+}
+
+bool kCanvasImplDamage::BindToContext(kContext context, const kRectInt *rect)
+{
+    return p_canvas->BindToContext(context, rect);
+}
+
+bool kCanvasImplDamage::BindToPrinter(kPrinter printer)
+{
+    return p_canvas->BindToPrinter(printer);
+}
+
+bool kCanvasImplDamage::Unbind()
+{
+    p_clips.resize(1);
+    return p_canvas->Unbind();
+}
+
+void kCanvasImplDamage::Line(const kPoint &a, const kPoint &b, const kPenBase *pen)
+{
+    kPoint points[2] = { a, b };
+    AddDamage(PointBounds(points, 2, pen, p_transform));
+    p_canvas->Line(a, b, pen);
+}
+
+void kCanvasImplDamage::Bezier(const kPoint &p1, const kPoint &p2, const kPoint &p3, const kPoint &p4, const kPenBase *pen)
+{
+    // curve lies inside of its control points hull
+    kPoint points[4] = { p1, p2, p3, p4 };
+    AddDamage(PointBounds(points, 4, pen, p_transform));
+    p_canvas->Bezier(p1, p2, p3, p4, pen);
+}
+
+void kCanvasImplDamage::PolyLine(const kPoint *points, size_t count, const kPenBase *pen)
+{
+    AddDamage(PointBounds(points, count, pen, p_transform));
+    p_canvas->PolyLine(points, count, pen);
+}
+
+void kCanvasImplDamage::PolyBezier(const kPoint *points, size_t count, const kPenBase *pen)
+{
+    AddDamage(PointBounds(points, count, pen, p_transform));
+    p_canvas->PolyBezier(points, count, pen);
+}
+
+void kCanvasImplDamage::Rectangle(const kRect &rect, const kPenBase *pen, const kBrushBase *brush)
+{
+    AddDamage(DeviceBounds(rect, pen, p_transform));
+    p_canvas->Rectangle(rect, pen, brush);
+}
+
+void kCanvasImplDamage::RoundedRectangle(const kRect &rect, const kSize &round, const kPenBase *pen, const kBrushBase *brush)
+{
+    AddDamage(DeviceBounds(rect, pen, p_transform));
+    p_canvas->RoundedRectangle(rect, round, pen, brush);
+}
+
+void kCanvasImplDamage::Ellipse(const kRect &rect, const kPenBase *pen, const kBrushBase *brush)
+{
+    AddDamage(DeviceBounds(rect, pen, p_transform));
+    p_canvas->Ellipse(rect, pen, brush);
+}
+
+void kCanvasImplDamage::Polygon(const kPoint *points, size_t count, const kPenBase *pen, const kBrushBase *brush)
+{
+    AddDamage(PointBounds(points, count, pen, p_transform));
+    p_canvas->Polygon(points, count, pen, brush);
+}
+
+void kCanvasImplDamage::PolygonBezier(const kPoint *points, size_t count, const kPenBase *pen, const kBrushBase *brush)
+{
+    AddDamage(PointBounds(points, count, pen, p_transform));
+    p_canvas->PolygonBezier(points, count, pen, brush);
+}
+
+// batched calls add single rectangle around all items, region would merge
+// items of dense batch anyway
+
+void kCanvasImplDamage::Rectangles(const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush)
+{
+    if (count) {
+        kRect bounds = rects[0];
+        for (size_t n = 1; n < count; ++n) {
+            Unite(bounds, rects[n]);
+        }
+        AddDamage(DeviceBounds(bounds, pen, p_transform));
+    }
+
+    p_canvas->Rectangles(rects, count, pen, brush);
+}
+
+void kCanvasImplDamage::Ellipses(const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush)
+{
+    if (count) {
+        kRect bounds = rects[0];
+        for (size_t n = 1; n < count; ++n) {
+            Unite(bounds, rects[n]);
+        }
+        AddDamage(DeviceBounds(bounds, pen, p_transform));
+    }
+
+    p_canvas->Ellipses(rects, count, pen, brush);
+}
+
+void kCanvasImplDamage::Lines(const kPoint *points, size_t count, const kPenBase *pen)
+{
+    if (count) {
+        AddDamage(PointBounds(points, count * 2, pen, p_transform));
+    }
+
+    p_canvas->Lines(points, count, pen);
+}
+
+void kCanvasImplDamage::Points(const kPoint *points, size_t count, kScalar size, const kBrushBase *brush)
+{
+    if (count) {
+        kScalar radius = size * 0.5f;
+        kRect bounds(points[0].x - radius, points[0].y - radius, points[0].x + radius, points[0].y + radius);
+        for (size_t n = 1; n < count; ++n) {
+            Unite(bounds, kRect(points[n].x - radius, points[n].y - radius, points[n].x + radius, points[n].y + radius));
+        }
+        AddDamage(DeviceBounds(bounds, nullptr, p_transform));
+    }
+
+    p_canvas->Points(points, count, size, brush);
+}
+
+void kCanvasImplDamage::DrawPath(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush)
+{
+    kRect bounds;
+    if (path->Bounds(bounds)) {
+        AddDamage(DeviceBounds(bounds, pen, p_transform));
+    } else {
+        AddClipDamage();
+    }
+
+    p_canvas->DrawPath(path, pen, brush);
+}
+
+void kCanvasImplDamage::DrawPath(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kTransform &transform)
+{
+    kRect bounds;
+    if (path->Bounds(bounds)) {
+        AddDamage(DeviceBounds(bounds, transform, pen, p_transform));
+    } else {
+        AddClipDamage();
+    }
+
+    p_canvas->DrawPath(path, pen, brush, transform);
+}
+
+void kCanvasImplDamage::DrawPathInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kTransform *transforms, size_t count)
+{
+    kRect bounds;
+    if (!path->Bounds(bounds)) {
+        AddClipDamage();
+    } else if (count) {
+        kRect damage = DeviceBounds(bounds, transforms[0], pen, p_transform);
+        for (size_t n = 1; n < count; ++n) {
+            Unite(damage, DeviceBounds(bounds, transforms[n], pen, p_transform));
+        }
+        AddDamage(damage);
+    }
+
+    p_canvas->DrawPathInstances(path, pen, brush, transforms, count);
+}
+
+void kCanvasImplDamage::DrawPathInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kPoint *offsets, size_t count)
+{
+    kRect bounds;
+    if (!path->Bounds(bounds)) {
+        AddClipDamage();
+    } else if (count) {
+        kRect local(
+            bounds.left + offsets[0].x, bounds.top + offsets[0].y,
+            bounds.right + offsets[0].x, bounds.bottom + offsets[0].y
+        );
+        for (size_t n = 1; n < count; ++n) {
+            Unite(local, kRect(
+                bounds.left + offsets[n].x, bounds.top + offsets[n].y,
+                bounds.right + offsets[n].x, bounds.bottom + offsets[n].y
+            ));
+        }
+        AddDamage(DeviceBounds(local, pen, p_transform));
+    }
+
+    p_canvas->DrawPathInstances(path, pen, brush, offsets, count);
+}
+
+void kCanvasImplDamage::DrawBitmap(const kBitmapImpl *bitmap, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize, kScalar sourcealpha)
+{
+    kRect rect(origin.x, origin.y, origin.x + destsize.width, origin.y + destsize.height);
+    AddDamage(DeviceBounds(rect, nullptr, p_transform));
+    p_canvas->DrawBitmap(bitmap, origin, destsize, source, sourcesize, sourcealpha);
+}
+
+void kCanvasImplDamage::DrawMask(const kBitmapImpl *mask, kBrushBase *brush, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize)
+{
+    kRect rect(origin.x, origin.y, origin.x + destsize.width, origin.y + destsize.height);
+    AddDamage(DeviceBounds(rect, nullptr, p_transform));
+    p_canvas->DrawMask(mask, brush, origin, destsize, source, sourcesize);
+}
+
+void kCanvasImplDamage::DrawBitmaps(const kBitmapImpl *atlas, const kSpriteInstance *instances, size_t count, const kTransform &transform)
+{
+    if (count) {
+        kRect damage = DeviceBounds(instances[0].dest, instances[0].transform, nullptr, transform);
+        for (size_t n = 1; n < count; ++n) {
+            Unite(damage, DeviceBounds(instances[n].dest, instances[n].transform, nullptr, transform));
+        }
+        AddDamage(damage);
+    }
+
+    p_canvas->DrawBitmaps(atlas, instances, count, transform);
+}
+
+void kCanvasImplDamage::GetFontMetrics(const kFontBase *font, kFontMetrics &metrics)
+{
+    p_canvas->GetFontMetrics(font, metrics);
+}
+
+void kCanvasImplDamage::GetGlyphMetrics(const kFontBase *font, size_t first, size_t last, kGlyphMetrics *metrics)
+{
+    p_canvas->GetGlyphMetrics(font, first, last, metrics);
+}
+
+kSize kCanvasImplDamage::TextSize(const char *text, size_t count, const kFontBase *font)
+{
+    return p_canvas->TextSize(text, count, font);
+}
+
+void kCanvasImplDamage::Text(const kPoint &p, const char *text, size_t count, const kFontBase *font, const kBrushBase *brush, kTextOrigin origin)
+{
+    AddDamage(DeviceBounds(TextBounds(p, text, count, font), nullptr, p_transform));
+    p_canvas->Text(p, text, count, font, brush, origin);
+}
+
+void kCanvasImplDamage::TextRun(const TextRunWord *words, size_t count, const kFontBase *font, const kBrushBase *brush)
+{
+    if (count) {
+        AddDamage(DeviceBounds(TextRunBounds(words, count, font), nullptr, p_transform));
+    }
+
+    p_canvas->TextRun(words, count, font, brush);
+}
+
+void kCanvasImplDamage::BeginClippedDrawingByMask(const kBitmapImpl *mask, const kTransform &transform, kExtendType xextend, kExtendType yextend)
+{
+    // clamped mask edge pixels cover everything outside of mask
+    p_clips.push_back(p_clips.back());
+    p_canvas->BeginClippedDrawingByMask(mask, transform, xextend, yextend);
+}
+
+void kCanvasImplDamage::BeginClippedDrawingByPath(const kPathImpl *clip, const kTransform &transform)
+{
+    kRect bounds;
+    if (clip->Bounds(bounds)) {
+        PushClip(DeviceBounds(bounds, transform, nullptr, p_transform));
+    } else {
+        p_clips.push_back(p_clips.back());
+    }
+
+    p_canvas->BeginClippedDrawingByPath(clip, transform);
+}
+
+void kCanvasImplDamage::BeginClippedDrawingByRect(const kRect &clip)
+{
+    PushClip(DeviceBounds(clip, nullptr, p_transform));
+    p_canvas->BeginClippedDrawingByRect(clip);
+}
+
+void kCanvasImplDamage::EndClippedDrawing()
+{
+    if (p_clips.size() > 1) {
+        p_clips.pop_back();
+    }
+
+    p_canvas->EndClippedDrawing();
+}
+
+void kCanvasImplDamage::PushLayer(const kRect &bounds, kScalar opacity, kBlendMode blend)
+{
+    // layer is blended back only where its content was drawn, so it
+    // changes nothing outside of damage of its content
+    PushClip(DeviceBounds(bounds, nullptr, p_transform));
+    p_canvas->PushLayer(bounds, opacity, blend);
+}
+
+void kCanvasImplDamage::PopLayer()
+{
+    if (p_clips.size() > 1) {
+        p_clips.pop_back();
+    }
+
+    p_canvas->PopLayer();
+}
+
+void kCanvasImplDamage::SetTransform(const kTransform &transform)
+{
+    p_transform = transform;
+    p_canvas->SetTransform(transform);
+}
+
+void kCanvasImplDamage::AddDamage(const kRect &bounds)
+{
+    const kRect &clip = p_clips.back();
+
+    kScalar left = umax(bounds.left, clip.left);
+    kScalar top = umax(bounds.top, clip.top);
+    kScalar right = umin(bounds.right, clip.right);
+    kScalar bottom = umin(bounds.bottom, clip.bottom);
+
+    if (right > left && bottom > top) {
+        p_damage.Add(kRectInt(
+            int(std::floor(left)), int(std::floor(top)),
+            int(std::ceil(right)), int(std::ceil(bottom))
+        ));
+    }
+}
+
+void kCanvasImplDamage::AddClipDamage()
+{
+    AddDamage(p_clips.back());
+}
+
+void kCanvasImplDamage::PushClip(const kRect &bounds)
+{
+    const kRect &clip = p_clips.back();
+
+    kScalar left = umax(bounds.left, clip.left);
+    kScalar top = umax(bounds.top, clip.top);
+
+    p_clips.push_back(kRect(
+        left, top,
+        umax(umin(bounds.right, clip.right), left),
+        umax(umin(bounds.bottom, clip.bottom), top)
+    ));
+}
@@ -0,0 +1,110 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    canvasdamage.h
+        damage tracking canvas implementation
+*/
+
+#pragma once
+#include "canvas.h"
+#include "canvasimpl.h"
+
+
+namespace k_canvas
+{
+    namespace impl
+    {
+        /*
+         -------------------------------------------------------------------------------
+         kCanvasImplDamage
+         -------------------------------------------------------------------------------
+            canvas implementation which passes all calls to wrapped
+            implementation canvas and adds conservative device bounds of
+            every drawing call to damage region
+
+            clipping by rectangle, path bounds and layer bounds narrows
+            damage, mask clipping doesn't
+        */
+        class kCanvasImplDamage : public kCanvasImpl
+        {
+        public:
+            // canvas - bound implementation canvas, owned by tracker
+            // target - bound part of target in pixels
+            kCanvasImplDamage(kCanvasImpl *canvas, const kRectInt &target, size_t maxrects);
+            ~kCanvasImplDamage() override;
+
+            void Clear() override;
+            void Clear(const kRect &rect, const kColor &color) override;
+
+            bool ConcurrentTiles() const override;
+
+            bool BindToBitmap(const kBitmapImpl *target, const kRectInt *rect) override;
+            bool BindToContext(kContext context, const kRectInt *rect) override;
+            bool BindToPrinter(kPrinter printer) override;
+            bool Unbind() override;
+
+            void Line(const kPoint &a, const kPoint &b, const kPenBase *pen) override;
+            void Bezier(const kPoint &p1, const kPoint &p2, const kPoint &p3, const kPoint &p4, const kPenBase *pen) override;
+            void PolyLine(const kPoint *points, size_t count, const kPenBase *pen) override;
+            void PolyBezier(const kPoint *points, size_t count, const kPenBase *pen) override;
+
+            void Rectangle(const kRect &rect, const kPenBase *pen, const kBrushBase *brush) override;
+            void RoundedRectangle(const kRect &rect, const kSize &round, const kPenBase *pen, const kBrushBase *brush) override;
+            void Ellipse(const kRect &rect, const kPenBase *pen, const kBrushBase *brush) override;
+            void Polygon(const kPoint *points, size_t count, const kPenBase *pen, const kBrushBase *brush) override;
+            void PolygonBezier(const kPoint *points, size_t count, const kPenBase *pen, const kBrushBase *brush) override;
+
+            void Rectangles(const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush) override;
+            void Ellipses(const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush) override;
+            void Lines(const kPoint *points, size_t count, const kPenBase *pen) override;
+            void Points(const kPoint *points, size_t count, kScalar size, const kBrushBase *brush) override;
+
+            void DrawPath(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush) override;
+            void DrawPath(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kTransform &transform) override;
+            void DrawPathInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kTransform *transforms, size_t count) override;
+            void DrawPathInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kPoint *offsets, size_t count) override;
+            void DrawBitmap(const kBitmapImpl *bitmap, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize, kScalar sourcealpha) override;
+            void DrawMask(const kBitmapImpl *mask, kBrushBase *brush, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize) override;
+            void DrawBitmaps(const kBitmapImpl *atlas, const kSpriteInstance *instances, size_t count, const kTransform &transform) override;
+
+            void GetFontMetrics(const kFontBase *font, kFontMetrics &metrics) override;
+            void GetGlyphMetrics(const kFontBase *font, size_t first, size_t last, kGlyphMetrics *metrics) override;
+            kSize TextSize(const char *text, size_t count, const kFontBase *font) override;
+            void Text(const kPoint &p, const char *text, size_t count, const kFontBase *font, const kBrushBase *brush, kTextOrigin origin) override;
+            void TextRun(const TextRunWord *words, size_t count, const kFontBase *font, const kBrushBase *brush) override;
+
+            void BeginClippedDrawingByMask(const kBitmapImpl *mask, const kTransform &transform, kExtendType xextend, kExtendType yextend) override;
+            void BeginClippedDrawingByPath(const kPathImpl *clip, const kTransform &transform) override;
+            void BeginClippedDrawingByRect(const kRect &clip) override;
+            void EndClippedDrawing() override;
+
+            void PushLayer(const kRect &bounds, kScalar opacity, kBlendMode blend) override;
+            void PopLayer() override;
+
+            void SetTransform(const kTransform &transform) override;
+
+            const kDamageRegion& damage() const { return p_damage; }
+            void ResetDamage() { p_damage.Clear(); }
+
+        private:
+            // adds device bounds limited by current clip to damage
+            void AddDamage(const kRect &bounds);
+            // damage of drawing which can touch any pixel inside of clip
+            void AddClipDamage();
+            // pushes clip of given device bounds intersected with current clip
+            void PushClip(const kRect &bounds);
+
+        private:
+            kCanvasImpl        *p_canvas;
+            kTransform          p_transform;
+            std::vector<kRect>  p_clips;   // device bounds of clips, target bounds first
+            kDamageRegion       p_damage;
+        };
+    }
+}
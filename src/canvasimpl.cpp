@@ -16,6 +16,25 @@
 
 using namespace k_canvas;
 using namespace impl;
+using namespace c_util;
+
+
+// stroke can go beyond shape outline by half of pen width, sharp miter
+// joins go further (up to miter limit, which is 10 by default)
+static const kScalar PEN_EXTENT = 5;
+
+
+/*
+ -------------------------------------------------------------------------------
+ kPathImpl implementation
+ -------------------------------------------------------------------------------
+*/
+
+bool kPathImpl::Bounds(kRect &bounds) const
+{
+    return false;
+}
+
 
 
 /*
@@ -132,6 +151,31 @@ void kPathImplDefault::Commit()
 {
 }
 
+bool kPathImplDefault::Bounds(kRect &bounds) const
+{
+    // text outlines have no control points
+    for (size_t n = 0; n < p_curr_command; ++n) {
+        if (p_commands[n].command == PC_TEXT) {
+            return false;
+        }
+    }
+
+    if (p_curr_point == 0) {
+        return false;
+    }
+
+    bounds = kRect(p_points[0].x, p_points[0].y, p_points[0].x, p_points[0].y);
+    for (size_t n = 1; n < p_curr_point; ++n) {
+        const kPoint &p = p_points[n];
+        bounds.left = c_util::umin(bounds.left, p.x);
+        bounds.top = c_util::umin(bounds.top, p.y);
+        bounds.right = c_util::umax(bounds.right, p.x);
+        bounds.bottom = c_util::umax(bounds.bottom, p.y);
+    }
+
+    return true;
+}
+
 void kPathImplDefault::AddCommand(CommandType command, size_t point_count)
 {
     if (p_curr_command + 1 > p_commands.size()) {
@@ -161,6 +205,256 @@ void kPathImplDefault::AddPoint(const kPoint &point)
 kCanvasImpl::~kCanvasImpl()
 {}
 
+bool kCanvasImpl::ConcurrentTiles() const
+{
+    return false;
+}
+
+void kCanvasImpl::Rectangles(const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush)
+{
+    for (size_t n = 0; n < count; ++n) {
+        Rectangle(rects[n], pen, brush);
+    }
+}
+
+void kCanvasImpl::Ellipses(const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush)
+{
+    for (size_t n = 0; n < count; ++n) {
+        Ellipse(rects[n], pen, brush);
+    }
+}
+
+void kCanvasImpl::Lines(const kPoint *points, size_t count, const kPenBase *pen)
+{
+    for (size_t n = 0; n < count; ++n) {
+        Line(points[n * 2], points[n * 2 + 1], pen);
+    }
+}
+
+void kCanvasImpl::Points(const kPoint *points, size_t count, kScalar size, const kBrushBase *brush)
+{
+    kScalar radius = size * 0.5f;
+    for (size_t n = 0; n < count; ++n) {
+        Ellipse(
+            kRect(points[n].x - radius, points[n].y - radius, points[n].x + radius, points[n].y + radius),
+            nullptr, brush
+        );
+    }
+}
+
+void kCanvasImpl::PushLayer(const kRect &bounds, kScalar opacity, kBlendMode blend)
+{
+    BeginClippedDrawingByRect(bounds);
+}
+
+void kCanvasImpl::PopLayer()
+{
+    EndClippedDrawing();
+}
+
+void kCanvasImpl::TextRun(const TextRunWord *words, size_t count, const kFontBase *font, const kBrushBase *brush)
+{
+    for (size_t n = 0; n < count; ++n) {
+        Text(words[n].position, words[n].text, words[n].count, font, brush, kTextOrigin::Top);
+    }
+}
+
+void kCanvasImpl::DrawPathInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kTransform *transforms, size_t count)
+{
+    for (size_t n = 0; n < count; ++n) {
+        DrawPath(path, pen, brush, transforms[n]);
+    }
+}
+
+void kCanvasImpl::DrawPathInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kPoint *offsets, size_t count)
+{
+    for (size_t n = 0; n < count; ++n) {
+        DrawPath(path, pen, brush, kTransform::construct::translate(offsets[n].x, offsets[n].y));
+    }
+}
+
+kRect kCanvasImpl::DeviceBounds(const kRect &rect, const kPenBase *pen, const kTransform &transform)
+{
+    kRect local = rect;
+
+    if (pen) {
+        kScalar extent = resourceData<PenData>(pen).p_width * PEN_EXTENT;
+        local = kRect(local.left - extent, local.top - extent, local.right + extent, local.bottom + extent);
+    }
+
+    const kTransform &t = transform;
+    kPoint corners[4] = {
+        kPoint(local.left, local.top), kPoint(local.right, local.top),
+        kPoint(local.right, local.bottom), kPoint(local.left, local.bottom)
+    };
+
+    kRect result;
+    for (size_t n = 0; n < 4; ++n) {
+        kScalar x = t.m00 * corners[n].x + t.m10 * corners[n].y + t.m20;
+        kScalar y = t.m01 * corners[n].x + t.m11 * corners[n].y + t.m21;
+
+        if (n == 0) {
+            result = kRect(x, y, x, y);
+        } else {
+            result.left = umin(result.left, x);
+            result.top = umin(result.top, y);
+            result.right = umax(result.right, x);
+            result.bottom = umax(result.bottom, y);
+        }
+    }
+
+    // antialiased edges touch neighbour pixels
+    return kRect(result.left - 1, result.top - 1, result.right + 1, result.bottom + 1);
+}
+
+kRect kCanvasImpl::PointBounds(const kPoint *points, size_t count, const kPenBase *pen, const kTransform &transform)
+{
+    if (count == 0) {
+        return kRect();
+    }
+
+    kRect rect(points[0].x, points[0].y, points[0].x, points[0].y);
+    for (size_t n = 1; n < count; ++n) {
+        rect.left = umin(rect.left, points[n].x);
+        rect.top = umin(rect.top, points[n].y);
+        rect.right = umax(rect.right, points[n].x);
+        rect.bottom = umax(rect.bottom, points[n].y);
+    }
+
+    return DeviceBounds(rect, pen, transform);
+}
+
+kRect kCanvasImpl::DeviceBounds(const kRect &rect, const kTransform &local, const kPenBase *pen, const kTransform &transform)
+{
+    kPoint corners[4] = {
+        kPoint(rect.left, rect.top), kPoint(rect.right, rect.top),
+        kPoint(rect.right, rect.bottom), kPoint(rect.left, rect.bottom)
+    };
+    for (size_t n = 0; n < 4; ++n) {
+        kPoint p = corners[n];
+        corners[n] = kPoint(
+            local.m00 * p.x + local.m10 * p.y + local.m20,
+            local.m01 * p.x + local.m11 * p.y + local.m21
+        );
+    }
+
+    return PointBounds(corners, 4, pen, transform);
+}
+
+kRect kCanvasImpl::TextBounds(const kPoint &p, const char *text, size_t count, const kFontBase *font)
+{
+    kSize size = TextSize(text, count, font);
+    return kRect(
+        p.x - size.height * 0.5f, p.y - size.height,
+        p.x + size.width + size.height * 0.5f, p.y + size.height
+    );
+}
+
+kRect kCanvasImpl::TextRunBounds(const TextRunWord *words, size_t count, const kFontBase *font)
+{
+    kRect rect;
+    for (size_t n = 0; n < count; ++n) {
+        const TextRunWord &word = words[n];
+        kSize size = TextSize(word.text, word.count, font);
+        kRect wordrect(
+            word.position.x - size.height * 0.5f, word.position.y,
+            word.position.x + size.width + size.height * 0.5f, word.position.y + size.height
+        );
+
+        if (n == 0) {
+            rect = wordrect;
+        } else {
+            rect.left = umin(rect.left, wordrect.left);
+            rect.top = umin(rect.top, wordrect.top);
+            rect.right = umax(rect.right, wordrect.right);
+            rect.bottom = umax(rect.bottom, wordrect.bottom);
+        }
+    }
+
+    return rect;
+}
+
+void kCanvasImpl::DrawBitmaps(const kBitmapImpl *atlas, const kSpriteInstance *instances, size_t count, const kTransform &transform)
+{
+    bool transformed = false;
+
+    for (size_t n = 0; n < count; ++n) {
+        const kSpriteInstance &sprite = instances[n];
+
+        if (!IsIdentity(sprite.transform)) {
+            SetTransform(transform * sprite.transform);
+            transformed = true;
+        } else if (transformed) {
+            SetTransform(transform);
+            transformed = false;
+        }
+
+        DrawBitmap(
+            atlas,
+            kPoint(sprite.dest.left, sprite.dest.top), kSize(sprite.dest.width(), sprite.dest.height()),
+            kPoint(sprite.source.left, sprite.source.top), kSize(sprite.source.width(), sprite.source.height()),
+            sprite.alpha
+        );
+    }
+
+    if (transformed) {
+        SetTransform(transform);
+    }
+}
+
+
+
+/*
+ -------------------------------------------------------------------------------
+ kBitmapImpl implementation
+ -------------------------------------------------------------------------------
+*/
+
+void kBitmapImpl::InitializeMapped(size_t width, size_t height, kBitmapFormat format, const char *path)
+{
+    Initialize(width, height, format);
+}
+
+void kBitmapImpl::InitializeWithData(
+    size_t width, size_t height, kBitmapFormat format, size_t pitch, void *data,
+    kBitmapReleaseProc release, void *context
+)
+{
+    Initialize(width, height, format);
+    Update(nullptr, format, pitch, data);
+
+    if (release) {
+        release(data, context);
+    }
+}
+
+bool kBitmapImpl::EncodePNG(kImageSink &sink)
+{
+    return false;
+}
+
+bool kBitmapImpl::Read(const kRectInt *readrect, kBitmapFormat destformat, size_t destpitch, void *data)
+{
+    return false;
+}
+
+void* kBitmapImpl::Lock(size_t &pitch)
+{
+    pitch = 0;
+    return nullptr;
+}
+
+void kBitmapImpl::Unlock(const kRectInt *dirtyrect)
+{}
+
+void kBitmapImpl::SetMipmaps(bool enable)
+{}
+
+bool kBitmapImpl::Allocated() const
+{
+    return true;
+}
+
 
 
 /*
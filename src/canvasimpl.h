@@ -21,6 +21,8 @@
 
 namespace k_canvas
 {
+    class kImageSink;
+
     namespace impl
     {
         /*
@@ -57,6 +59,10 @@ namespace k_canvas
             virtual void Commit() = 0;
 
             virtual void FromPath(const kPathImpl *source, const kTransform &transform) = 0;
+
+            // bounding box of path control points, returns false if bounds
+            // are unknown (default) or path has no points
+            virtual bool Bounds(kRect &bounds) const;
         };
 
 
@@ -84,6 +90,8 @@ namespace k_canvas
             void Clear() override;
             void Commit() override;
 
+            bool Bounds(kRect &bounds) const override;
+
         protected:
             enum CommandType
             {
@@ -135,6 +143,50 @@ namespace k_canvas
         public:
             virtual void Initialize(size_t width, size_t height, kBitmapFormat format) = 0;
             virtual void Update(const kRectInt *updaterect, kBitmapFormat sourceformat, size_t sourceputch, const void *data) = 0;
+
+            // initialize with memory mapped storage, default implementation
+            // uses regular memory
+            virtual void InitializeMapped(size_t width, size_t height, kBitmapFormat format, const char *path);
+
+            // initialize over caller owned memory, default implementation
+            // copies pixels into own storage and releases memory immediately
+            virtual void InitializeWithData(
+                size_t width, size_t height, kBitmapFormat format, size_t pitch, void *data,
+                kBitmapReleaseProc release, void *context
+            );
+
+            // PNG encoding, default implementation doesn't provide it
+            virtual bool EncodePNG(kImageSink &sink);
+
+            // pixel data readback, default implementation doesn't provide it
+            virtual bool Read(const kRectInt *readrect, kBitmapFormat destformat, size_t destpitch, void *data);
+
+            // direct pixel access, default implementation doesn't provide it
+            virtual void* Lock(size_t &pitch);
+            virtual void Unlock(const kRectInt *dirtyrect);
+
+            // reduced copies for downscaled drawing, default implementation
+            // doesn't provide them
+            virtual void SetMipmaps(bool enable);
+
+            // false if pixels requested by last initialization couldn't be
+            // allocated, bitmap is left empty then, true by default
+            virtual bool Allocated() const;
+        };
+
+
+        /*
+         -------------------------------------------------------------------------------
+         TextRunWord
+         -------------------------------------------------------------------------------
+            single positioned piece of text inside text run
+            text runs are produced by text layout and rendered with one TextRun() call
+        */
+        struct TextRunWord
+        {
+            const char *text;     // word text, not null terminated
+            size_t      count;    // word text length in bytes
+            kPoint      position; // top left word position
         };
 
 
@@ -150,6 +202,12 @@ namespace k_canvas
             virtual ~kCanvasImpl();
 
             virtual void Clear() = 0;
+            // sets pixels under rectangle to given color without blending
+            virtual void Clear(const kRect &rect, const kColor &color) = 0;
+
+            // true if several canvases can be bound to different parts of the
+            // same bitmap and render on separate threads, false by default
+            virtual bool ConcurrentTiles() const;
 
             virtual bool BindToBitmap(const kBitmapImpl *target, const kRectInt *rect) = 0;
             virtual bool BindToContext(kContext context, const kRectInt *rect) = 0;
@@ -167,24 +225,65 @@ namespace k_canvas
             virtual void Polygon(const kPoint *points, size_t count, const kPenBase *pen, const kBrushBase *brush) = 0;
             virtual void PolygonBezier(const kPoint *points, size_t count, const kPenBase *pen, const kBrushBase *brush) = 0;
 
+            // batched primitives, all items are filled and stroked as single shape
+            // default implementations draw items one by one
+            virtual void Rectangles(const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush);
+            virtual void Ellipses(const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush);
+            virtual void Lines(const kPoint *points, size_t count, const kPenBase *pen);
+            virtual void Points(const kPoint *points, size_t count, kScalar size, const kBrushBase *brush);
+
             virtual void DrawPath(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush) = 0;
             virtual void DrawPath(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kTransform &transform) = 0;
+            // default implementations draw instances one by one with DrawPath()
+            virtual void DrawPathInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kTransform *transforms, size_t count);
+            virtual void DrawPathInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kPoint *offsets, size_t count);
             virtual void DrawBitmap(const kBitmapImpl *bitmap, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize, kScalar sourcealpha) = 0;
             virtual void DrawMask(const kBitmapImpl *mask, kBrushBase *brush, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize) = 0;
+            // transform is current canvas transform, instance transforms are
+            // applied before it, canvas transform is in effect after the call
+            // default implementation draws sprites one by one with DrawBitmap()
+            virtual void DrawBitmaps(const kBitmapImpl *atlas, const kSpriteInstance *instances, size_t count, const kTransform &transform);
 
             virtual void GetFontMetrics(const kFontBase *font, kFontMetrics &metrics) = 0;
             virtual void GetGlyphMetrics(const kFontBase *font, size_t first, size_t last, kGlyphMetrics *metrics) = 0;
             virtual kSize TextSize(const char *text, size_t count, const kFontBase *font) = 0;
             virtual void Text(const kPoint &p, const char *text, size_t count, const kFontBase *font, const kBrushBase *brush, kTextOrigin origin) = 0;
+            // default implementation renders run word by word with Text() calls
+            virtual void TextRun(const TextRunWord *words, size_t count, const kFontBase *font, const kBrushBase *brush);
 
             virtual void BeginClippedDrawingByMask(const kBitmapImpl *mask, const kTransform &transform, kExtendType xextend, kExtendType yextend) = 0;
             virtual void BeginClippedDrawingByPath(const kPathImpl *clip, const kTransform &transform) = 0;
             virtual void BeginClippedDrawingByRect(const kRect &clip) = 0;
             virtual void EndClippedDrawing() = 0;
 
+            // layers share stack with clipping, default implementation only
+            // clips drawing by layer bounds
+            virtual void PushLayer(const kRect &bounds, kScalar opacity, kBlendMode blend);
+            virtual void PopLayer();
+
             virtual void SetTransform(const kTransform &transform) = 0;
 
+            // conservative device bounds of local rectangle or points drawn
+            // with pen under transform, antialiased edges are included
+            static kRect DeviceBounds(const kRect &rect, const kPenBase *pen, const kTransform &transform);
+            static kRect PointBounds(const kPoint *points, size_t count, const kPenBase *pen, const kTransform &transform);
+            // the same for rectangle with its own transform applied first
+            static kRect DeviceBounds(const kRect &rect, const kTransform &local, const kPenBase *pen, const kTransform &transform);
+
         protected:
+            static inline bool IsIdentity(const kTransform &transform)
+            {
+                return
+                    transform.m00 == 1 && transform.m01 == 0 &&
+                    transform.m10 == 0 && transform.m11 == 1 &&
+                    transform.m20 == 0 && transform.m21 == 0;
+            }
+
+            // local boxes of text, extended by text height above (for baseline
+            // origin) and by half of its height at sides (for overhanging glyphs)
+            kRect TextBounds(const kPoint &p, const char *text, size_t count, const kFontBase *font);
+            kRect TextRunBounds(const TextRunWord *words, size_t count, const kFontBase *font);
+
             // access to resource data
             template <typename T, typename R>
             static inline const T& resourceData(const R *resource)
@@ -0,0 +1,818 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    canvasrecorder.cpp
+        recording canvas implementation and tiled replay
+*/
+
+#include "canvasrecorder.h"
+#include <thread>
+#include <atomic>
+
+
+using namespace k_canvas;
+using namespace impl;
+using namespace c_util;
+
+
+// bounds of commands which can touch any pixel
+static const kRect UNBOUNDED(
+    -std::numeric_limits<kScalar>::max(), -std::numeric_limits<kScalar>::max(),
+    std::numeric_limits<kScalar>::max(), std::numeric_limits<kScalar>::max()
+);
+
+static inline bool Intersects(const kRect &a, const kRect &b)
+{
+    return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+}
+
+static inline kRect Unite(const kRect &a, const kRect &b)
+{
+    return kRect(umin(a.left, b.left), umin(a.top, b.top), umax(a.right, b.right), umax(a.bottom, b.bottom));
+}
+
+
+/*
+ -------------------------------------------------------------------------------
+ kCanvasImplRecorder implementation
+ -------------------------------------------------------------------------------
+*/
+
+kCanvasImplRecorder::kCanvasImplRecorder(kCanvasImpl *measure) :
+    p_measure(measure),
+    p_transform()
+{}
+
+kCanvasImplRecorder::~kCanvasImplRecorder()
+{
+    Reset();
+    delete p_measure;
+}
+
+void kCanvasImplRecorder::Clear()
+{
+    AddDrawing(RC_CLEAR, UNBOUNDED, nullptr, nullptr);
+}
+
+void kCanvasImplRecorder::Clear(const kRect &rect, const kColor &color)
+{
+    AddDrawing(RC_CLEARRECT, DeviceBounds(rect, nullptr, p_transform), nullptr, nullptr);
+
+    Command &command = p_commands.back();
+    command.rect = rect;
+    command.color = color;
+}
+
+bool kCanvasImplRecorder::ConcurrentTiles() const
+{
+    return p_measure->ConcurrentTiles();
+}
+
+bool kCanvasImplRecorder::BindToBitmap(const kBitmapImpl *target, const kRectInt *rect)
+{
+    return false;
+}
+
+bool kCanvasImplRecorder::BindToContext(kContext context, const kRectInt *rect)
+{
+    return false;
+}
+
+bool kCanvasImplRecorder::BindToPrinter(kPrinter printer)
+{
+    return false;
+}
+
+bool kCanvasImplRecorder::Unbind()
+{
+    return false;
+}
+
+void kCanvasImplRecorder::Line(const kPoint &a, const kPoint &b, const kPenBase *pen)
+{
+    kPoint points[2] = { a, b };
+    AddDrawing(RC_LINE, PointBounds(points, 2, pen, p_transform), pen, nullptr);
+    p_commands.back().first = AddPoints(points, 2);
+}
+
+void kCanvasImplRecorder::Bezier(const kPoint &p1, const kPoint &p2, const kPoint &p3, const kPoint &p4, const kPenBase *pen)
+{
+    // curve lies inside of its control points hull
+    kPoint points[4] = { p1, p2, p3, p4 };
+    AddDrawing(RC_BEZIER, PointBounds(points, 4, pen, p_transform), pen, nullptr);
+    p_commands.back().first = AddPoints(points, 4);
+}
+
+void kCanvasImplRecorder::PolyLine(const kPoint *points, size_t count, const kPenBase *pen)
+{
+    AddDrawing(RC_POLYLINE, PointBounds(points, count, pen, p_transform), pen, nullptr);
+    p_commands.back().first = AddPoints(points, count);
+    p_commands.back().count = count;
+}
+
+void kCanvasImplRecorder::PolyBezier(const kPoint *points, size_t count, const kPenBase *pen)
+{
+    AddDrawing(RC_POLYBEZIER, PointBounds(points, count, pen, p_transform), pen, nullptr);
+    p_commands.back().first = AddPoints(points, count);
+    p_commands.back().count = count;
+}
+
+void kCanvasImplRecorder::Rectangle(const kRect &rect, const kPenBase *pen, const kBrushBase *brush)
+{
+    AddDrawing(RC_RECTANGLE, DeviceBounds(rect, pen, p_transform), pen, brush);
+    p_commands.back().rect = rect;
+}
+
+void kCanvasImplRecorder::RoundedRectangle(const kRect &rect, const kSize &round, const kPenBase *pen, const kBrushBase *brush)
+{
+    AddDrawing(RC_ROUNDEDRECTANGLE, DeviceBounds(rect, pen, p_transform), pen, brush);
+    p_commands.back().rect = rect;
+    p_commands.back().size = round;
+}
+
+void kCanvasImplRecorder::Ellipse(const kRect &rect, const kPenBase *pen, const kBrushBase *brush)
+{
+    AddDrawing(RC_ELLIPSE, DeviceBounds(rect, pen, p_transform), pen, brush);
+    p_commands.back().rect = rect;
+}
+
+void kCanvasImplRecorder::Polygon(const kPoint *points, size_t count, const kPenBase *pen, const kBrushBase *brush)
+{
+    AddDrawing(RC_POLYGON, PointBounds(points, count, pen, p_transform), pen, brush);
+    p_commands.back().first = AddPoints(points, count);
+    p_commands.back().count = count;
+}
+
+void kCanvasImplRecorder::PolygonBezier(const kPoint *points, size_t count, const kPenBase *pen, const kBrushBase *brush)
+{
+    AddDrawing(RC_POLYGONBEZIER, PointBounds(points, count, pen, p_transform), pen, brush);
+    p_commands.back().first = AddPoints(points, count);
+    p_commands.back().count = count;
+}
+
+void kCanvasImplRecorder::Rectangles(const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush)
+{
+    AddRects(RC_RECTANGLES, rects, count, pen, brush);
+}
+
+void kCanvasImplRecorder::Ellipses(const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush)
+{
+    AddRects(RC_ELLIPSES, rects, count, pen, brush);
+}
+
+void kCanvasImplRecorder::Lines(const kPoint *points, size_t count, const kPenBase *pen)
+{
+    if (count == 0) {
+        return;
+    }
+
+    // every line takes two points
+    AddDrawing(RC_LINES, PointBounds(points, count * 2, pen, p_transform), pen, nullptr);
+    p_commands.back().first = AddPoints(points, count * 2);
+    p_commands.back().count = count;
+}
+
+void kCanvasImplRecorder::Points(const kPoint *points, size_t count, kScalar size, const kBrushBase *brush)
+{
+    if (count == 0) {
+        return;
+    }
+
+    kScalar radius = size * 0.5f;
+    kRect local(points[0].x, points[0].y, points[0].x, points[0].y);
+    for (size_t n = 1; n < count; ++n) {
+        local = Unite(local, kRect(points[n].x, points[n].y, points[n].x, points[n].y));
+    }
+    local = kRect(local.left - radius, local.top - radius, local.right + radius, local.bottom + radius);
+
+    AddDrawing(RC_POINTS, DeviceBounds(local, nullptr, p_transform), nullptr, brush);
+    p_commands.back().first = AddPoints(points, count);
+    p_commands.back().count = count;
+    p_commands.back().alpha = size;
+}
+
+void kCanvasImplRecorder::DrawPath(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush)
+{
+    kRect bounds;
+    AddDrawing(RC_PATH, path->Bounds(bounds) ? DeviceBounds(bounds, pen, p_transform) : UNBOUNDED, pen, brush);
+
+    const_cast<kPathImpl*>(path)->addref();
+    p_commands.back().path = path;
+}
+
+void kCanvasImplRecorder::DrawPath(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kTransform &transform)
+{
+    kRect bounds;
+    if (path->Bounds(bounds)) {
+        // path transform is applied first, then canvas transform
+        AddDrawing(RC_PATHTRANSFORMED, DeviceBounds(bounds, transform, pen, p_transform), pen, brush);
+    } else {
+        AddDrawing(RC_PATHTRANSFORMED, UNBOUNDED, pen, brush);
+    }
+
+    const_cast<kPathImpl*>(path)->addref();
+    p_commands.back().path = path;
+    p_commands.back().transform = transform;
+}
+
+void kCanvasImplRecorder::DrawPathInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kTransform *transforms, size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+
+    kRect bounds;
+    if (path->Bounds(bounds)) {
+        kRect device = DeviceBounds(bounds, transforms[0], pen, p_transform);
+        for (size_t n = 1; n < count; ++n) {
+            device = Unite(device, DeviceBounds(bounds, transforms[n], pen, p_transform));
+        }
+        AddDrawing(RC_PATHINSTANCES, device, pen, brush);
+    } else {
+        AddDrawing(RC_PATHINSTANCES, UNBOUNDED, pen, brush);
+    }
+
+    const_cast<kPathImpl*>(path)->addref();
+
+    Command &command = p_commands.back();
+    command.path = path;
+    command.first = p_transforms.size();
+    command.count = count;
+
+    p_transforms.insert(p_transforms.end(), transforms, transforms + count);
+}
+
+void kCanvasImplRecorder::DrawPathInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kPoint *offsets, size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+
+    kRect bounds;
+    if (path->Bounds(bounds)) {
+        // path bounds moved by extreme offsets cover all instances
+        kRect range(offsets[0].x, offsets[0].y, offsets[0].x, offsets[0].y);
+        for (size_t n = 1; n < count; ++n) {
+            range = Unite(range, kRect(offsets[n].x, offsets[n].y, offsets[n].x, offsets[n].y));
+        }
+        kRect local(
+            bounds.left + range.left, bounds.top + range.top,
+            bounds.right + range.right, bounds.bottom + range.bottom
+        );
+        AddDrawing(RC_PATHOFFSETS, DeviceBounds(local, pen, p_transform), pen, brush);
+    } else {
+        AddDrawing(RC_PATHOFFSETS, UNBOUNDED, pen, brush);
+    }
+
+    const_cast<kPathImpl*>(path)->addref();
+
+    Command &command = p_commands.back();
+    command.path = path;
+    command.first = AddPoints(offsets, count);
+    command.count = count;
+}
+
+void kCanvasImplRecorder::DrawBitmap(const kBitmapImpl *bitmap, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize, kScalar sourcealpha)
+{
+    kRect rect(origin.x, origin.y, origin.x + destsize.width, origin.y + destsize.height);
+    AddDrawing(RC_BITMAP, DeviceBounds(rect, nullptr, p_transform), nullptr, nullptr);
+
+    const_cast<kBitmapImpl*>(bitmap)->addref();
+
+    Command &command = p_commands.back();
+    command.bitmap = bitmap;
+    command.origin = origin;
+    command.size = destsize;
+    command.source = source;
+    command.sourcesize = sourcesize;
+    command.alpha = sourcealpha;
+}
+
+void kCanvasImplRecorder::DrawMask(const kBitmapImpl *mask, kBrushBase *brush, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize)
+{
+    kRect rect(origin.x, origin.y, origin.x + destsize.width, origin.y + destsize.height);
+    AddDrawing(RC_MASK, DeviceBounds(rect, nullptr, p_transform), nullptr, brush);
+
+    const_cast<kBitmapImpl*>(mask)->addref();
+
+    Command &command = p_commands.back();
+    command.bitmap = mask;
+    command.origin = origin;
+    command.size = destsize;
+    command.source = source;
+    command.sourcesize = sourcesize;
+}
+
+void kCanvasImplRecorder::DrawBitmaps(const kBitmapImpl *atlas, const kSpriteInstance *instances, size_t count, const kTransform &transform)
+{
+    if (count == 0) {
+        return;
+    }
+
+    kRect device = DeviceBounds(instances[0].dest, instances[0].transform, nullptr, transform);
+    for (size_t n = 1; n < count; ++n) {
+        device = Unite(device, DeviceBounds(instances[n].dest, instances[n].transform, nullptr, transform));
+    }
+    AddDrawing(RC_BITMAPS, device, nullptr, nullptr);
+
+    const_cast<kBitmapImpl*>(atlas)->addref();
+
+    Command &command = p_commands.back();
+    command.bitmap = atlas;
+    command.transform = transform;
+    command.first = p_sprites.size();
+    command.count = count;
+
+    p_sprites.insert(p_sprites.end(), instances, instances + count);
+}
+
+void kCanvasImplRecorder::GetFontMetrics(const kFontBase *font, kFontMetrics &metrics)
+{
+    p_measure->GetFontMetrics(font, metrics);
+}
+
+void kCanvasImplRecorder::GetGlyphMetrics(const kFontBase *font, size_t first, size_t last, kGlyphMetrics *metrics)
+{
+    p_measure->GetGlyphMetrics(font, first, last, metrics);
+}
+
+kSize kCanvasImplRecorder::TextSize(const char *text, size_t count, const kFontBase *font)
+{
+    return p_measure->TextSize(text, count, font);
+}
+
+void kCanvasImplRecorder::Text(const kPoint &p, const char *text, size_t count, const kFontBase *font, const kBrushBase *brush, kTextOrigin origin)
+{
+    AddDrawing(RC_TEXT, DeviceBounds(TextBounds(p, text, count, font), nullptr, p_transform), nullptr, brush);
+
+    Command &command = p_commands.back();
+    command.origin = p;
+    command.first = p_text.size();
+    command.count = count;
+    command.font = AddResource(font, p_fonts);
+    command.textorigin = origin;
+
+    p_text.insert(p_text.end(), text, text + count);
+}
+
+void kCanvasImplRecorder::TextRun(const TextRunWord *words, size_t count, const kFontBase *font, const kBrushBase *brush)
+{
+    if (count == 0) {
+        return;
+    }
+
+    AddDrawing(RC_TEXTRUN, DeviceBounds(TextRunBounds(words, count, font), nullptr, p_transform), nullptr, brush);
+
+    Command &command = p_commands.back();
+    command.first = p_words.size();
+    command.count = count;
+    command.font = AddResource(font, p_fonts);
+
+    // word text pointers are set before replay, text buffer
+    // can be reallocated until then
+    for (size_t n = 0; n < count; ++n) {
+        TextRunWord word = words[n];
+        p_wordtext.push_back(p_text.size());
+        p_text.insert(p_text.end(), word.text, word.text + word.count);
+        word.text = nullptr;
+        p_words.push_back(word);
+    }
+}
+
+void kCanvasImplRecorder::BeginClippedDrawingByMask(const kBitmapImpl *mask, const kTransform &transform, kExtendType xextend, kExtendType yextend)
+{
+    const_cast<kBitmapImpl*>(mask)->addref();
+
+    Command &command = AddCommand(RC_CLIPMASK);
+    command.bitmap = mask;
+    command.transform = transform;
+    command.xextend = xextend;
+    command.yextend = yextend;
+}
+
+void kCanvasImplRecorder::BeginClippedDrawingByPath(const kPathImpl *clip, const kTransform &transform)
+{
+    const_cast<kPathImpl*>(clip)->addref();
+
+    Command &command = AddCommand(RC_CLIPPATH);
+    command.path = clip;
+    command.transform = transform;
+}
+
+void kCanvasImplRecorder::BeginClippedDrawingByRect(const kRect &clip)
+{
+    AddCommand(RC_CLIPRECT).rect = clip;
+}
+
+void kCanvasImplRecorder::EndClippedDrawing()
+{
+    AddCommand(RC_CLIPEND);
+}
+
+void kCanvasImplRecorder::PushLayer(const kRect &bounds, kScalar opacity, kBlendMode blend)
+{
+    Command &command = AddCommand(RC_LAYER);
+    command.rect = bounds;
+    command.alpha = opacity;
+    command.blend = blend;
+}
+
+void kCanvasImplRecorder::PopLayer()
+{
+    AddCommand(RC_LAYEREND);
+}
+
+void kCanvasImplRecorder::SetTransform(const kTransform &transform)
+{
+    p_transform = transform;
+    AddCommand(RC_TRANSFORM).transform = transform;
+}
+
+void kCanvasImplRecorder::Reset()
+{
+    for (size_t n = 0; n < p_commands.size(); ++n) {
+        const Command &command = p_commands[n];
+        if (command.path) {
+            const_cast<kPathImpl*>(command.path)->release();
+        }
+        if (command.bitmap) {
+            const_cast<kBitmapImpl*>(command.bitmap)->release();
+        }
+    }
+
+    for (size_t n = 0; n < p_pens.size(); ++n) {
+        delete p_pens[n];
+    }
+    for (size_t n = 0; n < p_brushes.size(); ++n) {
+        delete p_brushes[n];
+    }
+    for (size_t n = 0; n < p_fonts.size(); ++n) {
+        delete p_fonts[n];
+    }
+
+    p_commands.clear();
+    p_points.clear();
+    p_rects.clear();
+    p_transforms.clear();
+    p_sprites.clear();
+    p_text.clear();
+    p_words.clear();
+    p_wordtext.clear();
+    p_pens.clear();
+    p_brushes.clear();
+    p_fonts.clear();
+    p_resourceindex.clear();
+
+    // next recording starts with transform canvas has now
+    AddCommand(RC_TRANSFORM).transform = p_transform;
+}
+
+kCanvasImplRecorder::Command& kCanvasImplRecorder::AddCommand(CommandType type)
+{
+    Command command = {};
+    command.type = type;
+    command.bounds = UNBOUNDED;
+    command.pen = -1;
+    command.brush = -1;
+    command.font = -1;
+
+    p_commands.push_back(command);
+    return p_commands.back();
+}
+
+void kCanvasImplRecorder::AddDrawing(CommandType type, const kRect &bounds, const kPenBase *pen, const kBrushBase *brush)
+{
+    Command &command = AddCommand(type);
+    command.bounds = bounds;
+    command.pen = pen ? AddResource(pen, p_pens) : -1;
+    command.brush = brush ? AddResource(brush, p_brushes) : -1;
+}
+
+size_t kCanvasImplRecorder::AddPoints(const kPoint *points, size_t count)
+{
+    size_t first = p_points.size();
+    p_points.insert(p_points.end(), points, points + count);
+    return first;
+}
+
+void kCanvasImplRecorder::AddRects(CommandType type, const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush)
+{
+    if (count == 0) {
+        return;
+    }
+
+    // rectangles may have any orientation
+    kRect local;
+    for (size_t n = 0; n < count; ++n) {
+        const kRect &r = rects[n];
+        kRect normalized(umin(r.left, r.right), umin(r.top, r.bottom), umax(r.left, r.right), umax(r.top, r.bottom));
+        local = n ? Unite(local, normalized) : normalized;
+    }
+
+    AddDrawing(type, DeviceBounds(local, pen, p_transform), pen, brush);
+    p_commands.back().first = p_rects.size();
+    p_commands.back().count = count;
+
+    p_rects.insert(p_rects.end(), rects, rects + count);
+}
+
+template <typename Tdata>
+int kCanvasImplRecorder::AddResource(const kSharedResourceBase<Tdata> *resource, std::vector<Resource<Tdata>*> &list)
+{
+    void *key = native(resource)[0];
+
+    if (key) {
+        std::unordered_map<void*, int>::const_iterator it = p_resourceindex.find(key);
+        if (it != p_resourceindex.end()) {
+            return it->second;
+        }
+    }
+
+    int index = int(list.size());
+    list.push_back(new Resource<Tdata>(*resource));
+
+    if (key) {
+        p_resourceindex[key] = index;
+    }
+
+    return index;
+}
+
+
+/*
+ -------------------------------------------------------------------------------
+ tiled replay
+ -------------------------------------------------------------------------------
+    tiles are taken from shared list by worker threads, every worker
+    has its own implementation canvas which is bound to tile rectangle
+    of the target bitmap, so workers don't share any drawing state
+*/
+
+struct kCanvasImplRecorder::TileWorker
+{
+    const kCanvasImplRecorder   *recorder;
+    kCanvasImpl                 *canvas;
+    const kBitmapImpl           *target;
+    const std::vector<kRectInt> *tiles;
+    std::atomic<size_t>         *next;
+
+    void operator()() const
+    {
+        for (size_t n = (*next)++; n < tiles->size(); n = (*next)++) {
+            recorder->RenderTile(canvas, target, (*tiles)[n]);
+        }
+    }
+};
+
+size_t kCanvasImplRecorder::Rasterize(const kBitmapImpl *target, size_t width, size_t height, size_t tilesize, size_t threads, size_t &tiles)
+{
+    tilesize = umax(tilesize, size_t(1));
+    size_t columns = (width + tilesize - 1) / tilesize;
+    size_t rows = (height + tilesize - 1) / tilesize;
+    tiles = columns * rows;
+
+    if (tiles == 0) {
+        return 0;
+    }
+
+    // mark tiles touched by drawing commands
+    std::vector<bool> touched(tiles, false);
+    for (size_t n = 0; n < p_commands.size(); ++n) {
+        const Command &command = p_commands[n];
+        if (command.type >= RC_CLIPMASK) {
+            continue;
+        }
+
+        kRect b = command.bounds;
+        if (b.right <= 0 || b.bottom <= 0 || b.left >= kScalar(width) || b.top >= kScalar(height) ||
+            b.right <= b.left || b.bottom <= b.top) {
+            continue;
+        }
+
+        size_t left = b.left > 0 ? size_t(b.left) / tilesize : 0;
+        size_t top = b.top > 0 ? size_t(b.top) / tilesize : 0;
+        size_t right = b.right < kScalar(width) ? size_t(b.right) / tilesize : columns - 1;
+        size_t bottom = b.bottom < kScalar(height) ? size_t(b.bottom) / tilesize : rows - 1;
+
+        for (size_t y = top; y <= bottom; ++y) {
+            for (size_t x = left; x <= right; ++x) {
+                touched[y * columns + x] = true;
+            }
+        }
+    }
+
+    std::vector<kRectInt> active;
+    for (size_t y = 0; y < rows; ++y) {
+        for (size_t x = 0; x < columns; ++x) {
+            if (touched[y * columns + x]) {
+                active.push_back(kRectInt(
+                    int(x * tilesize), int(y * tilesize),
+                    int(umin((x + 1) * tilesize, width)), int(umin((y + 1) * tilesize, height))
+                ));
+            }
+        }
+    }
+
+    if (active.empty()) {
+        return 0;
+    }
+
+    // recorded text doesn't move anymore
+    for (size_t n = 0; n < p_words.size(); ++n) {
+        p_words[n].text = p_text.data() + p_wordtext[n];
+    }
+
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (!p_measure->ConcurrentTiles()) {
+        threads = 1;
+    }
+    threads = umax(umin(threads, active.size()), size_t(1));
+
+    std::vector<kCanvasImpl*> canvases(threads);
+    for (size_t n = 0; n < threads; ++n) {
+        canvases[n] = CanvasFactory::CreateCanvas();
+    }
+
+    // all tiles are taken from the list concurrently, shared implementation
+    // objects (bitmap mip levels and patterns, font caches) guard themselves
+    // and recorded resources were set up while recording
+    std::atomic<size_t> next(0);
+
+    std::vector<std::thread> workers;
+    for (size_t n = 1; n < threads; ++n) {
+        TileWorker worker = { this, canvases[n], target, &active, &next };
+        workers.push_back(std::thread(worker));
+    }
+
+    // calling thread takes tiles too
+    TileWorker worker = { this, canvases[0], target, &active, &next };
+    worker();
+
+    for (size_t n = 0; n < workers.size(); ++n) {
+        workers[n].join();
+    }
+
+    for (size_t n = 0; n < threads; ++n) {
+        delete canvases[n];
+    }
+
+    return active.size();
+}
+
+void kCanvasImplRecorder::RenderTile(kCanvasImpl *canvas, const kBitmapImpl *target, const kRectInt &tile) const
+{
+    if (canvas->BindToBitmap(target, &tile)) {
+        Replay(canvas, kRect(kScalar(tile.left), kScalar(tile.top), kScalar(tile.right), kScalar(tile.bottom)));
+        canvas->Unbind();
+    }
+}
+
+void kCanvasImplRecorder::Replay(kCanvasImpl *canvas, const kRect &cull) const
+{
+    for (size_t n = 0; n < p_commands.size(); ++n) {
+        const Command &c = p_commands[n];
+
+        if (c.type < RC_CLIPMASK && !Intersects(c.bounds, cull)) {
+            continue;
+        }
+
+        const kPenBase *pen = c.pen >= 0 ? p_pens[c.pen] : nullptr;
+        kBrushBase *brush = c.brush >= 0 ? p_brushes[c.brush] : nullptr;
+        const kFontBase *font = c.font >= 0 ? p_fonts[c.font] : nullptr;
+        const kPoint *points = p_points.data() + c.first;
+
+        switch (c.type) {
+            case RC_CLEAR:
+                canvas->Clear();
+                break;
+
+            case RC_CLEARRECT:
+                canvas->Clear(c.rect, c.color);
+                break;
+
+            case RC_LINE:
+                canvas->Line(points[0], points[1], pen);
+                break;
+
+            case RC_BEZIER:
+                canvas->Bezier(points[0], points[1], points[2], points[3], pen);
+                break;
+
+            case RC_POLYLINE:
+                canvas->PolyLine(points, c.count, pen);
+                break;
+
+            case RC_POLYBEZIER:
+                canvas->PolyBezier(points, c.count, pen);
+                break;
+
+            case RC_RECTANGLE:
+                canvas->Rectangle(c.rect, pen, brush);
+                break;
+
+            case RC_ROUNDEDRECTANGLE:
+                canvas->RoundedRectangle(c.rect, c.size, pen, brush);
+                break;
+
+            case RC_ELLIPSE:
+                canvas->Ellipse(c.rect, pen, brush);
+                break;
+
+            case RC_POLYGON:
+                canvas->Polygon(points, c.count, pen, brush);
+                break;
+
+            case RC_POLYGONBEZIER:
+                canvas->PolygonBezier(points, c.count, pen, brush);
+                break;
+
+            case RC_RECTANGLES:
+                canvas->Rectangles(p_rects.data() + c.first, c.count, pen, brush);
+                break;
+
+            case RC_ELLIPSES:
+                canvas->Ellipses(p_rects.data() + c.first, c.count, pen, brush);
+                break;
+
+            case RC_LINES:
+                canvas->Lines(points, c.count, pen);
+                break;
+
+            case RC_POINTS:
+                canvas->Points(points, c.count, c.alpha, brush);
+                break;
+
+            case RC_PATH:
+                canvas->DrawPath(c.path, pen, brush);
+                break;
+
+            case RC_PATHTRANSFORMED:
+                canvas->DrawPath(c.path, pen, brush, c.transform);
+                break;
+
+            case RC_PATHINSTANCES:
+                canvas->DrawPathInstances(c.path, pen, brush, p_transforms.data() + c.first, c.count);
+                break;
+
+            case RC_PATHOFFSETS:
+                canvas->DrawPathInstances(c.path, pen, brush, points, c.count);
+                break;
+
+            case RC_BITMAP:
+                canvas->DrawBitmap(c.bitmap, c.origin, c.size, c.source, c.sourcesize, c.alpha);
+                break;
+
+            case RC_BITMAPS:
+                canvas->DrawBitmaps(c.bitmap, p_sprites.data() + c.first, c.count, c.transform);
+                break;
+
+            case RC_MASK:
+                canvas->DrawMask(c.bitmap, brush, c.origin, c.size, c.source, c.sourcesize);
+                break;
+
+            case RC_TEXT:
+                canvas->Text(c.origin, p_text.data() + c.first, c.count, font, brush, c.textorigin);
+                break;
+
+            case RC_TEXTRUN:
+                canvas->TextRun(p_words.data() + c.first, c.count, font, brush);
+                break;
+
+            case RC_CLIPMASK:
+                canvas->BeginClippedDrawingByMask(c.bitmap, c.transform, c.xextend, c.yextend);
+                break;
+
+            case RC_CLIPPATH:
+                canvas->BeginClippedDrawingByPath(c.path, c.transform);
+                break;
+
+            case RC_CLIPRECT:
+                canvas->BeginClippedDrawingByRect(c.rect);
+                break;
+
+            case RC_CLIPEND:
+                canvas->EndClippedDrawing();
+                break;
+
+            case RC_LAYER:
+                canvas->PushLayer(c.rect, c.alpha, c.blend);
+                break;
+
+            case RC_LAYEREND:
+                canvas->PopLayer();
+                break;
+
+            case RC_TRANSFORM:
+                canvas->SetTransform(c.transform);
+                break;
+        }
+    }
+}
@@ -0,0 +1,216 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    canvasrecorder.h
+        recording canvas implementation and tiled replay
+*/
+
+#pragma once
+#include "canvasimpl.h"
+#include <vector>
+#include <unordered_map>
+
+
+namespace k_canvas
+{
+    namespace impl
+    {
+        /*
+         -------------------------------------------------------------------------------
+         kCanvasImplRecorder
+         -------------------------------------------------------------------------------
+            canvas implementation which records drawing calls instead of
+            executing them, recorded calls are replayed into implementation
+            canvases bound to tiles of target bitmap
+
+            every drawing command keeps its conservative bounds in target
+            coordinates, tiles touched by no command are skipped and every
+            tile replays only commands touching it, batched primitives,
+            path instances and sprites are recorded as single command with
+            united bounds of all their items
+            resources are referenced by recorder, text measurement is done
+            by wrapped implementation canvas
+        */
+        class kCanvasImplRecorder : public kCanvasImpl
+        {
+        public:
+            // measure - implementation canvas, owned by recorder
+            kCanvasImplRecorder(kCanvasImpl *measure);
+            ~kCanvasImplRecorder() override;
+
+            void Clear() override;
+            void Clear(const kRect &rect, const kColor &color) override;
+
+            bool ConcurrentTiles() const override;
+
+            bool BindToBitmap(const kBitmapImpl *target, const kRectInt *rect) override;
+            bool BindToContext(kContext context, const kRectInt *rect) override;
+            bool BindToPrinter(kPrinter printer) override;
+            bool Unbind() override;
+
+            void Line(const kPoint &a, const kPoint &b, const kPenBase *pen) override;
+            void Bezier(const kPoint &p1, const kPoint &p2, const kPoint &p3, const kPoint &p4, const kPenBase *pen) override;
+            void PolyLine(const kPoint *points, size_t count, const kPenBase *pen) override;
+            void PolyBezier(const kPoint *points, size_t count, const kPenBase *pen) override;
+
+            void Rectangle(const kRect &rect, const kPenBase *pen, const kBrushBase *brush) override;
+            void RoundedRectangle(const kRect &rect, const kSize &round, const kPenBase *pen, const kBrushBase *brush) override;
+            void Ellipse(const kRect &rect, const kPenBase *pen, const kBrushBase *brush) override;
+            void Polygon(const kPoint *points, size_t count, const kPenBase *pen, const kBrushBase *brush) override;
+            void PolygonBezier(const kPoint *points, size_t count, const kPenBase *pen, const kBrushBase *brush) override;
+
+            void Rectangles(const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush) override;
+            void Ellipses(const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush) override;
+            void Lines(const kPoint *points, size_t count, const kPenBase *pen) override;
+            void Points(const kPoint *points, size_t count, kScalar size, const kBrushBase *brush) override;
+
+            void DrawPath(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush) override;
+            void DrawPath(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kTransform &transform) override;
+            void DrawPathInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kTransform *transforms, size_t count) override;
+            void DrawPathInstances(const kPathImpl *path, const kPenBase *pen, const kBrushBase *brush, const kPoint *offsets, size_t count) override;
+            void DrawBitmap(const kBitmapImpl *bitmap, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize, kScalar sourcealpha) override;
+            void DrawMask(const kBitmapImpl *mask, kBrushBase *brush, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize) override;
+            void DrawBitmaps(const kBitmapImpl *atlas, const kSpriteInstance *instances, size_t count, const kTransform &transform) override;
+
+            void GetFontMetrics(const kFontBase *font, kFontMetrics &metrics) override;
+            void GetGlyphMetrics(const kFontBase *font, size_t first, size_t last, kGlyphMetrics *metrics) override;
+            kSize TextSize(const char *text, size_t count, const kFontBase *font) override;
+            void Text(const kPoint &p, const char *text, size_t count, const kFontBase *font, const kBrushBase *brush, kTextOrigin origin) override;
+            void TextRun(const TextRunWord *words, size_t count, const kFontBase *font, const kBrushBase *brush) override;
+
+            void BeginClippedDrawingByMask(const kBitmapImpl *mask, const kTransform &transform, kExtendType xextend, kExtendType yextend) override;
+            void BeginClippedDrawingByPath(const kPathImpl *clip, const kTransform &transform) override;
+            void BeginClippedDrawingByRect(const kRect &clip) override;
+            void EndClippedDrawing() override;
+
+            void PushLayer(const kRect &bounds, kScalar opacity, kBlendMode blend) override;
+            void PopLayer() override;
+
+            void SetTransform(const kTransform &transform) override;
+
+            // drops recorded commands and releases referenced objects,
+            // current transform stays in effect for next commands
+            void Reset();
+
+            // renders recorded commands into target bitmap by tiles of
+            // tilesize pixels on given number of threads (0 - hardware threads)
+            // tiles - receives total number of tiles
+            // returns number of rendered tiles
+            size_t Rasterize(const kBitmapImpl *target, size_t width, size_t height, size_t tilesize, size_t threads, size_t &tiles);
+
+        private:
+            enum CommandType
+            {
+                // drawing commands
+                RC_CLEAR,
+                RC_CLEARRECT,
+                RC_LINE,
+                RC_BEZIER,
+                RC_POLYLINE,
+                RC_POLYBEZIER,
+                RC_RECTANGLE,
+                RC_ROUNDEDRECTANGLE,
+                RC_ELLIPSE,
+                RC_POLYGON,
+                RC_POLYGONBEZIER,
+                RC_RECTANGLES,
+                RC_ELLIPSES,
+                RC_LINES,
+                RC_POINTS,
+                RC_PATH,
+                RC_PATHTRANSFORMED,
+                RC_PATHINSTANCES,
+                RC_PATHOFFSETS,
+                RC_BITMAP,
+                RC_BITMAPS,
+                RC_MASK,
+                RC_TEXT,
+                RC_TEXTRUN,
+
+                // state commands, always replayed
+                RC_CLIPMASK,
+                RC_CLIPPATH,
+                RC_CLIPRECT,
+                RC_CLIPEND,
+                RC_LAYER,
+                RC_LAYEREND,
+                RC_TRANSFORM
+            };
+
+            struct Command
+            {
+                CommandType        type;
+                kRect              bounds;     // drawing bounds in target coordinates
+                kRect              rect;       // shape or clip rectangle
+                kPoint             origin;     // bitmap origin or text position
+                kSize              size;       // round size or bitmap destination size
+                kPoint             source;
+                kSize              sourcesize;
+                kScalar            alpha;      // bitmap or layer opacity, point size
+                size_t             first;      // first point, rect, transform, sprite, word or text byte
+                size_t             count;
+                int                pen;        // resource indices, -1 if not used
+                int                brush;
+                int                font;
+                const kPathImpl   *path;       // referenced path
+                const kBitmapImpl *bitmap;     // referenced bitmap, atlas or mask
+                kTransform         transform;  // path or clip transform, canvas transform for sprites
+                kTextOrigin        textorigin;
+                kExtendType        xextend;
+                kExtendType        yextend;
+                kBlendMode         blend;
+                kColor             color;      // clear color
+            };
+
+            // copy of canvas resource object which holds its reference
+            template <typename Tdata>
+            class Resource : public kSharedResourceBase<Tdata>
+            {
+            public:
+                Resource(const kSharedResourceBase<Tdata> &source) :
+                    kSharedResourceBase<Tdata>(source)
+                {}
+            };
+
+            struct TileWorker;
+
+            Command& AddCommand(CommandType type);
+            void AddDrawing(CommandType type, const kRect &bounds, const kPenBase *pen, const kBrushBase *brush);
+            size_t AddPoints(const kPoint *points, size_t count);
+            void AddRects(CommandType type, const kRect *rects, size_t count, const kPenBase *pen, const kBrushBase *brush);
+
+            template <typename Tdata>
+            int AddResource(const kSharedResourceBase<Tdata> *resource, std::vector<Resource<Tdata>*> &list);
+
+            void RenderTile(kCanvasImpl *canvas, const kBitmapImpl *target, const kRectInt &tile) const;
+            void Replay(kCanvasImpl *canvas, const kRect &cull) const;
+
+        private:
+            kCanvasImpl                       *p_measure;
+            kTransform                         p_transform;
+
+            std::vector<Command>               p_commands;
+            std::vector<kPoint>                p_points;
+            std::vector<kRect>                 p_rects;
+            std::vector<kTransform>            p_transforms;
+            std::vector<kSpriteInstance>       p_sprites;
+            std::vector<char>                  p_text;
+            std::vector<TextRunWord>           p_words;
+            std::vector<size_t>                p_wordtext; // word text offsets in p_text
+
+            std::vector<Resource<PenData>*>    p_pens;
+            std::vector<Resource<BrushData>*>  p_brushes;
+            std::vector<Resource<FontData>*>   p_fonts;
+
+            // native resource pointer to resource index, the same resource
+            // object used by many commands is referenced once
+            std::unordered_map<void*, int>     p_resourceindex;
+        };
+    }
+}
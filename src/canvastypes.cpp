@@ -241,3 +241,15 @@ kCanvasTransformer::~kCanvasTransformer()
 {
     p_canvas.PopTransform();
 }
+
+
+kCanvasLayer::kCanvasLayer(kCanvas &canvas, const kRect &bounds, kScalar opacity, kBlendMode blend) :
+    p_canvas(canvas)
+{
+    p_canvas.PushLayer(bounds, opacity, blend);
+}
+
+kCanvasLayer::~kCanvasLayer()
+{
+    p_canvas.PopLayer();
+}
@@ -0,0 +1,251 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    groupcache.cpp
+        cache of rendered groups
+*/
+
+#include "groupcache.h"
+#include "pixelconverter.h"
+
+
+using namespace k_canvas;
+using namespace impl;
+using namespace c_util;
+
+
+// cached bitmaps are used under transforms which differ from original one
+// by translation only, tiny differences of scale aren't visible
+static const kScalar SCALE_TOLERANCE = 1e-5f;
+
+static const kBitmapFormat GROUP_FORMAT = kBitmapFormat::Color32BitAlphaPremultiplied;
+
+
+/*
+ -------------------------------------------------------------------------------
+ kGroupCacheImpl implementation
+ -------------------------------------------------------------------------------
+*/
+
+kGroupCacheImpl::kGroupCacheImpl(size_t budget) :
+    p_budget(budget),
+    p_size(0),
+    p_use(0),
+    p_hits(0),
+    p_misses(0)
+{}
+
+kGroupCacheImpl::~kGroupCacheImpl()
+{
+    for (std::unordered_map<uint64_t, Entry>::iterator it = p_entries.begin(); it != p_entries.end(); ++it) {
+        delete it->second.bitmap;
+    }
+}
+
+kGroupCacheImpl::Entry* kGroupCacheImpl::Find(uint64_t key, const kTransform &transform)
+{
+    std::unordered_map<uint64_t, Entry>::iterator it = p_entries.find(key);
+
+    if (it != p_entries.end()) {
+        Entry &entry = it->second;
+        const kTransform &t = entry.transform;
+
+        if (!entry.locked && !entry.invalid &&
+            std::fabs(t.m00 - transform.m00) <= SCALE_TOLERANCE &&
+            std::fabs(t.m01 - transform.m01) <= SCALE_TOLERANCE &&
+            std::fabs(t.m10 - transform.m10) <= SCALE_TOLERANCE &&
+            std::fabs(t.m11 - transform.m11) <= SCALE_TOLERANCE) {
+            entry.lastuse = ++p_use;
+            ++p_hits;
+            return &entry;
+        }
+    }
+
+    ++p_misses;
+    return nullptr;
+}
+
+kGroupCacheImpl::Entry* kGroupCacheImpl::Create(uint64_t key, size_t width, size_t height)
+{
+    std::unordered_map<uint64_t, Entry>::iterator it = p_entries.find(key);
+    if (it != p_entries.end()) {
+        // entry of outer group with the same key is being rendered
+        if (it->second.locked) {
+            return nullptr;
+        }
+        Drop(it);
+    }
+
+    // new bitmap is always made, old one can still be referenced by
+    // recorded drawing commands
+    size_t bytes = width * height * PixelSize(GROUP_FORMAT);
+    if (width == 0 || height == 0 || bytes > p_budget || !Trim(p_budget - bytes)) {
+        return nullptr;
+    }
+
+    Entry entry = {};
+    entry.bitmap = new kBitmap(width, height, GROUP_FORMAT);
+    entry.bytes = bytes;
+    entry.lastuse = ++p_use;
+    entry.locked = true;
+    entry.invalid = false;
+
+    p_size += bytes;
+    return &(p_entries[key] = entry);
+}
+
+kGroupCacheImpl::Entry* kGroupCacheImpl::Get(uint64_t key)
+{
+    std::unordered_map<uint64_t, Entry>::iterator it = p_entries.find(key);
+    return it != p_entries.end() ? &it->second : nullptr;
+}
+
+void kGroupCacheImpl::Unlock(uint64_t key)
+{
+    std::unordered_map<uint64_t, Entry>::iterator it = p_entries.find(key);
+    if (it == p_entries.end()) {
+        return;
+    }
+
+    it->second.locked = false;
+    if (it->second.invalid) {
+        Drop(it);
+    }
+
+    // budget could be lowered while entry was rendered
+    Trim(p_budget);
+}
+
+void kGroupCacheImpl::SetBudget(size_t budget)
+{
+    p_budget = budget;
+    Trim(p_budget);
+}
+
+void kGroupCacheImpl::Invalidate(uint64_t key)
+{
+    std::unordered_map<uint64_t, Entry>::iterator it = p_entries.find(key);
+    if (it == p_entries.end()) {
+        return;
+    }
+
+    if (it->second.locked) {
+        it->second.invalid = true;
+    } else {
+        Drop(it);
+    }
+}
+
+void kGroupCacheImpl::Clear()
+{
+    std::unordered_map<uint64_t, Entry>::iterator it = p_entries.begin();
+    while (it != p_entries.end()) {
+        std::unordered_map<uint64_t, Entry>::iterator current = it++;
+        if (current->second.locked) {
+            current->second.invalid = true;
+        } else {
+            Drop(current);
+        }
+    }
+}
+
+void kGroupCacheImpl::ResetCounters()
+{
+    p_hits = 0;
+    p_misses = 0;
+}
+
+void kGroupCacheImpl::Drop(std::unordered_map<uint64_t, Entry>::iterator it)
+{
+    p_size -= it->second.bytes;
+    delete it->second.bitmap;
+    p_entries.erase(it);
+}
+
+bool kGroupCacheImpl::Trim(size_t budget)
+{
+    while (p_size > budget) {
+        std::unordered_map<uint64_t, Entry>::iterator oldest = p_entries.end();
+        for (std::unordered_map<uint64_t, Entry>::iterator it = p_entries.begin(); it != p_entries.end(); ++it) {
+            if (!it->second.locked && (oldest == p_entries.end() || it->second.lastuse < oldest->second.lastuse)) {
+                oldest = it;
+            }
+        }
+
+        // everything left is being rendered
+        if (oldest == p_entries.end()) {
+            return false;
+        }
+
+        Drop(oldest);
+    }
+
+    return true;
+}
+
+
+/*
+ -------------------------------------------------------------------------------
+ kGroupCache implementation
+ -------------------------------------------------------------------------------
+*/
+
+kGroupCache::kGroupCache(size_t budget) :
+    p_impl(new kGroupCacheImpl(budget))
+{}
+
+kGroupCache::~kGroupCache()
+{
+    delete p_impl;
+}
+
+void kGroupCache::SetBudget(size_t budget)
+{
+    p_impl->SetBudget(budget);
+}
+
+void kGroupCache::Invalidate(uint64_t key)
+{
+    p_impl->Invalidate(key);
+}
+
+void kGroupCache::Clear()
+{
+    p_impl->Clear();
+}
+
+void kGroupCache::ResetCounters()
+{
+    p_impl->ResetCounters();
+}
+
+size_t kGroupCache::budget() const
+{
+    return p_impl->budget();
+}
+
+size_t kGroupCache::size() const
+{
+    return p_impl->size();
+}
+
+size_t kGroupCache::count() const
+{
+    return p_impl->count();
+}
+
+size_t kGroupCache::hits() const
+{
+    return p_impl->hits();
+}
+
+size_t kGroupCache::misses() const
+{
+    return p_impl->misses();
+}
@@ -0,0 +1,85 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    groupcache.h
+        cache of rendered groups
+*/
+
+#pragma once
+#include "canvas.h"
+#include <unordered_map>
+
+
+namespace k_canvas
+{
+    namespace impl
+    {
+        /*
+         -------------------------------------------------------------------------------
+         kGroupCacheImpl
+         -------------------------------------------------------------------------------
+            keeps group bitmaps by key, every bitmap remembers transform it
+            was rendered with, so it's reused only under the same scale and
+            rotation
+
+            entry is locked while group is rendered into it, locked entries
+            aren't evicted and invalidated ones are dropped on unlock
+        */
+        class kGroupCacheImpl
+        {
+        public:
+            struct Entry
+            {
+                kBitmap    *bitmap;
+                kTransform  transform; // transform group was rendered with
+                kPoint      origin;    // bitmap position for that transform
+                size_t      bytes;
+                uint64_t    lastuse;
+                bool        locked;
+                bool        invalid;
+            };
+
+            kGroupCacheImpl(size_t budget);
+            ~kGroupCacheImpl();
+
+            // returns entry rendered under transform of the same scale and
+            // rotation, nullptr if there's none, counts hit or miss
+            Entry* Find(uint64_t key, const kTransform &transform);
+            // replaces entry by new locked entry with clear bitmap of given
+            // size, returns nullptr if bitmap doesn't fit budget
+            Entry* Create(uint64_t key, size_t width, size_t height);
+            Entry* Get(uint64_t key);
+            void Unlock(uint64_t key);
+
+            void SetBudget(size_t budget);
+            void Invalidate(uint64_t key);
+            void Clear();
+            void ResetCounters();
+
+            size_t budget() const { return p_budget; }
+            size_t size() const { return p_size; }
+            size_t count() const { return p_entries.size(); }
+            size_t hits() const { return p_hits; }
+            size_t misses() const { return p_misses; }
+
+        private:
+            void Drop(std::unordered_map<uint64_t, Entry>::iterator it);
+            // drops least recently used unlocked entries until size fits budget
+            bool Trim(size_t budget);
+
+        private:
+            std::unordered_map<uint64_t, Entry> p_entries;
+            size_t                              p_budget;
+            size_t                              p_size;
+            uint64_t                            p_use;    // use counter for LRU order
+            size_t                              p_hits;
+            size_t                              p_misses;
+        };
+    }
+}
@@ -0,0 +1,323 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    imageencoder.cpp
+        image sinks, row encoder and generic uncompressed image encoders
+*/
+
+#include "imageencoder.h"
+#include "pixelconverter.h"
+#include "pngencoder.h"
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+
+using namespace k_canvas;
+using namespace impl;
+using namespace c_util;
+
+
+/*
+ -------------------------------------------------------------------------------
+ kImageSink implementations
+ -------------------------------------------------------------------------------
+*/
+
+kImageFileSink::kImageFileSink(int fd) :
+    p_fd(fd)
+{}
+
+bool kImageFileSink::Write(const void *data, size_t size)
+{
+    const char *source = reinterpret_cast<const char*>(data);
+
+    // descriptor might accept only part of data (pipes, sockets)
+    while (size) {
+#ifdef _WIN32
+        int written = _write(p_fd, source, unsigned(umin(size, size_t(0x40000000))));
+#else
+        ssize_t written = write(p_fd, source, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+
+        if (written <= 0) {
+            return false;
+        }
+
+        source += written;
+        size -= size_t(written);
+    }
+
+    return true;
+}
+
+kImageMemorySink::kImageMemorySink(size_t reserve) :
+    p_buffer()
+{
+    p_buffer.reserve(reserve);
+}
+
+bool kImageMemorySink::Write(const void *data, size_t size)
+{
+    const uint8_t *source = reinterpret_cast<const uint8_t*>(data);
+    p_buffer.insert(p_buffer.end(), source, source + size);
+    return true;
+}
+
+void kImageMemorySink::Clear()
+{
+    p_buffer.clear();
+}
+
+kImageCallbackSink::kImageCallbackSink(kImageWriteProc proc, void *context) :
+    p_proc(proc),
+    p_context(context)
+{}
+
+bool kImageCallbackSink::Write(const void *data, size_t size)
+{
+    return p_proc(data, size, p_context);
+}
+
+
+/*
+ -------------------------------------------------------------------------------
+ generic image encoders
+ -------------------------------------------------------------------------------
+*/
+
+// size of band buffer, pixels are read and passed to sink by bands of rows
+static const size_t BAND_BUFFER_SIZE = 64 * 1024;
+
+static const size_t BMP_HEADER_SIZE = 54;
+
+static inline void put16(uint8_t *dest, uint32_t value)
+{
+    dest[0] = uint8_t(value);
+    dest[1] = uint8_t(value >> 8);
+}
+
+static inline void put32(uint8_t *dest, uint32_t value)
+{
+    dest[0] = uint8_t(value);
+    dest[1] = uint8_t(value >> 8);
+    dest[2] = uint8_t(value >> 16);
+    dest[3] = uint8_t(value >> 24);
+}
+
+// BITMAPFILEHEADER and BITMAPINFOHEADER of top-down 32 bit image
+static size_t BMPHeader(uint8_t *header, size_t width, size_t height)
+{
+    uint32_t imagesize = uint32_t(width * height * 4);
+
+    memset(header, 0, BMP_HEADER_SIZE);
+
+    header[0] = 'B';
+    header[1] = 'M';
+    put32(header + 2, uint32_t(BMP_HEADER_SIZE) + imagesize);
+    put32(header + 10, uint32_t(BMP_HEADER_SIZE));
+
+    put32(header + 14, 40);
+    put32(header + 18, uint32_t(width));
+    // negative height means rows go from top to bottom, so rows are
+    // written in the same order as they stored in bitmap
+    put32(header + 22, uint32_t(-int32_t(height)));
+    put16(header + 26, 1);
+    put16(header + 28, 32);
+    put32(header + 34, imagesize);
+    // 72 DPI
+    put32(header + 38, 2835);
+    put32(header + 42, 2835);
+
+    return BMP_HEADER_SIZE;
+}
+
+// header and row format of uncompressed image, false for unsupported formats
+static bool ImageHeader(
+    kImageFormat format, size_t width, size_t height, kBitmapFormat sourceformat,
+    uint8_t *header, size_t headercapacity, size_t &headersize, kBitmapFormat &rowformat
+)
+{
+    headersize = 0;
+
+    switch (format) {
+        case kImageFormat::PPM:
+            rowformat = kBitmapFormat::Color24Bit;
+            headersize = size_t(snprintf(
+                reinterpret_cast<char*>(header), headercapacity, "P6\n%llu %llu\n255\n",
+                static_cast<unsigned long long>(width), static_cast<unsigned long long>(height)
+            ));
+            return true;
+
+        case kImageFormat::BMP:
+            rowformat = kBitmapFormat::Color32BitAlpha;
+            headersize = BMPHeader(header, width, height);
+            return true;
+
+        case kImageFormat::Raw:
+            rowformat = sourceformat;
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+bool k_canvas::impl::EncodeImage(const kBitmap &bitmap, kImageFormat format, kImageSink &sink)
+{
+    size_t width = bitmap.width();
+    size_t height = bitmap.height();
+
+    uint8_t header[64];
+    size_t headersize;
+    kBitmapFormat rowformat;
+
+    if (!ImageHeader(format, width, height, bitmap.format(), header, sizeof(header), headersize, rowformat)) {
+        return false;
+    }
+
+    if (headersize && !sink.Write(header, headersize)) {
+        return false;
+    }
+
+    if (width == 0 || height == 0) {
+        return true;
+    }
+
+    // rows are written without padding
+    size_t pitch = width * PixelSize(rowformat);
+    size_t bandrows = umin(umax(BAND_BUFFER_SIZE / pitch, size_t(1)), height);
+    std::vector<uint8_t> band(pitch * bandrows);
+
+    for (size_t y = 0; y < height; y += bandrows) {
+        size_t rows = umin(bandrows, height - y);
+        kRectInt rect(0, int(y), int(width), int(y + rows));
+
+        if (!bitmap.Read(&rect, rowformat, pitch, band.data()) ||
+            !sink.Write(band.data(), pitch * rows)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/*
+ -------------------------------------------------------------------------------
+ kImageRowEncoder implementation
+ -------------------------------------------------------------------------------
+*/
+
+kImageRowEncoder::kImageRowEncoder(kImageFormat format, kImageSink &sink, const kImageEncodeProperties *properties) :
+    p_format(format),
+    p_sink(sink),
+    p_compression(properties ? properties->compression : -1),
+    p_width(0),
+    p_sourceformat(kBitmapFormat::Color32BitAlphaPremultiplied),
+    p_rowformat(kBitmapFormat::Color32BitAlphaPremultiplied),
+    p_buffer(),
+    p_png(nullptr)
+{}
+
+kImageRowEncoder::~kImageRowEncoder()
+{
+    delete p_png;
+}
+
+bool kImageRowEncoder::Begin(size_t width, size_t height, kBitmapFormat format)
+{
+    delete p_png;
+    p_png = nullptr;
+
+    p_width = width;
+    p_sourceformat = format;
+
+    if (p_format == kImageFormat::PNG) {
+        // mask is written as gray image, color as RGBA with straight alpha
+        bool gray = format == kBitmapFormat::Mask8Bit || format == kBitmapFormat::Gray8Bit;
+        p_rowformat = gray ? kBitmapFormat::Gray8Bit : kBitmapFormat::Color32BitRGBAAlpha;
+        p_png = CreatePNGStreamWriter(p_sink, width, height, gray, p_compression);
+        if (!p_png) {
+            return false;
+        }
+    } else {
+        uint8_t header[64];
+        size_t headersize;
+
+        if (!ImageHeader(p_format, width, height, format, header, sizeof(header), headersize, p_rowformat)) {
+            return false;
+        }
+
+        if (headersize && !p_sink.Write(header, headersize)) {
+            return false;
+        }
+    }
+
+    // rows which need no conversion are passed as is
+    if (p_rowformat == p_sourceformat) {
+        p_buffer.clear();
+    } else if (!GetPixelRowConverter(p_rowformat, p_sourceformat)) {
+        return false;
+    }
+
+    return true;
+}
+
+bool kImageRowEncoder::WriteRows(const void *data, size_t pitch, size_t count)
+{
+    const uint8_t *rows = reinterpret_cast<const uint8_t*>(data);
+    size_t rowsize = p_width * PixelSize(p_rowformat);
+
+    if (p_rowformat != p_sourceformat) {
+        PixelRowConverter converter = GetPixelRowConverter(p_rowformat, p_sourceformat);
+
+        // whole band is converted into buffer, which keeps its size between
+        // bands, so it's allocated only once
+        p_buffer.resize(rowsize * count);
+        for (size_t n = 0; n < count; ++n) {
+            converter(p_buffer.data() + rowsize * n, rows + pitch * n, p_width);
+        }
+
+        rows = p_buffer.data();
+        pitch = rowsize;
+    }
+
+    if (p_png) {
+        return p_png->WriteRows(rows, pitch, count);
+    }
+
+    if (pitch == rowsize) {
+        return p_sink.Write(rows, rowsize * count);
+    }
+
+    // rows are written without padding
+    for (size_t n = 0; n < count; ++n) {
+        if (!p_sink.Write(rows + pitch * n, rowsize)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool kImageRowEncoder::End()
+{
+    // PNG stream is finished with last row
+    return true;
+}
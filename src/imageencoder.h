@@ -0,0 +1,27 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    imageencoder.h
+        generic uncompressed image encoders for kBitmap::Encode
+*/
+
+#pragma once
+#include "canvas.h"
+
+
+namespace k_canvas
+{
+    namespace impl
+    {
+        // writes PPM, BMP or raw image, pixels are read from bitmap by bands
+        // of rows into single band buffer, so there's no full copy of bitmap
+        // returns false for unsupported format, failed Read or failed sink
+        bool EncodeImage(const kBitmap &bitmap, kImageFormat format, kImageSink &sink);
+    }
+}
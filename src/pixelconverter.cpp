@@ -0,0 +1,1089 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    pixelconverter.cpp
+        pixel format conversion between kBitmapFormat formats
+*/
+
+#include "pixelconverter.h"
+#include "simd.h"
+#include <cstring>
+
+
+namespace k_canvas
+{
+    namespace impl
+    {
+        // every kernel below has vectorised block part which converts as many
+        // whole blocks as possible and returns number of converted pixels,
+        // the rest of the row is converted by scalar code
+
+        // exact rounded c * a / 255
+        static inline uint32_t premultiply_channel(uint32_t c, uint32_t a)
+        {
+            uint32_t t = c * a + 128;
+            return (t + (t >> 8)) >> 8;
+        }
+
+        // rounded c * 255 / a, clamped for invalid premultiplied values, a must not be 0
+        static inline uint32_t unpremultiply_channel(uint32_t c, uint32_t a)
+        {
+            uint32_t r = (c * 255 + a / 2) / a;
+            return r > 255 ? 255 : r;
+        }
+
+        // all channels of 32 bit pixel multiplied by a with premultiply_channel rounding
+        static inline uint32_t scale_pixel(uint32_t v, uint32_t a)
+        {
+            return
+                premultiply_channel(v >> 24, a) << 24 |
+                premultiply_channel((v >> 16) & 0xff, a) << 16 |
+                premultiply_channel((v >> 8) & 0xff, a) << 8 |
+                premultiply_channel(v & 0xff, a);
+        }
+
+        // per channel sum of 32 bit pixels saturated to 255
+        static inline uint32_t add_pixel(uint32_t a, uint32_t b)
+        {
+            uint32_t result = 0;
+            for (unsigned shift = 0; shift < 32; shift += 8) {
+                uint32_t sum = ((a >> shift) & 0xff) + ((b >> shift) & 0xff);
+                result |= (sum > 255 ? 255 : sum) << shift;
+            }
+            return result;
+        }
+
+        // swap R and B channels of native 32 bit pixel
+        static inline uint32_t swizzle_pixel(uint32_t v)
+        {
+            return (v & 0xff00ff00u) | ((v >> 16) & 0xffu) | ((v & 0xffu) << 16);
+        }
+
+        // Rec. 601 luminance with weights summing up to 256
+        static inline uint8_t luminance(uint32_t r, uint32_t g, uint32_t b)
+        {
+            return uint8_t((r * 77 + g * 150 + b * 29 + 128) >> 8);
+        }
+
+#if defined(KCANVAS_SSE2)
+        static inline __m128i swizzle_sse2(__m128i v)
+        {
+            const __m128i ag = _mm_set1_epi32(int(0xff00ff00));
+            __m128i rb = _mm_andnot_si128(ag, v);
+            rb = _mm_shufflelo_epi16(rb, _MM_SHUFFLE(2, 3, 0, 1));
+            rb = _mm_shufflehi_epi16(rb, _MM_SHUFFLE(2, 3, 0, 1));
+            return _mm_or_si128(_mm_and_si128(v, ag), rb);
+        }
+
+        // rounded v * a / 255 of unpacked 16 bit channel values
+        static inline __m128i multiply_sse2(__m128i v, __m128i a)
+        {
+            __m128i t = _mm_add_epi16(_mm_mullo_epi16(v, a), _mm_set1_epi16(128));
+            return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        }
+
+        // alpha of 2 unpacked pixels replicated into all their channels
+        static inline __m128i alpha_sse2(__m128i v)
+        {
+            __m128i a = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+            return _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+
+        // multiply 2 unpacked pixels by their alpha, alpha channel is kept
+        static inline __m128i premultiply_sse2(__m128i v)
+        {
+            const __m128i keepcolor = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+            const __m128i alphalane = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+
+            __m128i a = _mm_or_si128(_mm_and_si128(alpha_sse2(v), keepcolor), alphalane);
+            return multiply_sse2(v, a);
+        }
+
+        static inline bool opaque_sse2(__m128i v)
+        {
+            const __m128i alpha = _mm_set1_epi32(int(0xff000000));
+            return _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(v, alpha), alpha)) == 0xffff;
+        }
+
+        static inline bool empty_sse2(__m128i v)
+        {
+            return _mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_setzero_si128())) == 0xffff;
+        }
+#endif
+
+#if defined(KCANVAS_NEON)
+        // rounded v * a / 255 of 16 channel values
+        static inline uint8x16_t multiply_neon(uint8x16_t v, uint8x16_t a)
+        {
+            uint16x8_t low = vmull_u8(vget_low_u8(v), vget_low_u8(a));
+            uint16x8_t high = vmull_u8(vget_high_u8(v), vget_high_u8(a));
+            return vcombine_u8(
+                vrshrn_n_u16(vrsraq_n_u16(low, low, 8), 8),
+                vrshrn_n_u16(vrsraq_n_u16(high, high, 8), 8)
+            );
+        }
+#endif
+
+#if defined(KCANVAS_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+        #define KCANVAS_NEON_DIVIDE
+
+        // unpremultiply 4 channel values, result isn't masked for zero alpha
+        static inline uint32x4_t unpremultiply_neon(uint16x4_t c, float32x4_t a)
+        {
+            float32x4_t v = vdivq_f32(vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(c)), 255.0f), a);
+            return vcvtq_u32_f32(vminq_f32(vaddq_f32(v, vdupq_n_f32(0.5f)), vdupq_n_f32(255.0f)));
+        }
+
+        static inline uint8x16_t unpremultiply_neon(uint8x16_t c, const float32x4_t *a)
+        {
+            uint16x8_t low = vmovl_u8(vget_low_u8(c));
+            uint16x8_t high = vmovl_u8(vget_high_u8(c));
+
+            uint16x8_t rlow = vcombine_u16(
+                vmovn_u32(unpremultiply_neon(vget_low_u16(low), a[0])),
+                vmovn_u32(unpremultiply_neon(vget_high_u16(low), a[1]))
+            );
+            uint16x8_t rhigh = vcombine_u16(
+                vmovn_u32(unpremultiply_neon(vget_low_u16(high), a[2])),
+                vmovn_u32(unpremultiply_neon(vget_high_u16(high), a[3]))
+            );
+
+            return vcombine_u8(vmovn_u16(rlow), vmovn_u16(rhigh));
+        }
+#endif
+
+
+        // solid fill of 32 bit pixels, stores are unaligned, so row
+        // can start anywhere
+        static size_t fill32_block(uint32_t *dst, uint32_t pixel, size_t width)
+        {
+            size_t pos = 0;
+
+#if defined(KCANVAS_SSE2)
+            __m128i v = _mm_set1_epi32(int(pixel));
+            while ((width - pos) >= 16) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), v);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos + 4), v);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos + 8), v);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos + 12), v);
+                pos += 16;
+            }
+            while ((width - pos) >= 4) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), v);
+                pos += 4;
+            }
+#elif defined(KCANVAS_NEON)
+            uint32x4_t v = vdupq_n_u32(pixel);
+            while ((width - pos) >= 4) {
+                vst1q_u32(dst + pos, v);
+                pos += 4;
+            }
+#else
+            (void)dst;
+            (void)pixel;
+            (void)width;
+#endif
+
+            return pos;
+        }
+
+        static void fill32_row(void *dstrow, uint32_t pixel, size_t width)
+        {
+            uint32_t *dst = reinterpret_cast<uint32_t*>(dstrow);
+
+            for (size_t x = fill32_block(dst, pixel, width); x < width; ++x) {
+                dst[x] = pixel;
+            }
+        }
+
+
+        // R and B channels swap, RGBA <-> BGRA
+        static size_t swizzle_block(uint32_t *dst, const uint32_t *src, size_t width)
+        {
+            size_t pos = 0;
+
+#if defined(KCANVAS_SSE2)
+            while ((width - pos) >= 4) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), swizzle_sse2(v));
+                pos += 4;
+            }
+#elif defined(KCANVAS_NEON)
+            while ((width - pos) >= 16) {
+                uint8x16x4_t v = vld4q_u8(reinterpret_cast<const uint8_t*>(src + pos));
+                uint8x16_t t = v.val[0];
+                v.val[0] = v.val[2];
+                v.val[2] = t;
+                vst4q_u8(reinterpret_cast<uint8_t*>(dst + pos), v);
+                pos += 16;
+            }
+#else
+            (void)dst;
+            (void)src;
+            (void)width;
+#endif
+
+            return pos;
+        }
+
+        static void swizzle_row(void *dstrow, const void *srcrow, size_t width)
+        {
+            uint32_t *dst = reinterpret_cast<uint32_t*>(dstrow);
+            const uint32_t *src = reinterpret_cast<const uint32_t*>(srcrow);
+
+            for (size_t x = swizzle_block(dst, src, width); x < width; ++x) {
+                dst[x] = swizzle_pixel(src[x]);
+            }
+        }
+
+
+        // straight alpha to premultiplied alpha, optionally with R and B swap
+        static size_t premultiply_block(uint32_t *dst, const uint32_t *src, size_t width, bool swizzle)
+        {
+            size_t pos = 0;
+
+#if defined(KCANVAS_SSE2)
+            const __m128i zero = _mm_setzero_si128();
+            while ((width - pos) >= 4) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos));
+                if (swizzle) {
+                    v = swizzle_sse2(v);
+                }
+
+                // opaque pixels are the same in both forms
+                if (!opaque_sse2(v)) {
+                    __m128i low = premultiply_sse2(_mm_unpacklo_epi8(v, zero));
+                    __m128i high = premultiply_sse2(_mm_unpackhi_epi8(v, zero));
+                    v = _mm_packus_epi16(low, high);
+                }
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), v);
+                pos += 4;
+            }
+#elif defined(KCANVAS_NEON)
+            while ((width - pos) >= 16) {
+                uint8x16x4_t v = vld4q_u8(reinterpret_cast<const uint8_t*>(src + pos));
+                if (swizzle) {
+                    uint8x16_t t = v.val[0];
+                    v.val[0] = v.val[2];
+                    v.val[2] = t;
+                }
+
+                for (int c = 0; c < 3; ++c) {
+                    v.val[c] = multiply_neon(v.val[c], v.val[3]);
+                }
+
+                vst4q_u8(reinterpret_cast<uint8_t*>(dst + pos), v);
+                pos += 16;
+            }
+#else
+            (void)dst;
+            (void)src;
+            (void)width;
+            (void)swizzle;
+#endif
+
+            return pos;
+        }
+
+        static inline void premultiply_row(void *dstrow, const void *srcrow, size_t width, bool swizzle)
+        {
+            uint32_t *dst = reinterpret_cast<uint32_t*>(dstrow);
+            const uint32_t *src = reinterpret_cast<const uint32_t*>(srcrow);
+
+            for (size_t x = premultiply_block(dst, src, width, swizzle); x < width; ++x) {
+                uint32_t v = swizzle ? swizzle_pixel(src[x]) : src[x];
+                uint32_t a = v >> 24;
+                dst[x] =
+                    (a << 24) |
+                    (premultiply_channel((v >> 16) & 0xff, a) << 16) |
+                    (premultiply_channel((v >> 8) & 0xff, a) << 8) |
+                    premultiply_channel(v & 0xff, a);
+            }
+        }
+
+        static void premultiply_row(void *dst, const void *src, size_t width)
+        {
+            premultiply_row(dst, src, width, false);
+        }
+
+        static void premultiply_swizzle_row(void *dst, const void *src, size_t width)
+        {
+            premultiply_row(dst, src, width, true);
+        }
+
+
+        // premultiplied alpha to straight alpha, optionally with R and B swap
+        static size_t unpremultiply_block(uint32_t *dst, const uint32_t *src, size_t width, bool swizzle)
+        {
+            size_t pos = 0;
+
+#if defined(KCANVAS_SSE2)
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i channel = _mm_set1_epi32(0xff);
+            const __m128 scale = _mm_set1_ps(255.0f);
+            const __m128 half = _mm_set1_ps(0.5f);
+            const __m128 max = _mm_set1_ps(255.0f);
+
+            while ((width - pos) >= 4) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos));
+
+                if (opaque_sse2(v)) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), swizzle ? swizzle_sse2(v) : v);
+                    pos += 4;
+                    continue;
+                }
+
+                __m128i a = _mm_srli_epi32(v, 24);
+                __m128 af = _mm_cvtepi32_ps(a);
+                __m128i result = _mm_slli_epi32(a, 24);
+
+                // division gives exactly rounded result for all valid
+                // premultiplied values, zero alpha pixels are masked out
+                for (int shift = 0; shift < 24; shift += 8) {
+                    __m128 c = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, shift), channel));
+                    c = _mm_div_ps(_mm_mul_ps(c, scale), af);
+                    c = _mm_min_ps(_mm_add_ps(c, half), max);
+
+                    __m128i ci = _mm_cvttps_epi32(c);
+                    switch (swizzle ? 16 - shift : shift) {
+                        case 0:  break;
+                        case 8:  ci = _mm_slli_epi32(ci, 8); break;
+                        default: ci = _mm_slli_epi32(ci, 16); break;
+                    }
+                    result = _mm_or_si128(result, ci);
+                }
+
+                result = _mm_andnot_si128(_mm_cmpeq_epi32(a, zero), result);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), result);
+                pos += 4;
+            }
+#elif defined(KCANVAS_NEON_DIVIDE)
+            while ((width - pos) >= 16) {
+                uint8x16x4_t v = vld4q_u8(reinterpret_cast<const uint8_t*>(src + pos));
+
+                uint16x8_t alow = vmovl_u8(vget_low_u8(v.val[3]));
+                uint16x8_t ahigh = vmovl_u8(vget_high_u8(v.val[3]));
+                float32x4_t a[4] = {
+                    vcvtq_f32_u32(vmovl_u16(vget_low_u16(alow))),
+                    vcvtq_f32_u32(vmovl_u16(vget_high_u16(alow))),
+                    vcvtq_f32_u32(vmovl_u16(vget_low_u16(ahigh))),
+                    vcvtq_f32_u32(vmovl_u16(vget_high_u16(ahigh)))
+                };
+
+                // zero alpha pixels are masked out
+                uint8x16_t nonzero = vtstq_u8(v.val[3], v.val[3]);
+                for (int c = 0; c < 3; ++c) {
+                    v.val[c] = vandq_u8(unpremultiply_neon(v.val[c], a), nonzero);
+                }
+
+                if (swizzle) {
+                    uint8x16_t t = v.val[0];
+                    v.val[0] = v.val[2];
+                    v.val[2] = t;
+                }
+
+                vst4q_u8(reinterpret_cast<uint8_t*>(dst + pos), v);
+                pos += 16;
+            }
+#else
+            // no vector division in 32 bit NEON, scalar code is used
+            (void)dst;
+            (void)src;
+            (void)width;
+            (void)swizzle;
+#endif
+
+            return pos;
+        }
+
+        static inline void unpremultiply_row(void *dstrow, const void *srcrow, size_t width, bool swizzle)
+        {
+            uint32_t *dst = reinterpret_cast<uint32_t*>(dstrow);
+            const uint32_t *src = reinterpret_cast<const uint32_t*>(srcrow);
+
+            for (size_t x = unpremultiply_block(dst, src, width, swizzle); x < width; ++x) {
+                uint32_t v = src[x];
+                uint32_t a = v >> 24;
+
+                if (a == 0) {
+                    dst[x] = 0;
+                    continue;
+                }
+
+                v =
+                    (a << 24) |
+                    (unpremultiply_channel((v >> 16) & 0xff, a) << 16) |
+                    (unpremultiply_channel((v >> 8) & 0xff, a) << 8) |
+                    unpremultiply_channel(v & 0xff, a);
+
+                dst[x] = swizzle ? swizzle_pixel(v) : v;
+            }
+        }
+
+        static void unpremultiply_row(void *dst, const void *src, size_t width)
+        {
+            unpremultiply_row(dst, src, width, false);
+        }
+
+        static void unpremultiply_swizzle_row(void *dst, const void *src, size_t width)
+        {
+            unpremultiply_row(dst, src, width, true);
+        }
+
+
+        // R, G, B bytes to opaque native pixels
+        static size_t expand_rgb_block(uint32_t *dst, const uint8_t *src, size_t width)
+        {
+            size_t pos = 0;
+
+#if defined(KCANVAS_SSE2)
+            const __m128i color = _mm_set1_epi32(0x00ffffff);
+            const __m128i opaque = _mm_set1_epi32(int(0xff000000));
+
+            // 4 pixels take 12 bytes, but 16 bytes are loaded
+            while ((width - pos) >= 6) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos * 3));
+
+                __m128i p01 = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+                __m128i p23 = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+                __m128i p = _mm_or_si128(_mm_and_si128(_mm_unpacklo_epi64(p01, p23), color), opaque);
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), swizzle_sse2(p));
+                pos += 4;
+            }
+#elif defined(KCANVAS_NEON)
+            while ((width - pos) >= 16) {
+                uint8x16x3_t v = vld3q_u8(src + pos * 3);
+
+                uint8x16x4_t p;
+                p.val[0] = v.val[2];
+                p.val[1] = v.val[1];
+                p.val[2] = v.val[0];
+                p.val[3] = vdupq_n_u8(255);
+
+                vst4q_u8(reinterpret_cast<uint8_t*>(dst + pos), p);
+                pos += 16;
+            }
+#else
+            (void)dst;
+            (void)src;
+            (void)width;
+#endif
+
+            return pos;
+        }
+
+        static void expand_rgb_row(void *dstrow, const void *srcrow, size_t width)
+        {
+            uint32_t *dst = reinterpret_cast<uint32_t*>(dstrow);
+            const uint8_t *src = reinterpret_cast<const uint8_t*>(srcrow);
+
+            for (size_t x = expand_rgb_block(dst, src, width); x < width; ++x) {
+                const uint8_t *p = src + x * 3;
+                dst[x] = 0xff000000u | (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2];
+            }
+        }
+
+
+        // native pixels to R, G, B bytes, premultiplied color is taken as is
+        // which gives the same result as drawing over black background
+        static size_t shrink_rgb_block(uint8_t *dst, const uint32_t *src, size_t width)
+        {
+            size_t pos = 0;
+
+#if defined(KCANVAS_SSE2)
+            const __m128i color = _mm_set_epi32(0, 0x00ffffff, 0, 0x00ffffff);
+            const __m128i shifted = _mm_set_epi32(0x0000ffff, int(0xff000000), 0x0000ffff, int(0xff000000));
+
+            // 8 pixels take 24 bytes, which are stored as 16 and 8 bytes
+            while ((width - pos) >= 8) {
+                __m128i packed[2];
+                for (size_t half = 0; half < 2; ++half) {
+                    __m128i v = swizzle_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos + half * 4)));
+
+                    // pixel pairs packed into 6 low bytes of both 64 bit halves
+                    v = _mm_or_si128(_mm_and_si128(v, color), _mm_and_si128(_mm_srli_epi64(v, 8), shifted));
+                    packed[half] = _mm_or_si128(_mm_move_epi64(v), _mm_slli_si128(_mm_srli_si128(v, 8), 6));
+                }
+
+                __m128i *out = reinterpret_cast<__m128i*>(dst + pos * 3);
+                _mm_storeu_si128(out, _mm_or_si128(packed[0], _mm_slli_si128(packed[1], 12)));
+                _mm_storel_epi64(out + 1, _mm_srli_si128(packed[1], 4));
+                pos += 8;
+            }
+#elif defined(KCANVAS_NEON)
+            while ((width - pos) >= 16) {
+                uint8x16x4_t v = vld4q_u8(reinterpret_cast<const uint8_t*>(src + pos));
+
+                uint8x16x3_t p;
+                p.val[0] = v.val[2];
+                p.val[1] = v.val[1];
+                p.val[2] = v.val[0];
+
+                vst3q_u8(dst + pos * 3, p);
+                pos += 16;
+            }
+#else
+            (void)dst;
+            (void)src;
+            (void)width;
+#endif
+
+            return pos;
+        }
+
+        static void shrink_rgb_row(void *dstrow, const void *srcrow, size_t width)
+        {
+            uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+            const uint32_t *src = reinterpret_cast<const uint32_t*>(srcrow);
+
+            // pixel bytes are B, G, R, A
+            size_t x = shrink_rgb_block(dst, src, width);
+            const uint8_t *s = reinterpret_cast<const uint8_t*>(src + x);
+            for (uint8_t *p = dst + x * 3; x < width; ++x, s += 4, p += 3) {
+                p[0] = s[2];
+                p[1] = s[1];
+                p[2] = s[0];
+            }
+        }
+
+
+        // 8 bit values replicated into all channels, alpha channel is either
+        // taken from value too (mask to premultiplied white) or set to opaque (gray)
+        static size_t expand_gray_block(uint32_t *dst, const uint8_t *src, size_t width, bool opaque)
+        {
+            size_t pos = 0;
+
+#if defined(KCANVAS_SSE2)
+            const __m128i alpha = _mm_set1_epi32(opaque ? int(0xff000000) : 0);
+
+            while ((width - pos) >= 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos));
+                __m128i low = _mm_unpacklo_epi8(v, v);
+                __m128i high = _mm_unpackhi_epi8(v, v);
+
+                __m128i *out = reinterpret_cast<__m128i*>(dst + pos);
+                _mm_storeu_si128(out, _mm_or_si128(_mm_unpacklo_epi16(low, low), alpha));
+                _mm_storeu_si128(out + 1, _mm_or_si128(_mm_unpackhi_epi16(low, low), alpha));
+                _mm_storeu_si128(out + 2, _mm_or_si128(_mm_unpacklo_epi16(high, high), alpha));
+                _mm_storeu_si128(out + 3, _mm_or_si128(_mm_unpackhi_epi16(high, high), alpha));
+
+                pos += 16;
+            }
+#elif defined(KCANVAS_NEON)
+            while ((width - pos) >= 16) {
+                uint8x16_t v = vld1q_u8(src + pos);
+
+                uint8x16x4_t p;
+                p.val[0] = v;
+                p.val[1] = v;
+                p.val[2] = v;
+                p.val[3] = opaque ? vdupq_n_u8(255) : v;
+
+                vst4q_u8(reinterpret_cast<uint8_t*>(dst + pos), p);
+                pos += 16;
+            }
+#else
+            (void)dst;
+            (void)src;
+            (void)width;
+            (void)opaque;
+#endif
+
+            return pos;
+        }
+
+        static inline void expand_gray_row(void *dstrow, const void *srcrow, size_t width, bool opaque)
+        {
+            uint32_t *dst = reinterpret_cast<uint32_t*>(dstrow);
+            const uint8_t *src = reinterpret_cast<const uint8_t*>(srcrow);
+            uint32_t alpha = opaque ? 0xff000000u : 0;
+
+            for (size_t x = expand_gray_block(dst, src, width, opaque); x < width; ++x) {
+                dst[x] = (uint32_t(src[x]) * 0x01010101u) | alpha;
+            }
+        }
+
+        static void expand_gray_row(void *dst, const void *src, size_t width)
+        {
+            expand_gray_row(dst, src, width, true);
+        }
+
+        static void expand_mask_row(void *dst, const void *src, size_t width)
+        {
+            expand_gray_row(dst, src, width, false);
+        }
+
+
+        // alpha channel of 32 bit pixels
+        static size_t alpha_block(uint8_t *dst, const uint32_t *src, size_t width)
+        {
+            size_t pos = 0;
+
+#if defined(KCANVAS_SSE2)
+            while ((width - pos) >= 16) {
+                const __m128i *in = reinterpret_cast<const __m128i*>(src + pos);
+                __m128i a0 = _mm_srli_epi32(_mm_loadu_si128(in), 24);
+                __m128i a1 = _mm_srli_epi32(_mm_loadu_si128(in + 1), 24);
+                __m128i a2 = _mm_srli_epi32(_mm_loadu_si128(in + 2), 24);
+                __m128i a3 = _mm_srli_epi32(_mm_loadu_si128(in + 3), 24);
+
+                __m128i a = _mm_packus_epi16(_mm_packs_epi32(a0, a1), _mm_packs_epi32(a2, a3));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), a);
+                pos += 16;
+            }
+#elif defined(KCANVAS_NEON)
+            while ((width - pos) >= 16) {
+                uint8x16x4_t v = vld4q_u8(reinterpret_cast<const uint8_t*>(src + pos));
+                vst1q_u8(dst + pos, v.val[3]);
+                pos += 16;
+            }
+#else
+            (void)dst;
+            (void)src;
+            (void)width;
+#endif
+
+            return pos;
+        }
+
+        static void alpha_row(void *dstrow, const void *srcrow, size_t width)
+        {
+            uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+            const uint32_t *src = reinterpret_cast<const uint32_t*>(srcrow);
+
+            for (size_t x = alpha_block(dst, src, width); x < width; ++x) {
+                dst[x] = uint8_t(src[x] >> 24);
+            }
+        }
+
+
+        // premultiplied source scaled by alpha drawn over destination, the same
+        // rounding and saturation as pixman has for OVER operator with solid mask
+        static size_t blend32_block(uint32_t *dst, const uint32_t *src, size_t width, uint32_t alpha)
+        {
+            size_t pos = 0;
+
+#if defined(KCANVAS_SSE2)
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i full = _mm_set1_epi16(255);
+            const __m128i scale = _mm_set1_epi16(short(alpha));
+
+            while ((width - pos) >= 4) {
+                __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos));
+                if (alpha < 255) {
+                    s = _mm_packus_epi16(
+                        multiply_sse2(_mm_unpacklo_epi8(s, zero), scale),
+                        multiply_sse2(_mm_unpackhi_epi8(s, zero), scale)
+                    );
+                }
+
+                // opaque source replaces destination, empty one leaves it as is
+                if (opaque_sse2(s)) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), s);
+                } else if (!empty_sse2(s)) {
+                    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + pos));
+                    __m128i low = multiply_sse2(
+                        _mm_unpacklo_epi8(d, zero),
+                        _mm_sub_epi16(full, alpha_sse2(_mm_unpacklo_epi8(s, zero)))
+                    );
+                    __m128i high = multiply_sse2(
+                        _mm_unpackhi_epi8(d, zero),
+                        _mm_sub_epi16(full, alpha_sse2(_mm_unpackhi_epi8(s, zero)))
+                    );
+                    d = _mm_adds_epu8(s, _mm_packus_epi16(low, high));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), d);
+                }
+                pos += 4;
+            }
+#elif defined(KCANVAS_NEON)
+            const uint8x16_t scale = vdupq_n_u8(uint8_t(alpha));
+
+            while ((width - pos) >= 16) {
+                uint8x16x4_t s = vld4q_u8(reinterpret_cast<const uint8_t*>(src + pos));
+                uint8x16x4_t d = vld4q_u8(reinterpret_cast<const uint8_t*>(dst + pos));
+
+                if (alpha < 255) {
+                    for (int c = 0; c < 4; ++c) {
+                        s.val[c] = multiply_neon(s.val[c], scale);
+                    }
+                }
+
+                uint8x16_t inverse = vmvnq_u8(s.val[3]);
+                for (int c = 0; c < 4; ++c) {
+                    d.val[c] = vqaddq_u8(s.val[c], multiply_neon(d.val[c], inverse));
+                }
+
+                vst4q_u8(reinterpret_cast<uint8_t*>(dst + pos), d);
+                pos += 16;
+            }
+#else
+            (void)dst;
+            (void)src;
+            (void)width;
+            (void)alpha;
+#endif
+
+            return pos;
+        }
+
+        static void blend32_row(void *dstrow, const void *srcrow, size_t width, uint32_t alpha)
+        {
+            uint32_t *dst = reinterpret_cast<uint32_t*>(dstrow);
+            const uint32_t *src = reinterpret_cast<const uint32_t*>(srcrow);
+
+            for (size_t x = blend32_block(dst, src, width, alpha); x < width; ++x) {
+                uint32_t s = alpha < 255 ? scale_pixel(src[x], alpha) : src[x];
+                uint32_t a = s >> 24;
+
+                if (a == 255) {
+                    dst[x] = s;
+                } else if (s) {
+                    dst[x] = add_pixel(s, scale_pixel(dst[x], 255 - a));
+                }
+            }
+        }
+
+        static void blend8_row(void *dstrow, const void *srcrow, size_t width, uint32_t alpha)
+        {
+            uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+            const uint8_t *src = reinterpret_cast<const uint8_t*>(srcrow);
+
+            for (size_t x = 0; x < width; ++x) {
+                uint32_t s = alpha < 255 ? premultiply_channel(src[x], alpha) : src[x];
+                dst[x] = uint8_t(s + premultiply_channel(dst[x], 255 - s));
+            }
+        }
+
+
+        // rarely used conversions, scalar code only
+
+        static void luminance_row(void *dstrow, const void *srcrow, size_t width)
+        {
+            uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+            const uint32_t *src = reinterpret_cast<const uint32_t*>(srcrow);
+
+            for (size_t x = 0; x < width; ++x) {
+                uint32_t v = src[x];
+                dst[x] = luminance((v >> 16) & 0xff, (v >> 8) & 0xff, v & 0xff);
+            }
+        }
+
+        static void luminance_rgb_row(void *dstrow, const void *srcrow, size_t width)
+        {
+            uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+            const uint8_t *src = reinterpret_cast<const uint8_t*>(srcrow);
+
+            for (size_t x = 0; x < width; ++x, src += 3) {
+                dst[x] = luminance(src[0], src[1], src[2]);
+            }
+        }
+
+        // mask to white color with straight alpha
+        static void mask_white_row(void *dstrow, const void *srcrow, size_t width)
+        {
+            uint32_t *dst = reinterpret_cast<uint32_t*>(dstrow);
+            const uint8_t *src = reinterpret_cast<const uint8_t*>(srcrow);
+
+            for (size_t x = 0; x < width; ++x) {
+                dst[x] = src[x] ? (uint32_t(src[x]) << 24) | 0x00ffffffu : 0;
+            }
+        }
+
+        // mask to white color drawn over black background
+        static void mask_rgb_row(void *dstrow, const void *srcrow, size_t width)
+        {
+            uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+            const uint8_t *src = reinterpret_cast<const uint8_t*>(srcrow);
+
+            for (size_t x = 0; x < width; ++x, dst += 3) {
+                dst[0] = dst[1] = dst[2] = src[x];
+            }
+        }
+
+        static void copy32_row(void *dst, const void *src, size_t width)
+        {
+            memcpy(dst, src, width * 4);
+        }
+
+        static void copy8_row(void *dst, const void *src, size_t width)
+        {
+            memcpy(dst, src, width);
+        }
+
+
+        // 2x2 box filter, every destination pixel is rounded average of
+        // 2x2 block of source pixels (premultiplied values are averaged as is)
+        static size_t downsample32_block(uint32_t *dst, const uint32_t *row0, const uint32_t *row1, size_t width, size_t srcwidth)
+        {
+            size_t pos = 0;
+
+#if defined(KCANVAS_SSE2)
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i two = _mm_set1_epi16(2);
+            while ((width - pos) >= 4 && (pos + 4) * 2 <= srcwidth) {
+                __m128i result[2];
+                for (size_t half = 0; half < 2; ++half) {
+                    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + pos * 2 + half * 4));
+                    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + pos * 2 + half * 4));
+
+                    // vertical sums of 4 source columns
+                    __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                    __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+                    // horizontal sums of column pairs
+                    __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high));
+                    result[half] = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), _mm_packus_epi16(result[0], result[1]));
+                pos += 4;
+            }
+#elif defined(KCANVAS_NEON)
+            while ((width - pos) >= 4 && (pos + 4) * 2 <= srcwidth) {
+                // even and odd source columns
+                uint32x4x2_t a = vld2q_u32(row0 + pos * 2);
+                uint32x4x2_t b = vld2q_u32(row1 + pos * 2);
+
+                uint8x16_t a0 = vreinterpretq_u8_u32(a.val[0]);
+                uint8x16_t a1 = vreinterpretq_u8_u32(a.val[1]);
+                uint8x16_t b0 = vreinterpretq_u8_u32(b.val[0]);
+                uint8x16_t b1 = vreinterpretq_u8_u32(b.val[1]);
+
+                uint16x8_t low = vaddl_u8(vget_low_u8(a0), vget_low_u8(a1));
+                low = vaddw_u8(vaddw_u8(low, vget_low_u8(b0)), vget_low_u8(b1));
+                uint16x8_t high = vaddl_u8(vget_high_u8(a0), vget_high_u8(a1));
+                high = vaddw_u8(vaddw_u8(high, vget_high_u8(b0)), vget_high_u8(b1));
+
+                vst1q_u8(
+                    reinterpret_cast<uint8_t*>(dst + pos),
+                    vcombine_u8(vrshrn_n_u16(low, 2), vrshrn_n_u16(high, 2))
+                );
+                pos += 4;
+            }
+#else
+            (void)dst;
+            (void)row0;
+            (void)row1;
+            (void)width;
+            (void)srcwidth;
+#endif
+
+            return pos;
+        }
+
+        static void downsample32_row(void *dstrow, const void *srcrow0, const void *srcrow1, size_t width, size_t srcwidth)
+        {
+            uint32_t *dst = reinterpret_cast<uint32_t*>(dstrow);
+            const uint32_t *row0 = reinterpret_cast<const uint32_t*>(srcrow0);
+            const uint32_t *row1 = reinterpret_cast<const uint32_t*>(srcrow1);
+
+            for (size_t x = downsample32_block(dst, row0, row1, width, srcwidth); x < width; ++x) {
+                size_t x0 = x * 2;
+                size_t x1 = x0 + 1 < srcwidth ? x0 + 1 : x0;
+
+                uint32_t result = 0;
+                for (unsigned shift = 0; shift < 32; shift += 8) {
+                    uint32_t sum =
+                        ((row0[x0] >> shift) & 0xff) + ((row0[x1] >> shift) & 0xff) +
+                        ((row1[x0] >> shift) & 0xff) + ((row1[x1] >> shift) & 0xff);
+                    result |= ((sum + 2) >> 2) << shift;
+                }
+                dst[x] = result;
+            }
+        }
+
+        static size_t downsample8_block(uint8_t *dst, const uint8_t *row0, const uint8_t *row1, size_t width, size_t srcwidth)
+        {
+            size_t pos = 0;
+
+#if defined(KCANVAS_SSE2)
+            const __m128i low = _mm_set1_epi16(0xff);
+            const __m128i two = _mm_set1_epi16(2);
+            while ((width - pos) >= 16 && (pos + 16) * 2 <= srcwidth) {
+                __m128i result[2];
+                for (size_t half = 0; half < 2; ++half) {
+                    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + pos * 2 + half * 16));
+                    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + pos * 2 + half * 16));
+
+                    // even and odd columns of both rows
+                    __m128i sum = _mm_add_epi16(
+                        _mm_add_epi16(_mm_and_si128(a, low), _mm_srli_epi16(a, 8)),
+                        _mm_add_epi16(_mm_and_si128(b, low), _mm_srli_epi16(b, 8))
+                    );
+                    result[half] = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), _mm_packus_epi16(result[0], result[1]));
+                pos += 16;
+            }
+#elif defined(KCANVAS_NEON)
+            while ((width - pos) >= 8 && (pos + 8) * 2 <= srcwidth) {
+                uint16x8_t sum = vpaddlq_u8(vld1q_u8(row0 + pos * 2));
+                sum = vpadalq_u8(sum, vld1q_u8(row1 + pos * 2));
+                vst1_u8(dst + pos, vrshrn_n_u16(sum, 2));
+                pos += 8;
+            }
+#else
+            (void)dst;
+            (void)row0;
+            (void)row1;
+            (void)width;
+            (void)srcwidth;
+#endif
+
+            return pos;
+        }
+
+        static void downsample8_row(void *dstrow, const void *srcrow0, const void *srcrow1, size_t width, size_t srcwidth)
+        {
+            uint8_t *dst = reinterpret_cast<uint8_t*>(dstrow);
+            const uint8_t *row0 = reinterpret_cast<const uint8_t*>(srcrow0);
+            const uint8_t *row1 = reinterpret_cast<const uint8_t*>(srcrow1);
+
+            for (size_t x = downsample8_block(dst, row0, row1, width, srcwidth); x < width; ++x) {
+                size_t x0 = x * 2;
+                size_t x1 = x0 + 1 < srcwidth ? x0 + 1 : x0;
+                dst[x] = uint8_t((row0[x0] + row0[x1] + row1[x0] + row1[x1] + 2) >> 2);
+            }
+        }
+
+
+        size_t PixelSize(kBitmapFormat format)
+        {
+            switch (format) {
+                case kBitmapFormat::Mask8Bit:
+                case kBitmapFormat::Gray8Bit:
+                    return 1;
+
+                case kBitmapFormat::Color24Bit:
+                    return 3;
+
+                default:
+                    return 4;
+            }
+        }
+
+        bool StorageFormat(kBitmapFormat format)
+        {
+            return
+                format == kBitmapFormat::Color32BitAlphaPremultiplied ||
+                format == kBitmapFormat::Mask8Bit;
+        }
+
+        PixelRowConverter GetPixelRowConverter(kBitmapFormat dstformat, kBitmapFormat srcformat)
+        {
+            switch (dstformat) {
+                case kBitmapFormat::Color32BitAlphaPremultiplied:
+                    // upload into color bitmap
+                    switch (srcformat) {
+                        case kBitmapFormat::Color32BitAlphaPremultiplied:     return copy32_row;
+                        case kBitmapFormat::Mask8Bit:                         return expand_mask_row;
+                        case kBitmapFormat::Color32BitAlpha:                  return premultiply_row;
+                        case kBitmapFormat::Color32BitRGBAAlphaPremultiplied: return swizzle_row;
+                        case kBitmapFormat::Color32BitRGBAAlpha:              return premultiply_swizzle_row;
+                        case kBitmapFormat::Color24Bit:                       return expand_rgb_row;
+                        case kBitmapFormat::Gray8Bit:                         return expand_gray_row;
+                    }
+                    break;
+
+                case kBitmapFormat::Mask8Bit:
+                    // upload into mask bitmap
+                    switch (srcformat) {
+                        case kBitmapFormat::Mask8Bit:
+                        case kBitmapFormat::Gray8Bit:
+                            return copy8_row;
+
+                        case kBitmapFormat::Color32BitAlphaPremultiplied:
+                        case kBitmapFormat::Color32BitAlpha:
+                        case kBitmapFormat::Color32BitRGBAAlphaPremultiplied:
+                        case kBitmapFormat::Color32BitRGBAAlpha:
+                            return alpha_row;
+
+                        case kBitmapFormat::Color24Bit:
+                            return luminance_rgb_row;
+                    }
+                    break;
+
+                default:
+                    break;
+            }
+
+            switch (srcformat) {
+                case kBitmapFormat::Color32BitAlphaPremultiplied:
+                    // read from color bitmap
+                    switch (dstformat) {
+                        case kBitmapFormat::Color32BitAlpha:                  return unpremultiply_row;
+                        case kBitmapFormat::Color32BitRGBAAlphaPremultiplied: return swizzle_row;
+                        case kBitmapFormat::Color32BitRGBAAlpha:              return unpremultiply_swizzle_row;
+                        case kBitmapFormat::Color24Bit:                       return shrink_rgb_row;
+                        case kBitmapFormat::Gray8Bit:                         return luminance_row;
+                        default:                                              break;
+                    }
+                    break;
+
+                case kBitmapFormat::Mask8Bit:
+                    // read from mask bitmap
+                    switch (dstformat) {
+                        case kBitmapFormat::Color32BitRGBAAlphaPremultiplied: return expand_mask_row;
+                        case kBitmapFormat::Color32BitAlpha:
+                        case kBitmapFormat::Color32BitRGBAAlpha:              return mask_white_row;
+                        case kBitmapFormat::Color24Bit:                       return mask_rgb_row;
+                        case kBitmapFormat::Gray8Bit:                         return copy8_row;
+                        default:                                              break;
+                    }
+                    break;
+
+                default:
+                    break;
+            }
+
+            return nullptr;
+        }
+
+        void DownsampleRow(kBitmapFormat format, void *dst, const void *row0, const void *row1, size_t width, size_t srcwidth)
+        {
+            if (PixelSize(format) == 1) {
+                downsample8_row(dst, row0, row1, width, srcwidth);
+            } else {
+                downsample32_row(dst, row0, row1, width, srcwidth);
+            }
+        }
+
+        uint32_t StoragePixel(kBitmapFormat format, const kColor &color)
+        {
+            if (PixelSize(format) == 1) {
+                return color.a;
+            }
+
+            return
+                uint32_t(color.a) << 24 |
+                premultiply_channel(color.r, color.a) << 16 |
+                premultiply_channel(color.g, color.a) << 8 |
+                premultiply_channel(color.b, color.a);
+        }
+
+        void FillRow(kBitmapFormat format, void *dst, uint32_t pixel, size_t width)
+        {
+            if (PixelSize(format) == 1) {
+                memset(dst, int(pixel), width);
+            } else {
+                fill32_row(dst, pixel, width);
+            }
+        }
+
+        void BlendRow(kBitmapFormat format, void *dst, const void *src, size_t width, uint32_t alpha)
+        {
+            if (PixelSize(format) == 1) {
+                blend8_row(dst, src, width, alpha);
+            } else {
+                blend32_row(dst, src, width, alpha);
+            }
+        }
+    }
+}
@@ -0,0 +1,61 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    pixelconverter.h
+        pixel format conversion between kBitmapFormat formats
+        used by bitmap implementations for Update and Read,
+        box filter for mip levels, solid color fill and blending
+*/
+
+#pragma once
+#include "canvastypes.h"
+
+
+namespace k_canvas
+{
+    namespace impl
+    {
+        // converts row of width pixels from source format to destination format
+        // conversion code assumes little endian platform, native 32 bit ARGB
+        // pixels are stored as B, G, R, A bytes
+        typedef void (*PixelRowConverter)(void *dst, const void *src, size_t width);
+
+        // byte size of single pixel of given format
+        size_t PixelSize(kBitmapFormat format);
+
+        // true for formats bitmap pixels can be stored in, the rest are
+        // only source and destination formats for Update and Read
+        bool StorageFormat(kBitmapFormat format);
+
+        // returns converter for given format pair, one of formats must be bitmap
+        // storage format (Color32BitAlphaPremultiplied or Mask8Bit),
+        // nullptr returned for unsupported pairs
+        PixelRowConverter GetPixelRowConverter(kBitmapFormat dstformat, kBitmapFormat srcformat);
+
+        // 2x2 box filter for mip level generation, averages blocks of 2x2
+        // pixels of source rows row0 and row1 into row of width pixels,
+        // source of 1 pixel width or height is handled by repeating
+        // its column (or passing the same row twice)
+        // format must be bitmap storage format
+        void DownsampleRow(kBitmapFormat format, void *dst, const void *row0, const void *row1, size_t width, size_t srcwidth);
+
+        // color as pixel of bitmap storage format, premultiplied native
+        // 32 bit ARGB or alpha byte for mask
+        uint32_t StoragePixel(kBitmapFormat format, const kColor &color);
+
+        // fills row of width pixels of bitmap storage format with pixel
+        // value returned by StoragePixel
+        void FillRow(kBitmapFormat format, void *dst, uint32_t pixel, size_t width);
+
+        // draws row of width pixels of bitmap storage format over destination
+        // row of the same format, source is scaled by alpha (0 - 255) first,
+        // result is the same as Cairo painting of source with that alpha
+        void BlendRow(kBitmapFormat format, void *dst, const void *src, size_t width, uint32_t alpha);
+    }
+}
@@ -0,0 +1,739 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    pngencoder.cpp
+        parallel and streaming PNG encoders
+*/
+
+#include "pngencoder.h"
+
+
+using namespace k_canvas;
+using namespace impl;
+using namespace c_util;
+
+
+#ifdef KCANVAS_ZLIB
+
+#include "pixelconverter.h"
+#include <zlib.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <cstdlib>
+
+
+// amount of filtered image data per band, smaller bands compress worse
+// because of flushes and give more synchronisation overhead
+static const size_t PNG_BAND_SIZE = 1024 * 1024;
+
+// deflate window size, amount of preceding data used to prime band compression
+static const size_t PNG_DICTIONARY_SIZE = 32768;
+
+static const uint8_t PNG_SIGNATURE[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+
+static inline void put32be(uint8_t *dest, uint32_t value)
+{
+    dest[0] = uint8_t(value >> 24);
+    dest[1] = uint8_t(value >> 16);
+    dest[2] = uint8_t(value >> 8);
+    dest[3] = uint8_t(value);
+}
+
+// CRC of chunk type and data
+static inline uint32_t ChunkCRC(const char *type, const uint8_t *data, size_t size)
+{
+    uLong crc = crc32(0, reinterpret_cast<const Bytef*>(type), 4);
+    return uint32_t(size ? crc32(crc, data, uInt(size)) : crc);
+}
+
+// writes chunk with precomputed CRC
+static bool WriteChunk(kImageSink &sink, const char *type, const uint8_t *data, size_t size, uint32_t crc)
+{
+    uint8_t header[8];
+    put32be(header, uint32_t(size));
+    memcpy(header + 4, type, 4);
+
+    uint8_t trailer[4];
+    put32be(trailer, crc);
+
+    return
+        sink.Write(header, sizeof(header)) &&
+        (size == 0 || sink.Write(data, size)) &&
+        sink.Write(trailer, sizeof(trailer));
+}
+
+// PNG signature and IHDR chunk
+static bool WriteHeader(kImageSink &sink, size_t width, size_t height, uint8_t colortype)
+{
+    uint8_t header[13];
+    put32be(header, uint32_t(width));
+    put32be(header + 4, uint32_t(height));
+    header[8] = 8;            // bit depth
+    header[9] = colortype;
+    header[10] = 0;           // deflate compression
+    header[11] = 0;           // adaptive filtering
+    header[12] = 0;           // no interlace
+
+    return
+        sink.Write(PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) &&
+        WriteChunk(sink, "IHDR", header, sizeof(header), ChunkCRC("IHDR", header, sizeof(header)));
+}
+
+static inline int paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+
+    if (pa <= pb && pa <= pc) {
+        return a;
+    }
+
+    return pb <= pc ? b : c;
+}
+
+// filter single row of size bytes, filter with minimal sum of absolute
+// signed differences is chosen (the same heuristic libpng uses)
+// prev points to zero row for the first image row
+// first bpp bytes have no left neighbours and are handled separately
+static void FilterRow(uint8_t *dest, const uint8_t *row, const uint8_t *prev, size_t size, size_t bpp)
+{
+    // sums for None, Sub, Up and Paeth filters
+    uint32_t sums[4] = { 0, 0, 0, 0 };
+
+    for (size_t n = 0; n < bpp; ++n) {
+        sums[0] += abs(int8_t(row[n]));
+        sums[1] += abs(int8_t(row[n]));
+        sums[2] += abs(int8_t(row[n] - prev[n]));
+        sums[3] += abs(int8_t(row[n] - prev[n]));
+    }
+
+    for (size_t n = bpp; n < size; ++n) {
+        int x = row[n];
+        sums[0] += abs(int8_t(x));
+        sums[1] += abs(int8_t(x - row[n - bpp]));
+        sums[2] += abs(int8_t(x - prev[n]));
+        sums[3] += abs(int8_t(x - paeth(row[n - bpp], prev[n], prev[n - bpp])));
+    }
+
+    size_t best = 0;
+    for (size_t f = 1; f < 4; ++f) {
+        if (sums[f] < sums[best]) {
+            best = f;
+        }
+    }
+
+    static const uint8_t filtertypes[4] = { 0, 1, 2, 4 };
+    *dest++ = filtertypes[best];
+
+    switch (best) {
+        case 0:
+            memcpy(dest, row, size);
+            break;
+
+        case 1:
+            memcpy(dest, row, bpp);
+            for (size_t n = bpp; n < size; ++n) {
+                dest[n] = uint8_t(row[n] - row[n - bpp]);
+            }
+            break;
+
+        case 2:
+            for (size_t n = 0; n < size; ++n) {
+                dest[n] = uint8_t(row[n] - prev[n]);
+            }
+            break;
+
+        default:
+            // Paeth predictor is the upper byte when there's no left neighbour
+            for (size_t n = 0; n < bpp; ++n) {
+                dest[n] = uint8_t(row[n] - prev[n]);
+            }
+            for (size_t n = bpp; n < size; ++n) {
+                dest[n] = uint8_t(row[n] - paeth(row[n - bpp], prev[n], prev[n - bpp]));
+            }
+            break;
+    }
+}
+
+
+/*
+ -------------------------------------------------------------------------------
+ ParallelPNGEncoder
+ -------------------------------------------------------------------------------
+    bands are taken by worker threads in order, compressed data is kept
+    in ring of band slots and written by calling thread in order, so
+    only limited number of compressed bands is held in memory
+*/
+
+struct PNGBand
+{
+    std::vector<uint8_t> data;   // compressed data
+    uint32_t             crc;    // CRC of IDAT chunk type and data
+    uLong                adler;  // adler32 of band's filtered data
+    size_t               length; // size of band's filtered data
+    bool                 ready;
+    bool                 failed;
+};
+
+class ParallelPNGEncoder
+{
+public:
+    ParallelPNGEncoder(const kBitmap &bitmap, const kImageEncodeProperties *properties);
+
+    size_t bands() const { return p_bands; }
+    size_t threads() const { return p_threads; }
+
+    bool Encode(kImageSink &sink);
+
+private:
+    // per thread buffers, reused for all bands compressed by a thread
+    struct Scratch
+    {
+        std::vector<uint8_t> pixels;
+        std::vector<uint8_t> filtered;
+        std::vector<uint8_t> zero;
+        z_stream             stream;
+        bool                 initialized;
+
+        Scratch(size_t rowsize);
+        ~Scratch();
+    };
+
+    struct Worker
+    {
+        ParallelPNGEncoder *encoder;
+        void operator()() const { encoder->Work(); }
+    };
+
+    void Work();
+    bool CompressBand(size_t band, PNGBand &slot, Scratch &scratch);
+
+private:
+    const kBitmap           &p_bitmap;
+    kBitmapFormat            p_format;   // format of PNG rows
+    uint8_t                  p_colortype;
+    size_t                   p_bpp;
+    size_t                   p_rowsize;  // row size without filter type byte
+    size_t                   p_bandrows;
+    size_t                   p_bands;
+    size_t                   p_threads;
+    int                      p_level;
+
+    const uint8_t           *p_pixels;   // bitmap pixels when implementation gives
+                                         // direct access, nullptr otherwise
+    size_t                   p_pitch;
+    PixelRowConverter        p_convert;  // bitmap format to PNG row format
+
+    std::vector<PNGBand>     p_slots;
+    std::mutex               p_lock;     // guards slots state and counters
+    std::mutex               p_readlock; // bitmap without direct access is read
+                                         // by one thread at a time
+    std::condition_variable  p_bandready;
+    std::condition_variable  p_slotfree;
+    size_t                   p_next;     // next band to compress
+    size_t                   p_written;  // number of bands written into sink
+    bool                     p_abort;
+};
+
+ParallelPNGEncoder::Scratch::Scratch(size_t rowsize) :
+    pixels(),
+    filtered(),
+    zero(rowsize, 0),
+    initialized(false)
+{
+    memset(&stream, 0, sizeof(stream));
+}
+
+ParallelPNGEncoder::Scratch::~Scratch()
+{
+    if (initialized) {
+        deflateEnd(&stream);
+    }
+}
+
+ParallelPNGEncoder::ParallelPNGEncoder(const kBitmap &bitmap, const kImageEncodeProperties *properties) :
+    p_bitmap(bitmap),
+    p_bands(0),
+    p_threads(1),
+    p_level(Z_DEFAULT_COMPRESSION),
+    p_pixels(nullptr),
+    p_pitch(0),
+    p_convert(nullptr),
+    p_next(0),
+    p_written(0),
+    p_abort(false)
+{
+    // mask is written as gray image, color as RGBA with straight alpha
+    if (bitmap.format() == kBitmapFormat::Mask8Bit) {
+        p_format = kBitmapFormat::Gray8Bit;
+        p_colortype = 0;
+        p_bpp = 1;
+    } else {
+        p_format = kBitmapFormat::Color32BitRGBAAlpha;
+        p_colortype = 6;
+        p_bpp = 4;
+    }
+
+    p_rowsize = bitmap.width() * p_bpp;
+
+    // band layout depends only on image, so output is the same for any
+    // number of threads
+    p_bandrows = umax(PNG_BAND_SIZE / (p_rowsize + 1), size_t(1));
+    p_bands = (bitmap.height() + p_bandrows - 1) / p_bandrows;
+
+    size_t threads = properties && properties->threads ?
+        properties->threads : size_t(std::thread::hardware_concurrency());
+    p_threads = umax(umin(threads, p_bands), size_t(1));
+
+    if (properties && properties->compression >= 0) {
+        p_level = umin(properties->compression, 9);
+    }
+}
+
+bool ParallelPNGEncoder::Encode(kImageSink &sink)
+{
+    if (p_bitmap.width() == 0 || p_bitmap.height() == 0) {
+        return false;
+    }
+
+    if (!WriteHeader(sink, p_bitmap.width(), p_bitmap.height(), p_colortype)) {
+        return false;
+    }
+
+    // when pixels are accessible directly every thread reads and converts
+    // its own rows, bitmap isn't changed, so it's unlocked with empty
+    // dirty rectangle
+    kBitmap &bitmap = const_cast<kBitmap&>(p_bitmap);
+    p_convert = GetPixelRowConverter(p_format, p_bitmap.format());
+    if (p_convert) {
+        p_pixels = reinterpret_cast<const uint8_t*>(bitmap.Lock(p_pitch));
+    }
+
+    // two slots per thread let threads go ahead while writer is busy
+    p_slots.resize(p_threads * 2);
+    for (size_t n = 0; n < p_slots.size(); ++n) {
+        p_slots[n].ready = false;
+        p_slots[n].failed = false;
+    }
+
+    std::vector<std::thread> workers;
+    if (p_threads > 1) {
+        Worker worker = { this };
+        for (size_t n = 0; n < p_threads; ++n) {
+            workers.push_back(std::thread(worker));
+        }
+    }
+
+    Scratch scratch(p_rowsize);
+    uLong adler = adler32(0, Z_NULL, 0);
+    bool result = true;
+
+    for (size_t band = 0; band < p_bands; ++band) {
+        PNGBand &slot = p_slots[band % p_slots.size()];
+
+        if (p_threads > 1) {
+            std::unique_lock<std::mutex> lock(p_lock);
+            while (!slot.ready) {
+                p_bandready.wait(lock);
+            }
+        } else {
+            slot.failed = !CompressBand(band, slot, scratch);
+        }
+
+        if (slot.failed) {
+            result = false;
+            break;
+        }
+
+        adler = adler32_combine(adler, slot.adler, z_off_t(slot.length));
+
+        // zlib stream ends with adler32 of all uncompressed data
+        if (band == p_bands - 1) {
+            uint8_t trailer[4];
+            put32be(trailer, uint32_t(adler));
+            slot.data.insert(slot.data.end(), trailer, trailer + 4);
+            slot.crc = uint32_t(crc32(slot.crc, trailer, 4));
+        }
+
+        if (!WriteChunk(sink, "IDAT", slot.data.data(), slot.data.size(), slot.crc)) {
+            result = false;
+            break;
+        }
+
+        if (p_threads > 1) {
+            {
+                std::lock_guard<std::mutex> lock(p_lock);
+                slot.ready = false;
+                ++p_written;
+            }
+            p_slotfree.notify_all();
+        }
+    }
+
+    if (!result) {
+        {
+            std::lock_guard<std::mutex> lock(p_lock);
+            p_abort = true;
+        }
+        p_slotfree.notify_all();
+    }
+
+    for (size_t n = 0; n < workers.size(); ++n) {
+        workers[n].join();
+    }
+
+    if (p_pixels) {
+        kRectInt unchanged(0, 0, 0, 0);
+        bitmap.Unlock(&unchanged);
+        p_pixels = nullptr;
+    }
+
+    return result && WriteChunk(sink, "IEND", nullptr, 0, ChunkCRC("IEND", nullptr, 0));
+}
+
+void ParallelPNGEncoder::Work()
+{
+    Scratch scratch(p_rowsize);
+
+    for (;;) {
+        size_t band;
+
+        {
+            std::unique_lock<std::mutex> lock(p_lock);
+
+            // band's slot should be written before it's reused
+            while (!p_abort && p_next < p_bands && p_next >= p_written + p_slots.size()) {
+                p_slotfree.wait(lock);
+            }
+
+            if (p_abort || p_next >= p_bands) {
+                break;
+            }
+
+            band = p_next++;
+        }
+
+        PNGBand &slot = p_slots[band % p_slots.size()];
+        bool compressed = CompressBand(band, slot, scratch);
+
+        {
+            std::lock_guard<std::mutex> lock(p_lock);
+            slot.ready = true;
+            slot.failed = !compressed;
+        }
+        p_bandready.notify_one();
+    }
+}
+
+bool ParallelPNGEncoder::CompressBand(size_t band, PNGBand &slot, Scratch &scratch)
+{
+    size_t height = p_bitmap.height();
+    size_t filteredsize = p_rowsize + 1;
+
+    size_t first = band * p_bandrows;
+    size_t last = umin(first + p_bandrows, height);
+
+    // rows preceding band are filtered too, their filtered data
+    // primes compression as it was compressed by previous band
+    size_t dictrows = umin(first, (PNG_DICTIONARY_SIZE + p_rowsize) / filteredsize);
+    size_t filterfirst = first - dictrows;
+    size_t readfirst = filterfirst ? filterfirst - 1 : 0;
+
+    scratch.pixels.resize((last - readfirst) * p_rowsize);
+    if (p_pixels) {
+        // rows of different bands are converted on their threads
+        for (size_t y = readfirst; y < last; ++y) {
+            p_convert(scratch.pixels.data() + (y - readfirst) * p_rowsize, p_pixels + y * p_pitch, p_bitmap.width());
+        }
+    } else {
+        std::lock_guard<std::mutex> lock(p_readlock);
+
+        kRectInt rect(0, int(readfirst), int(p_bitmap.width()), int(last));
+        if (!p_bitmap.Read(&rect, p_format, p_rowsize, scratch.pixels.data())) {
+            return false;
+        }
+    }
+
+    scratch.filtered.resize((last - filterfirst) * filteredsize);
+    for (size_t y = filterfirst; y < last; ++y) {
+        const uint8_t *row = scratch.pixels.data() + (y - readfirst) * p_rowsize;
+        FilterRow(
+            scratch.filtered.data() + (y - filterfirst) * filteredsize,
+            row, y ? row - p_rowsize : scratch.zero.data(),
+            p_rowsize, p_bpp
+        );
+    }
+
+    const uint8_t *input = scratch.filtered.data() + dictrows * filteredsize;
+    size_t inputsize = (last - first) * filteredsize;
+    size_t dictsize = umin(dictrows * filteredsize, PNG_DICTIONARY_SIZE);
+
+    slot.adler = adler32(adler32(0, Z_NULL, 0), input, uInt(inputsize));
+    slot.length = inputsize;
+
+    // raw deflate stream, zlib header and trailer are written separately
+    z_stream &stream = scratch.stream;
+    if (scratch.initialized) {
+        deflateReset(&stream);
+    } else {
+        if (deflateInit2(&stream, p_level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        scratch.initialized = true;
+    }
+
+    if (dictsize && deflateSetDictionary(&stream, input - dictsize, uInt(dictsize)) != Z_OK) {
+        return false;
+    }
+
+    size_t produced = 0;
+    slot.data.resize(deflateBound(&stream, uLong(inputsize)) + 16);
+
+    if (band == 0) {
+        // zlib header, deflate with 32K window and compression level hint
+        int level = p_level < 0 ? 6 : p_level;
+        uint8_t cmf = 0x78;
+        uint8_t flg = uint8_t((level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6);
+        flg += uint8_t(31 - (cmf * 256 + flg) % 31);
+
+        slot.data[0] = cmf;
+        slot.data[1] = flg;
+        produced = 2;
+    }
+
+    // last band finishes stream, others end with sync flush, which aligns
+    // output to byte boundary so next band's data can be appended
+    bool lastband = last == height;
+    int flush = lastband ? Z_FINISH : Z_SYNC_FLUSH;
+
+    stream.next_in = const_cast<Bytef*>(input);
+    stream.avail_in = uInt(inputsize);
+
+    for (;;) {
+        stream.next_out = slot.data.data() + produced;
+        stream.avail_out = uInt(slot.data.size() - produced);
+
+        int result = deflate(&stream, flush);
+        produced = slot.data.size() - stream.avail_out;
+
+        if (result == Z_STREAM_END) {
+            break;
+        }
+
+        if (result != Z_OK && result != Z_BUF_ERROR) {
+            return false;
+        }
+
+        if (!lastband && stream.avail_in == 0 && stream.avail_out != 0) {
+            break;
+        }
+
+        slot.data.resize(slot.data.size() * 2);
+    }
+
+    slot.data.resize(produced);
+    slot.crc = ChunkCRC("IDAT", slot.data.data(), produced);
+
+    return true;
+}
+
+/*
+ -------------------------------------------------------------------------------
+ StreamPNGWriter
+ -------------------------------------------------------------------------------
+    rows are filtered and compressed as they come, compressed data is
+    written as IDAT chunk each time output buffer is filled, so only
+    previous row and output buffer are held in memory
+*/
+
+// size of IDAT chunks written by streaming writer
+static const size_t PNG_CHUNK_SIZE = 64 * 1024;
+
+class StreamPNGWriter : public PNGStreamWriter
+{
+public:
+    StreamPNGWriter(kImageSink &sink, size_t width, size_t height, bool gray);
+    ~StreamPNGWriter() override;
+
+    bool Initialize(int compression);
+
+    bool WriteRows(const uint8_t *rows, size_t pitch, size_t count) override;
+
+private:
+    bool Deflate(int flush);
+
+private:
+    kImageSink           &p_sink;
+    size_t                p_width;
+    size_t                p_height;
+    size_t                p_bpp;
+    size_t                p_rowsize;  // row size without filter type byte
+    size_t                p_row;      // number of rows written
+    std::vector<uint8_t>  p_prev;     // previous unfiltered row
+    std::vector<uint8_t>  p_filtered; // filtered row with filter type byte
+    std::vector<uint8_t>  p_out;
+    z_stream              p_stream;
+    bool                  p_initialized;
+    bool                  p_failed;
+};
+
+StreamPNGWriter::StreamPNGWriter(kImageSink &sink, size_t width, size_t height, bool gray) :
+    p_sink(sink),
+    p_width(width),
+    p_height(height),
+    p_bpp(gray ? 1 : 4),
+    p_rowsize(width * p_bpp),
+    p_row(0),
+    p_prev(p_rowsize, 0),
+    p_filtered(p_rowsize + 1),
+    p_out(PNG_CHUNK_SIZE),
+    p_initialized(false),
+    p_failed(false)
+{
+    memset(&p_stream, 0, sizeof(p_stream));
+}
+
+StreamPNGWriter::~StreamPNGWriter()
+{
+    if (p_initialized) {
+        deflateEnd(&p_stream);
+    }
+}
+
+bool StreamPNGWriter::Initialize(int compression)
+{
+    int level = compression >= 0 ? umin(compression, 9) : Z_DEFAULT_COMPRESSION;
+
+    // zlib wrapper is produced by deflate itself since data
+    // is compressed as single stream
+    if (deflateInit(&p_stream, level) != Z_OK) {
+        return false;
+    }
+    p_initialized = true;
+
+    p_stream.next_out = p_out.data();
+    p_stream.avail_out = uInt(p_out.size());
+
+    return WriteHeader(p_sink, p_width, p_height, p_bpp == 1 ? 0 : 6);
+}
+
+bool StreamPNGWriter::Deflate(int flush)
+{
+    for (;;) {
+        int result = deflate(&p_stream, flush);
+        if (result == Z_STREAM_ERROR) {
+            return false;
+        }
+
+        bool finished = result == Z_STREAM_END;
+
+        // output buffer is full or stream is done, write pending data
+        if (p_stream.avail_out == 0 || (finished && p_stream.avail_out < p_out.size())) {
+            size_t size = p_out.size() - p_stream.avail_out;
+            if (!WriteChunk(p_sink, "IDAT", p_out.data(), size, ChunkCRC("IDAT", p_out.data(), size))) {
+                return false;
+            }
+            p_stream.next_out = p_out.data();
+            p_stream.avail_out = uInt(p_out.size());
+        }
+
+        if (finished) {
+            return true;
+        }
+
+        // all input consumed and there's room left in output buffer,
+        // deflate has nothing more to give for now
+        if (flush == Z_NO_FLUSH && p_stream.avail_in == 0 && p_stream.avail_out > 0) {
+            return true;
+        }
+    }
+}
+
+bool StreamPNGWriter::WriteRows(const uint8_t *rows, size_t pitch, size_t count)
+{
+    if (p_failed || count > p_height - p_row) {
+        return false;
+    }
+
+    for (size_t n = 0; n < count; ++n) {
+        const uint8_t *row = rows + pitch * n;
+
+        FilterRow(p_filtered.data(), row, p_prev.data(), p_rowsize, p_bpp);
+        memcpy(p_prev.data(), row, p_rowsize);
+
+        bool last = ++p_row == p_height;
+
+        p_stream.next_in = p_filtered.data();
+        p_stream.avail_in = uInt(p_filtered.size());
+
+        if (!Deflate(last ? Z_FINISH : Z_NO_FLUSH)) {
+            p_failed = true;
+            return false;
+        }
+
+        if (last && !WriteChunk(p_sink, "IEND", nullptr, 0, ChunkCRC("IEND", nullptr, 0))) {
+            p_failed = true;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool k_canvas::impl::UseParallelPNG(const kBitmap &bitmap, const kImageEncodeProperties *properties)
+{
+    ParallelPNGEncoder encoder(bitmap, properties);
+    return encoder.threads() > 1 && encoder.bands() > 1;
+}
+
+bool k_canvas::impl::EncodeParallelPNG(const kBitmap &bitmap, kImageSink &sink, const kImageEncodeProperties *properties)
+{
+    ParallelPNGEncoder encoder(bitmap, properties);
+    return encoder.Encode(sink);
+}
+
+PNGStreamWriter* k_canvas::impl::CreatePNGStreamWriter(kImageSink &sink, size_t width, size_t height, bool gray, int compression)
+{
+    if (width == 0 || height == 0) {
+        return nullptr;
+    }
+
+    StreamPNGWriter *writer = new StreamPNGWriter(sink, width, height, gray);
+    if (!writer->Initialize(compression)) {
+        delete writer;
+        return nullptr;
+    }
+
+    return writer;
+}
+
+#else
+
+bool k_canvas::impl::UseParallelPNG(const kBitmap &bitmap, const kImageEncodeProperties *properties)
+{
+    return false;
+}
+
+bool k_canvas::impl::EncodeParallelPNG(const kBitmap &bitmap, kImageSink &sink, const kImageEncodeProperties *properties)
+{
+    return false;
+}
+
+PNGStreamWriter* k_canvas::impl::CreatePNGStreamWriter(kImageSink &sink, size_t width, size_t height, bool gray, int compression)
+{
+    return nullptr;
+}
+
+#endif
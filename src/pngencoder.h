@@ -0,0 +1,48 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    pngencoder.h
+        parallel and streaming PNG encoders
+*/
+
+#pragma once
+#include "canvas.h"
+
+
+namespace k_canvas
+{
+    namespace impl
+    {
+        // true if bitmap is worth to be compressed by parallel encoder, requires
+        // zlib (KCANVAS_ZLIB), more than one thread and more than one band of rows
+        bool UseParallelPNG(const kBitmap &bitmap, const kImageEncodeProperties *properties);
+
+        // writes PNG image compressing bands of rows on separate threads,
+        // each band is primed with previous band's data and ends with sync flush,
+        // so compressed bands are stitched into single valid zlib stream
+        // output doesn't depend on number of threads
+        bool EncodeParallelPNG(const kBitmap &bitmap, kImageSink &sink, const kImageEncodeProperties *properties);
+
+        // streaming single threaded PNG writer for images produced by bands
+        // of rows, rows are given in PNG pixel format (RGBA or gray), IDAT
+        // chunks are written as compressed data is produced and image is
+        // finished after the last row
+        class PNGStreamWriter
+        {
+        public:
+            virtual ~PNGStreamWriter() {}
+
+            virtual bool WriteRows(const uint8_t *rows, size_t pitch, size_t count) = 0;
+        };
+
+        // writes PNG signature and header, returns nullptr if library is
+        // built without zlib or sink failed
+        PNGStreamWriter* CreatePNGStreamWriter(kImageSink &sink, size_t width, size_t height, bool gray, int compression);
+    }
+}
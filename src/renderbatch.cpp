@@ -0,0 +1,423 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    renderbatch.cpp
+        batch rendering of independent images on worker threads
+*/
+
+#include "canvas.h"
+#include "canvasimpl.h"
+#include "pixelconverter.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <cstring>
+
+
+using namespace k_canvas;
+using namespace impl;
+using namespace c_util;
+
+
+// number of scratch bitmaps kept by every worker
+static const size_t SCRATCH_BITMAPS = 4;
+
+typedef std::chrono::steady_clock Clock;
+
+
+namespace k_canvas
+{
+    namespace impl
+    {
+        /*
+         -------------------------------------------------------------------------------
+         kRenderBatchCanvas
+         -------------------------------------------------------------------------------
+            canvas which is bound to job bitmaps one after another, its
+            implementation object lives as long as worker does
+        */
+        class kRenderBatchCanvas : public kCanvas
+        {
+        public:
+            kRenderBatchCanvas() {}
+
+            bool Bind(const kBitmapImpl *target)
+            {
+                p_transform_stack.clear();
+                p_transform = kTransform();
+                return p_impl->BindToBitmap(target, nullptr);
+            }
+
+            void Unbind()
+            {
+                p_impl->Unbind();
+            }
+        };
+
+
+        /*
+         -------------------------------------------------------------------------------
+         kRenderBatchImpl
+         -------------------------------------------------------------------------------
+            every worker has its own job queue, jobs are distributed over
+            queues in round robin order, worker takes jobs from the front of
+            its queue and steals from the back of other queues when its own
+            queue is empty
+        */
+        class kRenderBatchImpl
+        {
+        public:
+            kRenderBatchImpl(size_t threads);
+            ~kRenderBatchImpl();
+
+            void Submit(
+                size_t width, size_t height, kRenderJob &job, kBitmapFormat format,
+                kImageFormat imageformat, kImageSink *sink
+            );
+            void Wait();
+
+            size_t threads() const { return p_workers.size(); }
+            kRenderBatchStats stats() const;
+
+        private:
+            struct Job
+            {
+                kRenderJob        *job;
+                size_t             width;
+                size_t             height;
+                kBitmapFormat      format;
+                kImageFormat       imageformat;
+                kImageSink        *sink;
+                Clock::time_point  submitted;
+            };
+
+            struct Worker
+            {
+                std::mutex            lock;    // guards job queue
+                std::deque<Job>       jobs;
+                std::vector<kBitmap*> scratch; // most recently used first
+            };
+
+            struct Runner
+            {
+                kRenderBatchImpl *batch;
+                size_t            index;
+                void operator()() const { batch->Work(index); }
+            };
+
+            void Work(size_t index);
+            bool Take(size_t index, Job &job);
+            bool Pop(size_t index, Job &job);
+            void Run(Worker &worker, kRenderBatchCanvas &canvas, const Job &job);
+            kBitmap& Scratch(Worker &worker, size_t width, size_t height, kBitmapFormat format);
+
+        private:
+            std::vector<Worker*>     p_workers;
+            std::vector<std::thread> p_threads;
+
+            mutable std::mutex       p_lock;     // guards counters and statistics
+            std::condition_variable  p_wake;     // jobs queued or shutdown
+            std::condition_variable  p_idle;     // all jobs finished
+            size_t                   p_next;     // queue for next submitted job
+            size_t                   p_queued;   // jobs in queues
+            size_t                   p_pending;  // submitted and not finished jobs
+            bool                     p_shutdown;
+
+            bool                     p_started;
+            Clock::time_point        p_start;    // first submission time
+            Clock::time_point        p_last;     // last job finish time
+            size_t                   p_finished;
+            size_t                   p_failed;
+            double                   p_latency;  // sum of job latencies
+            double                   p_maxlatency;
+        };
+    }
+}
+
+
+kRenderBatchImpl::kRenderBatchImpl(size_t threads) :
+    p_next(0),
+    p_queued(0),
+    p_pending(0),
+    p_shutdown(false),
+    p_started(false),
+    p_finished(0),
+    p_failed(0),
+    p_latency(0),
+    p_maxlatency(0)
+{
+    if (threads == 0) {
+        threads = umax(size_t(std::thread::hardware_concurrency()), size_t(1));
+    }
+
+    p_workers.resize(threads);
+    for (size_t n = 0; n < threads; ++n) {
+        p_workers[n] = new Worker();
+    }
+
+    for (size_t n = 0; n < threads; ++n) {
+        Runner runner = { this, n };
+        p_threads.push_back(std::thread(runner));
+    }
+}
+
+kRenderBatchImpl::~kRenderBatchImpl()
+{
+    Wait();
+
+    {
+        std::lock_guard<std::mutex> lock(p_lock);
+        p_shutdown = true;
+    }
+    p_wake.notify_all();
+
+    for (size_t n = 0; n < p_threads.size(); ++n) {
+        p_threads[n].join();
+    }
+
+    for (size_t n = 0; n < p_workers.size(); ++n) {
+        delete p_workers[n];
+    }
+}
+
+void kRenderBatchImpl::Submit(
+    size_t width, size_t height, kRenderJob &job, kBitmapFormat format,
+    kImageFormat imageformat, kImageSink *sink
+)
+{
+    Job item = { &job, width, height, format, imageformat, sink, Clock::now() };
+
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(p_lock);
+        if (!p_started) {
+            p_started = true;
+            p_start = item.submitted;
+        }
+        index = p_next++ % p_workers.size();
+        ++p_pending;
+
+        // job is counted in the same critical section it becomes visible
+        // in, so Pop never decrements p_queued before it was incremented
+        // (queue lock is always taken after p_lock, never the other way)
+        std::lock_guard<std::mutex> queue(p_workers[index]->lock);
+        p_workers[index]->jobs.push_back(item);
+        ++p_queued;
+    }
+    p_wake.notify_one();
+}
+
+void kRenderBatchImpl::Wait()
+{
+    std::unique_lock<std::mutex> lock(p_lock);
+    while (p_pending) {
+        p_idle.wait(lock);
+    }
+}
+
+kRenderBatchStats kRenderBatchImpl::stats() const
+{
+    std::lock_guard<std::mutex> lock(p_lock);
+
+    kRenderBatchStats result;
+    result.jobs = p_finished;
+    result.failed = p_failed;
+    result.elapsed = p_finished ? std::chrono::duration<double>(p_last - p_start).count() : 0;
+    result.throughput = result.elapsed > 0 ? double(p_finished) / result.elapsed : 0;
+    result.averagelatency = p_finished ? p_latency / double(p_finished) : 0;
+    result.maxlatency = p_maxlatency;
+
+    return result;
+}
+
+void kRenderBatchImpl::Work(size_t index)
+{
+    // canvas and its implementation object are created once per worker
+    kRenderBatchCanvas canvas;
+    Worker &worker = *p_workers[index];
+
+    Job job;
+    while (Take(index, job)) {
+        Run(worker, canvas, job);
+    }
+
+    for (size_t n = 0; n < worker.scratch.size(); ++n) {
+        delete worker.scratch[n];
+    }
+    worker.scratch.clear();
+}
+
+bool kRenderBatchImpl::Take(size_t index, Job &job)
+{
+    for (;;) {
+        if (Pop(index, job)) {
+            return true;
+        }
+
+        std::unique_lock<std::mutex> lock(p_lock);
+        while (p_queued == 0 && !p_shutdown) {
+            p_wake.wait(lock);
+        }
+
+        if (p_queued == 0 && p_shutdown) {
+            return false;
+        }
+    }
+}
+
+bool kRenderBatchImpl::Pop(size_t index, Job &job)
+{
+    size_t count = p_workers.size();
+
+    for (size_t n = 0; n < count; ++n) {
+        Worker &worker = *p_workers[(index + n) % count];
+        std::unique_lock<std::mutex> lock(worker.lock);
+
+        if (worker.jobs.empty()) {
+            continue;
+        }
+
+        // own queue is taken in submission order, other queues are
+        // stolen from the back to keep away from their owners
+        if (n == 0) {
+            job = worker.jobs.front();
+            worker.jobs.pop_front();
+        } else {
+            job = worker.jobs.back();
+            worker.jobs.pop_back();
+        }
+        lock.unlock();
+
+        std::lock_guard<std::mutex> counters(p_lock);
+        --p_queued;
+        return true;
+    }
+
+    return false;
+}
+
+void kRenderBatchImpl::Run(Worker &worker, kRenderBatchCanvas &canvas, const Job &job)
+{
+    bool success = false;
+
+    // jobs with source only pixel formats fail, there's no bitmap for them
+    if (job.width && job.height && StorageFormat(job.format)) {
+        kBitmap &bitmap = Scratch(worker, job.width, job.height, job.format);
+
+        if (canvas.Bind(bitmap.p_impl)) {
+            job.job->Draw(canvas);
+            canvas.Unbind();
+
+            // small images aren't worth parallel compression
+            kImageEncodeProperties properties = kImageEncodeProperties::construct(-1, 1);
+            success = !job.sink || bitmap.Encode(job.imageformat, *job.sink, &properties);
+            success = job.job->Output(bitmap) && success;
+        }
+    }
+
+    double latency = std::chrono::duration<double>(Clock::now() - job.submitted).count();
+    job.job->Finished(success, latency);
+
+    bool idle;
+    {
+        std::lock_guard<std::mutex> lock(p_lock);
+        ++p_finished;
+        if (!success) {
+            ++p_failed;
+        }
+        p_latency += latency;
+        p_maxlatency = umax(p_maxlatency, latency);
+        p_last = Clock::now();
+        idle = --p_pending == 0;
+    }
+
+    if (idle) {
+        p_idle.notify_all();
+    }
+}
+
+kBitmap& kRenderBatchImpl::Scratch(Worker &worker, size_t width, size_t height, kBitmapFormat format)
+{
+    std::vector<kBitmap*> &scratch = worker.scratch;
+
+    for (size_t n = 0; n < scratch.size(); ++n) {
+        kBitmap *bitmap = scratch[n];
+        if (bitmap->width() != width || bitmap->height() != height || bitmap->format() != format) {
+            continue;
+        }
+
+        scratch.erase(scratch.begin() + n);
+        scratch.insert(scratch.begin(), bitmap);
+
+        // clear previous job's pixels
+        size_t pitch;
+        void *pixels = bitmap->Lock(pitch);
+        if (pixels) {
+            memset(pixels, 0, pitch * height);
+            bitmap->Unlock();
+        } else {
+            std::vector<uint8_t> zero(width * height * PixelSize(format), 0);
+            bitmap->Update(nullptr, format, width * PixelSize(format), zero.data());
+        }
+
+        return *bitmap;
+    }
+
+    // new bitmap is already clear
+    if (scratch.size() == SCRATCH_BITMAPS) {
+        delete scratch.back();
+        scratch.pop_back();
+    }
+    scratch.insert(scratch.begin(), new kBitmap(width, height, format));
+
+    return *scratch.front();
+}
+
+
+/*
+ -------------------------------------------------------------------------------
+ kRenderBatch implementation
+ -------------------------------------------------------------------------------
+*/
+
+kRenderBatch::kRenderBatch(size_t threads) :
+    p_impl(new kRenderBatchImpl(threads))
+{}
+
+kRenderBatch::~kRenderBatch()
+{
+    delete p_impl;
+}
+
+void kRenderBatch::Submit(size_t width, size_t height, kRenderJob &job, kBitmapFormat format)
+{
+    p_impl->Submit(width, height, job, format, kImageFormat::Raw, nullptr);
+}
+
+void kRenderBatch::Submit(size_t width, size_t height, kRenderJob &job, kImageFormat imageformat, kImageSink &sink)
+{
+    p_impl->Submit(width, height, job, kBitmapFormat::Color32BitAlphaPremultiplied, imageformat, &sink);
+}
+
+void kRenderBatch::Wait()
+{
+    p_impl->Wait();
+}
+
+size_t kRenderBatch::threads() const
+{
+    return p_impl->threads();
+}
+
+kRenderBatchStats kRenderBatch::stats() const
+{
+    return p_impl->stats();
+}
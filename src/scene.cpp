@@ -0,0 +1,452 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    scene.cpp
+        retained scene with redrawing of changed areas
+*/
+
+#include "canvas.h"
+#include "canvasimpl.h"
+#include <algorithm>
+#include <cstring>
+
+
+using namespace k_canvas;
+using namespace impl;
+using namespace c_util;
+
+
+// bounds of items which can touch any pixel
+static const kRect UNBOUNDED(
+    -std::numeric_limits<kScalar>::max(), -std::numeric_limits<kScalar>::max(),
+    std::numeric_limits<kScalar>::max(), std::numeric_limits<kScalar>::max()
+);
+
+static inline bool Empty(const kRect &rect)
+{
+    return rect.right <= rect.left || rect.bottom <= rect.top;
+}
+
+static inline bool Intersects(const kRect &a, const kRect &b)
+{
+    return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+}
+
+// empty rectangles don't extend union
+static inline void Unite(kRect &a, const kRect &b)
+{
+    if (Empty(b)) {
+        return;
+    }
+
+    if (Empty(a)) {
+        a = b;
+    } else {
+        a.left = umin(a.left, b.left);
+        a.top = umin(a.top, b.top);
+        a.right = umax(a.right, b.right);
+        a.bottom = umax(a.bottom, b.bottom);
+    }
+}
+
+
+/*
+ -------------------------------------------------------------------------------
+ kSceneNode implementation
+ -------------------------------------------------------------------------------
+*/
+
+kSceneNode::kSceneNode() :
+    p_parent(nullptr),
+    p_transform(),
+    p_world(),
+    p_itembounds(0, 0, 0, 0),
+    p_bounds(0, 0, 0, 0),
+    p_visible(true),
+    p_changes(CHANGED_PLACEMENT)
+{}
+
+kSceneNode::~kSceneNode()
+{
+    ReleaseItems();
+
+    for (size_t n = 0; n < p_children.size(); ++n) {
+        delete p_children[n];
+    }
+}
+
+void kSceneNode::AddChild(kSceneNode *child)
+{
+    child->p_parent = this;
+    p_children.push_back(child);
+
+    // new child has empty bounds, so only its new area is invalidated
+    child->Changed(CHANGED_PLACEMENT);
+}
+
+void kSceneNode::RemoveChild(kSceneNode *child)
+{
+    std::vector<kSceneNode*>::iterator it = std::find(p_children.begin(), p_children.end(), child);
+    if (it == p_children.end()) {
+        return;
+    }
+
+    p_removed.push_back(child->p_bounds);
+    p_children.erase(it);
+    delete child;
+
+    Changed(CHANGED_CHILDREN);
+}
+
+void kSceneNode::SetTransform(const kTransform &transform)
+{
+    p_transform = transform;
+    Changed(CHANGED_PLACEMENT);
+}
+
+void kSceneNode::SetVisible(bool visible)
+{
+    if (p_visible != visible) {
+        p_visible = visible;
+        Changed(CHANGED_PLACEMENT);
+    }
+}
+
+void kSceneNode::Invalidate()
+{
+    Changed(CHANGED_ITEMS);
+}
+
+void kSceneNode::ClearItems()
+{
+    ReleaseItems();
+    p_items.clear();
+    Changed(CHANGED_ITEMS);
+}
+
+void kSceneNode::Rectangle(const kRect &rect, const kPen *pen, const kBrush *brush)
+{
+    AddItem(ITEM_RECTANGLE, pen, brush).rect = rect;
+}
+
+void kSceneNode::RoundedRectangle(const kRect &rect, const kSize &round, const kPen *pen, const kBrush *brush)
+{
+    Item &item = AddItem(ITEM_ROUNDEDRECTANGLE, pen, brush);
+    item.rect = rect;
+    item.round = round;
+}
+
+void kSceneNode::Ellipse(const kRect &rect, const kPen *pen, const kBrush *brush)
+{
+    AddItem(ITEM_ELLIPSE, pen, brush).rect = rect;
+}
+
+void kSceneNode::DrawPath(const kPath &path, const kPen *pen, const kBrush *brush)
+{
+    Item &item = AddItem(ITEM_PATH, pen, brush);
+    item.path = path.p_impl;
+    item.path->addref();
+}
+
+void kSceneNode::DrawBitmap(const kBitmap &bitmap, const kPoint &origin, kScalar sourcealpha)
+{
+    DrawBitmap(
+        bitmap, origin, kSize(kScalar(bitmap.width()), kScalar(bitmap.height())),
+        kPoint(), kSize(kScalar(bitmap.width()), kScalar(bitmap.height())), sourcealpha
+    );
+}
+
+void kSceneNode::DrawBitmap(const kBitmap &bitmap, const kPoint &origin, const kSize &destsize, const kPoint &source, const kSize &sourcesize, kScalar sourcealpha)
+{
+    Item &item = AddItem(ITEM_BITMAP, nullptr, nullptr);
+    item.rect = kRect(origin.x, origin.y, origin.x + destsize.width, origin.y + destsize.height);
+    item.source = source;
+    item.sourcesize = sourcesize;
+    item.alpha = sourcealpha;
+    item.bitmap = bitmap.p_impl;
+    item.bitmap->addref();
+}
+
+void kSceneNode::Text(const kPoint &p, const char *text, int count, const kFont &font, const kBrush &brush, kTextOrigin origin)
+{
+    if (count == -1) {
+        count = int(strlen(text));
+    }
+
+    Item &item = AddItem(ITEM_TEXT, nullptr, &brush);
+    item.rect = kRect(p.x, p.y, p.x, p.y);
+    item.font = font;
+    item.text.assign(text, size_t(count));
+    item.textorigin = origin;
+}
+
+kSceneNode::Item& kSceneNode::AddItem(ItemType type, const kPen *pen, const kBrush *brush)
+{
+    p_items.push_back(Item());
+
+    Item &item = p_items.back();
+    item.type = type;
+    item.alpha = 1;
+    item.haspen = pen != nullptr;
+    item.hasbrush = brush != nullptr;
+    if (pen) {
+        item.pen = *pen;
+    }
+    if (brush) {
+        item.brush = *brush;
+    }
+    item.path = nullptr;
+    item.bitmap = nullptr;
+    item.textorigin = kTextOrigin::Top;
+
+    Changed(CHANGED_ITEMS);
+    return item;
+}
+
+void kSceneNode::ReleaseItems()
+{
+    // items are copied only by vector itself, so every reference
+    // is held by exactly one item
+    for (size_t n = 0; n < p_items.size(); ++n) {
+        if (p_items[n].path) {
+            p_items[n].path->release();
+        }
+        if (p_items[n].bitmap) {
+            p_items[n].bitmap->release();
+        }
+    }
+}
+
+void kSceneNode::Changed(unsigned int changes)
+{
+    p_changes |= changes;
+
+    // every parent up to root is visited by next update, even if it has
+    // pending changes already (they could be left by invisible parent)
+    for (kSceneNode *node = p_parent; node; node = node->p_parent) {
+        node->p_changes |= CHANGED_CHILDREN;
+    }
+}
+
+void kSceneNode::Update(kScene &scene, kCanvas &canvas, const kTransform &parent, bool moved)
+{
+    bool placed = moved || (p_changes & CHANGED_PLACEMENT);
+
+    // old area, whole subtree if it's moved, own items otherwise
+    if (!moved) {
+        if (p_changes & CHANGED_PLACEMENT) {
+            scene.InvalidateBounds(p_bounds);
+        } else if (p_changes & CHANGED_ITEMS) {
+            scene.InvalidateBounds(p_itembounds);
+        }
+    }
+
+    for (size_t n = 0; n < p_removed.size(); ++n) {
+        scene.InvalidateBounds(p_removed[n]);
+    }
+    p_removed.clear();
+
+    p_world = parent * p_transform;
+
+    if (placed || (p_changes & CHANGED_ITEMS)) {
+        p_itembounds = kRect(0, 0, 0, 0);
+        if (p_visible) {
+            for (size_t n = 0; n < p_items.size(); ++n) {
+                Unite(p_itembounds, ItemBounds(canvas, p_items[n]));
+            }
+        }
+
+        if (!placed) {
+            scene.InvalidateBounds(p_itembounds);
+        }
+    }
+
+    // children of invisible node are updated when it's shown again,
+    // showing node is placement change, so all of them are visited
+    kRect bounds = p_itembounds;
+    if (p_visible) {
+        for (size_t n = 0; n < p_children.size(); ++n) {
+            kSceneNode *child = p_children[n];
+            if (placed || child->p_changes) {
+                child->Update(scene, canvas, p_world, placed);
+            }
+            Unite(bounds, child->p_bounds);
+        }
+    }
+    p_bounds = bounds;
+
+    // new area of moved subtree
+    if (!moved && (p_changes & CHANGED_PLACEMENT)) {
+        scene.InvalidateBounds(p_bounds);
+    }
+
+    p_changes = 0;
+}
+
+kRect kSceneNode::ItemBounds(kCanvas &canvas, const Item &item) const
+{
+    const kPen *pen = item.haspen ? &item.pen : nullptr;
+
+    switch (item.type) {
+        case ITEM_RECTANGLE:
+        case ITEM_ROUNDEDRECTANGLE:
+        case ITEM_ELLIPSE:
+            return kCanvasImpl::DeviceBounds(item.rect, pen, p_world);
+
+        case ITEM_PATH: {
+            kRect bounds;
+            return item.path->Bounds(bounds) ?
+                kCanvasImpl::DeviceBounds(bounds, pen, p_world) :
+                UNBOUNDED;
+        }
+
+        case ITEM_BITMAP:
+            return kCanvasImpl::DeviceBounds(item.rect, nullptr, p_world);
+
+        case ITEM_TEXT: {
+            // the same box as drawing implementations use, extended by text
+            // height above for baseline origin and at sides for overhanging glyphs
+            kSize size = canvas.TextSize(item.text.data(), int(item.text.size()), item.font);
+            kPoint p(item.rect.left, item.rect.top);
+            kRect rect(
+                p.x - size.height * 0.5f, p.y - size.height,
+                p.x + size.width + size.height * 0.5f, p.y + size.height
+            );
+            return kCanvasImpl::DeviceBounds(rect, nullptr, p_world);
+        }
+    }
+
+    return UNBOUNDED;
+}
+
+void kSceneNode::Draw(kCanvas &canvas, const kRect &clip) const
+{
+    if (!p_visible || !Intersects(p_bounds, clip)) {
+        return;
+    }
+
+    if (p_items.size() && Intersects(p_itembounds, clip)) {
+        canvas.SetTransform(p_world);
+
+        for (size_t n = 0; n < p_items.size(); ++n) {
+            const Item &item = p_items[n];
+            const kPen *pen = item.haspen ? &item.pen : nullptr;
+            const kBrush *brush = item.hasbrush ? &item.brush : nullptr;
+
+            switch (item.type) {
+                case ITEM_RECTANGLE:
+                    canvas.Rectangle(item.rect, pen, brush);
+                    break;
+
+                case ITEM_ROUNDEDRECTANGLE:
+                    canvas.RoundedRectangle(item.rect, item.round, pen, brush);
+                    break;
+
+                case ITEM_ELLIPSE:
+                    canvas.Ellipse(item.rect, pen, brush);
+                    break;
+
+                case ITEM_PATH:
+                    kCanvas::needResources(pen, brush);
+                    canvas.p_impl->DrawPath(item.path, pen, brush);
+                    break;
+
+                case ITEM_BITMAP:
+                    canvas.p_impl->DrawBitmap(
+                        item.bitmap,
+                        kPoint(item.rect.left, item.rect.top), kSize(item.rect.width(), item.rect.height()),
+                        item.source, item.sourcesize, item.alpha
+                    );
+                    break;
+
+                case ITEM_TEXT:
+                    canvas.Text(
+                        kPoint(item.rect.left, item.rect.top),
+                        item.text.data(), int(item.text.size()),
+                        item.font, item.brush, item.textorigin
+                    );
+                    break;
+            }
+        }
+    }
+
+    for (size_t n = 0; n < p_children.size(); ++n) {
+        p_children[n]->Draw(canvas, clip);
+    }
+}
+
+
+/*
+ -------------------------------------------------------------------------------
+ kScene implementation
+ -------------------------------------------------------------------------------
+*/
+
+kScene::kScene(kBitmap &target, const kColor &background, size_t maxrects) :
+    p_target(target),
+    p_background(background),
+    p_dirty(maxrects),
+    p_rendered(maxrects)
+{
+    Invalidate();
+}
+
+void kScene::Invalidate()
+{
+    Invalidate(kRectInt(0, 0, int(p_target.width()), int(p_target.height())));
+}
+
+void kScene::Invalidate(const kRectInt &rect)
+{
+    p_dirty.Add(kRectInt(
+        umax(rect.left, 0), umax(rect.top, 0),
+        umin(rect.right, int(p_target.width())), umin(rect.bottom, int(p_target.height()))
+    ));
+}
+
+void kScene::InvalidateBounds(const kRect &bounds)
+{
+    kScalar left = umax(bounds.left, kScalar(0));
+    kScalar top = umax(bounds.top, kScalar(0));
+    kScalar right = umin(bounds.right, kScalar(p_target.width()));
+    kScalar bottom = umin(bounds.bottom, kScalar(p_target.height()));
+
+    if (right > left && bottom > top) {
+        p_dirty.Add(kRectInt(
+            int(std::floor(left)), int(std::floor(top)),
+            int(std::ceil(right)), int(std::ceil(bottom))
+        ));
+    }
+}
+
+const kDamageRegion& kScene::Render()
+{
+    kBitmapCanvas canvas(p_target);
+
+    if (p_root.p_changes) {
+        p_root.Update(*this, canvas, kTransform(), false);
+    }
+
+    for (size_t n = 0; n < p_dirty.count(); ++n) {
+        const kRectInt &rect = p_dirty.rect(n);
+        kRect clip(kScalar(rect.left), kScalar(rect.top), kScalar(rect.right), kScalar(rect.bottom));
+
+        // rectangles are on whole pixels, so clearing writes pixels directly
+        canvas.SetTransform(kTransform());
+        canvas.Clear(clip, p_background);
+
+        kCanvasClipper clipper(canvas, clip);
+        p_root.Draw(canvas, clip);
+    }
+
+    p_rendered = p_dirty;
+    p_dirty.Clear();
+
+    return p_rendered;
+}
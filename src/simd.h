@@ -0,0 +1,65 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    simd.h
+        SIMD instruction set detection for vectorised code paths
+        defines KCANVAS_SSE2 or KCANVAS_NEON when corresponding instruction
+        set is available at compile time, define KCANVAS_NO_SIMD to build
+        scalar code paths only
+*/
+
+#pragma once
+#include <cstdint>
+
+
+#if !defined(KCANVAS_NO_SIMD)
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define KCANVAS_SSE2
+        #include <emmintrin.h>
+    #elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        #define KCANVAS_NEON
+        #include <arm_neon.h>
+    #endif
+#endif
+
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+namespace k_canvas
+{
+    namespace impl
+    {
+        // index of lowest set bit, value must not be 0
+        static inline unsigned LowestBitIndex(unsigned value)
+        {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward(&index, value);
+            return unsigned(index);
+#else
+            return unsigned(__builtin_ctz(value));
+#endif
+        }
+
+        // index of lowest set bit of 64 bit value, value must not be 0
+        static inline unsigned LowestBitIndex64(uint64_t value)
+        {
+#if defined(_MSC_VER)
+            unsigned low = unsigned(value);
+            return low ?
+                LowestBitIndex(low) :
+                LowestBitIndex(unsigned(value >> 32)) + 32;
+#else
+            return unsigned(__builtin_ctzll(value));
+#endif
+        }
+    }
+}
@@ -0,0 +1,956 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    textlayout.cpp
+        text layout helpers and kTextLayout object implementation
+*/
+
+#include "textlayout.h"
+#include "unicodeconverter.h"
+#include <cstring>
+#include <algorithm>
+
+
+using namespace k_canvas;
+using namespace impl;
+using namespace c_util;
+using namespace c_geometry;
+
+
+/*
+ -------------------------------------------------------------------------------
+ Text layout helpers implementation
+ -------------------------------------------------------------------------------
+*/
+
+void k_canvas::impl::GetLayoutParams(kCanvasImpl *impl, const kFontBase *font, const kTextPropertiesBase *properties, LayoutParams &params)
+{
+    // get basic space glyph and overall font metrics
+    impl->GetGlyphMetrics(font, ' ', ' ', &params.spaceglyph);
+    impl->GetFontMetrics(font, params.fm);
+
+    // fill in properties
+    if (properties) {
+        params.flags = properties->flags;
+        params.interval = properties->interval;
+        params.indent = properties->indent;
+        params.defaulttabwidth = properties->defaulttabwidth;
+        if (params.defaulttabwidth < params.spaceglyph.advance) {
+            params.defaulttabwidth = params.spaceglyph.advance;
+        }
+    } else {
+        params.defaulttabwidth = 0;
+        params.indent = 0;
+        params.interval = 0;
+        params.flags = kTextFlags::IgnoreLineBreaks;
+    }
+}
+
+void k_canvas::impl::MeasureWords(kCanvasImpl *impl, const char *text, size_t count, const kFontBase *font, kTextFlags flags, LayoutWordsList &words)
+{
+    WordBreaker wordbreaker(text, count, flags);
+
+    Word word;
+    while (wordbreaker.NextWord(word)) {
+        LayoutWord measured = {
+            word.text, word.length, word.type, 0, 0, 0
+        };
+
+        if (word.type == Word::Text) {
+            measured.width = impl->TextSize(word.text, word.length, font).width;
+
+            kGlyphMetrics gm;
+            // take word's first glyph metrics for adjusting left bound
+            size_t glyph = utf8codepoint(word.text, word.length);
+            impl->GetGlyphMetrics(font, glyph, glyph, &gm);
+            measured.leftbearing = gm.leftbearing;
+
+            // take word's last glyph metrics for adjusting right bound
+            if (word.length > 1) {
+                glyph = word.text[word.length - 1];
+                impl->GetGlyphMetrics(font, glyph, glyph, &gm);
+            }
+            measured.rightbearing = gm.rightbearing;
+        }
+
+        words.push_back(measured);
+    }
+}
+
+// helper function to count and measure word glyphs up until specified right edge from starting x position
+static size_t MeasureUntil(kCanvasImpl *impl, const kFontBase *font, const char *text, size_t count, kScalar x, kScalar right, kScalar &actualwidth)
+{
+    size_t result = 0;
+    kScalar startx = x;
+    for (; result < count; ++result) {
+        kGlyphMetrics gm;
+        size_t glyph = *text++;
+        impl->GetGlyphMetrics(font, glyph, glyph, &gm);
+
+        if ((x + gm.advance) > right) {
+            break;
+        }
+
+        x += gm.advance;
+    }
+    actualwidth = x - startx;
+    return result;
+}
+
+// compute bounds which will be used for text alignment
+static inline kSize AlignBoundsSize(const kSize &size, const kSize &bounds)
+{
+    return kSize(
+        umax(size.width, bounds.width),
+        umax(size.height, bounds.height)
+    );
+}
+
+// compute overall vertical offset for vertical alignment
+static kScalar VerticalOffset(const kTextOutProperties &properties, const kSize &alignboundssize, const kSize &size)
+{
+    switch (properties.vertalign) {
+        case kTextVerticalAlignment::Middle:
+            return alignboundssize.height * 0.5f - size.height * 0.5f;
+
+        case kTextVerticalAlignment::Bottom:
+            return alignboundssize.height - size.height;
+
+        default:
+            return 0;
+    }
+}
+
+// search for end of row which starts at given cached word
+static size_t RowEnd(const CachedWordsList &cache, size_t start)
+{
+    size_t cw = start + 1;
+    while (cw < cache.size() && !cache[cw].newline) {
+        ++cw;
+    }
+    return cw;
+}
+
+// compute horizontal alignment for the row of cached words
+// interwordspacing is used for additional spacing to add between words
+// in order to get line fit whole text block width
+static void RowAlignment(
+    const kTextOutProperties &properties, const kSize &alignboundssize,
+    const CachedWordsList &cache, size_t start, size_t end,
+    kScalar &totaloffset, kScalar &interwordspacing
+)
+{
+    // compute total width of current line of text
+    kScalar width = cache[end - 1].position.x + cache[end - 1].width;
+
+    totaloffset = 0;
+    interwordspacing = 0;
+
+    switch (properties.horzalign) {
+        case kTextHorizontalAlignment::Center:
+            totaloffset = alignboundssize.width * 0.5f - width * 0.5f;
+            break;
+
+        case kTextHorizontalAlignment::Right:
+            totaloffset = alignboundssize.width - width;
+            break;
+
+        case kTextHorizontalAlignment::Justify:
+            // last row is never justified
+            if (end < cache.size()) {
+                size_t spacecount = end - start - 1;
+                if (spacecount) {
+                    interwordspacing =
+                        (alignboundssize.width - width) /
+                        spacecount;
+                }
+            }
+            break;
+    }
+}
+
+// find nearest character boundary inside word for x offset from word start
+static size_t WordHitTest(kCanvasImpl *impl, const kFontBase *font, const CachedWord &word, kScalar x)
+{
+    kScalar prevwidth = 0;
+    size_t prevlength = 0;
+    size_t length = 0;
+
+    while (length < word.count) {
+        // advance to next UTF-8 code point boundary
+        ++length;
+        while (length < word.count && (static_cast<unsigned char>(word.text[length]) & 0xC0) == 0x80) {
+            ++length;
+        }
+
+        kScalar width = impl->TextSize(word.text, length, font).width;
+        if (x < (prevwidth + width) * 0.5f) {
+            return prevlength;
+        }
+
+        prevwidth = width;
+        prevlength = length;
+    }
+
+    return word.count;
+}
+
+// find nearest character boundary in cached layout for the point,
+// result is byte offset from text start
+static size_t CacheHitTest(
+    kCanvasImpl *impl, const kFontBase *font,
+    const kTextOutProperties &properties, const kSize &alignboundssize,
+    const char *text, const CachedWordsList &cache, const kPoint &point
+)
+{
+    size_t sz = cache.size();
+    if (sz == 0) {
+        return 0;
+    }
+
+    // find row under the point, points above first row hit first row
+    // points below last row hit last row
+    size_t start = 0;
+    size_t end = RowEnd(cache, start);
+    while (end < sz && point.y >= cache[end].position.y) {
+        start = end;
+        end = RowEnd(cache, start);
+    }
+
+    kScalar totaloffset;
+    kScalar interwordspacing;
+    RowAlignment(properties, alignboundssize, cache, start, end, totaloffset, interwordspacing);
+
+    // find word under the point, points between words hit nearest word edge
+    kScalar prevright = 0;
+    for (size_t n = start; n < end; ++n) {
+        const CachedWord &w = cache[n];
+        kScalar x = totaloffset + w.position.x + interwordspacing * (n - start);
+
+        if (point.x < x) {
+            if (n > start && (point.x - prevright) < (x - point.x)) {
+                return size_t(cache[n - 1].text - text) + cache[n - 1].count;
+            }
+            return size_t(w.text - text);
+        }
+
+        if (point.x < (x + w.width)) {
+            return size_t(w.text - text) + WordHitTest(impl, font, w, point.x - x);
+        }
+
+        prevright = x + w.width;
+    }
+
+    return size_t(cache[end - 1].text - text) + cache[end - 1].count;
+}
+
+void k_canvas::impl::AlignLayout(
+    kCanvasImpl *impl, const kRect &rect, const kFontBase *font,
+    const kTextOutProperties &properties, const kFontMetrics &fm,
+    const kSize &size, const CachedWordsList &cache, TextRunWordsList &run
+)
+{
+    bool ellipses = (properties.flags & kTextFlags::Ellipses) != 0;
+
+    kSize alignboundssize = AlignBoundsSize(size, kSize(rect.width(), rect.height()));
+    kScalar verticaloffset = VerticalOffset(properties, alignboundssize, size);
+
+    // compute ellipses width, if required
+    kScalar ellipseswidth = 0;
+    if (ellipses) {
+        kGlyphMetrics gm;
+        impl->GetGlyphMetrics(font, '.', '.', &gm);
+        ellipseswidth = gm.advance * 3;
+    }
+
+    // walk through cached layout result and render text line by line
+    // with applying horizontal alignment and other options
+    size_t cw = 0;
+    size_t sz = cache.size();
+    kScalar y = 0;
+    while (cw < sz) {
+        // search for row bounds
+        size_t start = cw;
+        cw = RowEnd(cache, start);
+
+        kScalar totaloffset;
+        kScalar interwordspacing;
+        RowAlignment(properties, alignboundssize, cache, start, cw, totaloffset, interwordspacing);
+
+        // compute current output position
+        kPoint cp = rect.getLeftTop() + kPoint(totaloffset, verticaloffset);
+
+        bool lasttextline = false;
+        if (ellipses) {
+            // check if this line of text is last row and next row
+            // can't fit in bounds (so ellipses should be painted)
+            kScalar nextrowbottom =
+                cp.y + y + fm.height * 2 + fm.linegap + properties.interval;
+            lasttextline = nextrowbottom > rect.bottom;
+        }
+
+        // output line words one by one
+        bool stopoutput = false;
+        for (size_t n = start; n < cw; ++n) {
+            const CachedWord &w = cache[n];
+
+            if (ellipses) {
+                // check if word crosses right bound (this is possible for
+                // single line text or for adding ellipses on a last visible row)
+                kScalar wordrightbound = cp.x + w.position.x + w.width;
+
+                // if this is last visible line of text - adjust right bound to fit
+                // ellipses
+                if (lasttextline) {
+                    wordrightbound += ellipseswidth;
+                }
+
+                // check if word is last in a visible row
+                bool lastword = lasttextline && n == (cw - 1);
+
+                if (wordrightbound > rect.right || lastword) {
+                    cp += w.position;
+
+                    if ((cp.x + w.width + ellipseswidth) < rect.right) {
+                        AddRunWord(run, cp, w.text, w.count);
+                        cp.x += w.width;
+                    } else {
+                        // measure word glyphs one by one while there's enough space
+                        // to fit ellipses after word, then paint fitted glyphs of the word
+                        kScalar fitwidth;
+                        size_t c = MeasureUntil(impl, font, w.text, w.count, cp.x, rect.right - ellipseswidth, fitwidth);
+
+                        AddRunWord(run, cp, w.text, c);
+                        cp.x += fitwidth;
+                    }
+
+                    AddRunWord(run, cp, "...", 3);
+
+                    // TODO: currently first word out of bounds will stop text output
+                    // this seems to be layout issue, since it doesn't break long words
+                    stopoutput = true;
+                    break;
+                }
+            }
+
+            AddRunWord(run, cp + w.position, w.text, w.count);
+            cp.x += interwordspacing;
+        }
+
+        if (stopoutput) {
+            break;
+        }
+
+        if (cw < sz) {
+            y += fm.height + fm.linegap + properties.interval;
+        }
+    }
+}
+
+
+/*
+ -------------------------------------------------------------------------------
+ kTextLayoutImpl implementation
+ -------------------------------------------------------------------------------
+*/
+
+kTextLayoutImpl::kTextLayoutImpl(const kSize &bounds, const char *text, size_t count, const kFont &font, const kTextOutProperties *properties) :
+    p_measure(CanvasFactory::CreateCanvas()),
+    p_text(text, count),
+    p_font(font),
+    p_bounds(bounds)
+{
+    if (properties) {
+        p_properties = *properties;
+    } else {
+        p_properties = kTextOutProperties::construct(kTextFlags::IgnoreLineBreaks);
+    }
+
+    p_font.needResource();
+
+    // measure phase is done only once here, all the following
+    // layout changes reuse measured words
+    GetLayoutParams(p_measure, &p_font, properties ? &p_properties : nullptr, p_params);
+    p_words.reserve(count / 4 + 1);
+    MeasureWords(p_measure, p_text.data(), p_text.length(), &p_font, p_params.flags, p_words);
+
+    Flow();
+}
+
+kTextLayoutImpl::~kTextLayoutImpl()
+{
+    delete p_measure;
+}
+
+void kTextLayoutImpl::SetBounds(const kSize &bounds)
+{
+    bool reflow =
+        bounds.width != p_bounds.width &&
+        (p_params.flags & kTextFlags::Multiline) != 0;
+
+    p_bounds = bounds;
+
+    // only width affects line breaks, height is used only during drawing
+    if (reflow) {
+        Flow();
+    }
+}
+
+void kTextLayoutImpl::Flow()
+{
+    p_cache.clear();
+    p_cache.reserve(p_words.size());
+
+    CacheLayoutCallback callback(p_cache);
+    p_size = FlowWords(
+        p_words.data(), p_words.size(), p_params,
+        p_bounds.width, callback, p_inkbounds
+    );
+}
+
+kSize kTextLayoutImpl::size() const
+{
+    kSize result = p_size;
+    if (p_properties.flags & kTextFlags::StrictBounds) {
+        result.width = umin(result.width, p_bounds.width);
+        result.height = umin(result.height, p_bounds.height);
+    }
+    return result;
+}
+
+void kTextLayoutImpl::Draw(kCanvasImpl *impl, const kPoint &origin, const kBrush &brush)
+{
+    if (p_cache.empty()) {
+        return;
+    }
+
+    brush.needResource();
+
+    kRect rect(origin.x, origin.y, origin.x + p_bounds.width, origin.y + p_bounds.height);
+
+    bool cliptobounds = (p_properties.flags & kTextFlags::ClipToBounds) != 0;
+    if (cliptobounds) {
+        impl->BeginClippedDrawingByRect(rect);
+    }
+
+    TextRunWordsList run;
+    run.reserve(p_cache.size());
+
+    bool directoutput =
+        p_properties.horzalign == kTextHorizontalAlignment::Left &&
+        p_properties.vertalign == kTextVerticalAlignment::Top &&
+        (p_properties.flags & kTextFlags::Ellipses) == 0;
+
+    if (directoutput) {
+        for (size_t n = 0; n < p_cache.size(); ++n) {
+            const CachedWord &w = p_cache[n];
+            AddRunWord(run, origin + w.position, w.text, w.count);
+        }
+    } else {
+        AlignLayout(impl, rect, &p_font, p_properties, p_params.fm, p_size, p_cache, run);
+    }
+
+    if (run.size()) {
+        impl->TextRun(run.data(), run.size(), &p_font, &brush);
+    }
+
+    if (cliptobounds) {
+        impl->EndClippedDrawing();
+    }
+}
+
+size_t kTextLayoutImpl::HitTest(const kPoint &point) const
+{
+    kSize alignboundssize = AlignBoundsSize(p_size, p_bounds);
+    kScalar verticaloffset = VerticalOffset(p_properties, alignboundssize, p_size);
+
+    return CacheHitTest(
+        p_measure, &p_font, p_properties, alignboundssize,
+        p_text.data(), p_cache, point - kPoint(0, verticaloffset)
+    );
+}
+
+
+/*
+ -------------------------------------------------------------------------------
+ kTextEditLayoutImpl implementation
+ -------------------------------------------------------------------------------
+*/
+
+kTextEditLayoutImpl::kTextEditLayoutImpl(kScalar width, const kFont &font, const kTextOutProperties *properties) :
+    p_measure(CanvasFactory::CreateCanvas()),
+    p_font(font),
+    p_width(width)
+{
+    if (properties) {
+        p_properties = *properties;
+    } else {
+        p_properties = kTextOutProperties::construct(kTextFlags::IgnoreLineBreaks);
+    }
+
+    p_font.needResource();
+
+    GetLayoutParams(p_measure, &p_font, properties ? &p_properties : nullptr, p_params);
+    // paragraph text never contains line breaks, stray CR characters
+    // are treated as spaces
+    p_params.flags = p_params.flags | kTextFlags::IgnoreLineBreaks;
+
+    // layout always has at least one (possibly empty) paragraph
+    SetText("", 0);
+}
+
+kTextEditLayoutImpl::~kTextEditLayoutImpl()
+{
+    p_paragraphs.Clear();
+    delete p_measure;
+}
+
+void kTextEditLayoutImpl::SetText(const char *text, size_t count)
+{
+    p_paragraphs.Clear();
+
+    // split text into paragraphs by LF characters
+    const char *end = text + count;
+    const char *start = text;
+    while (true) {
+        const char *separator = std::find(start, end, '\n');
+
+        Paragraph *paragraph = new Paragraph();
+        paragraph->text.assign(start, separator);
+        Measure(paragraph);
+        Flow(paragraph);
+        p_paragraphs.Insert(
+            p_paragraphs.size(), paragraph,
+            paragraph->advance, paragraph->text.length() + 1, paragraph->width
+        );
+
+        if (separator == end) {
+            break;
+        }
+        start = separator + 1;
+    }
+}
+
+void kTextEditLayoutImpl::Insert(size_t position, const char *text, size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+
+    size_t index;
+    size_t offset;
+    Locate(position, index, offset);
+
+    Paragraph *paragraph = p_paragraphs[index];
+    std::string tail(paragraph->text, offset);
+    paragraph->text.erase(offset);
+
+    // text up to first separator goes into paragraph at insert position
+    const char *end = text + count;
+    const char *separator = std::find(text, end, '\n');
+    paragraph->text.append(text, separator);
+
+    if (separator == end) {
+        // no new paragraphs, only one paragraph is changed
+        paragraph->text += tail;
+        Update(index);
+        return;
+    }
+
+    // every separator starts new paragraph, tail of the paragraph at insert
+    // position goes to the last one
+    ParagraphsList inserted;
+    while (separator != end) {
+        const char *start = separator + 1;
+        separator = std::find(start, end, '\n');
+
+        Paragraph *newparagraph = new Paragraph();
+        newparagraph->text.assign(start, separator);
+        inserted.push_back(newparagraph);
+    }
+    inserted.back()->text += tail;
+
+    Update(index);
+    InsertParagraphs(index + 1, inserted);
+}
+
+void kTextEditLayoutImpl::Erase(size_t position, size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+
+    size_t first;
+    size_t firstoffset;
+    Locate(position, first, firstoffset);
+
+    size_t last;
+    size_t lastoffset;
+    Locate(position + count, last, lastoffset);
+
+    Paragraph *paragraph = p_paragraphs[first];
+
+    if (first == last) {
+        // erase within one paragraph
+        paragraph->text.erase(firstoffset, lastoffset - firstoffset);
+        Update(first);
+        return;
+    }
+
+    // erased range spans several paragraphs, they are merged into first one
+    paragraph->text.erase(firstoffset);
+    paragraph->text.append(p_paragraphs[last]->text, lastoffset, std::string::npos);
+
+    p_paragraphs.Erase(first + 1, last - first);
+    Update(first);
+}
+
+void kTextEditLayoutImpl::SetWidth(kScalar width)
+{
+    if (width == p_width) {
+        return;
+    }
+
+    p_width = width;
+
+    // only multiline text is wrapped, otherwise width affects only alignment
+    if ((p_params.flags & kTextFlags::Multiline) == 0) {
+        return;
+    }
+
+    // re-wrap all paragraphs with cached word measurements
+    for (size_t n = 0; n < p_paragraphs.size(); ++n) {
+        Flow(p_paragraphs[n]);
+        UpdateTree(n);
+    }
+}
+
+kSize kTextEditLayoutImpl::size() const
+{
+    // last paragraph doesn't add spacing after itself
+    kScalar height =
+        p_paragraphs.advance() -
+        p_params.fm.linegap - p_params.interval;
+
+    return kSize(p_paragraphs.width(), height);
+}
+
+void kTextEditLayoutImpl::Draw(kCanvasImpl *impl, const kPoint &origin, const kBrush &brush, const kRect *visible)
+{
+    size_t count = p_paragraphs.size();
+
+    // skip paragraphs above visible area
+    size_t index = 0;
+    kScalar y = 0;
+    if (visible) {
+        index = p_paragraphs.FindAdvance(visible->top);
+        if (index >= count) {
+            return;
+        }
+        y = p_paragraphs.AdvancePrefix(index);
+    }
+
+    brush.needResource();
+
+    TextRunWordsList run;
+    run.reserve(256);
+
+    for (; index < count; ++index) {
+        if (visible && y >= visible->bottom) {
+            break;
+        }
+
+        const Paragraph *paragraph = p_paragraphs[index];
+        const CachedWordsList &cache = paragraph->cache;
+        kSize alignboundssize(umax(paragraph->width, p_width), 0);
+
+        size_t cw = 0;
+        size_t sz = cache.size();
+        while (cw < sz) {
+            size_t start = cw;
+            cw = RowEnd(cache, start);
+
+            // skip invisible rows of long wrapped paragraphs
+            if (visible) {
+                kScalar rowtop = y + cache[start].position.y;
+                if (rowtop >= visible->bottom) {
+                    break;
+                }
+                if ((rowtop + p_params.fm.height) < visible->top) {
+                    continue;
+                }
+            }
+
+            kScalar totaloffset;
+            kScalar interwordspacing;
+            RowAlignment(p_properties, alignboundssize, cache, start, cw, totaloffset, interwordspacing);
+
+            for (size_t n = start; n < cw; ++n) {
+                const CachedWord &w = cache[n];
+                kPoint position(
+                    totaloffset + w.position.x + interwordspacing * (n - start),
+                    y + w.position.y
+                );
+                AddRunWord(run, origin + position, w.text, w.count);
+            }
+        }
+
+        y += paragraph->advance;
+    }
+
+    if (run.size()) {
+        impl->TextRun(run.data(), run.size(), &p_font, &brush);
+    }
+}
+
+size_t kTextEditLayoutImpl::HitTest(const kPoint &point) const
+{
+    size_t index = p_paragraphs.FindAdvance(point.y);
+    if (index >= p_paragraphs.size()) {
+        index = p_paragraphs.size() - 1;
+    }
+
+    const Paragraph *paragraph = p_paragraphs[index];
+    kSize alignboundssize(umax(paragraph->width, p_width), 0);
+
+    return p_paragraphs.LengthPrefix(index) + CacheHitTest(
+        p_measure, &p_font, p_properties, alignboundssize,
+        paragraph->text.data(), paragraph->cache,
+        point - kPoint(0, p_paragraphs.AdvancePrefix(index))
+    );
+}
+
+void kTextEditLayoutImpl::Measure(Paragraph *paragraph)
+{
+    paragraph->words.clear();
+    MeasureWords(
+        p_measure, paragraph->text.data(), paragraph->text.length(),
+        &p_font, p_params.flags, paragraph->words
+    );
+}
+
+void kTextEditLayoutImpl::Flow(Paragraph *paragraph)
+{
+    paragraph->cache.clear();
+
+    CacheLayoutCallback callback(paragraph->cache);
+    kRect inkbounds;
+    kSize size = FlowWords(
+        paragraph->words.data(), paragraph->words.size(), p_params,
+        p_width, callback, inkbounds
+    );
+
+    // empty paragraph still takes one line
+    paragraph->width = size.width;
+    paragraph->advance =
+        umax(size.height, p_params.fm.height) +
+        p_params.fm.linegap + p_params.interval;
+}
+
+// relayout single changed paragraph and update its tree values
+void kTextEditLayoutImpl::Update(size_t index)
+{
+    Paragraph *paragraph = p_paragraphs[index];
+    Measure(paragraph);
+    Flow(paragraph);
+    UpdateTree(index);
+}
+
+// store paragraph advance, length and width into tree, O(log n)
+void kTextEditLayoutImpl::UpdateTree(size_t index)
+{
+    const Paragraph *paragraph = p_paragraphs[index];
+    p_paragraphs.Set(index, paragraph->advance, paragraph->text.length() + 1, paragraph->width);
+}
+
+// every paragraph is inserted into tree in O(log n), other paragraphs
+// aren't touched
+void kTextEditLayoutImpl::InsertParagraphs(size_t index, const ParagraphsList &paragraphs)
+{
+    for (size_t n = 0; n < paragraphs.size(); ++n) {
+        Paragraph *paragraph = paragraphs[n];
+        Measure(paragraph);
+        Flow(paragraph);
+        p_paragraphs.Insert(
+            index + n, paragraph,
+            paragraph->advance, paragraph->text.length() + 1, paragraph->width
+        );
+    }
+}
+
+// convert text position into paragraph index and offset inside paragraph
+void kTextEditLayoutImpl::Locate(size_t position, size_t &index, size_t &offset) const
+{
+    index = p_paragraphs.FindLength(position);
+    if (index >= p_paragraphs.size()) {
+        // position past the end of text
+        index = p_paragraphs.size() - 1;
+        offset = p_paragraphs[index]->text.length();
+    } else {
+        offset = position - p_paragraphs.LengthPrefix(index);
+    }
+}
+
+
+/*
+ -------------------------------------------------------------------------------
+ kTextLayout implementation
+ -------------------------------------------------------------------------------
+*/
+
+kTextLayout::kTextLayout(const kSize &bounds, const char *text, int count, const kFont &font, const kTextOutProperties *properties)
+{
+    if (count == -1) {
+        count = int(strlen(text));
+    }
+
+    p_impl = new kTextLayoutImpl(bounds, text, size_t(count), font, properties);
+}
+
+kTextLayout::~kTextLayout()
+{
+    delete p_impl;
+}
+
+kTextLayout::kTextLayout(kTextLayout &&source) :
+    p_impl(source.p_impl)
+{
+    source.p_impl = nullptr;
+}
+
+kTextLayout &kTextLayout::operator=(kTextLayout &&source)
+{
+    delete p_impl;
+    p_impl = source.p_impl;
+    source.p_impl = nullptr;
+
+    return *this;
+}
+
+const kSize& kTextLayout::bounds() const
+{
+    return p_impl->bounds();
+}
+
+void kTextLayout::SetBounds(const kSize &bounds)
+{
+    p_impl->SetBounds(bounds);
+}
+
+void kTextLayout::SetWidth(kScalar width)
+{
+    p_impl->SetBounds(kSize(width, p_impl->bounds().height));
+}
+
+kSize kTextLayout::Size() const
+{
+    return p_impl->size();
+}
+
+kRect kTextLayout::InkBounds() const
+{
+    return p_impl->inkbounds();
+}
+
+size_t kTextLayout::HitTest(const kPoint &point) const
+{
+    return p_impl->HitTest(point);
+}
+
+void kTextLayout::Draw(kCanvas &canvas, const kPoint &origin, const kBrush &brush)
+{
+    p_impl->Draw(canvas.p_impl, origin, brush);
+}
+
+
+/*
+ -------------------------------------------------------------------------------
+ kTextEditLayout implementation
+ -------------------------------------------------------------------------------
+*/
+
+kTextEditLayout::kTextEditLayout(kScalar width, const kFont &font, const kTextOutProperties *properties) :
+    p_impl(new kTextEditLayoutImpl(width, font, properties))
+{}
+
+kTextEditLayout::~kTextEditLayout()
+{
+    delete p_impl;
+}
+
+kTextEditLayout::kTextEditLayout(kTextEditLayout &&source) :
+    p_impl(source.p_impl)
+{
+    source.p_impl = nullptr;
+}
+
+kTextEditLayout &kTextEditLayout::operator=(kTextEditLayout &&source)
+{
+    delete p_impl;
+    p_impl = source.p_impl;
+    source.p_impl = nullptr;
+
+    return *this;
+}
+
+kScalar kTextEditLayout::width() const
+{
+    return p_impl->width();
+}
+
+size_t kTextEditLayout::length() const
+{
+    return p_impl->length();
+}
+
+size_t kTextEditLayout::paragraphs() const
+{
+    return p_impl->paragraphs();
+}
+
+void kTextEditLayout::SetText(const char *text, int count)
+{
+    if (count == -1) {
+        count = int(strlen(text));
+    }
+    p_impl->SetText(text, size_t(count));
+}
+
+void kTextEditLayout::Insert(size_t position, const char *text, int count)
+{
+    if (count == -1) {
+        count = int(strlen(text));
+    }
+    p_impl->Insert(position, text, size_t(count));
+}
+
+void kTextEditLayout::Erase(size_t position, size_t count)
+{
+    p_impl->Erase(position, count);
+}
+
+void kTextEditLayout::SetWidth(kScalar width)
+{
+    p_impl->SetWidth(width);
+}
+
+kSize kTextEditLayout::Size() const
+{
+    return p_impl->size();
+}
+
+size_t kTextEditLayout::HitTest(const kPoint &point) const
+{
+    return p_impl->HitTest(point);
+}
+
+void kTextEditLayout::Draw(kCanvas &canvas, const kPoint &origin, const kBrush &brush, const kRect *visible)
+{
+    p_impl->Draw(canvas.p_impl, origin, brush, visible);
+}
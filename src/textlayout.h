@@ -0,0 +1,921 @@
+/*
+        KCANVAS PROJECT
+
+    Common 2D graphics API abstraction with multiple back-end support
+
+    (c) livingcreative, 2015 - 2017
+
+    https://github.com/livingcreative/kcanvas
+
+    textlayout.h
+        text layout helpers header
+        word breaking, word measurement and flow layout shared by
+        text measurement, text drawing and kTextLayout object
+*/
+
+#pragma once
+#include "canvas.h"
+#include "canvasimpl.h"
+#include "simd.h"
+#include <string>
+
+
+namespace k_canvas
+{
+    namespace impl
+    {
+        /*
+         -------------------------------------------------------------------------------
+         Word & WordBreaker helper classes
+         -------------------------------------------------------------------------------
+            Breaks text into words and other elements
+        */
+
+        // defines word inside text by pointer to first char, length and type
+        class Word
+        {
+        public:
+            enum Type
+            {
+                Text,
+                Space,
+                Tab,
+                LineBreak
+            };
+
+        public:
+            const char *text;
+            size_t      length;
+            Type        type;
+        };
+
+        // helps to split source text into words
+        class WordBreaker
+        {
+        public:
+            // initialize word breaker with text, length and flags
+            WordBreaker(const char *text, size_t length, kTextFlags flags) :
+                p_text(reinterpret_cast<const unsigned char *>(text)),
+                p_pos(0),
+                p_length(length),
+                p_linebreaks((flags & kTextFlags::IgnoreLineBreaks) == 0),
+                p_tabstops((flags & kTextFlags::UseTabs) != 0),
+                p_block(size_t(-1)),
+                p_spaces(0),
+                p_special(0)
+            {}
+
+            // extract next word from text
+            bool NextWord(Word &word)
+            {
+                if (p_pos == p_length) {
+                    return false;
+                }
+
+                word.text = reinterpret_cast<const char *>(p_text + p_pos);
+
+                // if there are some characters this part of text is a word,
+                // try to find word boundaries
+                if (p_text[p_pos] > ' ') {
+                    size_t start = p_pos;
+                    p_pos = ScanWord(p_pos + 1);
+                    word.length = p_pos - start;
+                    word.type = Word::Text;
+                    return true;
+                }
+
+                // loop through spacing characters
+                word.length = 0;
+                while (p_pos < p_length) {
+                    // skip plain spacing characters in bulk, they're just counted
+                    size_t spaces = ScanSpaces(p_pos) - p_pos;
+                    p_pos += spaces;
+                    word.length += spaces;
+                    if (p_pos == p_length || p_text[p_pos] > ' ') {
+                        break;
+                    }
+
+                    bool returnspaces = false;
+
+                    switch (p_text[p_pos]) {
+                        // check for tab stop character
+                        case '\t':
+                            if (p_tabstops) {
+                                if (word.length) {
+                                    returnspaces = true;
+                                } else {
+                                    word.type = Word::Tab;
+                                    ++p_pos;
+                                    return true;
+                                }
+                            } else {
+                                ++p_pos;
+                                ++word.length;
+                            }
+                            break;
+
+                        // check for line break sequence
+                        case '\n':
+                        case '\r': {
+                            size_t linebreak = 0;
+
+                            // check for one or two characters line breaks (LF, CRLF or LFCR)
+                            if ((p_length - p_pos) == 1) {
+                                linebreak = 1;
+                            } else {
+                                if ((p_text[p_pos] == '\r' && p_text[p_pos + 1] == '\n') ||
+                                    (p_text[p_pos] == '\n' && p_text[p_pos + 1] == '\r')) {
+                                    linebreak = 2;
+                                } else {
+                                    linebreak = 1;
+                                }
+                            }
+
+                            if (p_linebreaks) {
+                                if (word.length) {
+                                    returnspaces = true;
+                                } else {
+                                    word.type = Word::LineBreak;
+                                    p_pos += linebreak;
+                                    return true;
+                                }
+                            } else {
+                                p_pos += linebreak;
+                                ++word.length;
+                            }
+                            break;
+                        }
+
+                        default:
+                            if (p_text[p_pos] > ' ') {
+                                returnspaces = true;
+                            } else {
+                                ++p_pos;
+                                ++word.length;
+                            }
+                    }
+
+                    if (returnspaces) {
+                        break;
+                    }
+                }
+
+                word.type = Word::Space;
+                return true;
+            }
+
+        private:
+#if defined(KCANVAS_SSE2)
+            // text is classified in 64 byte blocks, each block gets two bit masks
+            // with one bit per byte, so word and spacing boundaries are found with
+            // bit scans instead of checking every byte
+            static const size_t BLOCK_SIZE = 64;
+            static const size_t SCALAR_SCAN = 16;
+
+            // classify whole block of text starting at block position
+            //      p_spaces  - spacing and control characters (<= ' ')
+            //      p_special - line break characters and tabs (when tab stops are used)
+            void Classify(size_t block)
+            {
+                const __m128i space = _mm_set1_epi8(' ');
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i lf = _mm_set1_epi8('\n');
+                const __m128i cr = _mm_set1_epi8('\r');
+                const __m128i tab = _mm_set1_epi8('\t');
+                // tab is plain spacing when tab stops aren't used
+                const __m128i tabmask = _mm_set1_epi8(p_tabstops ? -1 : 0);
+
+                p_block = block;
+                p_spaces = 0;
+                p_special = 0;
+
+                for (size_t n = 0; n < BLOCK_SIZE; n += 16) {
+                    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_text + block + n));
+                    // unsigned bytes <= ' ' saturate to zero
+                    __m128i spaces = _mm_cmpeq_epi8(_mm_subs_epu8(bytes, space), zero);
+                    __m128i special = _mm_or_si128(
+                        _mm_or_si128(_mm_cmpeq_epi8(bytes, lf), _mm_cmpeq_epi8(bytes, cr)),
+                        _mm_and_si128(_mm_cmpeq_epi8(bytes, tab), tabmask)
+                    );
+                    p_spaces |= uint64_t(unsigned(_mm_movemask_epi8(spaces))) << n;
+                    p_special |= uint64_t(unsigned(_mm_movemask_epi8(special))) << n;
+                }
+            }
+
+            // find first position starting from pos which has bit set in the mask
+            // returned by provided mask selector, only whole blocks are scanned
+            // returns found position or start of the last incomplete block
+            template <typename M>
+            size_t Scan(size_t pos, const M &mask)
+            {
+                size_t end = p_length & ~(BLOCK_SIZE - 1);
+                while (pos < end) {
+                    size_t block = pos & ~(BLOCK_SIZE - 1);
+                    if (block != p_block) {
+                        Classify(block);
+                    }
+
+                    uint64_t bits = mask(p_spaces, p_special) >> (pos - block);
+                    if (bits) {
+                        return pos + LowestBitIndex64(bits);
+                    }
+
+                    pos = block + BLOCK_SIZE;
+                }
+                return pos;
+            }
+
+            // true if pos is inside of last classified block, its masks
+            // are ready and scanning them is cheaper than checking bytes
+            bool Classified(size_t pos) const
+            {
+                return (pos & ~(BLOCK_SIZE - 1)) == p_block;
+            }
+
+            // selects spacing and control characters (<= ' ')
+            struct WordEndMask
+            {
+                uint64_t operator()(uint64_t spaces, uint64_t special) const
+                {
+                    return spaces;
+                }
+            };
+
+            // selects everything which isn't plain spacing
+            // (word character, line break or tab when tab stops are used)
+            struct SpacesEndMask
+            {
+                uint64_t operator()(uint64_t spaces, uint64_t special) const
+                {
+                    return ~spaces | special;
+                }
+            };
+#endif
+
+            // returns position of first spacing or control character (<= ' ')
+            // starting from pos, or text length if there's no such character
+            size_t ScanWord(size_t pos)
+            {
+#if defined(KCANVAS_SSE2)
+                // most words are short, unless block is classified already
+                // few first bytes are checked directly before block scan
+                if (!Classified(pos)) {
+                    size_t scalarend = c_util::umin(pos + SCALAR_SCAN, p_length);
+                    while (pos < scalarend) {
+                        if (p_text[pos] <= ' ') {
+                            return pos;
+                        }
+                        ++pos;
+                    }
+                }
+
+                pos = Scan(pos, WordEndMask());
+#endif
+                while (pos < p_length && p_text[pos] > ' ') {
+                    ++pos;
+                }
+                return pos;
+            }
+
+            // returns position of first character which isn't plain spacing
+            // (word character, line break or tab when tab stops are used)
+            // starting from pos, or text length if there's no such character
+            size_t ScanSpaces(size_t pos)
+            {
+#if defined(KCANVAS_SSE2)
+                // most spacing runs are short, unless block is classified
+                // already few first bytes are checked directly before block scan
+                if (!Classified(pos)) {
+                    size_t scalarend = c_util::umin(pos + SCALAR_SCAN, p_length);
+                    while (pos < scalarend) {
+                        if (!PlainSpacing(p_text[pos])) {
+                            return pos;
+                        }
+                        ++pos;
+                    }
+                }
+
+                pos = Scan(pos, SpacesEndMask());
+#endif
+                while (pos < p_length && PlainSpacing(p_text[pos])) {
+                    ++pos;
+                }
+                return pos;
+            }
+
+            bool PlainSpacing(unsigned char c) const
+            {
+                return c <= ' ' && c != '\n' && c != '\r' && (c != '\t' || !p_tabstops);
+            }
+
+        private:
+            const unsigned char *p_text;
+            size_t               p_pos;
+            size_t               p_length;
+            bool                 p_linebreaks;
+            bool                 p_tabstops;
+            size_t               p_block;   // position of classified block
+            uint64_t             p_spaces;  // spacing characters mask of the block
+            uint64_t             p_special; // special characters mask of the block
+        };
+
+
+        /*
+         -------------------------------------------------------------------------------
+         Text layout helpers
+         -------------------------------------------------------------------------------
+            text layout is done in two phases
+                measure - text is broken into words, each text word is measured
+                          (this is the expensive part, it calls implementation)
+                flow    - measured words are positioned in lines for given width
+                          (this is cheap and can be repeated for different widths)
+        */
+
+        // measured word, result of measure phase
+        struct LayoutWord
+        {
+            const char *text;
+            size_t      length;
+            Word::Type  type;
+            kScalar     width;        // word advance width, only for Text words
+            kScalar     leftbearing;  // first glyph left bearing
+            kScalar     rightbearing; // last glyph right bearing
+        };
+
+        typedef std::vector<LayoutWord> LayoutWordsList;
+
+        // font metrics and text properties needed for flow phase
+        struct LayoutParams
+        {
+            kGlyphMetrics spaceglyph;
+            kFontMetrics  fm;
+            kTextFlags    flags;
+            kScalar       interval;
+            kScalar       indent;
+            kScalar       defaulttabwidth;
+        };
+
+        // struct for storing layout output provided by callback function
+        struct CachedWord
+        {
+            const char *text;
+            size_t      count;
+            kPoint      position;
+            kScalar     width;
+            bool        newline;
+        };
+
+        typedef std::vector<CachedWord> CachedWordsList;
+
+        // text run collected from layout output, rendered with single TextRun() call
+        typedef std::vector<TextRunWord> TextRunWordsList;
+
+        #define LAYOUT_CALLBACK_PARAMS\
+            const kPoint &cp,\
+            const char *text, size_t count,\
+            kScalar width, bool newline
+
+        // this callback class for layout functions stores layout results in a cache
+        // before any actual output occurs
+        // when additional alignment and adjustment work required for some of text render behaviors
+        // it's being done on cached layout output
+        class CacheLayoutCallback
+        {
+        public:
+            CacheLayoutCallback(CachedWordsList &cache) :
+                p_cache(cache)
+            {}
+
+            void operator()(LAYOUT_CALLBACK_PARAMS) const
+            {
+                CachedWord word = {
+                    text, count, cp, width, newline
+                };
+                p_cache.push_back(word);
+            }
+
+        private:
+            CachedWordsList &p_cache;
+        };
+
+        static inline void AddRunWord(TextRunWordsList &run, const kPoint &position, const char *text, size_t count)
+        {
+            TextRunWord word = {
+                text, count, position
+            };
+            run.push_back(word);
+        }
+
+        // fill in layout parameters from font and optional text properties
+        void GetLayoutParams(kCanvasImpl *impl, const kFontBase *font, const kTextPropertiesBase *properties, LayoutParams &params);
+
+        // break text into words and measure them, measured words are appended to words list
+        void MeasureWords(kCanvasImpl *impl, const char *text, size_t count, const kFontBase *font, kTextFlags flags, LayoutWordsList &words);
+
+        // render cached layout result inside rect with alignment and ellipses applied
+        // rendered words are appended to text run
+        void AlignLayout(
+            kCanvasImpl *impl, const kRect &rect, const kFontBase *font,
+            const kTextOutProperties &properties, const kFontMetrics &fm,
+            const kSize &size, const CachedWordsList &cache, TextRunWordsList &run
+        );
+
+        // helper flow layout function
+        //      performs layout of measured word blocks
+        //      each layed out word passed to provided callback function
+        //      text mesure functions use it to compute final text dimensions and metrics
+        //      text painting functions use it to render text with computed position
+        //
+        // this is "common" flow layout, eventually it should be changed to klayout generic
+        // algorithms
+        template <typename C>
+        kSize FlowWords(
+            const LayoutWord *words, size_t count, const LayoutParams &params,
+            kScalar maxwidth, const C &callback, kRect &bounds
+        )
+        {
+            const kFontMetrics &fm = params.fm;
+            const kScalar spaceadvance = params.spaceglyph.advance;
+
+            bool multiline = (params.flags & kTextFlags::Multiline) != 0;
+            bool ignorelinebreaks = !multiline || (params.flags & kTextFlags::IgnoreLineBreaks) != 0;
+            bool usetabs = (params.flags & kTextFlags::UseTabs) != 0;
+            bool mergespaces = (params.flags & kTextFlags::MergeSpaces) != 0;
+
+            kScalar tabwidth = 0;
+            kSize result;
+            kPoint cp(params.indent, 0);
+
+            kScalar leftbound = 0;
+            kScalar rightbound = 0;
+
+            bool breaktonextline = false;
+            for (size_t n = 0; n < count; ++n) {
+                const LayoutWord &word = words[n];
+
+                switch (word.type) {
+                    case Word::Text:
+                        // TODO
+                        // here might be tricky situation when the word itself bigger than
+                        // provided width to fit it in
+                        // in this case word should be broken in subwords which fit required width
+                        // propose an options for that or do it by default?
+                        //      in case without doing long word break - words will fall outside
+                        //      provided bounds
+
+                        // don't do line break if word doesn't fit and it's first word in a line
+                        breaktonextline =
+                            breaktonextline ||
+                            (multiline && cp.x > 0 && (cp.x + word.width) > maxwidth);
+
+                        if (breaktonextline) {
+                            cp.x = 0;
+                            cp.y += fm.height + fm.linegap + params.interval;
+                            result.height = cp.y;
+                        }
+
+                        // word's first glyph adjusts left bound
+                        if ((cp.x + word.leftbearing) < leftbound) {
+                            leftbound = cp.x + word.leftbearing;
+                        }
+
+                        callback(cp, word.text, word.length, word.width, breaktonextline);
+                        cp.x += word.width;
+
+                        breaktonextline = false;
+
+                        if (cp.x > result.width) {
+                            result.width = cp.x;
+                        }
+
+                        // word's last glyph adjusts right bound
+                        if ((cp.x + word.rightbearing) > rightbound) {
+                            rightbound = cp.x + word.rightbearing;
+                        }
+                        break;
+
+                    case Word::LineBreak:
+                        if (multiline && !ignorelinebreaks) {
+                            breaktonextline = true;
+                        } else {
+                            cp.x += spaceadvance;
+                        }
+                        break;
+
+                    case Word::Space:
+                        // NOTE: now all spaces at end of line are ignored if word-wrapping
+                        // occurs, actually spaces should wrap to next line too (except first one)
+                        //      this behaviour should be examined
+                        cp.x += spaceadvance *
+                            (mergespaces ? 1 : word.length);
+                        break;
+
+                    case Word::Tab:
+                        if (!usetabs) {
+                            cp.x += spaceadvance;
+                        } else {
+                            while (tabwidth <= cp.x) {
+                                tabwidth += params.defaulttabwidth;
+                            }
+                            cp.x = tabwidth;
+                        }
+                        break;
+                }
+            }
+
+            if (cp.x > 0.0f) {
+                if (cp.x > result.width) {
+                    result.width = cp.x;
+                }
+                result.height += fm.height;
+            }
+
+            bounds.left = leftbound;
+            bounds.top = 0;
+            bounds.right = rightbound;
+            bounds.bottom = result.height + fm.linegap;
+
+            return result;
+        }
+
+        // helper layout function, does both measure and flow phases
+        template <typename C>
+        kSize TextLayout(
+            kCanvasImpl *impl, const char *text, size_t count, const kFontBase *font,
+            const kTextPropertiesBase *properties, kScalar maxwidth, const C &callback, kRect &bounds,
+            kFontMetrics *fontmetrics = nullptr
+        )
+        {
+            LayoutParams params;
+            GetLayoutParams(impl, font, properties, params);
+            if (fontmetrics) {
+                *fontmetrics = params.fm;
+            }
+
+            LayoutWordsList words;
+            words.reserve(count / 4 + 1);
+            MeasureWords(impl, text, count, font, params.flags, words);
+
+            return FlowWords(words.data(), words.size(), params, maxwidth, callback, bounds);
+        }
+
+
+        /*
+         -------------------------------------------------------------------------------
+         kTextLayoutImpl
+         -------------------------------------------------------------------------------
+            kTextLayout object implementation
+            keeps text copy, measured words and last flow result
+        */
+        class kTextLayoutImpl
+        {
+        public:
+            kTextLayoutImpl(const kSize &bounds, const char *text, size_t count, const kFont &font, const kTextOutProperties *properties);
+            ~kTextLayoutImpl();
+
+            void SetBounds(const kSize &bounds);
+
+            void Draw(kCanvasImpl *impl, const kPoint &origin, const kBrush &brush);
+            size_t HitTest(const kPoint &point) const;
+
+            const kSize& bounds() const { return p_bounds; }
+            kSize size() const;
+            const kRect& inkbounds() const { return p_inkbounds; }
+
+        private:
+            void Flow();
+
+        private:
+            kCanvasImpl        *p_measure;    // measurement only implementation
+            std::string         p_text;
+            kFont               p_font;
+            kTextOutProperties  p_properties;
+            LayoutParams        p_params;
+            LayoutWordsList     p_words;      // measure phase result
+            CachedWordsList     p_cache;      // flow phase result
+            kSize               p_bounds;
+            kSize               p_size;
+            kRect               p_inkbounds;
+        };
+
+
+
+        /*
+         -------------------------------------------------------------------------------
+         ParagraphTree
+         -------------------------------------------------------------------------------
+            balanced tree (treap keyed by item index) of paragraph items
+            every node keeps its item vertical advance, text length and width
+            together with their sums (and widest width) over its subtree, so
+            insertion and removal of items, item update, prefix sums and search
+            by prefix sum are O(log n), nothing is rebuilt on edits
+            tree owns its items, they are deleted when removed from tree
+        */
+        template <typename T>
+        class ParagraphTree
+        {
+        public:
+            ParagraphTree() :
+                p_root(nullptr),
+                p_seed(0x9e3779b9)
+            {}
+
+            ~ParagraphTree()
+            {
+                Clear();
+            }
+
+            ParagraphTree(const ParagraphTree &source) = delete;
+            ParagraphTree &operator=(const ParagraphTree &source) = delete;
+
+            size_t size() const { return Count(p_root); }
+            kScalar advance() const { return p_root ? p_root->advancesum : 0; }
+            size_t length() const { return p_root ? p_root->lengthsum : 0; }
+            kScalar width() const { return p_root ? p_root->maxwidth : 0; }
+
+            T* operator[](size_t index) const
+            {
+                Node *node = p_root;
+                while (true) {
+                    size_t left = Count(node->left);
+                    if (index == left) {
+                        return node->item;
+                    }
+                    if (index < left) {
+                        node = node->left;
+                    } else {
+                        index -= left + 1;
+                        node = node->right;
+                    }
+                }
+            }
+
+            // insert item before item at index (or after the last one)
+            void Insert(size_t index, T *item, kScalar advance, size_t length, kScalar width)
+            {
+                // xorshift priorities keep tree balanced on average
+                p_seed ^= p_seed << 13;
+                p_seed ^= p_seed >> 17;
+                p_seed ^= p_seed << 5;
+
+                Node *node = new Node();
+                node->item = item;
+                node->left = nullptr;
+                node->right = nullptr;
+                node->priority = p_seed;
+                node->advance = advance;
+                node->length = length;
+                node->width = width;
+                Fix(node);
+
+                Node *left;
+                Node *right;
+                Split(p_root, index, left, right);
+                p_root = Merge(Merge(left, node), right);
+            }
+
+            // remove and delete count items starting from index
+            void Erase(size_t index, size_t count)
+            {
+                Node *left;
+                Node *middle;
+                Node *right;
+                Split(p_root, index, left, right);
+                Split(right, count, middle, right);
+                Destroy(middle);
+                p_root = Merge(left, right);
+            }
+
+            // set new values of item at index
+            void Set(size_t index, kScalar advance, size_t length, kScalar width)
+            {
+                Set(p_root, index, advance, length, width);
+            }
+
+            void Clear()
+            {
+                Destroy(p_root);
+                p_root = nullptr;
+            }
+
+            // sums of first count items
+            kScalar AdvancePrefix(size_t count) const { return Prefix(&Node::advance, &Node::advancesum, count); }
+            size_t LengthPrefix(size_t count) const { return Prefix(&Node::length, &Node::lengthsum, count); }
+
+            // find first item which ends after value (prefix sum including
+            // the item is greater than value), returns size() if there's no such item
+            size_t FindAdvance(kScalar value) const { return Find(&Node::advance, &Node::advancesum, value); }
+            size_t FindLength(size_t value) const { return Find(&Node::length, &Node::lengthsum, value); }
+
+        private:
+            struct Node
+            {
+                T       *item;
+                Node    *left;
+                Node    *right;
+                uint32_t priority;   // parent priority is never less than child's
+                size_t   count;      // number of items in subtree
+                kScalar  advance;
+                size_t   length;
+                kScalar  width;
+                kScalar  advancesum; // subtree sums
+                size_t   lengthsum;
+                kScalar  maxwidth;
+            };
+
+            static size_t Count(const Node *node)
+            {
+                return node ? node->count : 0;
+            }
+
+            // update subtree values from node's own values and its children
+            static void Fix(Node *node)
+            {
+                node->count = 1;
+                node->advancesum = node->advance;
+                node->lengthsum = node->length;
+                node->maxwidth = node->width;
+
+                const Node *children[2] = { node->left, node->right };
+                for (size_t n = 0; n < 2; ++n) {
+                    if (const Node *child = children[n]) {
+                        node->count += child->count;
+                        node->advancesum += child->advancesum;
+                        node->lengthsum += child->lengthsum;
+                        node->maxwidth = c_util::umax(node->maxwidth, child->maxwidth);
+                    }
+                }
+            }
+
+            // split subtree into first count items and the rest
+            static void Split(Node *node, size_t count, Node *&left, Node *&right)
+            {
+                if (!node) {
+                    left = nullptr;
+                    right = nullptr;
+                    return;
+                }
+
+                if (count <= Count(node->left)) {
+                    Split(node->left, count, left, node->left);
+                    right = node;
+                } else {
+                    Split(node->right, count - Count(node->left) - 1, node->right, right);
+                    left = node;
+                }
+                Fix(node);
+            }
+
+            // join subtrees, all left items go before right items
+            static Node* Merge(Node *left, Node *right)
+            {
+                if (!left) {
+                    return right;
+                }
+                if (!right) {
+                    return left;
+                }
+
+                if (left->priority > right->priority) {
+                    left->right = Merge(left->right, right);
+                    Fix(left);
+                    return left;
+                }
+
+                right->left = Merge(left, right->left);
+                Fix(right);
+                return right;
+            }
+
+            static void Set(Node *node, size_t index, kScalar advance, size_t length, kScalar width)
+            {
+                size_t left = Count(node->left);
+                if (index < left) {
+                    Set(node->left, index, advance, length, width);
+                } else if (index > left) {
+                    Set(node->right, index - left - 1, advance, length, width);
+                } else {
+                    node->advance = advance;
+                    node->length = length;
+                    node->width = width;
+                }
+                Fix(node);
+            }
+
+            static void Destroy(Node *node)
+            {
+                if (node) {
+                    Destroy(node->left);
+                    Destroy(node->right);
+                    delete node->item;
+                    delete node;
+                }
+            }
+
+            template <typename S>
+            S Prefix(S Node::*value, S Node::*sum, size_t count) const
+            {
+                S result = S();
+                const Node *node = p_root;
+                while (node) {
+                    size_t left = Count(node->left);
+                    if (count <= left) {
+                        node = node->left;
+                    } else {
+                        result += node->left ? node->left->*sum : S();
+                        result += node->*value;
+                        count -= left + 1;
+                        node = node->right;
+                    }
+                }
+                return result;
+            }
+
+            template <typename S>
+            size_t Find(S Node::*value, S Node::*sum, S target) const
+            {
+                size_t result = 0;
+                const Node *node = p_root;
+                while (node) {
+                    S left = node->left ? node->left->*sum : S();
+                    if (target < left) {
+                        node = node->left;
+                        continue;
+                    }
+
+                    target -= left;
+                    if (target < node->*value) {
+                        return result + Count(node->left);
+                    }
+
+                    target -= node->*value;
+                    result += Count(node->left) + 1;
+                    node = node->right;
+                }
+                return result;
+            }
+
+        private:
+            Node     *p_root;
+            uint32_t  p_seed;
+        };
+
+
+        /*
+         -------------------------------------------------------------------------------
+         kTextEditLayoutImpl
+         -------------------------------------------------------------------------------
+            kTextEditLayout object implementation
+            text is kept as a list of paragraphs, each paragraph has its own
+            measured words and flow result, paragraphs are kept in balanced
+            tree which sums their vertical advances and text lengths
+        */
+        class kTextEditLayoutImpl
+        {
+        public:
+            kTextEditLayoutImpl(kScalar width, const kFont &font, const kTextOutProperties *properties);
+            ~kTextEditLayoutImpl();
+
+            void SetText(const char *text, size_t count);
+            void Insert(size_t position, const char *text, size_t count);
+            void Erase(size_t position, size_t count);
+            void SetWidth(kScalar width);
+
+            void Draw(kCanvasImpl *impl, const kPoint &origin, const kBrush &brush, const kRect *visible);
+            size_t HitTest(const kPoint &point) const;
+
+            kScalar width() const { return p_width; }
+            size_t length() const { return p_paragraphs.length() - 1; }
+            size_t paragraphs() const { return p_paragraphs.size(); }
+            kSize size() const;
+
+        private:
+            struct Paragraph
+            {
+                std::string     text;
+                LayoutWordsList words;   // measured words
+                CachedWordsList cache;   // flow result for current width
+                kScalar         width;   // widest row width
+                kScalar         advance; // vertical advance to next paragraph
+            };
+
+            typedef std::vector<Paragraph*> ParagraphsList;
+
+            void Measure(Paragraph *paragraph);
+            void Flow(Paragraph *paragraph);
+            void Update(size_t index);
+            void UpdateTree(size_t index);
+            void InsertParagraphs(size_t index, const ParagraphsList &paragraphs);
+            void Locate(size_t position, size_t &index, size_t &offset) const;
+
+        private:
+            kCanvasImpl             *p_measure;    // measurement only implementation
+            kFont                    p_font;
+            kTextOutProperties       p_properties;
+            LayoutParams             p_params;
+            kScalar                  p_width;
+            ParagraphTree<Paragraph> p_paragraphs; // paragraphs, never empty
+        };
+
+    } // namespace impl
+} // namespace k_canvas
@@ -1,84 +1,243 @@
 #include "unicodeconverter.h"
+#include "simd.h"
+#include <cstring>
 
 using namespace std;
 
 
-static wstring g_buffer;
-static u32string g_buffer32;
-
-
 namespace k_canvas
 {
     namespace impl
     {
-        static inline char32_t utf8_codepoint(const char *&utf8)
+        static const char32_t REPLACEMENT_CHARACTER = 0xfffd;
+
+        static inline bool utf8_continuation(unsigned char c)
         {
+            return (c & 0xc0) == 0x80;
+        }
+
+        // decode single code point with validation, overlong sequences, surrogates,
+        // out of range code points and truncated sequences give U+FFFD
+        // invalid sequence consumes its lead byte and all valid continuation bytes
+        static inline char32_t utf8_codepoint(const unsigned char *&utf8, const unsigned char *end)
+        {
+            unsigned char lead = *utf8++;
+
             // check single byte 7-bit ASCII code and return it as a codepoint
-            if ((*utf8 & 0x80) == 0) {
-                return char32_t(unsigned char(*utf8++));
+            if (lead < 0x80) {
+                return char32_t(lead);
             }
 
-            // here should be at least two byte codepoint
-            auto bytecount = 2u;
+            size_t bytecount;
+            char32_t codepoint;
+            // valid range for the second byte, it's narrower than continuation
+            // byte range for some lead bytes
+            unsigned char low = 0x80;
+            unsigned char high = 0xbf;
+
+            if (lead >= 0xc2 && lead <= 0xdf) {
+                bytecount = 1;
+                codepoint = lead & 0x1f;
+            } else if (lead >= 0xe0 && lead <= 0xef) {
+                bytecount = 2;
+                codepoint = lead & 0x0f;
+                if (lead == 0xe0) {
+                    low = 0xa0;  // overlong
+                } else if (lead == 0xed) {
+                    high = 0x9f; // surrogates
+                }
+            } else if (lead >= 0xf0 && lead <= 0xf4) {
+                bytecount = 3;
+                codepoint = lead & 0x07;
+                if (lead == 0xf0) {
+                    low = 0x90;  // overlong
+                } else if (lead == 0xf4) {
+                    high = 0x8f; // above U+10FFFF
+                }
+            } else {
+                return REPLACEMENT_CHARACTER;
+            }
+
+            // read rest bytes code bits
+            for (size_t n = 0; n < bytecount; ++n) {
+                if (utf8 == end) {
+                    return REPLACEMENT_CHARACTER;
+                }
 
-            // count bytes
-            auto mask = 0x20u;
-            while ((*utf8 & mask) != 0) {
-                ++bytecount;
-                mask = mask >> 1;
+                unsigned char c = *utf8;
+                if (n == 0 ? (c < low || c > high) : !utf8_continuation(c)) {
+                    return REPLACEMENT_CHARACTER;
+                }
+
+                codepoint = (codepoint << 6) | (c & 0x3f);
+                ++utf8;
             }
 
-            // set first byte code mask
-            mask = 0xffffff80 >> bytecount;
-            mask = mask ^ 0xffffffff;
+            return codepoint;
+        }
 
-            // calc code shift
-            auto shift = (bytecount - 1) * 6;
+        // ASCII fast path, converts as many whole 16 byte ASCII blocks as possible
+        // returns number of converted bytes (and written code units)
+        template <typename T>
+        static inline size_t utf8_ascii_block(const unsigned char *utf8, size_t size, T *output)
+        {
+            size_t pos = 0;
+
+#if defined(KCANVAS_SSE2)
+            const __m128i zero = _mm_setzero_si128();
+            while ((size - pos) >= 16) {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf8 + pos));
+                if (_mm_movemask_epi8(bytes) != 0) {
+                    break;
+                }
 
-            // read first byte code bits
-            auto codepoint = (*utf8++ & mask) << shift;
+                __m128i low = _mm_unpacklo_epi8(bytes, zero);
+                __m128i high = _mm_unpackhi_epi8(bytes, zero);
+
+                __m128i *dest = reinterpret_cast<__m128i*>(output + pos);
+                if (sizeof(T) == 2) {
+                    _mm_storeu_si128(dest, low);
+                    _mm_storeu_si128(dest + 1, high);
+                } else {
+                    _mm_storeu_si128(dest, _mm_unpacklo_epi16(low, zero));
+                    _mm_storeu_si128(dest + 1, _mm_unpackhi_epi16(low, zero));
+                    _mm_storeu_si128(dest + 2, _mm_unpacklo_epi16(high, zero));
+                    _mm_storeu_si128(dest + 3, _mm_unpackhi_epi16(high, zero));
+                }
 
-            // read rest bytes code bits
-            while (--bytecount > 0) {
-                shift -= 6;
-                codepoint |= ((*utf8++) & 0x7f) << shift;
+                pos += 16;
             }
+#elif defined(KCANVAS_NEON)
+            const uint8x16_t highbit = vdupq_n_u8(0x80);
+            while ((size - pos) >= 16) {
+                uint8x16_t bytes = vld1q_u8(utf8 + pos);
+                uint64x2_t test = vreinterpretq_u64_u8(vandq_u8(bytes, highbit));
+                if ((vgetq_lane_u64(test, 0) | vgetq_lane_u64(test, 1)) != 0) {
+                    break;
+                }
+
+                uint16x8_t low = vmovl_u8(vget_low_u8(bytes));
+                uint16x8_t high = vmovl_u8(vget_high_u8(bytes));
+
+                if (sizeof(T) == 2) {
+                    uint16_t *dest = reinterpret_cast<uint16_t*>(output + pos);
+                    vst1q_u16(dest, low);
+                    vst1q_u16(dest + 8, high);
+                } else {
+                    uint32_t *dest = reinterpret_cast<uint32_t*>(output + pos);
+                    vst1q_u32(dest, vmovl_u16(vget_low_u16(low)));
+                    vst1q_u32(dest + 4, vmovl_u16(vget_high_u16(low)));
+                    vst1q_u32(dest + 8, vmovl_u16(vget_low_u16(high)));
+                    vst1q_u32(dest + 12, vmovl_u16(vget_high_u16(high)));
+                }
 
-            return char32_t(codepoint);
+                pos += 16;
+            }
+#else
+            // scalar build, whole text goes through scalar decoder
+            (void)utf8;
+            (void)size;
+            (void)output;
+#endif
+
+            return pos;
         }
 
         unsigned utf8codepoint(const char *utf8char)
         {
-            return utf8_codepoint(utf8char);
+            // decoding stops at first invalid continuation byte, so null
+            // terminated strings are never read past terminator
+            return utf8codepoint(utf8char, 4);
         }
 
-        wstring utf8toutf16(const char *utf8)
+        unsigned utf8codepoint(const char *utf8char, size_t size)
         {
-            return utf8toutf16(utf8, strlen(utf8));
+            if (size == 0) {
+                return 0;
+            }
+
+            auto utf8 = reinterpret_cast<const unsigned char*>(utf8char);
+            return utf8_codepoint(utf8, utf8 + size);
         }
 
-        wstring utf8toutf16(const char *utf8, size_t size)
+        size_t utf8toutf16(const char *utf8, size_t size, wchar_t *output)
         {
-            g_buffer.resize(size);
+            auto source = reinterpret_cast<const unsigned char*>(utf8);
+            auto end = source + size;
+            auto result = output;
+
+            while (source < end) {
+                // try bulk conversion of ASCII blocks only when there's ASCII char
+                if (*source < 0x80) {
+                    size_t converted = utf8_ascii_block(source, end - source, result);
+                    source += converted;
+                    result += converted;
+
+                    // remaining ASCII chars before next multi-byte sequence
+                    while (source < end && *source < 0x80) {
+                        *result++ = wchar_t(*source++);
+                    }
+
+                    if (source == end) {
+                        break;
+                    }
+                }
 
-            auto result = g_buffer.data();
-            auto end = utf8 + size;
-            while (utf8 < end) {
-                auto codepoint = utf8_codepoint(utf8);
+                auto codepoint = utf8_codepoint(source, end);
 
-                if (codepoint < 0x10000) {
+                if (codepoint < 0x10000 || sizeof(wchar_t) > 2) {
                     *result++ = wchar_t(codepoint);
                     continue;
                 }
 
+                // 4 byte UTF-8 sequence always gives 2 UTF-16 code units
                 codepoint -= 0x10000;
                 *result++ = wchar_t(0xd800 | (codepoint >> 10));
                 *result++ = wchar_t(0xdc00 | (codepoint & 0x03ff));
             }
 
-            g_buffer.resize(result - g_buffer.data());
+            return result - output;
+        }
+
+        size_t utf8toutf32(const char *utf8, size_t size, char32_t *output)
+        {
+            auto source = reinterpret_cast<const unsigned char*>(utf8);
+            auto end = source + size;
+            auto result = output;
+
+            while (source < end) {
+                // try bulk conversion of ASCII blocks only when there's ASCII char
+                if (*source < 0x80) {
+                    size_t converted = utf8_ascii_block(source, end - source, result);
+                    source += converted;
+                    result += converted;
+
+                    // remaining ASCII chars before next multi-byte sequence
+                    while (source < end && *source < 0x80) {
+                        *result++ = char32_t(*source++);
+                    }
+
+                    if (source == end) {
+                        break;
+                    }
+                }
+
+                *result++ = utf8_codepoint(source, end);
+            }
+
+            return result - output;
+        }
+
+        wstring utf8toutf16(const char *utf8)
+        {
+            return utf8toutf16(utf8, strlen(utf8));
+        }
 
-            return g_buffer;
+        wstring utf8toutf16(const char *utf8, size_t size)
+        {
+            wstring result(size, wchar_t(0));
+            result.resize(utf8toutf16(utf8, size, &result[0]));
+            return result;
         }
 
         u32string utf8toutf32(const char *utf8)
@@ -88,18 +247,9 @@ namespace k_canvas
 
         u32string utf8toutf32(const char *utf8, size_t size)
         {
-            g_buffer32.resize(size);
-
-            auto result = g_buffer32.data();
-            auto end = utf8 + size;
-            while (utf8 < end) {
-                auto codepoint = utf8_codepoint(utf8);
-                *result++ = codepoint;
-            }
-
-            g_buffer32.resize(result - g_buffer32.data());
-
-            return g_buffer32;
+            u32string result(size, char32_t(0));
+            result.resize(utf8toutf32(utf8, size, &result[0]));
+            return result;
         }
     }
 }
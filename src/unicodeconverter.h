@@ -6,7 +6,18 @@ namespace k_canvas
 {
     namespace impl
     {
+        // decode single code point, invalid sequence gives U+FFFD
         unsigned utf8codepoint(const char *utf8char);
+        unsigned utf8codepoint(const char *utf8char, size_t size);
+
+        // decode UTF-8 text into caller provided buffer, output buffer must have
+        // room for at least size code units (UTF-8 text never decodes into more
+        // code units than it has bytes)
+        // invalid sequences are replaced with U+FFFD
+        // returns number of code units written, no memory is allocated
+        size_t utf8toutf16(const char *utf8, size_t size, wchar_t *output);
+        size_t utf8toutf32(const char *utf8, size_t size, char32_t *output);
+
         std::wstring utf8toutf16(const char *utf8);
         std::wstring utf8toutf16(const char *utf8, size_t size);
         std::u32string utf8toutf32(const char *utf8);
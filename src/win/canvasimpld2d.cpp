@@ -13,6 +13,7 @@
 
 #include "canvasimpld2d.h"
 #include "../unicodeconverter.h"
+#include "../pixelconverter.h"
 
 using namespace c_util;
 using namespace k_canvas;
@@ -392,7 +393,8 @@ void kPathImplD2D::CloseFigure(bool opened)
 */
 
 kBitmapImplD2D::kBitmapImplD2D() :
-    p_bitmap(nullptr)
+    p_bitmap(nullptr),
+    p_format(kBitmapFormat::Color32BitAlphaPremultiplied)
 {}
 
 kBitmapImplD2D::~kBitmapImplD2D()
@@ -400,16 +402,27 @@ kBitmapImplD2D::~kBitmapImplD2D()
     SafeRelease(p_bitmap);
 }
 
-static const DXGI_FORMAT bitmapformats[3] = {
+// only storage formats are valid for bitmap creation
+static const DXGI_FORMAT bitmapformats[8] = {
     DXGI_FORMAT_UNKNOWN,
     DXGI_FORMAT_B8G8R8A8_UNORM,
-    DXGI_FORMAT_A8_UNORM
+    DXGI_FORMAT_A8_UNORM,
+    DXGI_FORMAT_UNKNOWN,
+    DXGI_FORMAT_UNKNOWN,
+    DXGI_FORMAT_UNKNOWN,
+    DXGI_FORMAT_UNKNOWN,
+    DXGI_FORMAT_UNKNOWN
 };
 
-static const D2D1_ALPHA_MODE alfamodes[3] = {
+static const D2D1_ALPHA_MODE alfamodes[8] = {
     D2D1_ALPHA_MODE_UNKNOWN,
     D2D1_ALPHA_MODE_PREMULTIPLIED,
-    D2D1_ALPHA_MODE_STRAIGHT
+    D2D1_ALPHA_MODE_STRAIGHT,
+    D2D1_ALPHA_MODE_UNKNOWN,
+    D2D1_ALPHA_MODE_UNKNOWN,
+    D2D1_ALPHA_MODE_UNKNOWN,
+    D2D1_ALPHA_MODE_UNKNOWN,
+    D2D1_ALPHA_MODE_UNKNOWN
 };
 
 void kBitmapImplD2D::Initialize(size_t width, size_t height, kBitmapFormat format)
@@ -424,6 +437,7 @@ void kBitmapImplD2D::Initialize(size_t width, size_t height, kBitmapFormat forma
     props.pixelFormat.format = bitmapformats[size_t(format)];
     props.pixelFormat.alphaMode = alfamodes[size_t(format)];
 
+    p_format = format;
     P_RT->CreateBitmap(sz, nullptr, 0, props, &p_bitmap);
 }
 
@@ -432,14 +446,47 @@ void kBitmapImplD2D::Update(const kRectInt *updaterect, kBitmapFormat sourceform
     D2D1_SIZE_F size = p_bitmap->GetSize();
 
     kRectInt bitmaprect(0, 0, int(size.width), int(size.height));
+    kRectInt source(updaterect ? *updaterect : bitmaprect);
     kRectInt update(updaterect ? bitmaprect.intersectionwith(*updaterect) : bitmaprect);
 
+    if (update.right <= update.left || update.bottom <= update.top) {
+        return;
+    }
+
+    // source data starts at the top left corner of update rectangle
+    const unsigned char *src =
+        reinterpret_cast<const unsigned char*>(data) +
+        (update.top - source.top) * sourcepitch +
+        (update.left - source.left) * PixelSize(sourceformat);
+
     D2D1_RECT_U rect;
     rect.left = update.left;
     rect.top = update.top;
     rect.right = update.right;
     rect.bottom = update.bottom;
-    p_bitmap->CopyFromMemory(&rect, data, UINT32(sourcepitch));
+
+    if (sourceformat == p_format) {
+        p_bitmap->CopyFromMemory(&rect, src, UINT32(sourcepitch));
+        return;
+    }
+
+    // bitmap accepts only its own pixel format, other formats are converted
+    // into temporary buffer first
+    PixelRowConverter convert = GetPixelRowConverter(p_format, sourceformat);
+    if (!convert) {
+        return;
+    }
+
+    size_t width = update.right - update.left;
+    size_t height = update.bottom - update.top;
+    size_t pitch = width * PixelSize(p_format);
+
+    std::vector<unsigned char> buffer(pitch * height);
+    for (size_t y = 0; y < height; ++y) {
+        convert(&buffer[y * pitch], src + y * sourcepitch, width);
+    }
+
+    p_bitmap->CopyFromMemory(&rect, buffer.data(), UINT32(pitch));
 }
 
 
@@ -466,6 +513,14 @@ void kCanvasImplD2D::Clear()
     P_RT->Clear();
 }
 
+void kCanvasImplD2D::Clear(const kRect &rect, const kColor &color)
+{
+    // render target Clear ignores blending and respects axis aligned clip
+    P_RT->PushAxisAlignedClip(r2rD2D(rect), D2D1_ANTIALIAS_MODE_ALIASED);
+    P_RT->Clear(c2c(color));
+    P_RT->PopAxisAlignedClip();
+}
+
 bool kCanvasImplD2D::BindToBitmap(const kBitmapImpl *target, const kRectInt *rect)
 {
     if (boundDC) {
@@ -799,11 +854,21 @@ void kCanvasImplD2D::GetGlyphMetrics(const kFontBase *font, size_t first, size_t
     }
 }
 
-kSize kCanvasImplD2D::TextSize(const char *text, size_t count, const kFontBase *font)
+const char32_t* kCanvasImplD2D::DecodeText(const char *text, size_t count, size_t &length)
 {
-    auto utf32text = utf8toutf32(text, count);
+    // buffer only grows, so no allocation happens for text of already seen length
+    if (textBuffer.size() < count) {
+        textBuffer.resize(count);
+    }
 
-    auto length = utf32text.length();
+    length = utf8toutf32(text, count, &textBuffer[0]);
+    return textBuffer.data();
+}
+
+kSize kCanvasImplD2D::TextSize(const char *text, size_t count, const kFontBase *font)
+{
+    size_t length;
+    auto utf32text = DecodeText(text, count, length);
     auto pos = size_t(0);
 
     kSize result;
@@ -821,7 +886,7 @@ kSize kCanvasImplD2D::TextSize(const char *text, size_t count, const kFontBase *
     while (pos < length) {
         size_t curlen = umin(length - pos, BUFFER_LEN);
 
-        GetGlyphRunMetrics(utf32text.data() + pos, curlen, font, abc, indices);
+        GetGlyphRunMetrics(utf32text + pos, curlen, font, abc, indices);
         for (size_t n = 0; n < curlen; ++n) {
             result.width += abc[n].advanceWidth * k;
         }
@@ -834,9 +899,8 @@ kSize kCanvasImplD2D::TextSize(const char *text, size_t count, const kFontBase *
 
 void kCanvasImplD2D::Text(const kPoint &p, const char *text, size_t count, const kFontBase *font, const kBrushBase *brush, kTextOrigin origin)
 {
-    auto utf32text = utf8toutf32(text, count);
-
-    auto length = utf32text.length();
+    size_t length;
+    auto utf32text = DecodeText(text, count, length);
     auto pos = size_t(0);
 
     const size_t BUFFER_LEN = 256;
@@ -862,7 +926,7 @@ void kCanvasImplD2D::Text(const kPoint &p, const char *text, size_t count, const
         size_t curlen = umin(length - pos, BUFFER_LEN);
 
         // TODO: pass isSideways
-        GetGlyphRunMetrics(utf32text.data() + pos, curlen, font, abc, indices);
+        GetGlyphRunMetrics(utf32text + pos, curlen, font, abc, indices);
         FLOAT advance = 0;
         for (size_t n = 0; n < curlen; ++n) {
             advance += abc[n].advanceWidth * k;
@@ -967,6 +1031,32 @@ void kCanvasImplD2D::EndClippedDrawing()
     clipStack.pop_back();
 }
 
+void kCanvasImplD2D::PushLayer(const kRect &bounds, kScalar opacity, kBlendMode blend)
+{
+    // Direct2D layers are blended only in normal mode
+    Clip layer;
+    layer.brush = nullptr;
+
+    P_RT->CreateLayer(&layer.layer);
+
+    D2D1_LAYER_PARAMETERS layerprops;
+    layerprops.contentBounds = r2rD2D(bounds);
+    layerprops.geometricMask = nullptr;
+    layerprops.maskAntialiasMode = D2D1_ANTIALIAS_MODE_PER_PRIMITIVE;
+    layerprops.maskTransform = D2D1::IdentityMatrix();
+    layerprops.opacity = opacity;
+    layerprops.opacityBrush = nullptr;
+    layerprops.layerOptions = D2D1_LAYER_OPTIONS_NONE;
+    P_RT->PushLayer(layerprops, layer.layer);
+
+    clipStack.push_back(layer);
+}
+
+void kCanvasImplD2D::PopLayer()
+{
+    EndClippedDrawing();
+}
+
 void kCanvasImplD2D::SetTransform(const kTransform &transform)
 {
     // transform always should be combined with origin
@@ -15,6 +15,7 @@
 #include "../canvasimpl.h"
 #include <d2d1.h>
 #include <dwrite.h>
+#include <string>
 
 
 namespace k_canvas
@@ -104,7 +105,8 @@ namespace k_canvas
             void Update(const kRectInt *updaterect, kBitmapFormat sourceformat, size_t sourceputch, const void *data) override;
 
         private:
-            ID2D1Bitmap *p_bitmap;
+            ID2D1Bitmap   *p_bitmap;
+            kBitmapFormat  p_format;
         };
 
 
@@ -126,6 +128,7 @@ namespace k_canvas
             ~kCanvasImplD2D() override;
 
             void Clear() override;
+            void Clear(const kRect &rect, const kColor &color) override;
 
             bool BindToBitmap(const kBitmapImpl *target, const kRectInt *rect) override;
             bool BindToContext(kContext context, const kRectInt *rect) override;
@@ -158,6 +161,9 @@ namespace k_canvas
             void BeginClippedDrawingByRect(const kRect &clip) override;
             void EndClippedDrawing() override;
 
+            void PushLayer(const kRect &bounds, kScalar opacity, kBlendMode blend) override;
+            void PopLayer() override;
+
             void SetTransform(const kTransform &transform) override;
 
         private:
@@ -167,6 +173,8 @@ namespace k_canvas
                 const char32_t *codepoints, size_t curlen, const kFontBase *font,
                 DWRITE_GLYPH_METRICS *abc, UINT16 *indices
             );
+            // decodes UTF-8 text into reusable code point buffer
+            const char32_t* DecodeText(const char *text, size_t count, size_t &length);
 
         private:
             struct Clip
@@ -182,6 +190,7 @@ namespace k_canvas
             kRectInt           renderRect;
             std::vector<Clip>  clipStack;
             kTransform         origin;
+            std::u32string     textBuffer;
         };
 
 